@@ -5,6 +5,9 @@
 #ifndef AMP_RACK_AUDIOBUFFER_H
 #define AMP_RACK_AUDIOBUFFER_H
 
+// plugin outputs that can be recorded alongside, see Processor::slotTap
+#define MAX_SLOT_TAPS 4
+
 typedef struct audio_buffer {
     int overruns;
     int pos;
@@ -12,6 +15,8 @@ typedef struct audio_buffer {
     float *data;
     float * raw;
     int size ;
+    float * slots [MAX_SLOT_TAPS] ;
+    int nslots ;
 } AudioBuffer;
 
 #endif //AMP_RACK_AUDIOBUFFER_H
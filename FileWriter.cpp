@@ -1,189 +1,33 @@
 #include <cstdlib>
 #include <cstring>
-#include <chrono>
-#include <math.h>
+#include <fstream>
 #include "FileWriter.h"
 
-std::thread FileWriter::fileWriteThread  ;
-int FileWriter::buffer_write_index = 0 ;
-LockFreeQueue<buffer_t*, LOCK_FREE_SIZE> FileWriter::lockFreeQueue;
-void * FileWriter::mp3_buffer = NULL;
-bool FileWriter:: useStaticBuffer = false ;
-staticBuffer_t FileWriter::buffers [1025] ;
-/* the reason this has to be less than buffer size is that arrays start at zero
- * why this worked at all on some devices amazes me
- */
-int FileWriter::MAX_STATIC_BUFFER  = 1024;
-long FileWriter::disk_writes = 0 ;
-long FileWriter::processed = 0 ;
-int FileWriter::bufferUsed = 0;
-int FileWriter::unreported_overruns = 0 ;
-int FileWriter::total_overruns = 0;
-# ifdef __linux__
-SNDFILE * FileWriter::soundfile = NULL;
-# endif
-buffer_t *FileWriter::current_buffer;
-buffer_t *FileWriter::bg_buffer;
-int FileWriter::num_channels = 1 ;
-int FileWriter::block_size = 384 ;
-float FileWriter::min_buffer_time = 0.01f,
-        FileWriter::max_buffer_time = 40.0f ;
-int FileWriter::jack_samplerate ;
-int FileWriter::buffer_size_in_bytes;
-bool FileWriter::ready = false ;
-vringbuffer_t * FileWriter::vringbuffer = NULL;
-FileType FileWriter::fileType = MP3 ;
-OpusEncoder *FileWriter::encoder ;
-opus_int16 FileWriter::opusIn[960 * 2];
-int FileWriter::opusRead = 0;
-unsigned char FileWriter::opusOut[MAX_PACKET_SIZE];
-FILE * FileWriter::outputFile = NULL;
-OggOpusEnc * FileWriter:: oggOpusEnc = NULL;
-OggOpusComments *FileWriter::comments = NULL;
-lame_t FileWriter::lame = NULL ;
-
-static char * extensions [] = {
-        ".wav",
-        ".ogg",
-        ".mp3"
-} ;
-
-int FileWriter::autoincrease_callback(vringbuffer_t *vrb, bool first_call, int reading_size, int writing_size) {
-//    HERE
-//    LOGD("first call: %d, reading size: %d, writing size: %d", first_call, reading_size, writing_size);
-    if(buffers_to_seconds(writing_size) < min_buffer_time) {
-//        LOGD("return 2");
-        return 2; // autoincrease_callback is called approx. at every block. So it should not be necessary to return a value higher than 2. Returning a very low number might also theoretically put a lower constant strain on the memory bus, thus theoretically lower the chance of xruns.
-    }
-
-    return 0 ;
-}
-
-int64_t FileWriter::seconds_to_frames(float seconds){
-    return (int64_t) (((long double)seconds)*((long double)jack_samplerate));
-}
-
-
-float FileWriter::frames_to_seconds(int frames){
-    return ((float)frames)/jack_samplerate;
-}
-
-// round up.
-int FileWriter::seconds_to_blocks(float seconds){
-    return (int)ceilf((seconds*jack_samplerate/(float)block_size));
-}
-
-void* FileWriter:: my_calloc(size_t size1,size_t size2){
-    size_t size = size1*size2;
-    void*  ret  = malloc(size);
-    if(ret==NULL){
-        fprintf(stderr,"\nOut of memory. Try a smaller buffer.\n");
-        return NULL; }
-    memset(ret,0,size);
-    return ret;
-}
-
-// same return value as seconds_to_blocks
-int FileWriter::seconds_to_buffers(float seconds){
-    return seconds_to_blocks(seconds);
+FileWriter::FileWriter (LockFreeQueueManager * queue) {
+    IN
+    this -> queue = queue ;
+    // MP3 as before, "recording_formats" adds a WAV master or anything else
+    formats = { MP3 };
+    OUT
 }
 
 FileWriter::~FileWriter () {
-    free (empty_buffer);
-//    vringbuffer_delete(vringbuffer);
+    stopRecording ();
 }
-FileWriter::FileWriter () {
+
+void FileWriter::setSampleRate (int sampleRate) {
     IN
-    ready = false ;
-    OUT
+    if (sampleRate == 0) {
+        HERE LOGE("sample rate passed as 0!") ;
+        jack_samplerate = 48000 ;
+    } else
+        jack_samplerate = sampleRate ;
 }
 
-void FileWriter::openFile () {
+void FileWriter::setFileName (std::string name) {
     IN
-    LOGD("opening file [%s] using sample rate: [%d]\tchannels: [%d]", filename.c_str(), jack_samplerate, num_channels);
-    memset (&opusIn, 0, 960*2);
-    memset (&opusOut, 0, 3*1276);
-    
-    # ifdef __linux__
-    memset(&sf_info,0,sizeof(SF_INFO));
-    sf_info.channels = num_channels ;
-    // why the below?
-//    sf_info.samplerate = jack_samplerate * num_channels ;
-    sf_info.samplerate = jack_samplerate ;
-    sf_info.format = SF_FORMAT_WAV ;
-    sf_info.format |= SF_FORMAT_FLOAT ;
-
-    if(sf_format_check(&sf_info)==0){
-        LOGE ("\nFileformat not supported by libsndfile. Try other options.\n");
-        return ;
-    }
-    
-    # endif
-
-    if (fileType == WAV) {
-        # ifdef __linux__
-        LOGD("[%s] %d %d %d", __PRETTY_FUNCTION__, sf_info.samplerate, sf_info.channels,
-             sf_info.format);
-        FileWriter::soundfile = sf_open(filename.c_str(), SFM_WRITE, &sf_info);
-        if (soundfile == NULL) { // || ai==10){
-            HERE
-            LOGF ("\nCan not open sndfile \"%s\" for output (%s)\n", filename.c_str(),
-                  sf_strerror(NULL));
-        } else {
-            LOGD("[%s] Opened file %s", __PRETTY_FUNCTION__, filename.c_str());
-//            sf_command (soundfile, SFC_SET_CLIPPING, NULL, SF_TRUE) ;
-        }
-        # endif
-    }
-
-    else if (fileType == OPUS) {
-        int err;
-        encoder = opus_encoder_create(jack_samplerate, num_channels, OPUS_APPLICATION_AUDIO, &err);
-        if (err<0) {
-            HERE LOGF("failed to create an encoder: %s\n", opus_strerror(err));
-        }
-
-        err = opus_encoder_ctl(encoder, OPUS_SET_BITRATE(bitRate));
-        if (err<0) {
-            LOGF("failed to set bitrate: %s\n", opus_strerror(err));
-        }
-
-//        outputFile = fopen(filename.c_str(), "wb");
-        outputFile = NULL ;
-        int error = 0 ;
-        LOGD("going to create opus encoder with filename: %s", filename.c_str());
-        
-        # ifdef __linux__
-        
-        comments = ope_comments_create() ;
-        ope_comments_add(comments, "TITLE", "AmpRack Demo");
-
-        oggOpusEnc = ope_encoder_create_file(filename.c_str(), comments, jack_samplerate, num_channels, 0, &error) ;
-        if (error != NULL) {
-            HERE LOGF("cannot create encoder: %s", ope_strerror(error));
-        }
-        err = ope_encoder_ctl(oggOpusEnc, OPUS_SET_BITRATE(bitRate));
-        # endif
-
-    } else if (fileType == MP3) {
-        LOGD("init lame encoder");
-        lame = lame_init();
-        lame_set_in_samplerate(lame, jack_samplerate);
-        lame_set_VBR(lame, vbr_default);
-        lame_set_out_samplerate(lame, jack_samplerate);
-        lame_set_num_channels(lame, num_channels);
-        /*
-        lame_set_brate(lame, 64);
-         */
-        lame_set_preset(lame, MEDIUM);
-        int retval = lame_init_params(lame);
-        if (retval < 0) {
-            HERE LOGF("Unable to intialize lame parameters: %d", retval);
-        }
-        outputFile = fopen(filename.c_str(), "wb");
-        mp3_buffer =  malloc ((block_size * 1.25) + 7200);
-    }
-
+    filename = name ;
+    LOGD("[%s] filename set to %s", __PRETTY_FUNCTION__ , name.c_str());
     OUT
 }
 
@@ -191,453 +35,316 @@ void FileWriter::setChannels (int channels) {
     num_channels = channels ;
 }
 
-void FileWriter::closeFile () {
-    IN
-    if (fileType == MP3) {
-        LOGD ("[mp3] free buffer\n");
-        unsigned char       *mp3buf  ;
-        mp3buf = (unsigned char *) malloc (8192*3);
-        lame_encode_flush(lame, mp3buf, 8192*3);
-        fwrite (mp3buf, 8192*3, sizeof (unsigned char), outputFile);
-        free (mp3buf);
-        lame_close(lame) ;
-        fclose(outputFile);
-        outputFile = NULL;
-        lame = NULL ;
-        free(mp3_buffer);
-    }
+void FileWriter::setFileType (int fType) {
+    formats.clear ();
+    addFileType (fType);
+}
 
-    else if (fileType == WAV && outputFile) {
-        LOGD ("[wav] free buffer\n");
-        fclose(outputFile);
-        outputFile = NULL;
-    }
+void FileWriter::addFileType (int fType) {
+    if (fType < 0 || fType >= FILE_TYPES)
+        return ;
+    for (FileType f: formats)
+        if (f == fType)
+            return ;
+    formats.push_back (static_cast<FileType>(fType));
+}
 
-    else if (fileType == OPUS )  {
-        LOGD ("[opus] free buffer\n");
-
-        if (oggOpusEnc) {
-            # ifdef __linux__
-            ope_encoder_drain(oggOpusEnc);
-            ope_encoder_destroy(oggOpusEnc);
-            ope_comments_destroy(comments);
-            oggOpusEnc = NULL ;
-            comments = NULL ;
-            # endif
-        }
-    }
+void FileWriter::setFileTypes (nlohmann::json names) {
+    if (! names.is_array ())
+        return ;
 
-    # ifdef __linux__
-    if (soundfile) {
-        LOGD ("[sndfile] free buffer\n");
-        sf_close(soundfile);
-        soundfile = NULL;
+    formats.clear ();
+    for (auto & n: names) {
+        int type = n.is_string () ? Encoder::parse (n.get <std::string> ()) : -1 ;
+        if (type < 0)
+            LOGW ("[recording] unknown format %s\n", n.dump ().c_str ());
+        else
+            addFileType (type);
     }
-    # endif
-
-    OUT
 }
 
-int FileWriter::disk_write_callback(float *arg,size_t nframes) {
-    if (bufferUsed < MAX_STATIC_BUFFER) {
-        for (int i = 0; i < nframes; i++) {
-            buffers[bufferUsed].data [i] = arg[i];
-        }
-
-        buffers[bufferUsed].pos = nframes;
-        bufferUsed ++ ;
-        return 0;
-
-    } else {
-//        disk_write(arg, nframes);
-        bufferUsed = 0;
-    }
+void FileWriter::setLamePreset (int preset) {
+    lamePreset = preset ;
+}
 
-    return 0 ;
+void FileWriter::setMode (nlohmann::json name) {
+    std::string m = name.is_string () ? name.get <std::string> () : "" ;
+    if (m == "wet")
+        mode = RECORD_WET ;
+    else if (m == "dry_wet")
+        mode = RECORD_DRY_WET ;
+    else if (m == "split")
+        mode = RECORD_SPLIT ;
+    else
+        LOGW ("[recording] unknown mode %s\n", name.dump ().c_str ());
 }
 
-int FileWriter::disk_write(AudioBuffer * buffer) {
-    float * data = buffer -> data ;
-    int frames = buffer -> pos ;
+void FileWriter::setSlots (nlohmann::json positions) {
+    if (! positions.is_array ())
+        return ;
 
-   /*
-    LOGD("----------| %d  |-----------", std::chrono::system_clock::now()) ;
-    for (int i = 0 ; i < frames ; i ++) {
-        LOGD("%f\t", data [i]) ;
+    slots.clear ();
+    for (auto & p: positions) {
+        if (! p.is_number_integer () || p.get <int> () < 0)
+            LOGW ("[recording] not a chain position: %s\n", p.dump ().c_str ());
+        else if (slots.size () == MAX_SLOT_TAPS)
+            LOGW ("[recording] only %d slots can be recorded\n", MAX_SLOT_TAPS);
+        else
+            slots.push_back (p.get <int> ());
     }
-     return 0 ;
-     */
+}
 
+std::string FileWriter::streamName (int stream) {
+    if (stream == STREAM_WET)
+        return "wet" ;
+    if (stream == STREAM_DRY)
+        return "dry" ;
 
-//    LOGD("[ringbuffer id] %d", getpid ());
+    int k = stream - STREAM_SLOT ;
+    if (k < slotNames.size () && ! slotNames [k].empty ())
+        return slotNames [k] ;
+    return std::string ("slot").append (std::to_string (k + 1));
+}
 
-//    IN
-//    LOGD("ready: %d", ready);
-    if (! ready || frames == 0 ) {
-        return 0;
-    }
+static float * stream (AudioBuffer * buffer, int s) {
+    if (s == STREAM_WET)
+        return buffer -> data ;
+    if (s == STREAM_DRY)
+        return buffer -> raw ;
+    // a slot the audio thread did not fill this time
+    if (s - STREAM_SLOT >= buffer -> nslots)
+        return nullptr ;
+    return buffer -> slots [s - STREAM_SLOT] ;
+}
 
-//    LOGD("disk write [%d] %d frames", disk_writes, frames);
-    disk_writes ++ ;
-    if (fileType == MP3) {
-        int write = lame_encode_buffer_ieee_float(lame, data, NULL, frames, (unsigned char *) mp3_buffer, (block_size * 1.25) + 7200);
-        if (write < 0) {
-            LOGF("unable to encode mp3 stream: %d", write);
-        } else {
-            fwrite(mp3_buffer, write, 1, outputFile);
+// one block to every file of the output, silence if buffer is nullptr
+bool FileWriter::put (Output * o, AudioBuffer * buffer, int frames) {
+    int channels = o -> streams.size ();
+    if (o -> encoders.size () == 1 && channels > 1) {
+        o -> scratch.assign (frames * channels, 0);
+        for (int c = 0 ; c < channels && buffer ; c ++) {
+            float * in = stream (buffer, o -> streams [c]);
+            if (in == nullptr)
+                continue ;
+            for (int i = 0 ; i < frames ; i ++)
+                o -> scratch [i * channels + c] = in [i] ;
         }
 
-//        OUT
-        return 0 ;
-    }
-
-    if (fileType== OPUS) {
-        # ifdef __linux__
-        ope_encoder_write_float(oggOpusEnc, data, frames);
-        #endif
-//        OUT
-        return 1;
+        o -> peaks [0] -> add (o -> scratch.data (), frames);
+        return o -> encoders [0] -> write (o -> scratch.data (), frames);
     }
 
-    if (fileType == 987) {
-        if (opusRead < 960) {
-            float * f = static_cast<float *>(data);
-            for (int x = 0 ; x < frames ; x ++) {
-                opusIn[opusRead] = (opus_int )(size_t) f ;
-                opusRead ++ ;
-                *f ++ ;
-            }
-
-//            OUT
-            return 1 ;
-
-        } else {
-
-            int nbBytes = opus_encode(encoder, opusIn, 960, opusOut, MAX_PACKET_SIZE);
-            if (nbBytes<0) {
-                LOGF("encode failed: %s\n", opus_strerror(nbBytes));
-            } else {
-                fwrite(opusOut, sizeof (unsigned char ), opusRead, outputFile) ;
-                opusRead = 0 ;
-//                OUT
-                return 1 ;
-            }
-
-
+    for (int c = 0 ; c < channels ; c ++) {
+        Encoder * e = o -> encoders [c] ;
+        float * in = buffer ? stream (buffer, o -> streams [c]) : nullptr ;
+        if (in == nullptr) {
+            o -> scratch.assign (frames * e -> channels, 0);
+            in = o -> scratch.data ();
         }
-    }
 
-    # ifdef __linux__
-    if((size_t)sf_writef_float(FileWriter::soundfile, data,frames) != frames){
-        LOGF("Error. Can not write sndfile (%s)\n",
-                      sf_strerror(FileWriter::soundfile)
-        );
-//        OUT
-        return 0;
+        o -> peaks [c] -> add (in, frames);
+        if (! e -> write (in, frames))
+            return false ;
     }
-    #endif
 
-//    OUT
-    return 1;
+    return true ;
 }
 
-void FileWriter::startRecording () {
-    IN
-    openFile();
-    ready = true ;
-    // fileWriteThread = std::thread (&FileWriter::writeLoop, this);
-    OUT
-}
+// on the output's own tap thread
+int FileWriter::write (AudioBuffer * buffer, void * data) {
+    Output * o = (Output *) data ;
+    if (buffer -> pos == 0 || o -> failed)
+        return 0 ;
 
-void FileWriter::writeLoop () {
-    buffer_t *buffer ;
-    while (ready) {
-        if (lockFreeQueue.pop(buffer)) {
-//            disk_write(buffer);
+    int frames = buffer -> pos / o -> encoders [0] -> channels ;
+    if (o -> streams.size () > 1)
+        frames = buffer -> pos ;
+
+    // blocks this output fell too far behind for, told at the end; written
+    // as silence so the streams stay in time with each other and the take
+    o -> missing += buffer -> overruns ;
+    for (int i = 0 ; i <= buffer -> overruns ; i ++) {
+        if (! put (o, i < buffer -> overruns ? nullptr : buffer, frames)) {
+            LOGE ("[recording] cannot write %s, giving up on it\n", o -> encoders [0] -> filename.c_str ());
+            o -> failed = 1 ;
+            return 0 ;
         }
 
-//        std::this_thread::sleep_for(std::chrono::microseconds (10));
+        for (Encoder * e: o -> encoders)
+            e -> frames += frames ;
     }
-}
 
-void FileWriter::stopRecording () {
-    IN
-    // because we use a large buffer, there can be samples in the buffer which have not been written yet
-//    if (useStaticBuffer)
-//        vringbuffer_return_writing(vringbuffer,buffers);
-
-//    vringbuffer_stop_callbacks(vringbuffer);
-    ready = false ;
-    closeFile();
-    HERE
-    // fileWriteThread.join();
-    LOGD("recording stopped: %d buffer underruns", total_overruns);
-    //~ bg_buffer->pos = 0 ;
-    OUT
+    return 1 ;
 }
 
-void FileWriter::setBufferSize (int bufferSize) {
-    IN
-    block_size = bufferSize ;
-    buffer_size_in_bytes = ALIGN_UP_DOUBLE(sizeof(buffer_t) + block_size*num_channels*sizeof(float ));
-//    buffer_size_in_bytes = buffer_size_in_bytes * 4 ;
-
-    LOGD("setting buffer size: %d from block size: %d", buffer_size_in_bytes, block_size);
-    disk_writes = 0 ;
-    processed = 0 ;
-    if (vringbuffer != NULL) {
-        ///| @attention: this *must* be freed
-        free (bg_buffer->data);
-        free (bg_buffer) ;
-        free (empty_buffer);
-        vringbuffer_delete(vringbuffer);
-        vringbuffer = NULL ;
+Encoder * FileWriter::open (FileType type, std::string name, int channels) {
+    Encoder * e = Encoder::create (type, bitRate, lamePreset);
+    if (e == nullptr)
+        return nullptr ;
+
+    e -> filename = name ;
+    e -> sampleRate = jack_samplerate ;
+    e -> channels = channels ;
+    // so the file still says what it is without take.json
+    if (type == WAV || type == FLAC)
+        e -> comment = nlohmann::json ({{"latency", latency}, {"preset", preset}}).dump ();
+    LOGD("opening file [%s] using sample rate: [%d]\tchannels: [%d]", e -> filename.c_str (), jack_samplerate, channels);
+    if (! e -> open ()) {
+        delete e ;
+        return nullptr ;
     }
 
-    if (bg_buffer != nullptr) {
-        free (bg_buffer->data);
-        free (bg_buffer) ;
-
-    }
-
-    bg_buffer = static_cast<buffer_t *>(calloc(1, sizeof(buffer_t)));
-//    HERE LOGD("using buffer size %d", bufferSize);
-    bg_buffer->data = static_cast<float *>(malloc(buffer_size_in_bytes));
-    bg_buffer->pos = 0 ;
-
-
-    if (false &&vringbuffer == NULL) {
-//        vringbuffer = vringbuffer_create(JC_MAX(4, seconds_to_buffers(min_buffer_time)),
-//                                         JC_MAX(4, seconds_to_buffers(max_buffer_time)),
-//                                         (size_t) buffer_size_in_bytes);
-//        vringbuffer_set_receiver_callback(vringbuffer, disk_callback);
-//        vringbuffer_set_autoincrease_callback(vringbuffer,autoincrease_callback,0);
-        /// TODO: Free this memory!
-//        current_buffer = static_cast<buffer_t *>(vringbuffer_get_writing(vringbuffer));
-        bg_buffer = static_cast<buffer_t *>(calloc(1, sizeof(buffer_t)));
-//    HERE LOGD("using buffer size %d", bufferSize);
-        bg_buffer->data = static_cast<float *>(malloc(buffer_size_in_bytes));
-        bg_buffer->pos = 0 ;
-//        empty_buffer   = static_cast<float *>(my_calloc(sizeof(float), block_size * num_channels));
-
-    }
-//    if(vringbuffer == NULL){
-//        HERE LOGF ("Unable to create ringbuffer!") ;
-//        OUT
-//        return ;
-//    }
-
-//    for (int i = 0 ; i < 32 ; i ++) {
-//        buffers[i] = static_cast<buffer_t *>(malloc(sizeof(buffer_t)));
-//        buffers [i] -> data = static_cast<float *>(malloc(block_size));
-//    }
-
-    OUT
-}
-
-void FileWriter::setSampleRate (int sampleRate) {
-    IN
-    if (sampleRate == 0) {
-        HERE LOGE("sample rate passed as 0!") ;
-        jack_samplerate = 48000 ;
-    } else
-        jack_samplerate = sampleRate ;
-}
-
-void FileWriter::setFileName (std::string name) {
-    IN
-    filename = std::string (name) + std::string (extensions [fileType]) ;
-    LOGD("[%s] filename set to %s", __PRETTY_FUNCTION__ , name.c_str());
-    OUT
+    return e ;
 }
 
-void FileWriter::process_fill_buffer(float *in[], buffer_t *buffer, int i, int end){
-    float *data=buffer->data;
-    int pos=buffer->pos*num_channels;
-
-    buffer->pos=pos/num_channels;
-}
-
-bool FileWriter::process_new_current_buffer(int frames_left){
-    IN
-    current_buffer=(buffer_t*)vringbuffer_get_writing(vringbuffer);
-//    current_buffer = vringbuffer->for_writer1 ;
-    if(current_buffer==NULL){
-        total_overruns++;
-        unreported_overruns += frames_left;
-        OUT
-        return false;
+// take.json: what the files of a take hold and how to line them up
+void FileWriter::writeTake () {
+    take ["files"] = nlohmann::json::array ();
+    for (Output * o: outputs) {
+        for (int i = 0 ; i < o -> encoders.size () ; i ++) {
+            Encoder * e = o -> encoders [i] ;
+            nlohmann::json streams = nlohmann::json::array ();
+            if (o -> encoders.size () == 1)
+                for (int s: o -> streams)
+                    streams.push_back (streamName (s));
+            else
+                streams.push_back (streamName (o -> streams [i]));
+
+            take ["files"].push_back ({
+                {"file", e -> filename},
+                {"format", Encoder::extension (e -> type) + 1},
+                {"channels", streams},
+                {"frames", e -> frames},
+                {"missing_blocks", o -> missing}
+            });
+        }
     }
 
-    current_buffer->pos=0;
-    OUT
-    return true;
-}
-
-void FileWriter::send_buffer_to_disk_thread(buffer_t *buffer){
-    buffer->overruns = unreported_overruns;
-    vringbuffer_return_writing(vringbuffer,buffer);
-    unreported_overruns = 0;
+    std::ofstream out (filename + ".json");
+    out << take.dump (4);
+    if (! out.good ())
+        LOGW ("[recording] cannot write %s.json\n", filename.c_str ());
 }
 
-void FileWriter::process_fill_buffers(void *data, int samples){
-    if(current_buffer==NULL && process_new_current_buffer(samples)==false) {
-        LOGD("no buffer and no samples!") ;
-        return;
+bool FileWriter::startRecording () {
+    IN
+    stopRecording ();
+    files.clear ();
+
+    // the streams after the wet signal are mono, like the chain
+    RecordMode m = mode ;
+    if (m != RECORD_WET && num_channels != 1) {
+        LOGW ("[recording] dry and slot streams need a mono chain, recording wet only\n");
+        m = RECORD_WET ;
     }
 
-    // fixme: why do I always take void* as argument type and cast it to float?
-    current_buffer->data = (float*) data ;
-    current_buffer->pos = samples ;
-    send_buffer_to_disk_thread(current_buffer);
-    current_buffer = NULL;
-    return ;
-
-    float *in[num_channels];
-    int i = 0 ;
-    while(i<samples){
-        int size=JC_MIN(samples - i,
-                        block_size - current_buffer->pos
-        );
-
-        process_fill_buffer(in,current_buffer,i,i+size);
-
-        LOGD("%d %d %d %d", i, samples, size, current_buffer->pos) ;
-        i+=size;
-
-        if(current_buffer->pos == block_size){
-            send_buffer_to_disk_thread(current_buffer);
-            if(process_new_current_buffer(samples-i)==false)
-                return;
+    std::vector <int> multitrack = { STREAM_DRY, STREAM_WET };
+    for (int k = 0 ; k < slots.size () ; k ++)
+        multitrack.push_back (STREAM_SLOT + k);
+
+    for (FileType type: formats) {
+        Output * o = new Output ;
+        o -> failed = 0 ;
+        o -> missing = 0 ;
+        // the compressed ones are for listening, they stay wet
+        bool lossless = type == WAV || type == FLAC ;
+        if (m == RECORD_WET || ! lossless) {
+            o -> streams = { STREAM_WET };
+            Encoder * e = open (type, filename + Encoder::extension (type), num_channels);
+            if (e)
+                o -> encoders.push_back (e);
+        } else if (m == RECORD_DRY_WET) {
+            o -> streams = multitrack ;
+            Encoder * e = open (type, filename + Encoder::extension (type), multitrack.size ());
+            if (e)
+                o -> encoders.push_back (e);
         } else {
-            LOGD("pos != block size") ;
-        }
-
-    }
-}
-
-int FileWriter::process(int nframes, const float *arg) {
-//    IN
-//    LOGD("file writer process");
-    if (!ready) {
-        HERE LOGW("not ready, return");
-//        OUT
-        return 0 ;
-    }
-//    process_fill_buffers(arg, nframes);
-//  simplified the following 26-06-22
-//  don't know the consequences yet
-//    if ((buffer_t*)vringbuffer_get_writing(vringbuffer) == NULL)
-//        return 0;
-
-    if (useStaticBuffer) {
-//        LOGD("use static buffer");
-        if (bufferUsed < MAX_STATIC_BUFFER) {
-//            LOGD("buffer used: %d", bufferUsed);
-//            LOGD("bufferUsed: %d, nframes: %d",  bufferUsed, nframes) ;
-            for (int i = 0; i < nframes; i++) {
-                buffers[bufferUsed].data [i] = arg[i];
-//                LOGD("buffers[bufferUsed].data [%d] = arg[%d];", i, i);
+            o -> streams = multitrack ;
+            for (int s: multitrack) {
+                Encoder * e = open (type, filename + "." + streamName (s) + Encoder::extension (type), 1);
+                if (e == nullptr)
+                    break ;
+                o -> encoders.push_back (e);
             }
 
-            buffers[bufferUsed].pos = nframes;
-            bufferUsed ++ ;
-//            OUT
-            return 0;
+            // all or nothing, half a split take is no use
+            if (o -> encoders.size () != multitrack.size ()) {
+                for (Encoder * e: o -> encoders) {
+                    e -> close ();
+                    delete e ;
+                }
+                o -> encoders.clear ();
+            }
+        }
 
-        } else {
-//            LOGD("bufferUsed = MAX_STATIC_BUFFER, vringbuffer_return_writing") ;
-//            vringbuffer_return_writing(vringbuffer,buffers);
-            bufferUsed = 0;
+        if (o -> encoders.empty ()) {
+            delete o ;
+            continue ;
         }
-    } else {
-//        bg_buffer->data = (float *) arg;
-
-//        LOGD("frames: %d", nframes);
-//        if (bg_buffer->pos >= buffer_size_in_bytes - 1)
-//            bg_buffer->pos = 0 ;
-
-//        if (false && buffer_write_index > 19 ) {
-            buffer_write_index = 0 ;
-//            LOGD("[realtime id] %d", gettid ());
-//            process_new_current_buffer(nframes);
-//            vringbuffer_return_writing(vringbuffer,bg_buffer);
-//            if (current_buffer != nullptr)
-//                LOGD("current buffer %d", current_buffer->pos);
-            bg_buffer->pos = 0 ;
-//        }
-
-//        process_new_current_buffer(nframes) ;
-//        if (current_buffer == NULL) {
-//            LOGE("no new buffer");
-//            return 0 ;
-//        }
-
-//        LOGD("testmest %d", current_buffer->data [0]);
-//        vringbuffer_return_writing(vringbuffer,current_buffer);
-//        while (vringbuffer_writing_size(vringbuffer)==0)
-//                usleep(2);
-//        while(vringbuffer_reading_size(vringbuffer) > 0)
-//            usleep(2);
-
-//        jack_ringbuffer_read(vringbuffer->for_writer2,(char*)&current_buffer,sizeof(void*)); // Checking writer2 first since that memory is more likely to already be in the cache.
-//        jack_ringbuffer_read(vringbuffer->for_writer1,(char*)&current_buffer,sizeof(void*));
-
-        for (int i = 0 ; i < nframes ; i ++) {
-            if (i >= block_size) {
-                HERE LOGF("more samples than we can handle! [%d]", nframes) ;
-                break ;
-            }
 
-//            if (arg [i] < -1.0)
-//                bg_buffer->data[bg_buffer->pos] = -.95 ;
-//            else if (arg [i] > 1.0)
-//                bg_buffer->data[bg_buffer->pos] = .95 ;
-//            else
-//            LOGD("%f", arg [i]);
-
-            bg_buffer->data[i] = arg [i] ;
-//            buffer_write_index ++ ;
-//            bg_buffer->pos ++ ;
-//            HERE
-//            current_buffer -> data [i] = arg [i];
-//            HERE
+        for (Encoder * e: o -> encoders)
+            o -> peaks.push_back (new PeakBuilder (e -> channels, jack_samplerate));
+
+        o -> tap = queue -> tap (write, o, TAP_OLDEST);
+        if (o -> tap < 0) {
+            for (Encoder * e: o -> encoders) {
+                e -> close ();
+                delete e ;
+            }
+            for (PeakBuilder * p: o -> peaks)
+                delete p ;
+            delete o ;
+            continue ;
         }
 
-//        current_buffer->pos = nframes;
-//        vringbuffer_return_writing(vringbuffer,current_buffer);
-
-//        bg_buffer->pos += nframes;
-        bg_buffer->pos = nframes;
-        // lockFreeQueue.push(bg_buffer);
-//        LOGD("lock free queue push [%d] %d", processed, nframes);
-        processed++;
-//        vringbuffer_return_writing(vringbuffer,bg_buffer);
-//        current_buffer->data = (float *) arg;
-//        current_buffer->pos = nframes;
-//        disk_write(bg_buffer->data, nframes);
+        outputs.push_back (o);
+        for (Encoder * e: o -> encoders)
+            files.push_back (e -> filename);
     }
 
-    /// does the following do ANYTHING?
-//    vringbuffer_trigger_autoincrease_callback(vringbuffer);
-//    OUT
-    return 0 ;
-}
+    ready = ! outputs.empty ();
+    if (ready && m != RECORD_WET) {
+        take = {
+            {"sample_rate", jack_samplerate},
+            // frames the wet stream trails the dry one by
+            {"latency", latency},
+            {"preset", preset}
+        };
+        writeTake ();
+    }
 
-float FileWriter::buffers_to_seconds(int buffers){
-    return blocks_to_seconds(buffers);
+    OUT
+    return ready ;
 }
 
-float FileWriter::blocks_to_seconds(int blocks){
-    return (float)blocks*(float)block_size/jack_samplerate;
-}
+void FileWriter::stopRecording () {
+    IN
+    ready = false ;
+    for (Output * o: outputs) {
+        // lets the encoders finish what is already in the ring
+        queue -> untap (o -> tap);
+        for (int i = 0 ; i < o -> encoders.size () ; i ++) {
+            Encoder * e = o -> encoders [i] ;
+            e -> close ();
+            // after the file, so the peaks are newer and count as current
+            o -> peaks [i] -> save (e -> filename);
+            LOGD ("[recording] %s: %llu frames, %llu blocks missing\n", e -> filename.c_str (), (unsigned long long) e -> frames, (unsigned long long) o -> missing);
+        }
+    }
 
-void FileWriter::setFileType (int fType) {
-    fileType = static_cast<FileType>(fType);
-}
+    // now with the lengths
+    if (! take.is_null ())
+        writeTake ();
+    take = nullptr ;
+
+    for (Output * o: outputs) {
+        for (Encoder * e: o -> encoders)
+            delete e ;
+        for (PeakBuilder * p: o -> peaks)
+            delete p ;
+        delete o ;
+    }
 
-void FileWriter::setLamePreset (int preset) {
-    IN
-    lame_set_preset(lame, preset);
+    outputs.clear ();
     OUT
 }
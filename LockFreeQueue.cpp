@@ -3,135 +3,339 @@
 //
 
 #include "LockFreeQueue.h"
+#include <cstring>
+#include <ctime>
+#include <cerrno>
 
-LockFreeQueue<AudioBuffer *, LOCK_FREE_SIZE> LockFreeQueueManager::lockFreeQueue;
-std::thread LockFreeQueueManager::fileWriteThread  ;
-bool LockFreeQueueManager::ready = false;
-void (* LockFreeQueueManager::functions [MAX_FUNCTIONS])(AudioBuffer *) ;
-AudioBuffer * LockFreeQueueManager::pAudioBuffer [SPARE_BUFFERS]; 
-int  LockFreeQueueManager::buffer_counter ;
+LockFreeQueueManager::LockFreeQueueManager () {
+    buffer_size = 0 ;
+    for (int i = 0 ; i < LOCK_FREE_SIZE ; i ++) {
+        ring [i].seq = 0 ;
+        memset (& ring [i].buffer, 0, sizeof (AudioBuffer));
+    }
+
+    for (int i = 0 ; i < MAX_TAPS ; i ++) {
+        taps [i].function = nullptr ;
+        taps [i].active = false ;
+        taps [i].sleeping = false ;
+        taps [i].stop = false ;
+        memset (& taps [i].buffer, 0, sizeof (AudioBuffer));
+        sem_init (& taps [i].wakeup, 0, 0);
+    }
+}
+
+LockFreeQueueManager::~LockFreeQueueManager () {
+    quit ();
+    release ();
+    for (int i = 0 ; i < MAX_TAPS ; i ++)
+        sem_destroy (& taps [i].wakeup);
+}
+
+static void buffer_alloc (AudioBuffer * buffer, int size) {
+    buffer->data = static_cast<float *>(calloc(size, sizeof(float)));
+    buffer->raw = static_cast<float *>(calloc(size, sizeof(float)));
+    for (int i = 0 ; i < MAX_SLOT_TAPS ; i ++)
+        buffer->slots [i] = static_cast<float *>(calloc(size, sizeof(float)));
+    buffer->nslots = 0;
+    buffer->pos = 0;
+    buffer->overruns = 0;
+    buffer->size = size;
+}
+
+static void buffer_free (AudioBuffer * buffer) {
+    free (buffer->data);
+    free (buffer->raw);
+    buffer->data = nullptr ;
+    buffer->raw = nullptr ;
+    for (int i = 0 ; i < MAX_SLOT_TAPS ; i ++) {
+        free (buffer->slots [i]);
+        buffer->slots [i] = nullptr ;
+    }
+}
+
+void LockFreeQueueManager::allocate () {
+    for (int i = 0; i < LOCK_FREE_SIZE; i++) {
+        buffer_alloc (& ring [i].buffer, buffer_size);
+        ring [i].seq = 0 ;
+    }
+    head = 0 ;
+}
+
+// only with no tap running and the audio thread kept out by ready
+void LockFreeQueueManager::release () {
+    for (int i = 0; i < LOCK_FREE_SIZE; i++)
+        buffer_free (& ring [i].buffer);
+}
 
 void LockFreeQueueManager::init (int _buffer_size) {
     IN
-    if (buffer_size < _buffer_size) {
-        if (pAudioBuffer[0] != nullptr) {
-            for (int i = 0; i < SPARE_BUFFERS; i++) {
-                free(pAudioBuffer[i]->data);
-                free(pAudioBuffer[i]->raw);
-                free(pAudioBuffer[i]);
-            }
+    std::lock_guard <std::mutex> guard (tapsLock);
+    if (buffer_size < _buffer_size && ring [0].buffer.data != nullptr) {
+        // every tap is holding a copy of the old size; stop them, grow
+        // everything and start them again
+        ready = false ;
+        for (int i = 0 ; i < MAX_TAPS ; i ++) {
+            if (! taps [i].active)
+                continue ;
+            taps [i].until = 0 ;
+            taps [i].stop = true ;
+            sem_post (& taps [i].wakeup);
+            taps [i].thread.join ();
+            buffer_free (& taps [i].buffer);
         }
-
-        pAudioBuffer[0] = nullptr ;
+        release ();
     }
 
-    buffer_size = _buffer_size ;
-    if (pAudioBuffer [0] == nullptr) {
-        //    pAudioBuffer = static_cast<AudioBuffer *>(calloc(SPARE_BUFFERS, sizeof(AudioBuffer)));
-        for (int i = 0; i < SPARE_BUFFERS; i++) {
-            pAudioBuffer[i] = static_cast<AudioBuffer *>(malloc(sizeof(AudioBuffer)));
-            pAudioBuffer[i]->data = static_cast<float *>(malloc(buffer_size * sizeof(float)));
-            pAudioBuffer[i]->raw = static_cast<float *>(malloc(buffer_size * sizeof(float)));
-            pAudioBuffer[i]->pos = 0;
+    if (buffer_size < _buffer_size)
+        buffer_size = _buffer_size ;
+    if (ring [0].buffer.data == nullptr) {
+        allocate ();
+        for (int i = 0 ; i < MAX_TAPS ; i ++) {
+            if (! taps [i].active)
+                continue ;
+            buffer_alloc (& taps [i].buffer, buffer_size);
+            taps [i].cursor = head + 1 ;
+            taps [i].stop = false ;
+            taps [i].thread = std::thread (&LockFreeQueueManager::run, this, & taps [i]);
         }
     }
-//        for (int x = 0 ; x < buffer_size ; x ++) {
-//            pAudioBuffer [i]->data [x] = 0.0f ;
-//            pAudioBuffer [i]->raw [x] = 0.0f ;
-//        }
-
-    buffer_counter = 0 ;
 
     ready = true ;
-    if (! thread_started) {
-        fileWriteThread = std::thread(&LockFreeQueueManager::main, this);
-        thread_started = true;
-    }
-
     LOGD("[LockFreeQueue thread id] %d", gettid ());
 
 //    attach();
     OUT
 }
 
-void LockFreeQueueManager::pop_function () {
-    functions [functions_count] = nullptr ;
-    functions_count -- ;
+int LockFreeQueueManager::add (int (* f) (AudioBuffer *), int (* callback) (AudioBuffer *, void *), void * data, TapPolicy policy) {
+    IN
+    std::lock_guard <std::mutex> guard (tapsLock);
+    int id = -1 ;
+    for (int i = 0 ; i < MAX_TAPS && id < 0 ; i ++)
+        if (! taps [i].active)
+            id = i ;
+
+    if (id < 0) {
+        HERE LOGE ("already have %d taps, cannot add any more!", MAX_TAPS);
+        OUT return -1 ;
+    }
+
+    Tap * t = & taps [id] ;
+    t->function = f ;
+    t->callback = callback ;
+    t->data = data ;
+    t->policy = policy ;
+    t->stop = false ;
+    t->sleeping = false ;
+    t->delivered = 0 ;
+    t->lost = 0 ;
+    // a new tap hears from now on, not the backlog
+    t->cursor = head + 1 ;
+    t->until = 0 ;
+    if (buffer_size > 0) {
+        buffer_alloc (& t->buffer, buffer_size);
+        t->thread = std::thread (&LockFreeQueueManager::run, this, t);
+    }
+
+    t->active = true ;
+    lastTap = id ;
+    OUT
+    return id ;
 }
 
-void LockFreeQueueManager::add_function (int (* f) (AudioBuffer *)) {
+int LockFreeQueueManager::tap (int (* f) (AudioBuffer *), TapPolicy policy) {
+    return add (f, nullptr, nullptr, policy);
+}
+
+int LockFreeQueueManager::tap (int (* f) (AudioBuffer *, void *), void * data, TapPolicy policy) {
+    return add (nullptr, f, data, policy);
+}
+
+void LockFreeQueueManager::untap (int id) {
     IN
-    if (functions_count > MAX_FUNCTIONS) {
-        HERE LOGE ("already have %d functions added to queue, cannot add any more!", MAX_FUNCTIONS);
+    std::lock_guard <std::mutex> guard (tapsLock);
+    if (id < 0 || id >= MAX_TAPS || ! taps [id].active) {
         OUT return ;
     }
 
-    functions [functions_count] = reinterpret_cast<void (*)(AudioBuffer *)>(f);
-    functions_count ++ ;
+    Tap * t = & taps [id] ;
+    // the audio thread may still post the semaphore, which is harmless;
+    // the slot itself is never freed
+    t->active = false ;
+    // whatever is already written still goes through, a recorder wants
+    // the end of the take
+    t->until = head ;
+    t->stop = true ;
+    sem_post (& t->wakeup);
+    if (t->thread.joinable ())
+        t->thread.join ();
+    buffer_free (& t->buffer);
+    while (sem_trywait (& t->wakeup) == 0)
+        ;
     OUT
 }
 
-void LockFreeQueueManager::process (float * raw, float * data, int samplesToProcess) {
-//    IN
-    if (! ready) {
-//        OUT
-//        HERE LOGD("not ready");
+void LockFreeQueueManager::add_function (int (* f) (AudioBuffer *)) {
+    tap (f, TAP_OLDEST);
+}
+
+void LockFreeQueueManager::pop_function () {
+    untap (lastTap);
+}
+
+void LockFreeQueueManager::subscribe () {
+    subscribers ++ ;
+}
+
+void LockFreeQueueManager::unsubscribe () {
+    if (subscribers > 0)
+        subscribers -- ;
+}
+
+uint64_t LockFreeQueueManager::dropped () {
+    uint64_t total = 0 ;
+    for (int i = 0 ; i < MAX_TAPS ; i ++)
+        if (taps [i].active)
+            total += taps [i].lost ;
+    return total ;
+}
+
+// audio thread: no locks, no allocation, a sem_post per sleeping tap
+void LockFreeQueueManager::process (float * raw, float * data, int samplesToProcess, float ** slots, int nslots) {
+    if (! ready || subscribers == 0) {
         return;
     }
 
-    for (int i = 0 ; i < samplesToProcess ; i ++) {
-        pAudioBuffer [buffer_counter]->raw [i] = raw [i] ;
-        pAudioBuffer [buffer_counter]->data [i] = data [i] ;
+    if (samplesToProcess > buffer_size) {
+        overruns ++ ;
+        samplesToProcess = buffer_size ;
     }
 
-    pAudioBuffer [buffer_counter]->pos = samplesToProcess;
-    lockFreeQueue.push (pAudioBuffer [buffer_counter]);
+    uint64_t n = head.load (std::memory_order_relaxed) + 1 ;
+    TapSlot * slot = & ring [n & (LOCK_FREE_SIZE - 1)] ;
 
-    buffer_counter ++ ;
-    if (buffer_counter >= SPARE_BUFFERS) {
-        buffer_counter = 0 ;
-    }
+    // 0 while it is being written, so a reader can tell
+    slot->seq.store (0, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+    memcpy (slot->buffer.raw, raw, samplesToProcess * sizeof (float));
+    memcpy (slot->buffer.data, data, samplesToProcess * sizeof (float));
+    if (nslots > MAX_SLOT_TAPS)
+        nslots = MAX_SLOT_TAPS ;
+    for (int i = 0 ; i < nslots ; i ++)
+        memcpy (slot->buffer.slots [i], slots [i], samplesToProcess * sizeof (float));
+    slot->buffer.nslots = nslots ;
+    slot->buffer.pos = samplesToProcess ;
+    slot->seq.store (n, std::memory_order_release);
+    head.store (n);
 
-//    OUT
+    for (int i = 0 ; i < MAX_TAPS ; i ++)
+        if (taps [i].active.load (std::memory_order_acquire) && taps [i].sleeping.exchange (false))
+            sem_post (& taps [i].wakeup);
 }
 
-void LockFreeQueueManager::main () {
+// block n into to, false if the audio thread got to it first
+bool LockFreeQueueManager::copy (uint64_t n, AudioBuffer * to) {
+    TapSlot * slot = & ring [n & (LOCK_FREE_SIZE - 1)] ;
+    if (slot->seq.load (std::memory_order_acquire) != n)
+        return false ;
+
+    int pos = slot->buffer.pos ;
+    if (pos < 0 || pos > to->size)
+        return false ;
+    memcpy (to->raw, slot->buffer.raw, pos * sizeof (float));
+    memcpy (to->data, slot->buffer.data, pos * sizeof (float));
+    int nslots = slot->buffer.nslots ;
+    if (nslots < 0 || nslots > MAX_SLOT_TAPS)
+        return false ;
+    for (int i = 0 ; i < nslots ; i ++)
+        memcpy (to->slots [i], slot->buffer.slots [i], pos * sizeof (float));
+    to->nslots = nslots ;
+    to->pos = pos ;
+
+    std::atomic_thread_fence (std::memory_order_acquire);
+    return slot->seq.load (std::memory_order_relaxed) == n ;
+}
+
+static void call (Tap * t, AudioBuffer * buffer) {
+    if (t->callback != nullptr)
+        t->callback (buffer, t->data);
+    else
+        t->function (buffer);
+}
+
+void LockFreeQueueManager::run (Tap * t) {
     IN
-    AudioBuffer * buffer ;
-//    int size = 0 ;
-    while (ready) {
-        while (lockFreeQueue.pop (buffer)) {
-//            if (size < lockFreeQueue.size())
-//                size = lockFreeQueue.size();
-//            LOGI("[lockfreequeue] peak size: %d", size);
-            for (int i = 0; i < functions_count; i++) {
-                (functions[i])(buffer);
+    // for taps that also want to run while nothing is copied
+    AudioBuffer nothing = {} ;
+    uint64_t missed = 0, reported = 0 ;
+    time_t lastReport = 0 ;
+
+    while (! t->stop || t->cursor <= t->until) {
+        uint64_t newest = head ;
+        if (t->cursor > newest) {
+            // say we are going to sleep, then look once more, so a block
+            // written in between is not slept through
+            t->sleeping = true ;
+            if (head >= t->cursor || t->stop) {
+                t->sleeping = false ;
+                continue ;
             }
+
+            struct timespec until ;
+            clock_gettime (CLOCK_REALTIME, & until);
+            until.tv_nsec += LOCK_FREE_IDLE_MS * 1000000L ;
+            until.tv_sec += until.tv_nsec / 1000000000L ;
+            until.tv_nsec %= 1000000000L ;
+
+            if (sem_timedwait (& t->wakeup, & until) != 0 && errno == ETIMEDOUT)
+                call (t, & nothing);
+            t->sleeping = false ;
+            continue ;
+        }
+
+        uint64_t from = t->cursor ;
+        if (t->policy == TAP_NEWEST)
+            t->cursor = newest ;
+        else if (newest - t->cursor >= LOCK_FREE_SIZE)
+            t->cursor = newest - LOCK_FREE_SIZE + 1 ;
+        // skipping on purpose is not losing
+        missed += t->cursor - from ;
+        if (t->policy == TAP_OLDEST)
+            t->lost += t->cursor - from ;
+
+        if (copy (t->cursor, & t->buffer)) {
+            t->buffer.overruns = missed ;
+            missed = 0 ;
+            call (t, & t->buffer);
+            t->delivered ++ ;
+        } else {
+            missed ++ ;
+            t->lost ++ ;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds (100));
+        t->cursor ++ ;
+
+        if (t->policy == TAP_OLDEST && t->lost != reported && time (NULL) != lastReport) {
+            reported = t->lost ;
+            lastReport = time (NULL);
+            LOGW ("[LockFreeQueue] tap %d fell behind, %llu blocks lost so far", (int) (t - taps), (unsigned long long) reported);
+        }
     }
     OUT
 }
 
+// stops every tap, from any thread but the audio one
 void LockFreeQueueManager::quit () {
     IN
-//    ready = false ;
-    AudioBuffer * buffer ;
-    while (lockFreeQueue.pop(buffer))
-        1 ; // TIL this can also be a statement
+    ready = false ;
+    for (int i = 0 ; i < MAX_TAPS ; i ++)
+        untap (i);
 
     //    detach();
-//    fileWriteThread.join();
-//    for (int i = 0; i < SPARE_BUFFERS; i ++) {
-//        free (pAudioBuffer [i] -> data) ;
-//        free (pAudioBuffer [i] -> raw) ;
-//        free (pAudioBuffer [i]) ;
-//    }
-
     OUT
 }
 
+#ifdef __ANDROID__
 void LockFreeQueueManager::detach () {
     IN
 
@@ -160,3 +364,4 @@ void LockFreeQueueManager::attach () {
 
     OUT
 }
+#endif
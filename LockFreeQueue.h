@@ -25,13 +25,18 @@
 #endif
 
 #include <cstdint>
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <thread>
+#include <mutex>
+#include <semaphore.h>
 #include "logging_macros.h"
 #include <unistd.h>
 #include "AudioBuffer.h"
+#ifdef __ANDROID__
 #include <jni.h>
+#endif
 //#include "Engine.h"
 
 /**
@@ -45,6 +50,16 @@
  * myQueue.push(value);
  * myQueue.pop(value);
  *
+ * For sample streams, move many items at once, or work on the queue memory directly:
+ *
+ * LockFreeQueue<float, 8192> samples;
+ * samples.try_push_n(block, frames);
+ *
+ * INDEX_TYPE n;
+ * const float * p = samples.read_span(n);
+ * fwrite(p, sizeof(float), n, file);
+ * samples.commit_read(n);
+ *
  * @tparam T - The item type
  * @tparam CAPACITY - Maximum number of items which can be held in the queue. Must be a power of 2.
  * Must be less than the maximum value permissible in INDEX_TYPE
@@ -53,6 +68,8 @@
  * UINT32_MAX can be time consuming and is not always possible.
  */
 
+#define LOCK_FREE_CACHE_LINE 64
+
 template <typename T, uint32_t CAPACITY, typename INDEX_TYPE = uint32_t>
 class LockFreeQueue {
 public:
@@ -67,6 +84,13 @@ public:
      * array. This approach avoids having a "dead item" in the buffer to distinguish between full
      * and empty states. It also allows us to have a size() method which is easily calculated.
      *
+     * Each counter lives on its own cache line, next to the owning side's copy of the other
+     * counter. The producer only reloads readCounter when its cached copy says there is less
+     * room than it wants, and the consumer only reloads writeCounter when its copy says there
+     * are fewer items than it wants, so while the queue is neither the two threads do not
+     * touch each other's cache lines at all. A side publishes its counter with release after touching the items and loads the
+     * other's with acquire before touching them, which is all the ordering that is needed.
+     *
      * IMPORTANT: This implementation is only thread-safe with a single reader thread and a single
      * writer thread. Have more than one of either will result in Bad Things™.
      */
@@ -82,13 +106,14 @@ public:
      * @return true if value was popped successfully, false if the queue is empty
      */
     bool pop(T &val) {
-        if (isEmpty()){
+        INDEX_TYPE read = readCounter.load(std::memory_order_relaxed);
+        if (readable(read, 1) == 0) {
             return false;
-        } else {
-            val = buffer[mask(readCounter)];
-            ++readCounter;
-            return true;
         }
+
+        val = buffer[mask(read)];
+        readCounter.store(read + 1, std::memory_order_release);
+        return true;
     }
 
     /**
@@ -98,13 +123,90 @@ public:
      * @return true if item was added, false if the queue was full
      */
     bool push(const T& item) {
-        if (isFull()){
+        INDEX_TYPE write = writeCounter.load(std::memory_order_relaxed);
+        if (writable(write, 1) == 0) {
             return false;
-        } else {
-            buffer[mask(writeCounter)] = item;
-            ++writeCounter;
-            return true;
         }
+
+        buffer[mask(write)] = item;
+        writeCounter.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Add up to count items to the back of the queue
+     *
+     * @param items - the items to add
+     * @param count - how many there are
+     * @return how many were added, less than count if the queue filled up
+     */
+    INDEX_TYPE try_push_n(const T * items, INDEX_TYPE count) {
+        INDEX_TYPE write = writeCounter.load(std::memory_order_relaxed);
+        INDEX_TYPE n = writable(write, count);
+        if (n > count)
+            n = count;
+
+        // at most two runs, before and after the end of the array
+        INDEX_TYPE first = contiguous(write, n);
+        std::copy(items, items + first, buffer + mask(write));
+        std::copy(items + first, items + n, buffer);
+        writeCounter.store(write + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * Take up to count items off the head of the queue
+     *
+     * @param items - where to put them
+     * @param count - how many there is room for
+     * @return how many were taken, less than count if the queue ran out
+     */
+    INDEX_TYPE try_pop_n(T * items, INDEX_TYPE count) {
+        INDEX_TYPE read = readCounter.load(std::memory_order_relaxed);
+        INDEX_TYPE n = readable(read, count);
+        if (n > count)
+            n = count;
+
+        INDEX_TYPE first = contiguous(read, n);
+        std::copy(buffer + mask(read), buffer + mask(read) + first, items);
+        std::copy(buffer, buffer + (n - first), items + first);
+        readCounter.store(read + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * Producer side: the free space that follows on in memory from the back of the queue,
+     * to be written in place and then handed over with commit_write(). Stops at the end of
+     * the array, so call again after committing to get the part that wrapped.
+     *
+     * @param count - set to how many items may be written at the returned address
+     */
+    T * write_span(INDEX_TYPE &count) {
+        INDEX_TYPE write = writeCounter.load(std::memory_order_relaxed);
+        count = contiguous(write, writable(write, CAPACITY - mask(write)));
+        return buffer + mask(write);
+    }
+
+    void commit_write(INDEX_TYPE count) {
+        writeCounter.store(writeCounter.load(std::memory_order_relaxed) + count,
+                           std::memory_order_release);
+    }
+
+    /**
+     * Consumer side: the items at the head of the queue that follow on in memory, to be
+     * read in place and then released with commit_read(). Stops at the end of the array.
+     *
+     * @param count - set to how many items may be read at the returned address
+     */
+    const T * read_span(INDEX_TYPE &count) {
+        INDEX_TYPE read = readCounter.load(std::memory_order_relaxed);
+        count = contiguous(read, readable(read, CAPACITY - mask(read)));
+        return buffer + mask(read);
+    }
+
+    void commit_read(INDEX_TYPE count) {
+        readCounter.store(readCounter.load(std::memory_order_relaxed) + count,
+                          std::memory_order_release);
     }
 
     /**
@@ -113,13 +215,14 @@ public:
      * @param item - item will be stored in this variable
      * @return true if item was stored, false if the queue was empty
      */
-    bool peek(T &item) const {
-        if (isEmpty()){
+    bool peek(T &item) {
+        INDEX_TYPE read = readCounter.load(std::memory_order_relaxed);
+        if (readable(read, 1) == 0) {
             return false;
-        } else {
-            item = buffer[mask(readCounter)];
-            return true;
         }
+
+        item = buffer[mask(read)];
+        return true;
     }
 
     /**
@@ -146,58 +249,148 @@ public:
          * e.g. if write is 0, read is 150 and the INDEX_TYPE is uint8_t where the max value is
          * 255 the return value will be (255 - (0 - 150)) = 105.
          *
+         * Either thread may ask, so both counters are loaded fresh rather than cached.
          */
-        return writeCounter - readCounter;
+        return writeCounter.load(std::memory_order_acquire) -
+               readCounter.load(std::memory_order_acquire);
     };
 
 private:
 
-    bool isEmpty() const { return readCounter == writeCounter; }
+    // items the consumer may read, refreshing its copy of writeCounter only when it
+    // shows fewer than wanted
+    INDEX_TYPE readable(INDEX_TYPE read, INDEX_TYPE want) {
+        if ((INDEX_TYPE) (cachedWrite - read) < want)
+            cachedWrite = writeCounter.load(std::memory_order_acquire);
+        return cachedWrite - read;
+    }
+
+    // room the producer may fill, refreshing its copy of readCounter only when it shows
+    // less than wanted
+    INDEX_TYPE writable(INDEX_TYPE write, INDEX_TYPE want) {
+        if (CAPACITY - (INDEX_TYPE) (write - cachedRead) < want)
+            cachedRead = readCounter.load(std::memory_order_acquire);
+        return CAPACITY - (write - cachedRead);
+    }
 
-    bool isFull() const { return size() == CAPACITY; }
+    // how many of count items starting at counter fit before the end of the array
+    INDEX_TYPE contiguous(INDEX_TYPE counter, INDEX_TYPE count) const {
+        INDEX_TYPE tail = CAPACITY - mask(counter);
+        return count < tail ? count : tail;
+    }
 
     INDEX_TYPE mask(INDEX_TYPE n) const { return static_cast<INDEX_TYPE>(n & (CAPACITY - 1)); }
 
     T buffer[CAPACITY];
-    std::atomic<INDEX_TYPE> writeCounter { 0 };
-    std::atomic<INDEX_TYPE> readCounter { 0 };
 
+    // producer's line
+    alignas(LOCK_FREE_CACHE_LINE) std::atomic<INDEX_TYPE> writeCounter { 0 };
+    INDEX_TYPE cachedRead { 0 };
+
+    // consumer's line
+    alignas(LOCK_FREE_CACHE_LINE) std::atomic<INDEX_TYPE> readCounter { 0 };
+    INDEX_TYPE cachedWrite { 0 };
 };
 
 #define LOCK_FREE_SIZE 128
-#define SPARE_BUFFERS 128
+// how often a tap runs with nothing to read, for check_notify
+#define LOCK_FREE_IDLE_MS 100
+#define MAX_TAPS 10
+
+typedef enum {
+    // lapped: go on from the oldest block still there, the rest are lost
+    TAP_OLDEST,
+    // behind: skip to the newest block; meters, tuner, notify
+    TAP_NEWEST
+} TapPolicy ;
+
+// one block of the ring, stamped with its number while it is whole
+typedef struct {
+    std::atomic<uint64_t> seq ;
+    AudioBuffer buffer ;
+} TapSlot ;
 
+// a consumer of the tap, with its own cursor and thread
+typedef struct {
+    int (* function) (AudioBuffer *) ;
+    int (* callback) (AudioBuffer *, void *) ;
+    void * data ;
+    TapPolicy policy ;
+    std::atomic<bool> active ;
+    std::atomic<bool> sleeping ;
+    std::atomic<bool> stop ;
+    sem_t wakeup ;
+    uint64_t cursor ;           // next block to read
+    uint64_t until ;            // once stopped, the last block to read
+    std::atomic<uint64_t> delivered ;
+    std::atomic<uint64_t> lost ;
+    AudioBuffer buffer ;        // the tap's own copy of the block
+    std::thread thread ;
+} Tap ;
+
+/*  Broadcasts copies of the audio from the audio thread to any number of
+ *  taps: the recorder, check_notify, and whatever else wants to listen.
+ *
+ *  The audio thread writes each block into the next slot of a ring and
+ *  never waits for anyone. Every tap reads the ring at its own pace on
+ *  its own thread, copying a block out and checking its stamp afterwards,
+ *  so a block that was written over while being copied is counted as lost
+ *  rather than handed on torn. A slow encoder therefore only costs the
+ *  recorder blocks, never notify its latency.
+ *
+ *  Taps come and go from any thread but the audio one; it only looks at
+ *  which tap slots are active to wake the ones that are asleep. Nothing
+ *  is copied unless someone has subscribed.
+ */
 class LockFreeQueueManager {
-    static LockFreeQueue<AudioBuffer *, LOCK_FREE_SIZE> lockFreeQueue ;
-    static AudioBuffer * pAudioBuffer [SPARE_BUFFERS];
+    TapSlot ring [LOCK_FREE_SIZE] ;
+    std::atomic<uint64_t> head { 0 };    // newest block written, 0 for none
     int buffer_size ;
-    static int buffer_counter ;
-    static bool ready ;
+    std::atomic<bool> ready { false };
+    std::atomic<int> subscribers { 0 };
+    std::atomic<uint64_t> overruns { 0 };
 
-    #define MAX_FUNCTIONS 10
-    static void (* functions [MAX_FUNCTIONS])(AudioBuffer *) ;
-    int functions_count ;
+    Tap taps [MAX_TAPS] ;
+    std::mutex tapsLock ;
+    int lastTap = -1 ;
 
-    static std::thread fileWriteThread ;
-    bool thread_started = false;
+    void allocate () ;
+    void release () ;
+    bool copy (uint64_t n, AudioBuffer * to) ;
+    void run (Tap * tap) ;
+    int add (int (*f)(AudioBuffer *), int (*callback)(AudioBuffer *, void *), void * data, TapPolicy policy) ;
 
 public:
+#ifdef __ANDROID__
     JavaVM * vm = NULL  ;
+#endif
 
     void init (int _buffer_size) ;
-    void add_function(int (*f)(AudioBuffer *));
-    void process (float * raw, float * data, int samplesToProcess) ;
-    void main () ;
+    void process (float * raw, float * data, int samplesToProcess, float ** slots = nullptr, int nslots = 0) ;
     void quit () ;
 
-    LockFreeQueueManager () {
-        functions_count = 0 ;
-        pAudioBuffer [0] = nullptr;
-    }
+    // returns the tap id, -1 if there are MAX_TAPS already
+    int tap (int (*f)(AudioBuffer *), TapPolicy policy) ;
+    int tap (int (*f)(AudioBuffer *, void *), void * data, TapPolicy policy) ;
+    // returns after the tap has read what was written before the call
+    void untap (int id) ;
+    void add_function(int (*f)(AudioBuffer *));
+    void pop_function();
+
+    // while nobody is subscribed process () copies nothing
+    void subscribe () ;
+    void unsubscribe () ;
+    uint64_t dropped () ;
+    uint64_t lost (int id) { return taps [id].lost ; }
+    uint64_t delivered (int id) { return taps [id].delivered ; }
+    uint64_t overrun () { return overruns ; }
+
+    LockFreeQueueManager () ;
+    ~LockFreeQueueManager () ;
 
+#ifdef __ANDROID__
     void attach();
     void detach ();
-
-    void pop_function();
+#endif
 };
 #endif //AMP_RACK_LOCKFREEQUEUE_H
@@ -3,6 +3,7 @@
 #include "lv2/lv2plug.in/ns/ext/atom/forge.h"
 
 using namespace nlohmann ;
+PortCache * Plugin::portCache = nullptr ;
 void replaceAll(std::string& str, const std::string& from, const std::string& to) {
     if(from.empty())
         return;
@@ -186,7 +187,7 @@ void Plugin::load () {
             continue ;
         }
 
-        json jsonPort = json::parse (el.value ().dump ());
+        json & jsonPort = el.value ();
         std::string portNameStr = std::string (jsonPort ["name"]);
         const char * portName = portNameStr.c_str ();
         // ayyo why ...?
@@ -981,6 +982,12 @@ Plugin::Plugin (char * _uri, unsigned long _sampleRate, LilvWorld * world, const
     }
 
     lilv_plugin = lilv_plugins_get_by_uri(_plugins, uri);
+    if (lilv_plugin == nullptr) {
+        LOGF ("[%s:%s] plugin not found in world: %s", __FILE__, __PRETTY_FUNCTION__, _uri);
+        uri = nullptr;
+        return ;
+    }
+
     instance = lilv_plugin_instantiate(lilv_plugin, sampleRate, features);
     if (instance == nullptr) {
         LOGF ("[%s:%s] could not instantiate lilv plugin from uri: %s", __FILE__, __PRETTY_FUNCTION__, _uri);
@@ -993,41 +1000,42 @@ Plugin::Plugin (char * _uri, unsigned long _sampleRate, LilvWorld * world, const
 
     type = SharedLibrary::PluginType::LILV;
     sampleRate = _sampleRate ;
+    LilvNode * plugin_name = lilv_plugin_get_name (lilv_plugin);
+    lv2_name = std::string (lilv_node_as_string (plugin_name));
+    lilv_node_free (plugin_name);
+
+    if (portCache == nullptr)
+        portCache = new PortCache (world, std::string ());
 
-    const uint32_t n_ports = lilv_plugin_get_num_ports(lilv_plugin);
-    float* min_values = (float*)calloc(n_ports, sizeof(float));
-    float* max_values = (float*)calloc(n_ports, sizeof(float));
-    float* def_values = (float*)calloc(n_ports, sizeof(float));
+    // port layout comes from the compiled cache, no RDF queries here
+    portInfo = portCache->get (lilv_plugin);
+    if (portInfo == nullptr) {
+        LOGF ("[%s:%s] no port info for %s", __FILE__, __PRETTY_FUNCTION__, _uri);
+        uri = nullptr;
+        return ;
+    }
 
     float * dummy_output_control_port = (float *) malloc (sizeof (float));
 
-    // Get the port ranges using the convenience function
-    lilv_plugin_get_port_ranges_float(lilv_plugin, min_values, max_values, def_values);
-    LilvNode* lv2_InputPort   = lilv_new_uri(world, LV2_CORE__InputPort);
-    LilvNode* lv2_OutputPort  = lilv_new_uri(world, LV2_CORE__OutputPort);
-    LilvNode* lv2_AudioPort   = lilv_new_uri(world, LV2_CORE__AudioPort);
-    LilvNode* lv2_ControlPort = lilv_new_uri(world, LV2_CORE__ControlPort);
-    LilvNode* lv2_AtomPort    = lilv_new_uri(world, LV2_ATOM__AtomPort);
-
-    for (uint32_t i = 0; i < n_ports; ++i) {
-        const LilvPort* port = lilv_plugin_get_port_by_index(lilv_plugin, i);
-        if (lilv_port_is_a(lilv_plugin, port, lv2_AudioPort)) {
-            if (lilv_port_is_a(lilv_plugin, port, lv2_OutputPort)) {
-                //~ LOGD("[%s %d]: found output port", lilv_node_as_string(lilv_plugin_get_name(lilv_plugin)), i);
+    for (const PortInfo & info: portInfo->ports) {
+        uint32_t i = info.index ;
+        if (info.flags & PortInfo::AUDIO) {
+            if (info.flags & PortInfo::OUTPUT) {
+                //~ LOGD("[%s %d]: found output port", lv2_name.c_str (), i);
                 if (outputPort == -1)
                     outputPort = i;
                 else if (outputPort2 == -1)
                     outputPort2 = i;
                 else
-                    LOGE("[%s %d]: is third output port", lilv_node_as_string(lilv_plugin_get_name(lilv_plugin)), i);
-            } else if (lilv_port_is_a(lilv_plugin, port, lv2_InputPort)) {
-                //~ LOGD("[%s %d]: found input port", lilv_node_as_string(lilv_plugin_get_name(lilv_plugin)), i);
+                    LOGE("[%s %d]: is third output port", lv2_name.c_str (), i);
+            } else if (info.flags & PortInfo::INPUT) {
+                //~ LOGD("[%s %d]: found input port", lv2_name.c_str (), i);
                 if (inputPort == -1)
                     inputPort = i;
                 else if (inputPort2 == -1)
                     inputPort2 = i;
                 else
-                    LOGE("[%s %d]: is third input port", lilv_node_as_string(lilv_plugin_get_name(lilv_plugin)), i);
+                    LOGE("[%s %d]: is third input port", lv2_name.c_str (), i);
             }
 
             // dummy connect audio ports
@@ -1035,44 +1043,49 @@ Plugin::Plugin (char * _uri, unsigned long _sampleRate, LilvWorld * world, const
             continue;            
         }
 
-        if (lilv_port_is_a(lilv_plugin, port, lv2_ControlPort)) {
-            if (lilv_port_is_a(lilv_plugin, port, lv2_InputPort) == false) {
-                lilv_instance_connect_port(instance, i, dummy_output_control_port);
+        if (info.flags & PortInfo::CONTROL) {
+            if (! (info.flags & PortInfo::INPUT)) {
+                if (info.flags & PortInfo::LATENCY)
+                    lilv_instance_connect_port(instance, i, &latency);
+                else
+                    lilv_instance_connect_port(instance, i, dummy_output_control_port);
                 continue;
             } else {
                 PluginControl* pluginControl = new PluginControl(lilv_plugin, i);
 
-                pluginControl->min = min_values[i];
-                pluginControl->max = max_values[i];
-                pluginControl->default_value = def_values[i];
+                pluginControl->min = info.min;
+                pluginControl->max = info.max;
+                pluginControl->default_value = info.def;
                 pluginControl->def = (LADSPA_Data *) malloc (sizeof(LADSPA_Data));
                 lilv_instance_connect_port(instance, i, pluginControl->def);
-                *pluginControl->def = def_values[i];
+                *pluginControl->def = info.def;
 
-                pluginControl->lv2_name = std::string(lilv_node_as_string(lilv_port_get_name(lilv_plugin, port)));
-
-                pluginControl->name = lilv_node_as_string(lilv_port_get_name(lilv_plugin, port));
+                pluginControl->lv2_name = info.name;
+                pluginControl->name = pluginControl->lv2_name.c_str ();
+                pluginControl->symbol = info.symbol;
                 pluginControls.push_back(pluginControl);
                 continue;
             }
         }
 
-        if (lilv_port_is_a(lilv_plugin, port, lv2_AtomPort)) {
+        if (info.flags & PortInfo::ATOM) {
             PluginControl* pluginControl = new PluginControl(lilv_plugin, i);
-            pluginControl->lv2_name = std::string(lilv_node_as_string(lilv_port_get_name(lilv_plugin, port)));
-            pluginControl->name = lilv_node_as_string(lilv_port_get_name(lilv_plugin, port));
+            pluginControl->lv2_name = info.name;
+            pluginControl->name = pluginControl->lv2_name.c_str ();
+            pluginControl->symbol = info.symbol;
             pluginControl->lilv_port_index = i ;
             pluginControls.push_back(pluginControl);
-            pluginControl->file_port_size = 8192;
+            if (info.minimumSize > pluginControl->file_port_size)
+                pluginControl->file_port_size = info.minimumSize;
             pluginControl->filePort = (LV2_Atom_Sequence *) malloc (pluginControl->file_port_size);
             memset(pluginControl->filePort, 0, pluginControl->file_port_size);
             lilv_instance_connect_port(instance, i, pluginControl->filePort);
 
-            if (lilv_port_is_a(lilv_plugin, port, lv2_InputPort)) {
-                LOGD("[%s %d]: found atom input port", lilv_node_as_string(lilv_plugin_get_name(lilv_plugin)), i);
+            if (info.flags & PortInfo::INPUT) {
+                LOGD("[%s %d]: found atom input port", lv2_name.c_str (), i);
                 pluginControl->type = PluginControl::Type::LV2_ATOM_INPUT_PORT;
             } else {
-                LOGD("[%s %d]: found atom output port", lilv_node_as_string(lilv_plugin_get_name(lilv_plugin)), i);
+                LOGD("[%s %d]: found atom output port", lv2_name.c_str (), i);
                 pluginControl->type = PluginControl::Type::LV2_ATOM_OUTPUT_PORT;
             }
 
@@ -1085,4 +1098,58 @@ Plugin::Plugin (char * _uri, unsigned long _sampleRate, LilvWorld * world, const
     process_atom_sequences();
     print();
     OUT
-}
\ No newline at end of file
+}
+// Run a few silent periods through a freshly instantiated plugin before it is
+// handed to the audio thread. The first run () of many plugins is an order of
+// magnitude slower than the rest (page faults on tables, lazy init), which is
+// an xrun if it happens inside the jack callback.
+void Plugin::warmup (int periods, int nframes) {
+    IN
+    if (instance == nullptr || periods < 1 || nframes < 1) {
+        OUT
+        return ;
+    }
+
+    // audio ports are only dummy connected by the constructor, so give them
+    // a real buffer for now; the processor connects its own every cycle
+    float * scratch = (float *) calloc (nframes * 2, sizeof (float));
+    float * in = scratch, * out = scratch + nframes ;
+    if (inputPort != -1)
+        lilv_instance_connect_port (instance, inputPort, in);
+    if (inputPort2 != -1)
+        lilv_instance_connect_port (instance, inputPort2, in);
+    if (outputPort != -1)
+        lilv_instance_connect_port (instance, outputPort, out);
+    if (outputPort2 != -1)
+        lilv_instance_connect_port (instance, outputPort2, out);
+
+    double total = 0 ;
+    int settled = 0 ;
+    for (int i = 0 ; i < periods ; i ++) {
+        auto start = std::chrono::steady_clock::now ();
+        lilv_instance_run (instance, nframes);
+        auto end = std::chrono::steady_clock::now ();
+        float cost = std::chrono::duration <float, std::micro> (end - start).count ();
+
+        if (i == 0)
+            firstRunCost = cost ;
+        // the first half of the pass is still settling down
+        else if (i >= periods / 2) {
+            total += cost ;
+            settled ++ ;
+        }
+
+        // plugins may leave a tail in the buffer, keep feeding silence
+        memset (in, 0, sizeof (float) * nframes);
+    }
+
+    ::free (scratch);
+
+    warmupPeriods = periods ;
+    runCost = settled ? total / settled : firstRunCost ;
+    dspLoad = runCost / (1000000.0f * nframes / sampleRate) ;
+
+    LOGD ("[warmup] %s: %d periods, first run %.1f us, settled %.1f us (%.2f%% dsp)\n",
+          lv2_name.c_str (), periods, firstRunCost, runCost, dspLoad * 100);
+    OUT
+}
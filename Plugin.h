@@ -8,6 +8,7 @@
 #include <fstream>
 #include "logging_macros.h"
 #include <vector>
+#include <chrono>
 
 #ifdef _android
 #include "android/asset_manager.h"
@@ -19,6 +20,7 @@
 #include "lv2_ext.h"
 #include "atom.h"
 #include "symap.h"
+#include "portcache.h"
 //~ #include "lv2/atom/forge.h"
 #include <lilv/lilv.h>
 #include <lv2/core/lv2.h>
@@ -74,6 +76,7 @@ public:
     int outputPort = -1;
     int outputPort2 = -1;
     LADSPA_Data dummy_output_control_port = 0; // from th pulseaudio ladspa sink module
+    LADSPA_Data latency = 0; // frames, from the reportsLatency port if there is one
     LADSPA_Handle *handle ;
     Plugin(const LADSPA_Descriptor * descriptor, unsigned long _sampleRate, SharedLibrary::PluginType _type = SharedLibrary::LADSPA);
     void print();
@@ -110,6 +113,17 @@ public:
     void setAtomPortValue (int control, std::string text) ;
 
     bool check_notify();
+
+    // warm-up and load metrics, filled in by warmup () before the
+    // plugin is handed to the audio thread
+    int warmupPeriods = 0 ;
+    float firstRunCost = 0 ;    // microseconds for the very first run ()
+    float runCost = 0 ;         // settled microseconds per period
+    float dspLoad = 0 ;         // runCost as a fraction of the period
+    void warmup (int periods, int nframes) ;
+
+    static PortCache * portCache ;
+    const PortCacheEntry * portInfo = nullptr ;
 };
 
 LV2_Worker_Status lv2ScheduleWork (LV2_Worker_Schedule_Handle  handle, uint32_t size, const void * data);
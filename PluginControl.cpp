@@ -302,6 +302,7 @@ PluginControl::PluginControl(const LilvPlugin *plugin, int index) {
     desc = nullptr ;
     hint = nullptr ;
     def = nullptr ;
+    type = FLOAT ;
     lv2AtomSequence = nullptr ;
     lilv_port = lilv_plugin_get_port_by_index(plugin, index);
     lilv_port_index = index;
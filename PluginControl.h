@@ -63,6 +63,7 @@ public:
     LADSPA_Data presetValue = -1;
     Type type ;
     std::string lv2_name ;
+    std::string symbol ;
     bool name_allocated = false ;
     LV2_Atom_Sequence * lv2AtomSequence ;
 
@@ -0,0 +1,213 @@
+#include <cmath>
+#include <cstdio>
+#include "asset.h"
+#include "resampler.h"
+
+#ifdef __linux__
+#include "snd.h"
+#endif
+
+// bytes hashed at a time
+#define ASSET_CHUNK (1 << 20)
+
+AssetLoader::AssetLoader () {
+    worker = std::thread (& AssetLoader::work, this);
+}
+
+AssetLoader::~AssetLoader () {
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        done = true ;
+    }
+    ready.notify_one ();
+    worker.join ();
+}
+
+void AssetLoader::setNormalize (nlohmann::json name) {
+    if (name == "none")
+        normalize = NORMALIZE_NONE ;
+    else if (name == "peak")
+        normalize = NORMALIZE_PEAK ;
+    else if (name == "energy")
+        normalize = NORMALIZE_ENERGY ;
+    else
+        LOGW ("[asset] unknown normalization %s\n", name.dump ().c_str ());
+}
+
+void AssetLoader::request (std::string filename, int sampleRate, int channels, AssetReady f, void * data) {
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        todo.push_back ({filename, sampleRate, channels, normalize, f, data});
+    }
+
+    ready.notify_one ();
+}
+
+void AssetLoader::work () {
+    IN
+    std::unique_lock <std::mutex> guard (lock);
+    while (true) {
+        ready.wait (guard, [this] { return done || ! todo.empty (); });
+        if (done)
+            break ;
+
+        Job job = todo.front ();
+        todo.pop_front ();
+        guard.unlock ();
+
+        std::shared_ptr <const Asset> asset = load (job);
+        if (job.callback)
+            job.callback (asset, job.data);
+
+        guard.lock ();
+    }
+
+    OUT
+}
+
+// FNV-1a of the contents, it only has to tell files apart
+std::string AssetLoader::hashOf (std::string filename) {
+    std::error_code ec ;
+    uintmax_t size = std::filesystem::file_size (filename, ec);
+    std::filesystem::file_time_type time = std::filesystem::last_write_time (filename, ec);
+    if (ec)
+        return std::string ();
+
+    auto k = known.find (filename);
+    if (k != known.end () && k -> second.size == size && k -> second.time == time)
+        return k -> second.hash ;
+
+    FILE * file = fopen (filename.c_str (), "rb");
+    if (file == nullptr)
+        return std::string ();
+
+    uint64_t h = 0xcbf29ce484222325ULL ;
+    std::vector <unsigned char> buffer (ASSET_CHUNK);
+    size_t n ;
+    while ((n = fread (buffer.data (), 1, buffer.size (), file)) > 0)
+        for (size_t i = 0 ; i < n ; i ++) {
+            h ^= buffer [i] ;
+            h *= 0x100000001b3ULL ;
+        }
+    fclose (file);
+
+    char hex [17];
+    snprintf (hex, sizeof (hex), "%016llx", (unsigned long long) h);
+    known [filename] = {size, time, hex};
+    return hex ;
+}
+
+std::shared_ptr <const Asset> AssetLoader::load (Job & job) {
+    std::string hash = hashOf (job.filename);
+    if (hash.empty ()) {
+        LOGW ("[asset] cannot read %s\n", job.filename.c_str ());
+        return nullptr ;
+    }
+
+    std::string key = hash + "@" + std::to_string (job.sampleRate) + "/" +
+        std::to_string (job.channels) + "/" + std::to_string (job.normalize);
+    used [key] = ++ tick ;
+    auto hit = cache.find (key);
+    if (hit != cache.end ()) {
+        LOGD ("[asset] %s from the cache\n", job.filename.c_str ());
+        return hit -> second ;
+    }
+
+#ifdef __linux__
+    SoundFile * sf = snd_read ((char *) job.filename.c_str ());
+    if (sf == nullptr) {
+        used.erase (key);
+        return nullptr ;
+    }
+
+    Asset source ;
+    source.frames = * sf -> len ;
+    source.channels = sf -> channels ;
+    source.sampleRate = source.sourceRate = sf -> sampleRate ;
+    source.data.assign (sf -> data, sf -> data + (size_t) source.frames * source.channels);
+    delete sf ;
+
+    std::shared_ptr <Asset> asset = std::make_shared <Asset> ();
+    convert (source, job.sampleRate, job.channels, * asset);
+    asset -> hash = hash ;
+
+    double peak = 0, energy = 0 ;
+    for (float v: asset -> data) {
+        peak = fmax (peak, fabs (v));
+        energy += (double) v * v ;
+    }
+
+    // energy is per channel, each one is convolved on its own
+    double gain = 1 ;
+    if (job.normalize == NORMALIZE_PEAK && peak > 0)
+        gain = 1 / peak ;
+    else if (job.normalize == NORMALIZE_ENERGY && energy > 0)
+        gain = 1 / sqrt (energy / asset -> channels);
+    if (gain != 1)
+        for (float & v: asset -> data)
+            v *= gain ;
+
+    LOGD ("[asset] %s: %d frames of %d at %d Hz, %d at %d Hz here\n", job.filename.c_str (),
+        source.frames, source.channels, source.sampleRate, asset -> channels, asset -> sampleRate);
+    cache [key] = asset ;
+    trim ();
+    return asset ;
+#else
+    used.erase (key);
+    return nullptr ;
+#endif
+}
+
+// whatever no one holds any more, oldest first, down to the budget
+void AssetLoader::trim () {
+    size_t idle = 0 ;
+    for (auto & a: cache)
+        if (a.second.use_count () == 1)
+            idle += a.second -> data.size () * sizeof (float);
+
+    while (idle > ASSET_CACHE) {
+        auto oldest = cache.end ();
+        for (auto a = cache.begin () ; a != cache.end () ; a ++)
+            if (a -> second.use_count () == 1 && (oldest == cache.end () || used [a -> first] < used [oldest -> first]))
+                oldest = a ;
+        if (oldest == cache.end ())
+            break ;
+
+        idle -= oldest -> second -> data.size () * sizeof (float);
+        used.erase (oldest -> first);
+        cache.erase (oldest);
+    }
+}
+
+void AssetLoader::convert (const Asset & from, int sampleRate, int channels, Asset & to) {
+    // channels first, so a stereo IR going mono is resampled once
+    int frames = from.frames ;
+    std::vector <float> mixed ((size_t) frames * channels);
+    for (int i = 0 ; i < frames ; i ++) {
+        const float * in = from.data.data () + (size_t) i * from.channels ;
+        float * out = mixed.data () + (size_t) i * channels ;
+        if (channels == 1 && from.channels > 1) {
+            float sum = 0 ;
+            for (int c = 0 ; c < from.channels ; c ++)
+                sum += in [c] ;
+            out [0] = sum / from.channels ;
+        } else
+            for (int c = 0 ; c < channels ; c ++)
+                out [c] = in [c % from.channels] ;
+    }
+
+    // a file that does not say is taken to be at our rate
+    Resampler resampler (from.sampleRate > 0 ? from.sampleRate : sampleRate, sampleRate);
+    to.frames = resampler.length (frames);
+    to.channels = channels ;
+    to.sampleRate = sampleRate ;
+    to.sourceRate = from.sourceRate ;
+    to.data.resize ((size_t) to.frames * channels);
+
+    std::vector <float> one (to.frames);
+    for (int c = 0 ; c < channels ; c ++) {
+        resampler.process (mixed.data () + c, frames, channels, one.data ());
+        for (int i = 0 ; i < to.frames ; i ++)
+            to.data [(size_t) i * channels + c] = one [i] ;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "logging_macros.h"
+#include "json.hpp"
+
+// bytes of decoded audio kept that nothing is using any more
+#define ASSET_CACHE (64 << 20)
+
+typedef enum {
+    NORMALIZE_NONE,
+    // loudest sample at full scale
+    NORMALIZE_PEAK,
+    // unit energy, so an IR neither adds nor takes away level
+    NORMALIZE_ENERGY
+} Normalize ;
+
+// decoded and converted, shared by everything that asked for the same
+typedef struct {
+    // interleaved
+    std::vector <float> data ;
+    int frames ;
+    int channels ;
+    int sampleRate ;
+    // as the file had it
+    int sourceRate ;
+    std::string hash ;
+} Asset ;
+
+// from the loader's thread, asset is nullptr if the file could not be read
+typedef void (* AssetReady) (std::shared_ptr <const Asset> asset, void * data);
+
+/*  Reads audio files for plugins, IRs mostly, on a thread of its own,
+ *  and hands them over at the rate and channel count asked for.
+ *
+ *  The result is kept by the hash of the file's contents and the rate,
+ *  so loading a preset again, or the same IR in two plugins, or the same
+ *  file under another name, decodes once. A path seen before is not even
+ *  read again unless its size or time changed.
+ */
+class AssetLoader {
+    typedef struct {
+        std::string filename ;
+        int sampleRate ;
+        int channels ;
+        Normalize normalize ;
+        AssetReady callback ;
+        void * data ;
+    } Job ;
+
+    typedef struct {
+        uintmax_t size ;
+        std::filesystem::file_time_type time ;
+        std::string hash ;
+    } Known ;
+
+    std::deque <Job> todo ;
+    std::mutex lock ;
+    std::condition_variable ready ;
+    std::thread worker ;
+    std::atomic <bool> done { false };
+
+    // the worker's alone
+    std::unordered_map <std::string, std::shared_ptr <const Asset>> cache ;
+    std::unordered_map <std::string, uint64_t> used ;
+    std::unordered_map <std::string, Known> known ;
+    uint64_t tick = 0 ;
+
+    void work ();
+    std::shared_ptr <const Asset> load (Job & job);
+    std::string hashOf (std::string filename);
+    void trim ();
+
+public:
+    Normalize normalize = NORMALIZE_NONE ;
+
+    AssetLoader ();
+    ~AssetLoader ();
+
+    void request (std::string filename, int sampleRate, int channels, AssetReady f, void * data);
+    // "none", "peak" or "energy"
+    void setNormalize (nlohmann::json name);
+    // mono to many is copied, many to mono is averaged
+    static void convert (const Asset & from, int sampleRate, int channels, Asset & to);
+};
+
+#endif
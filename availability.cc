@@ -0,0 +1,280 @@
+#include "availability.h"
+
+#include <algorithm>
+
+static uint64_t key (int tab, int index) {
+    return ((uint64_t) (uint32_t) tab << 32) | (uint32_t) index ;
+}
+
+PresetAvailability::PresetAvailability (const Catalog * catalog) {
+    this -> catalog = catalog ;
+}
+
+// plugin names in the order the preset chains them
+std::vector <std::string> PresetAvailability::pluginsOf (json & preset) {
+    std::vector <std::string> names ;
+    if (! preset.is_object () || ! preset.contains ("controls") || ! preset ["controls"].is_object ())
+        return names ;
+
+    for (auto & p: preset ["controls"])
+        if (p.is_object () && p.contains ("name") && p ["name"].is_string ())
+            names.push_back (p ["name"].get <std::string> ());
+    return names ;
+}
+
+bool PresetAvailability::resolve (const std::string & name) {
+    auto o = overrides.find (name);
+    if (o != overrides.end ())
+        return o->second ;
+    return catalog != nullptr && catalog -> find (name.c_str ()) != nullptr ;
+}
+
+int PresetAvailability::plugin (const std::string & name) {
+    auto it = pluginIds.find (name);
+    if (it != pluginIds.end ())
+        return it->second ;
+
+    int id = pluginNames.size ();
+    pluginIds.emplace (name, id);
+    pluginNames.push_back (name);
+    installed.push_back (resolve (name));
+    users.emplace_back ();
+    return id ;
+}
+
+PresetAvailability::PresetUse * PresetAvailability::use (int tab, int index) {
+    if (tab < 0 || tab >= (int) tabs.size () || index < 0 || index >= (int) tabs [tab].size ())
+        return nullptr ;
+    PresetUse * p = & tabs [tab][index] ;
+    return p -> live ? p : nullptr ;
+}
+
+void PresetAvailability::setMissing (PresetUse * p, int missing) {
+    if (p -> missing == 0 && missing > 0)
+        unplayableCount ++ ;
+    else if (p -> missing > 0 && missing == 0)
+        unplayableCount -- ;
+    p -> missing = missing ;
+}
+
+void PresetAvailability::add (int tab, int index, json & preset) {
+    if (tab < 0 || index < 0)
+        return ;
+    if (tab >= (int) tabs.size ())
+        tabs.resize (tab + 1);
+    if (index >= (int) tabs [tab].size ())
+        tabs [tab].resize (index + 1, { {}, 0, false });
+
+    remove (tab, index);
+    PresetUse & p = tabs [tab][index] ;
+    p.plugins.clear ();
+    p.missing = 0 ;
+    p.live = true ;
+
+    int missing = 0 ;
+    for (auto & name: pluginsOf (preset)) {
+        int id = plugin (name);
+        // a plugin used twice in one chain counts once
+        if (std::find (p.plugins.begin (), p.plugins.end (), id) != p.plugins.end ())
+            continue ;
+        p.plugins.push_back (id);
+        users [id].push_back (key (tab, index));
+        if (! installed [id])
+            missing ++ ;
+    }
+
+    setMissing (& p, missing);
+}
+
+void PresetAvailability::remove (int tab, int index) {
+    PresetUse * p = use (tab, index);
+    if (p == nullptr)
+        return ;
+
+    uint64_t k = key (tab, index);
+    for (int id: p -> plugins) {
+        auto it = std::find (users [id].begin (), users [id].end (), k);
+        if (it != users [id].end ())
+            users [id].erase (it);
+    }
+
+    setMissing (p, 0);
+    p -> live = false ;
+}
+
+void PresetAvailability::clearTab (int tab) {
+    if (tab < 0 || tab >= (int) tabs.size ())
+        return ;
+
+    for (auto & p: tabs [tab])
+        if (p.live)
+            setMissing (& p, 0);
+    tabs [tab].clear ();
+
+    // one pass over the users lists instead of one per preset
+    for (auto & list: users)
+        list.erase (std::remove_if (list.begin (), list.end (), [tab] (uint64_t k) { return (int) (k >> 32) == tab ; }), list.end ());
+}
+
+bool PresetAvailability::playable (int tab, int index) {
+    PresetUse * p = use (tab, index);
+    return p == nullptr || p -> missing == 0 ;
+}
+
+int PresetAvailability::missingCount (int tab, int index) {
+    PresetUse * p = use (tab, index);
+    return p == nullptr ? 0 : p -> missing ;
+}
+
+std::vector <std::string> PresetAvailability::missing (int tab, int index) {
+    std::vector <std::string> names ;
+    PresetUse * p = use (tab, index);
+    if (p == nullptr || p -> missing == 0)
+        return names ;
+
+    for (int id: p -> plugins)
+        if (! installed [id])
+            names.push_back (pluginNames [id]);
+    return names ;
+}
+
+// for a preset that is not in any tab, e.g. one being loaded from a file
+std::vector <std::string> PresetAvailability::missing (json & preset) {
+    std::vector <std::string> names ;
+    for (auto & name: pluginsOf (preset))
+        if (! installed [plugin (name)])
+            names.push_back (name);
+    return names ;
+}
+
+// flip one plugin and fix up the presets that use it; returns how many
+// presets changed between playable and not
+int PresetAvailability::update (int id, bool have) {
+    if (installed [id] == have)
+        return 0 ;
+
+    installed [id] = have ;
+    int changed = 0 ;
+    for (uint64_t k: users [id]) {
+        PresetUse * p = use (k >> 32, (int) (uint32_t) k);
+        if (p == nullptr)
+            continue ;
+
+        bool was = p -> missing == 0 ;
+        setMissing (p, p -> missing + (have ? -1 : 1));
+        if (was != (p -> missing == 0))
+            changed ++ ;
+    }
+
+    return changed ;
+}
+
+int PresetAvailability::setInstalled (const std::string & name, bool have) {
+    // loaded fine and never failed: the catalog already said so
+    if (have && overrides.find (name) == overrides.end ())
+        return 0 ;
+    overrides [name] = have ;
+    return update (plugin (name), have);
+}
+
+// the catalog was rebuilt: resolve every name again, and give plugins
+// that failed to load another go
+int PresetAvailability::refresh () {
+    overrides.clear ();
+    int changed = 0 ;
+    for (int id = 0 ; id < (int) pluginNames.size () ; id ++)
+        changed += update (id, resolve (pluginNames [id]));
+    LOGD ("[availability] %d presets changed, %d unplayable\n", changed, unplayableCount);
+    return changed ;
+}
+
+int PresetAvailability::size () {
+    int n = 0 ;
+    for (auto & tab: tabs)
+        for (auto & p: tab)
+            n += p.live ;
+    return n ;
+}
+
+// missing plugins by how many unplayable presets use them
+std::vector <std::pair <std::string, int>> PresetAvailability::mostMissing (size_t max) {
+    std::vector <std::pair <std::string, int>> out ;
+    for (int id = 0 ; id < (int) pluginNames.size () ; id ++) {
+        if (installed [id])
+            continue ;
+        int n = 0 ;
+        for (uint64_t k: users [id])
+            n += use (k >> 32, (int) (uint32_t) k) != nullptr ;
+        if (n > 0)
+            out.push_back ({ pluginNames [id], n });
+    }
+
+    std::sort (out.begin (), out.end (), [] (const std::pair <std::string, int> & a, const std::pair <std::string, int> & b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first ;
+    });
+
+    if (out.size () > max)
+        out.resize (max);
+    return out ;
+}
+
+/*  Greedy set cover over the unplayable presets: each step installs the
+ *  missing plugin that completes the most presets, and breaks ties (or a
+ *  step where nothing completes yet) by how far it gets the rest, a
+ *  preset missing n plugins counting 1 / n. Greedy is within a log factor
+ *  of the best choice and answers in milliseconds on the whole library.
+ */
+std::vector <UnlockStep> PresetAvailability::unlock (size_t max) {
+    std::vector <UnlockStep> steps ;
+    std::vector <int> need ;
+    std::vector <std::vector <int>> usedBy (pluginNames.size ());
+
+    for (auto & tab: tabs)
+        for (auto & p: tab) {
+            if (! p.live || p.missing == 0)
+                continue ;
+            int slot = need.size ();
+            need.push_back (p.missing);
+            for (int id: p.plugins)
+                if (! installed [id])
+                    usedBy [id].push_back (slot);
+        }
+
+    std::vector <bool> taken (pluginNames.size ());
+    int total = 0 ;
+    while (steps.size () < max) {
+        int best = -1, bestDone = 0 ;
+        double bestProgress = 0 ;
+        for (int id = 0 ; id < (int) usedBy.size () ; id ++) {
+            if (taken [id] || usedBy [id].empty ())
+                continue ;
+
+            int done = 0 ;
+            double progress = 0 ;
+            for (int slot: usedBy [id]) {
+                if (need [slot] == 0)
+                    continue ;
+                done += need [slot] == 1 ;
+                progress += 1.0 / need [slot] ;
+            }
+
+            if (done > bestDone || (done == bestDone && progress > bestProgress)) {
+                best = id ;
+                bestDone = done ;
+                bestProgress = progress ;
+            }
+        }
+
+        if (best == -1)
+            break ;
+
+        taken [best] = true ;
+        for (int slot: usedBy [best])
+            if (need [slot] > 0)
+                need [slot] -- ;
+        total += bestDone ;
+        steps.push_back ({ pluginNames [best], bestDone, total });
+    }
+
+    return steps ;
+}
@@ -0,0 +1,77 @@
+#ifndef AVAILABILITY_H
+#define AVAILABILITY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "json.hpp"
+#include "log.h"
+#include "catalog.h"
+
+using json = nlohmann::json;
+
+/*  Which presets can be played with the plugins we have.
+ *
+ *  Every plugin name a preset uses is interned once and resolved against
+ *  the catalog once, so a preset's flag is just the number of its plugins
+ *  we do not have, kept up to date as presets come and go. When a plugin
+ *  turns up or goes away only the presets that use it are touched.
+ *
+ *  Presets are keyed by tab and position, the same as the preset index.
+ */
+
+typedef struct {
+    std::string plugin ;
+    int unlocked ;          // presets this plugin alone makes playable now
+    int total ;             // presets unlocked by this and the ones before
+} UnlockStep ;
+
+class PresetAvailability {
+    typedef struct {
+        std::vector <int> plugins ;
+        int missing ;
+        bool live ;
+    } PresetUse ;
+
+    const Catalog * catalog ;
+    std::unordered_map <std::string, int> pluginIds ;
+    std::vector <std::string> pluginNames ;
+    std::vector <bool> installed ;
+    // plugins the catalog has but that failed to load
+    std::unordered_map <std::string, bool> overrides ;
+    std::vector <std::vector <uint64_t>> users ;
+    std::vector <std::vector <PresetUse>> tabs ;
+    int unplayableCount = 0 ;
+
+    int plugin (const std::string & name);
+    bool resolve (const std::string & name);
+    PresetUse * use (int tab, int index);
+    void setMissing (PresetUse * p, int missing);
+    int update (int id, bool have);
+
+public:
+    PresetAvailability (const Catalog * catalog) ;
+
+    void add (int tab, int index, json & preset);
+    void remove (int tab, int index);
+    void clearTab (int tab);
+
+    bool playable (int tab, int index);
+    int missingCount (int tab, int index);
+    std::vector <std::string> missing (int tab, int index);
+    std::vector <std::string> missing (json & preset);
+
+    int setInstalled (const std::string & name, bool have);
+    int refresh ();
+
+    int size ();
+    int unplayable () { return unplayableCount ; }
+    std::vector <std::pair <std::string, int>> mostMissing (size_t max);
+    std::vector <UnlockStep> unlock (size_t max);
+
+    static std::vector <std::string> pluginsOf (json & preset);
+} ;
+
+#endif
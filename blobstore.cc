@@ -0,0 +1,342 @@
+#include "blobstore.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+/*  SHA-256 (FIPS 180-4). Kept here rather than pulling in a crypto
+ *  library for one function; it only names files.
+ */
+typedef struct {
+    uint32_t h [8] ;
+    unsigned char block [64] ;
+    size_t used ;
+    uint64_t length ;
+} Sha256 ;
+
+static const uint32_t K [64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t rotr (uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static void sha256_init (Sha256 * s) {
+    static const uint32_t h0 [8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy (s->h, h0, sizeof (h0));
+    s->used = 0 ;
+    s->length = 0 ;
+}
+
+static void sha256_block (Sha256 * s, const unsigned char * p) {
+    uint32_t w [64] ;
+    for (int i = 0 ; i < 16 ; i ++)
+        w [i] = (uint32_t) p [i * 4] << 24 | p [i * 4 + 1] << 16 | p [i * 4 + 2] << 8 | p [i * 4 + 3] ;
+    for (int i = 16 ; i < 64 ; i ++) {
+        uint32_t s0 = rotr (w [i - 15], 7) ^ rotr (w [i - 15], 18) ^ (w [i - 15] >> 3);
+        uint32_t s1 = rotr (w [i - 2], 17) ^ rotr (w [i - 2], 19) ^ (w [i - 2] >> 10);
+        w [i] = w [i - 16] + s0 + w [i - 7] + s1 ;
+    }
+
+    uint32_t a = s->h [0], b = s->h [1], c = s->h [2], d = s->h [3] ;
+    uint32_t e = s->h [4], f = s->h [5], g = s->h [6], h = s->h [7] ;
+    for (int i = 0 ; i < 64 ; i ++) {
+        uint32_t t1 = h + (rotr (e, 6) ^ rotr (e, 11) ^ rotr (e, 25)) + ((e & f) ^ (~e & g)) + K [i] + w [i] ;
+        uint32_t t2 = (rotr (a, 2) ^ rotr (a, 13) ^ rotr (a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g ; g = f ; f = e ; e = d + t1 ;
+        d = c ; c = b ; b = a ; a = t1 + t2 ;
+    }
+
+    s->h [0] += a ; s->h [1] += b ; s->h [2] += c ; s->h [3] += d ;
+    s->h [4] += e ; s->h [5] += f ; s->h [6] += g ; s->h [7] += h ;
+}
+
+static void sha256_update (Sha256 * s, const unsigned char * p, size_t size) {
+    s->length += size ;
+    if (s->used > 0) {
+        size_t take = std::min (size, 64 - s->used);
+        memcpy (s->block + s->used, p, take);
+        s->used += take ;
+        p += take ;
+        size -= take ;
+        if (s->used < 64)
+            return ;
+        sha256_block (s, s->block);
+        s->used = 0 ;
+    }
+
+    for ( ; size >= 64 ; p += 64, size -= 64)
+        sha256_block (s, p);
+
+    memcpy (s->block, p, size);
+    s->used = size ;
+}
+
+static std::string sha256_final (Sha256 * s) {
+    uint64_t bits = s->length * 8 ;
+    unsigned char pad [72] = { 0x80 };
+    size_t padding = (s->used < 56 ? 56 : 120) - s->used ;
+    for (int i = 0 ; i < 8 ; i ++)
+        pad [padding + i] = (unsigned char) (bits >> (56 - 8 * i));
+    sha256_update (s, pad, padding + 8);
+
+    static const char * hex = "0123456789abcdef" ;
+    std::string out ;
+    for (int i = 0 ; i < 8 ; i ++)
+        for (int k = 28 ; k >= 0 ; k -= 4)
+            out.push_back (hex [(s->h [i] >> k) & 0xF]);
+    return out ;
+}
+
+std::string BlobStore::sha256 (const char * data, size_t size) {
+    Sha256 s ;
+    sha256_init (& s);
+    sha256_update (& s, (const unsigned char *) data, size);
+    return sha256_final (& s);
+}
+
+std::string BlobStore::sha256File (const std::string & path) {
+    FILE * f = fopen (path.c_str (), "rb");
+    if (f == nullptr)
+        return std::string ();
+
+    Sha256 s ;
+    sha256_init (& s);
+    std::vector <unsigned char> buf (1 << 16);
+    size_t n ;
+    while ((n = fread (buf.data (), 1, buf.size (), f)) > 0)
+        sha256_update (& s, buf.data (), n);
+    bool ok = ! ferror (f);
+    fclose (f);
+    return ok ? sha256_final (& s) : std::string ();
+}
+
+// both come off the network, neither may walk out of the store
+bool BlobStore::validHash (const std::string & hash) {
+    if (hash.size () != 64)
+        return false ;
+    for (char c: hash)
+        if (! ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+            return false ;
+    return true ;
+}
+
+bool BlobStore::validName (const std::string & name) {
+    return ! name.empty () && name.size () < 256 && name != "." && name != ".." &&
+        name.find_first_of ("/\\:") == std::string::npos ;
+}
+
+BlobStore::BlobStore (std::string dir) {
+    this -> dir = dir ;
+    std::error_code ec ;
+    std::filesystem::create_directories (dir, ec);
+    share (dir);
+    loadHashes ();
+}
+
+// files under dir may go to a peer that asks for them by hash
+void BlobStore::share (const std::string & dir) {
+    std::error_code ec ;
+    std::filesystem::path real = std::filesystem::weakly_canonical (dir, ec);
+    if (! ec)
+        roots.push_back (real);
+}
+
+// a file, not a link out or a .. out, under one of the shared folders
+bool BlobStore::shareable (const std::string & path) {
+    std::error_code ec ;
+    std::filesystem::path real = std::filesystem::canonical (path, ec);
+    if (ec || ! std::filesystem::is_regular_file (real, ec))
+        return false ;
+
+    for (auto & root: roots) {
+        std::filesystem::path rel = real.lexically_relative (root);
+        if (! rel.empty () && * rel.begin () != "..")
+            return true ;
+    }
+
+    return false ;
+}
+
+void BlobStore::loadHashes () {
+    std::ifstream in (dir + "/hashes.json");
+    if (! in.is_open ())
+        return ;
+
+    json j = json::parse (in, nullptr, false);
+    if (! j.is_object ())
+        return ;
+
+    for (auto & e: j.items ()) {
+        json & v = e.value ();
+        if (v.is_array () && v.size () == 3 && v [2].is_string ())
+            hashed [e.key ()] = { v [0].get <uint64_t> (), v [1].get <int64_t> (), v [2].get <std::string> () };
+    }
+}
+
+void BlobStore::saveHashes () {
+    json j = json::object ();
+    for (auto & e: hashed)
+        j [e.first] = { e.second.size, e.second.mtime, e.second.hash };
+
+    std::string tmp = dir + "/hashes.json.tmp" ;
+    {
+        std::ofstream out (tmp);
+        out << j.dump ();
+        if (! out.good ())
+            return ;
+    }
+
+    std::error_code ec ;
+    std::filesystem::rename (tmp, dir + "/hashes.json", ec);
+}
+
+// sha256 of any file, worked out again only when it has changed
+std::string BlobStore::hashOf (const std::string & path) {
+    std::error_code ec ;
+    uint64_t size = std::filesystem::file_size (path, ec);
+    if (ec)
+        return std::string ();
+    int64_t mtime = std::filesystem::last_write_time (path, ec).time_since_epoch ().count ();
+    if (ec)
+        return std::string ();
+
+    {
+        std::lock_guard <std::recursive_mutex> guard (lock);
+        auto it = hashed.find (path);
+        if (it != hashed.end () && it->second.size == size && it->second.mtime == mtime)
+            return it->second.hash ;
+    }
+
+    std::string hash = sha256File (path);
+    if (hash.empty ())
+        return hash ;
+
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    hashed [path] = { size, mtime, hash };
+    saveHashes ();
+    return hash ;
+}
+
+std::string BlobStore::folder (const std::string & hash) {
+    return std::string (dir).append ("/").append (hash);
+}
+
+// the complete file for a hash, empty if we do not have it
+std::string BlobStore::path (const std::string & hash) {
+    if (! validHash (hash))
+        return std::string ();
+
+    std::error_code ec ;
+    for (auto & e: std::filesystem::directory_iterator (folder (hash), ec)) {
+        std::string name = e.path ().filename ().string ();
+        if (e.is_regular_file (ec) && (name.size () < 5 || name.compare (name.size () - 5, 5, ".part") != 0))
+            return e.path ().string ();
+    }
+
+    return std::string ();
+}
+
+bool BlobStore::has (const std::string & hash) {
+    return ! path (hash).empty ();
+}
+
+// where a file will be once it is here
+std::string BlobStore::target (const std::string & hash, const std::string & name) {
+    std::string have = path (hash);
+    if (! have.empty ())
+        return have ;
+    return folder (hash).append ("/").append (name);
+}
+
+// a file we hashed somewhere else on disk, copied in instead of sent
+bool BlobStore::adopt (const std::string & hash, const std::string & name) {
+    if (! validHash (hash) || ! validName (name))
+        return false ;
+    if (has (hash))
+        return true ;
+
+    std::vector <std::string> candidates ;
+    {
+        std::lock_guard <std::recursive_mutex> guard (lock);
+        for (auto & e: hashed)
+            if (e.second.hash == hash)
+                candidates.push_back (e.first);
+    }
+
+    std::error_code ec ;
+    for (auto & source: candidates) {
+        // still the same file
+        if (hashOf (source) != hash)
+            continue ;
+
+        std::string final = target (hash, name);
+        std::filesystem::create_directories (folder (hash), ec);
+        std::filesystem::copy_file (source, final + ".part", std::filesystem::copy_options::overwrite_existing, ec);
+        if (! ec)
+            std::filesystem::rename (final + ".part", final, ec);
+        if (! ec)
+            return true ;
+    }
+
+    return false ;
+}
+
+uint64_t BlobStore::partial (const std::string & hash, const std::string & name) {
+    if (! validHash (hash) || ! validName (name))
+        return 0 ;
+    std::error_code ec ;
+    uint64_t size = std::filesystem::file_size (target (hash, name) + ".part", ec);
+    return ec ? 0 : size ;
+}
+
+int BlobStore::write (const std::string & hash, const std::string & name, uint64_t offset, const char * data, size_t size, uint64_t total) {
+    if (! validHash (hash) || ! validName (name) || offset + size > total)
+        return -1 ;
+    if (has (hash))
+        return 1 ;
+
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    std::string final = target (hash, name);
+    std::string part = final + ".part" ;
+    std::error_code ec ;
+    std::filesystem::create_directories (folder (hash), ec);
+
+    // pieces arrive in order; anything else means the part file is not
+    // what the sender thinks, so start it again
+    if (partial (hash, name) != offset) {
+        LOGD ("[blobs] %s: have %llu, got a piece at %llu\n", hash.c_str (), (unsigned long long) partial (hash, name), (unsigned long long) offset);
+        std::filesystem::remove (part, ec);
+        return -1 ;
+    }
+
+    FILE * f = fopen (part.c_str (), "ab");
+    if (f == nullptr)
+        return -1 ;
+    bool ok = fwrite (data, 1, size, f) == size ;
+    ok = fclose (f) == 0 && ok ;
+    if (! ok)
+        return -1 ;
+
+    if (offset + size < total)
+        return 0 ;
+
+    if (sha256File (part) != hash) {
+        LOGD ("[blobs] %s does not match its hash, dropped\n", name.c_str ());
+        std::filesystem::remove (part, ec);
+        return -1 ;
+    }
+
+    std::filesystem::rename (part, final, ec);
+    return ec ? -1 : 1 ;
+}
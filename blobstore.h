@@ -0,0 +1,69 @@
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <filesystem>
+
+#include "json.hpp"
+#include "log.h"
+
+using json = nlohmann::json;
+
+/*  Model and IR files by content.
+ *
+ *  A file is kept as <dir>/<sha256>/<its name>, so two presets that use
+ *  the same model share one copy whatever it was called where it came
+ *  from, and plugins that look at the extension still see it. Files come
+ *  in in pieces: <name>.part grows until it has them all, is checked
+ *  against its hash and only then renamed into place, so a sync that
+ *  broke off picks up where it stopped.
+ *
+ *  Hashing a 50 MB model is not free, so hashes of files anywhere on disk
+ *  are remembered by path, size and mtime in hashes.json. That also means
+ *  a model the other rack sends that we already have somewhere else on
+ *  disk is copied in rather than sent.
+ */
+
+class BlobStore {
+    typedef struct {
+        uint64_t size ;
+        int64_t mtime ;
+        std::string hash ;
+    } Hashed ;
+
+    std::string dir ;
+    // the only places a file is hashed or sent from, set before any sync
+    std::vector <std::filesystem::path> roots ;
+    std::recursive_mutex lock ;
+    std::unordered_map <std::string, Hashed> hashed ;
+
+    void loadHashes ();
+    void saveHashes ();
+    std::string folder (const std::string & hash);
+
+public:
+    BlobStore (std::string dir) ;
+
+    void share (const std::string & dir);
+    bool shareable (const std::string & path);
+
+    std::string hashOf (const std::string & path);
+    bool has (const std::string & hash);
+    std::string path (const std::string & hash);
+    std::string target (const std::string & hash, const std::string & name);
+    bool adopt (const std::string & hash, const std::string & name);
+    uint64_t partial (const std::string & hash, const std::string & name);
+    // -1 bad piece, 0 more to come, 1 complete and verified
+    int write (const std::string & hash, const std::string & name, uint64_t offset, const char * data, size_t size, uint64_t total);
+
+    static bool validHash (const std::string & hash);
+    static bool validName (const std::string & name);
+    static std::string sha256 (const char * data, size_t size);
+    static std::string sha256File (const std::string & path);
+} ;
+
+#endif
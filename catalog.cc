@@ -0,0 +1,292 @@
+#include "catalog.h"
+
+CatalogSet::CatalogSet (int n, bool full) {
+    bits.assign ((n + 63) / 64, full ? ~0ULL : 0);
+    // keep the tail of the last word clear so count () is exact
+    if (full && (n & 63))
+        bits.back () = (1ULL << (n & 63)) - 1 ;
+}
+
+void CatalogSet::set (int i, bool on) {
+    if (on)
+        bits [i >> 6] |= 1ULL << (i & 63);
+    else
+        bits [i >> 6] &= ~(1ULL << (i & 63));
+}
+
+CatalogSet & CatalogSet::operator &= (const CatalogSet & other) {
+    for (size_t i = 0 ; i < bits.size () ; i ++)
+        bits [i] &= i < other.bits.size () ? other.bits [i] : 0 ;
+    return *this ;
+}
+
+int CatalogSet::count () const {
+    int n = 0 ;
+    for (uint64_t w: bits)
+        n += __builtin_popcountll (w);
+    return n ;
+}
+
+static uint32_t trigram (const char * p) {
+    return ((uint32_t) (unsigned char) p [0] << 16) | ((uint32_t) (unsigned char) p [1] << 8) | (unsigned char) p [2] ;
+}
+
+std::string Catalog::stub (const std::string & uri) {
+    size_t x = uri.find ('#');
+    if (x == std::string::npos)
+        x = uri.find_last_of ('/');
+    if (x == std::string::npos)
+        return uri ;
+    return uri.substr (x + 1);
+}
+
+std::string Catalog::lower (const std::string & s) {
+    std::string l (s);
+    for (char & c: l)
+        c = tolower ((unsigned char) c);
+    return l ;
+}
+
+void Catalog::add (CatalogEntry entry) {
+    int pos = entries.size ();
+    // first one wins, same as the old linear scans
+    byName.emplace (entry.name, pos);
+    byLowerName.emplace (lower (entry.name), pos);
+    byUri.emplace (entry.uri, pos);
+    if (! entry.stub.empty ())
+        byStub.emplace (entry.stub, pos);
+    byId.emplace (entry.id, pos);
+    entries.push_back (std::move (entry));
+    index (pos);
+}
+
+// trigrams of the whole name, and 1 and 2 letter prefixes of every word
+// for queries too short to have a trigram
+void Catalog::index (int pos) {
+    lowerNames.push_back (lower (entries [pos].name));
+    const std::string & name = lowerNames.back ();
+
+    for (size_t i = 0 ; i + 3 <= name.size () ; i ++) {
+        std::vector <int> & list = trigrams [trigram (name.c_str () + i)];
+        if (list.empty () || list.back () != pos)
+            list.push_back (pos);
+    }
+
+    for (size_t i = 0 ; i < name.size () ; i ++) {
+        if (i > 0 && isalnum ((unsigned char) name [i - 1]))
+            continue ;
+        for (size_t len = 1 ; len <= 2 && i + len <= name.size () ; len ++) {
+            std::vector <int> & list = prefixes [name.substr (i, len)];
+            if (list.empty () || list.back () != pos)
+                list.push_back (pos);
+        }
+    }
+}
+
+void Catalog::build (json & lv2Json, json & ladspaJson, json & aliases) {
+    IN
+    entries.clear ();
+    byName.clear (); byLowerName.clear (); byUri.clear ();
+    byStub.clear (); byAlias.clear (); byId.clear ();
+    lowerNames.clear (); trigrams.clear (); prefixes.clear ();
+    entries.reserve (lv2Json.size () + ladspaJson.size ());
+
+    for (auto & plugin: lv2Json) {
+        CatalogEntry e ;
+        e.id = plugin.value ("id", 0);
+        e.index = plugin.value ("index", 0);
+        e.ladspa = false ;
+        e.name = plugin.value ("name", "");
+        e.uri = plugin.value ("uri", "");
+        e.library = plugin.value ("library", e.uri);
+        e.stub = stub (e.uri);
+        e.effectType = plugin.value ("effect_type", "Unknown");
+        e.author = plugin.value ("author", "Unknown");
+        e.bundle = plugin.value ("bundle", "");
+        e.hasFile = plugin.contains ("file");
+        e.fileType = plugin.value ("fileType", 0);
+        add (std::move (e));
+    }
+
+    for (auto & plugin: ladspaJson) {
+        CatalogEntry e ;
+        e.id = plugin.value ("id", 0);
+        e.index = plugin.value ("plugin", 0);
+        e.ladspa = true ;
+        e.name = plugin.value ("name", "");
+        e.library = plugin.value ("library", "");
+        e.uri = e.library ;
+        e.effectType = plugin.value ("effect_type", "Unknown");
+        e.author = plugin.value ("author", "Unknown");
+        e.hasFile = plugin.contains ("file") && plugin ["file"].is_boolean () && plugin ["file"].get <bool> ();
+        e.fileType = plugin.value ("fileType", 0);
+        add (std::move (e));
+    }
+
+    // aliases map an old name to a stub or uri of a plugin we have
+    for (auto & alias: aliases.items ()) {
+        if (! alias.value ().is_string ())
+            continue ;
+
+        std::string target = alias.value ().get <std::string> ();
+        auto u = byUri.find (target);
+        auto s = byStub.find (target);
+        if (u != byUri.end ())
+            byAlias.emplace (alias.key (), u->second);
+        else if (s != byStub.end ())
+            byAlias.emplace (alias.key (), s->second);
+    }
+
+    favourites = CatalogSet (entries.size ());
+    LOGD ("[catalog] %d plugins, %d aliases\n", (int) entries.size (), (int) byAlias.size ());
+    OUT
+}
+
+// category and creator sets, from the id lists the dropdowns are built from
+void Catalog::buildGroups (json & categoriesJson, json & creatorsJson) {
+    categories.clear ();
+    creators.clear ();
+    for (auto group: { std::make_pair (&categoriesJson, &categories), std::make_pair (&creatorsJson, &creators) }) {
+        for (auto & g: group.first->items ()) {
+            CatalogSet set (entries.size ());
+            for (auto & id: g.value ()) {
+                int pos = position (id.get <int> ());
+                if (pos != -1)
+                    set.set (pos);
+            }
+
+            group.second->emplace (g.key (), std::move (set));
+        }
+    }
+}
+
+const CatalogSet * Catalog::category (const std::string & name) const {
+    auto it = categories.find (name);
+    return it == categories.end () ? nullptr : & it->second ;
+}
+
+const CatalogSet * Catalog::creator (const std::string & name) const {
+    auto it = creators.find (name);
+    return it == creators.end () ? nullptr : & it->second ;
+}
+
+void Catalog::setFavourite (int pos, bool fav) {
+    if (pos >= 0 && pos < (int) entries.size ())
+        favourites.set (pos, fav);
+}
+
+// fav.json is keyed by plugin name
+void Catalog::loadFavourites (json & favs) {
+    favourites = CatalogSet (entries.size ());
+    for (auto & f: favs.items ()) {
+        auto it = byName.find (f.key ());
+        if (it != byName.end ())
+            favourites.set (it->second);
+    }
+}
+
+json Catalog::favouritesJson () const {
+    json favs = json::object ();
+    for (int i = 0 ; i < (int) entries.size () ; i ++)
+        if (favourites.test (i))
+            favs [entries [i].name] = true ;
+    return favs ;
+}
+
+/*  Positions of the entries in within that match query, best first.
+ *
+ *  exact name, name prefix, word prefix and substring matches rank in that
+ *  order. Names that only share at least half of the query's trigrams
+ *  still match (a single typo breaks at most three), ranked below those
+ *  by how many trigrams they share.
+ */
+std::vector <int> Catalog::search (const std::string & query, const CatalogSet & within) const {
+    std::vector <int> result ;
+    std::string q = lower (query);
+    q.erase (0, q.find_first_not_of (' '));
+    q.erase (q.find_last_not_of (' ') + 1);
+
+    if (q.empty ()) {
+        for (int i = 0 ; i < (int) entries.size () ; i ++)
+            if (within.test (i))
+                result.push_back (i);
+        return result ;
+    }
+
+    // (rank, -shared trigrams, position)
+    std::vector <std::tuple <int, int, int>> hits ;
+    auto rank = [&] (int pos) {
+        const std::string & name = lowerNames [pos] ;
+        if (name == q)
+            return 0 ;
+        size_t at = name.find (q);
+        if (at == 0)
+            return 1 ;
+        if (at != std::string::npos)
+            return isalnum ((unsigned char) name [at - 1]) ? 3 : 2 ;
+        return 4 ;
+    };
+
+    if (q.size () < 3) {
+        auto it = prefixes.find (q);
+        if (it != prefixes.end ())
+            for (int pos: it->second)
+                if (within.test (pos))
+                    hits.emplace_back (rank (pos), 0, pos);
+    } else {
+        std::vector <uint16_t> shared (entries.size ());
+        int ntris = 0 ;
+        for (size_t i = 0 ; i + 3 <= q.size () ; i ++, ntris ++) {
+            auto it = trigrams.find (trigram (q.c_str () + i));
+            if (it == trigrams.end ())
+                continue ;
+            for (int pos: it->second)
+                shared [pos] ++ ;
+        }
+
+        int needed = (ntris + 1) / 2 ;
+        for (int pos = 0 ; pos < (int) entries.size () ; pos ++) {
+            if (shared [pos] == 0 || ! within.test (pos))
+                continue ;
+            int r = rank (pos);
+            if (r < 4 || shared [pos] >= needed)
+                hits.emplace_back (r, - shared [pos], pos);
+        }
+    }
+
+    std::sort (hits.begin (), hits.end ());
+    result.reserve (hits.size ());
+    for (auto & h: hits)
+        result.push_back (std::get <2> (h));
+    return result ;
+}
+
+const CatalogEntry * Catalog::find (const char * key) const {
+    if (key == nullptr)
+        return nullptr ;
+
+    std::string k (key);
+    for (auto map: { &byName, &byUri, &byAlias, &byStub }) {
+        auto it = map->find (k);
+        if (it != map->end ())
+            return & entries [it->second] ;
+    }
+
+    auto it = byLowerName.find (lower (k));
+    if (it != byLowerName.end ())
+        return & entries [it->second] ;
+
+    return nullptr ;
+}
+
+int Catalog::position (int id) const {
+    auto it = byId.find (id);
+    return it == byId.end () ? -1 : it->second ;
+}
+
+const CatalogEntry * Catalog::findById (int id) const {
+    auto it = byId.find (id);
+    if (it == byId.end ())
+        return nullptr ;
+    return & entries [it->second] ;
+}
@@ -0,0 +1,83 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+
+#include "json.hpp"
+#include "log.h"
+
+using json = nlohmann::json;
+
+/*  In-memory index of every plugin we know about, built once from
+ *  lv2_plugins.json (and the ladspa list, if any). Lookups by display
+ *  name, uri, uri stub (the part after # or the last /) and legacy
+ *  aliases are all single hash lookups.
+ */
+
+typedef struct {
+    int id ;
+    int index ;             // plugin index inside library
+    bool ladspa ;
+    bool hasFile ;
+    int fileType ;
+    std::string name, uri, stub, library, effectType, author, bundle ;
+} CatalogEntry ;
+
+// one bit per catalog entry
+class CatalogSet {
+public:
+    std::vector <uint64_t> bits ;
+
+    CatalogSet (int n = 0, bool full = false) ;
+    void set (int i, bool on = true) ;
+    bool test (int i) const {
+        return (bits [i >> 6] >> (i & 63)) & 1 ;
+    }
+
+    CatalogSet & operator &= (const CatalogSet & other) ;
+    int count () const ;
+} ;
+
+class Catalog {
+    std::unordered_map <std::string, int> byName, byLowerName, byUri, byStub, byAlias ;
+    std::unordered_map <int, int> byId ;
+
+    // search index over lowercased names
+    std::vector <std::string> lowerNames ;
+    std::unordered_map <uint32_t, std::vector <int>> trigrams ;
+    std::unordered_map <std::string, std::vector <int>> prefixes ;
+
+    void add (CatalogEntry entry) ;
+    void index (int pos) ;
+
+public:
+    std::vector <CatalogEntry> entries ;
+    std::unordered_map <std::string, CatalogSet> categories, creators ;
+    CatalogSet favourites ;
+
+    void build (json & lv2Json, json & ladspaJson, json & aliases) ;
+    void buildGroups (json & categoriesJson, json & creatorsJson) ;
+    // exact name, uri, alias or uri stub, then the name in any case
+    const CatalogEntry * find (const char * key) const ;
+    const CatalogEntry * findById (int id) const ;
+    int position (int id) const ;
+    int size () const { return entries.size (); }
+
+    CatalogSet all () const { return CatalogSet (entries.size (), true); }
+    const CatalogSet * category (const std::string & name) const ;
+    const CatalogSet * creator (const std::string & name) const ;
+    void setFavourite (int pos, bool fav) ;
+    void loadFavourites (json & favs) ;
+    json favouritesJson () const ;
+    std::vector <int> search (const std::string & query, const CatalogSet & within) const ;
+
+    static std::string stub (const std::string & uri) ;
+    static std::string lower (const std::string & s) ;
+} ;
+
+#endif
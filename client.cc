@@ -18,7 +18,7 @@ void Client::run() {
     echo();
 }
 
-void
+bool
 Client::create() {
     IN
     struct sockaddr_in server_addr;
@@ -28,7 +28,7 @@ Client::create() {
     hostEntry = gethostbyname(host_.c_str());
     if (!hostEntry) {
         LOGD ("No such host name: %s" , host_.c_str ());
-        return ;
+        return false;
     }
 
     LOGD ("[client] connect to %s:%d\n", host_.c_str (), port_);
@@ -46,12 +46,19 @@ Client::create() {
         exit(-1);
     }
 
+    // a peer that goes away mid sync must not hang us for good; the send
+    // timeout bounds connect too
+    struct timeval tv = { SYNC_TIMEOUT, 0 };
+    setsockopt(server_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(server_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
     // connect to server
     if (connect(server_,(const struct sockaddr *)&server_addr,sizeof(server_addr)) < 0) {
-        HERE LOGD ("cannot connect to server\n");
-        perror("connect");
-        exit(-1);
+        HERE LOGD ("cannot connect to server: %s\n", strerror (errno));
+        return false;
     }
+
+    return true;
 }
 
 void
@@ -61,6 +68,12 @@ Client::close_socket() {
     OUT
 }
 
+void
+Client::cancel() {
+    if (server_ >= 0)
+        shutdown(server_, SHUT_RDWR);
+}
+
 void
 Client::echo() {
     string line;
@@ -85,51 +98,31 @@ Client::echo() {
     close_socket();
 }
 
-std::string
-Client::send_preset(json j) {
-    IN
-    // loop to handle user interface
-    string toSend = j.dump () ;
-    if (j.empty ())
-        toSend = string ("{}");
-        
-    bool success = send_request(toSend);
-    if (not success) {
-        printf ("[86] break if an error occurred\n");
-    }
-    // get a response
-    string response = "";
-    // read until we get a newline
-    while (response.find("}}}") == string::npos) {
-        int nread = recv(server_,buf_,1024,0);
-        if (nread < 0) {
-            if (errno == EINTR) {
-                printf ("the socket call was interrupted -- try again\n");
-                continue;
-            }
-            else {
-                HERE LOGD ("an error occurred: %s\n", strerror (errno));
-                return std::string ("");
-            }
-        } else if (nread == 0) {
-            printf ("the socket is closed\n");
-            return std::string ("");
-        }
-        // be sure to use append in case we have binary data
-        response.append(buf_,nread);
-        if (response.c_str ()[1] == '}')
-            return std::string ("");
-    }
-    
-    // a better client would cut off anything after the newline and
-    // save it in a cache
-    if (not success) {
-        HERE LOGD ("[92] break if an error occurred\n");
-    }
+// SyncIO over a blocking socket, for both ends of a sync
+long sync_write (char * data, size_t size, void * fd) {
+    long n ;
+    do {
+        n = send (* (int *) fd, data, size, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n ;
+}
 
-    //~ close_socket();
+long sync_read (char * data, size_t size, void * fd) {
+    long n ;
+    do {
+        n = recv (* (int *) fd, data, size, 0);
+    } while (n < 0 && errno == EINTR);
+    return n ;
+}
+
+bool
+Client::sync(SyncSession * session) {
+    IN
+    // we connected, so we go first
+    session -> start ();
+    bool ok = session -> run (sync_write, sync_read, & server_);
     OUT
-    return response ;
+    return ok ;
 }
 
 bool
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 #include <fstream>
@@ -15,20 +16,26 @@
 
 
 #include "presets.h"
+#include "syncproto.h"
 #include "json.hpp"
 
 using namespace std;
 using json = nlohmann::json;
 
+long sync_write (char * data, size_t size, void * fd) ;
+long sync_read (char * data, size_t size, void * fd) ;
+
 class Client {
 public:
     Client(string host, int port);
     ~Client();
 
     void run();
-    std::string send_preset(json j) ;
-    virtual void create();
+    bool sync(SyncSession * session) ;
+    virtual bool create();
     virtual void close_socket();
+    // from another thread, unblocks whatever the sync is waiting on
+    void cancel();
     void echo();
     bool get_response();
     
@@ -37,7 +44,7 @@ private:
     
     string host_;
     int port_;
-    int server_;
+    int server_ = -1;
     int buflen_;
     char* buf_;
 };
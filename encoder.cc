@@ -0,0 +1,576 @@
+#include "encoder.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <semaphore.h>
+#include "LockFreeQueue.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include "sndfile.h"
+#include "opusenc.h"
+#endif
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+#include "lame.h"
+
+static const char * extensions [FILE_TYPES] = {
+        ".wav",
+        ".ogg",
+        ".mp3",
+        ".flac"
+} ;
+
+static const char * names [FILE_TYPES] = {
+        "wav",
+        "opus",
+        "mp3",
+        "flac"
+} ;
+
+const char * Encoder::extension (FileType type) {
+    return extensions [type] ;
+}
+
+int Encoder::parse (const std::string & name) {
+    for (int i = 0 ; i < FILE_TYPES ; i ++)
+        if (name == names [i])
+            return i ;
+    return -1 ;
+}
+
+static uint32_t xorshift (uint32_t * s) {
+    uint32_t x = * s ;
+    x ^= x << 13 ;
+    x ^= x >> 17 ;
+    x ^= x << 5 ;
+    return * s = x ;
+}
+
+/*  Two uniform values of half a step each make triangular dither of one
+ *  step either way, which keeps the quantization error from following
+ *  the signal on quiet tails. Four lanes of xorshift so the SSE2 path
+ *  does four samples at a time; the plain loop runs the same lanes for
+ *  whatever is left, or for everything without SSE2.
+ */
+void float_to_s16 (const float * in, short * out, int samples, uint32_t seed [4]) {
+    const float half = 1.0f / 4294967296.0f ;
+    int i = 0 ;
+
+#ifdef __SSE2__
+    __m128i s = _mm_loadu_si128 ((const __m128i *) seed);
+    const __m128 scale = _mm_set1_ps (32767.0f);
+    const __m128 lsb = _mm_set1_ps (half);
+    const __m128 lo = _mm_set1_ps (-32768.0f), hi = _mm_set1_ps (32767.0f);
+
+    for ( ; i + 8 <= samples ; i += 8) {
+        __m128 v [2] ;
+        for (int k = 0 ; k < 2 ; k ++) {
+            __m128 d = _mm_setzero_ps ();
+            for (int r = 0 ; r < 2 ; r ++) {
+                s = _mm_xor_si128 (s, _mm_slli_epi32 (s, 13));
+                s = _mm_xor_si128 (s, _mm_srli_epi32 (s, 17));
+                s = _mm_xor_si128 (s, _mm_slli_epi32 (s, 5));
+                d = _mm_add_ps (d, _mm_mul_ps (_mm_cvtepi32_ps (s), lsb));
+            }
+
+            __m128 x = _mm_add_ps (_mm_mul_ps (_mm_loadu_ps (in + i + k * 4), scale), d);
+            v [k] = _mm_min_ps (_mm_max_ps (x, lo), hi);
+        }
+
+        __m128i packed = _mm_packs_epi32 (_mm_cvtps_epi32 (v [0]), _mm_cvtps_epi32 (v [1]));
+        _mm_storeu_si128 ((__m128i *) (out + i), packed);
+    }
+
+    _mm_storeu_si128 ((__m128i *) seed, s);
+#endif
+
+    for ( ; i < samples ; i ++) {
+        uint32_t * lane = & seed [i & 3] ;
+        float d = (float) (int32_t) xorshift (lane) * half + (float) (int32_t) xorshift (lane) * half ;
+        float x = in [i] * 32767.0f + d ;
+        if (x < -32768.0f)
+            x = -32768.0f ;
+        else if (x > 32767.0f)
+            x = 32767.0f ;
+        out [i] = (short) lrintf (x);
+    }
+}
+
+// bytes a WAV is written in; the header is brought up to date after each
+#define WAV_CHUNK (1 << 18)
+// chunks between the tap and the writer, a few seconds of a stereo take
+#define WAV_CHUNKS 16
+// disk reserved ahead of the data at a time
+#define WAV_PREALLOCATE (64 << 20)
+// seconds of audio between making sure it is on the disk
+#define WAV_SYNC_SECONDS 10
+
+static void put (std::string & s, uint64_t v, int bytes) {
+    for (int i = 0 ; i < bytes ; i ++)
+        s.push_back ((char) (v >> (i * 8)));
+}
+
+typedef struct {
+    std::vector <char> data ;
+    size_t filled ;
+} WavChunk ;
+
+/*  WAV of the float samples we have, without libsndfile, so it is there
+ *  on every platform.
+ *
+ *  The tap thread hands over a period at a time; those are gathered into
+ *  WAV_CHUNK sized chunks and passed to a writer thread of the encoder's
+ *  own, which does every write, reservation and sync, so a disk that
+ *  stalls holds up the writer and not the tap. Only with all WAV_CHUNKS
+ *  queued does the tap wait for it. The sizes in the header are
+ *  rewritten after every chunk: a take cut short by a crash opens with
+ *  everything up to the last chunk in it.
+ *
+ *  The header starts with a JUNK chunk the size of a ds64 one, which it
+ *  becomes if the take goes past 4 GB, and RIFF turns to RF64 (EBU 3306).
+ */
+class WavEncoder: public Encoder {
+    FILE * file = nullptr ;
+    WavChunk chunks [WAV_CHUNKS] ;
+    // the one the tap is filling
+    WavChunk * current = nullptr ;
+    // tap to writer, and back empty
+    LockFreeQueue <WavChunk *, WAV_CHUNKS> full, spare ;
+    sem_t ready, freed ;
+    std::thread writer ;
+    std::atomic <bool> failed { false };
+
+    // the writer's alone: where the samples start, and how many bytes of
+    // them are on the disk
+    uint64_t dataStart = 0, onDisk = 0 ;
+    uint64_t allocated = 0, synced = 0 ;
+    long factAt = 0 ;
+    bool rf64 = false ;
+
+    void at (uint64_t offset, const std::string & bytes) {
+        fseek64 (file, offset, SEEK_SET);
+        fwrite (bytes.data (), 1, bytes.size (), file);
+    }
+
+    // the sizes as they are on the disk now
+    bool header () {
+        uint64_t riff = dataStart + onDisk - 8 ;
+        uint64_t samples = onDisk / (channels * sizeof (float));
+        if (! rf64 && riff > 0xFFFFFFFF) {
+            rf64 = true ;
+            at (0, "RF64");
+            at (12, "ds64");
+        }
+
+        std::string s ;
+        if (rf64) {
+            put (s, riff, 8);
+            put (s, onDisk, 8);
+            put (s, samples, 8);
+            at (20, s);
+            // the 32 bit fields say to look in ds64
+            riff = samples = 0xFFFFFFFF ;
+        }
+
+        s.clear ();
+        put (s, riff, 4);
+        at (4, s);
+        s.clear ();
+        put (s, samples, 4);
+        at (factAt, s);
+        s.clear ();
+        put (s, rf64 ? 0xFFFFFFFF : onDisk, 4);
+        at (dataStart - 4, s);
+        return fseek64 (file, 0, SEEK_END) == 0 && fflush (file) == 0 ;
+    }
+
+    // on the writer
+    bool flush (WavChunk * c) {
+        if (c -> filled == 0)
+            return true ;
+
+#ifdef __linux__
+        int fd = fileno (file);
+        if (dataStart + onDisk + c -> filled > allocated) {
+            // keeps the size, so a crash does not leave a tail of zeros
+            if (fallocate (fd, FALLOC_FL_KEEP_SIZE, allocated, WAV_PREALLOCATE) == 0)
+                allocated += WAV_PREALLOCATE ;
+            else
+                allocated = UINT64_MAX ;    // not on this filesystem
+        }
+#endif
+
+        if (fwrite (c -> data.data (), 1, c -> filled, file) != c -> filled)
+            return false ;
+#ifdef __linux__
+        // start writeback now instead of in one burst the disk stalls on
+        sync_file_range (fd, dataStart + onDisk, c -> filled, SYNC_FILE_RANGE_WRITE);
+#endif
+        onDisk += c -> filled ;
+        if (! header ())
+            return false ;
+
+#ifdef __linux__
+        uint64_t done = onDisk / (channels * sizeof (float));
+        if (done - synced >= (uint64_t) sampleRate * WAV_SYNC_SECONDS) {
+            fdatasync (fd);
+            synced = done ;
+        }
+#endif
+        return true ;
+    }
+
+    void work () {
+        WavChunk * c ;
+        while (true) {
+            sem_wait (& ready);
+            // posted with nothing queued: close () has handed over the last
+            if (! full.pop (c))
+                break ;
+            if (! failed && ! flush (c))
+                failed = true ;
+            c -> filled = 0 ;
+            spare.push (c);
+            sem_post (& freed);
+        }
+
+#ifdef __linux__
+        // give back what was reserved past the end
+        if (allocated != UINT64_MAX && allocated > dataStart + onDisk && ftruncate (fileno (file), dataStart + onDisk) != 0)
+            LOGW ("[encoder] %s keeps the space reserved for it\n", filename.c_str ());
+        fdatasync (fileno (file));
+#endif
+    }
+
+public:
+    ~WavEncoder () {
+        close ();
+    }
+
+    bool open () {
+        file = fopen (filename.c_str (), "wb+");
+        if (file == nullptr) {
+            LOGE ("[encoder] cannot open %s\n", filename.c_str ());
+            return false ;
+        }
+
+        // the chunks are our buffering
+        setvbuf (file, NULL, _IONBF, 0);
+        onDisk = synced = 0 ;
+        allocated = 0 ;
+        rf64 = false ;
+        failed = false ;
+
+        // more than two channels wants WAVE_FORMAT_EXTENSIBLE
+        bool extensible = channels > 2 ;
+        std::string s = "RIFF" ;
+        put (s, 0, 4);
+        s.append ("WAVE");
+        s.append ("JUNK");
+        put (s, 28, 4);
+        s.append (28, '\0');
+
+        s.append ("fmt ");
+        put (s, extensible ? 40 : 16, 4);
+        put (s, extensible ? 0xFFFE : 3, 2);
+        put (s, channels, 2);
+        put (s, sampleRate, 4);
+        put (s, sampleRate * channels * sizeof (float), 4);
+        put (s, channels * sizeof (float), 2);
+        put (s, 32, 2);
+        if (extensible) {
+            put (s, 22, 2);
+            put (s, 32, 2);
+            put (s, 0, 4);
+            // KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+            put (s, 3, 4);
+            put (s, 0x00100000, 4);
+            put (s, 0xaa000080, 4);
+            put (s, 0x719b3800, 4);
+        }
+
+        s.append ("fact");
+        put (s, 4, 4);
+        factAt = s.size ();
+        put (s, 0, 4);
+
+        if (! comment.empty ()) {
+            std::string text = comment ;
+            text.push_back ('\0');
+            if (text.size () & 1)
+                text.push_back ('\0');
+            s.append ("LIST");
+            put (s, 4 + 8 + text.size (), 4);
+            s.append ("INFO");
+            s.append ("ICMT");
+            put (s, text.size (), 4);
+            s.append (text);
+        }
+
+        s.append ("data");
+        put (s, 0, 4);
+        dataStart = s.size ();
+
+        if (fwrite (s.data (), 1, s.size (), file) != s.size () || fflush (file) != 0) {
+            LOGE ("[encoder] cannot write to %s\n", filename.c_str ());
+            fclose (file);
+            file = nullptr ;
+            return false ;
+        }
+
+        // one to fill, the rest spare
+        for (WavChunk & c: chunks) {
+            c.data.resize (WAV_CHUNK);
+            c.filled = 0 ;
+        }
+        current = chunks ;
+        for (int i = 1 ; i < WAV_CHUNKS ; i ++)
+            spare.push (chunks + i);
+        sem_init (& ready, 0, 0);
+        sem_init (& freed, 0, WAV_CHUNKS - 1);
+        writer = std::thread (& WavEncoder::work, this);
+        return true ;
+    }
+
+    bool write (const float * data, int n) {
+        const char * in = (const char *) data ;
+        size_t bytes = n * channels * sizeof (float);
+        while (bytes) {
+            size_t room = WAV_CHUNK - current -> filled ;
+            size_t take = bytes < room ? bytes : room ;
+            memcpy (current -> data.data () + current -> filled, in, take);
+            current -> filled += take ;
+            in += take ;
+            bytes -= take ;
+            if (current -> filled < WAV_CHUNK)
+                continue ;
+
+            full.push (current);
+            sem_post (& ready);
+            // the writer is the whole queue behind, wait for it rather
+            // than drop what we have
+            sem_wait (& freed);
+            spare.pop (current);
+        }
+
+        return ! failed ;
+    }
+
+    void close () {
+        if (file == nullptr)
+            return ;
+
+        // the last chunk, then an empty post to say that was it
+        full.push (current);
+        sem_post (& ready);
+        sem_post (& ready);
+        writer.join ();
+        if (failed)
+            LOGE ("[encoder] cannot write the end of %s\n", filename.c_str ());
+
+        sem_destroy (& ready);
+        sem_destroy (& freed);
+        fclose (file);
+        file = nullptr ;
+    }
+} ;
+
+#ifdef __linux__
+// FLAC at 16 bit with dither
+class SndEncoder: public Encoder {
+    SNDFILE * file = nullptr ;
+    std::vector <short> pcm ;
+    uint32_t seed [4] = { 0x9e3779b9, 0x7f4a7c15, 0x94d049bb, 0xbf58476d } ;
+
+public:
+    bool open () {
+        SF_INFO info ;
+        memset (& info, 0, sizeof (info));
+        info.channels = channels ;
+        info.samplerate = sampleRate ;
+        info.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_16 ;
+        if (! sf_format_check (& info)) {
+            LOGE ("[encoder] libsndfile cannot write %s\n", extension (type));
+            return false ;
+        }
+
+        file = sf_open (filename.c_str (), SFM_WRITE, & info);
+        if (file == nullptr) {
+            LOGE ("[encoder] cannot open %s: %s\n", filename.c_str (), sf_strerror (NULL));
+            return false ;
+        }
+
+        if (! comment.empty () && sf_set_string (file, SF_STR_COMMENT, comment.c_str ()) != 0)
+            LOGW ("[encoder] %s: no room for the comment\n", filename.c_str ());
+        return true ;
+    }
+
+    bool write (const float * data, int n) {
+        pcm.resize (n * channels);
+        float_to_s16 (data, pcm.data (), n * channels, seed);
+        return sf_writef_short (file, pcm.data (), n) == n ;
+    }
+
+    void close () {
+        if (file)
+            sf_close (file);
+        file = nullptr ;
+    }
+} ;
+
+class OpusFileEncoder: public Encoder {
+    OggOpusEnc * enc = nullptr ;
+    OggOpusComments * comments = nullptr ;
+
+public:
+    int bitRate = 64000 ;
+
+    bool open () {
+        int error = 0 ;
+        comments = ope_comments_create ();
+        ope_comments_add (comments, "TITLE", "AmpRack Demo");
+        enc = ope_encoder_create_file (filename.c_str (), comments, sampleRate, channels, 0, & error);
+        if (enc == nullptr) {
+            LOGE ("[encoder] cannot create opus encoder: %s\n", ope_strerror (error));
+            ope_comments_destroy (comments);
+            comments = nullptr ;
+            return false ;
+        }
+
+        ope_encoder_ctl (enc, OPUS_SET_BITRATE (bitRate));
+        return true ;
+    }
+
+    bool write (const float * data, int n) {
+        return ope_encoder_write_float (enc, data, n) == OPE_OK ;
+    }
+
+    void close () {
+        if (enc) {
+            ope_encoder_drain (enc);
+            ope_encoder_destroy (enc);
+            ope_comments_destroy (comments);
+        }
+
+        enc = nullptr ;
+        comments = nullptr ;
+    }
+} ;
+#endif
+
+class Mp3Encoder: public Encoder {
+    lame_t lame = nullptr ;
+    FILE * file = nullptr ;
+    std::vector <unsigned char> mp3 ;
+
+public:
+    int preset = MEDIUM ;
+
+    bool open () {
+        lame = lame_init ();
+        lame_set_in_samplerate (lame, sampleRate);
+        lame_set_out_samplerate (lame, sampleRate);
+        lame_set_num_channels (lame, channels);
+        lame_set_VBR (lame, vbr_default);
+        lame_set_preset (lame, preset);
+        if (lame_init_params (lame) < 0) {
+            LOGE ("[encoder] unable to initialize lame parameters\n");
+            lame_close (lame);
+            lame = nullptr ;
+            return false ;
+        }
+
+        // read too: lame_mp3_tags_fid goes back for the first frame
+        file = fopen (filename.c_str (), "wb+");
+        if (file == nullptr) {
+            LOGE ("[encoder] cannot open %s\n", filename.c_str ());
+            lame_close (lame);
+            lame = nullptr ;
+            return false ;
+        }
+
+        return true ;
+    }
+
+    bool write (const float * data, int n) {
+        // worst case, from lame.h
+        mp3.resize (n * 5 / 4 + 7200);
+        int bytes ;
+        if (channels == 2)
+            bytes = lame_encode_buffer_interleaved_ieee_float (lame, data, n, mp3.data (), mp3.size ());
+        else
+            bytes = lame_encode_buffer_ieee_float (lame, data, NULL, n, mp3.data (), mp3.size ());
+
+        if (bytes < 0) {
+            LOGE ("[encoder] unable to encode mp3 stream: %d\n", bytes);
+            return false ;
+        }
+
+        return fwrite (mp3.data (), 1, bytes, file) == (size_t) bytes ;
+    }
+
+    void close () {
+        if (lame && file) {
+            mp3.resize (7200);
+            int bytes = lame_encode_flush (lame, mp3.data (), mp3.size ());
+            if (bytes > 0)
+                fwrite (mp3.data (), 1, bytes, file);
+            // so players know the length of a VBR file
+            lame_mp3_tags_fid (lame, file);
+        }
+
+        if (file)
+            fclose (file);
+        if (lame)
+            lame_close (lame);
+        file = nullptr ;
+        lame = nullptr ;
+    }
+} ;
+
+Encoder * Encoder::create (FileType type, int bitRate, int lamePreset) {
+    Encoder * e = nullptr ;
+    switch (type) {
+        case MP3: {
+            Mp3Encoder * m = new Mp3Encoder ();
+            m->preset = lamePreset ;
+            e = m ;
+            break ;
+        }
+        case WAV:
+            e = new WavEncoder ();
+            break ;
+#ifdef __linux__
+        case FLAC:
+            e = new SndEncoder ();
+            break ;
+        case OPUS: {
+            OpusFileEncoder * o = new OpusFileEncoder ();
+            o->bitRate = bitRate ;
+            e = o ;
+            break ;
+        }
+#endif
+        default:
+            LOGW ("[encoder] %s is not available in this build\n", extensions [type]);
+            return nullptr ;
+    }
+
+    e->type = type ;
+    return e ;
+}
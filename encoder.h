@@ -0,0 +1,50 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <cstdint>
+#include <string>
+#include "logging_macros.h"
+
+typedef enum  {
+    WAV = 0,
+    OPUS = 1,
+    MP3 = 2,
+    FLAC = 3
+} FileType;
+
+#define FILE_TYPES 4
+
+// float samples to 16 bit with triangular dither, seed is four lanes of state
+void float_to_s16 (const float * in, short * out, int samples, uint32_t seed [4]);
+
+/*  One output file of a recording.
+ *
+ *  Each format is its own object with its own state, so a take can be
+ *  written as a WAV master and an MP3 to share at the same time, and two
+ *  takes can run side by side. write () is only ever called from the one
+ *  tap thread that feeds it (see FileWriter), never from the audio thread.
+ */
+class Encoder {
+public:
+    FileType type ;
+    std::string filename ;
+    int sampleRate = 48000 ;
+    int channels = 1 ;
+    uint64_t frames = 0 ;
+    // stored in the file where the format has room for it
+    std::string comment ;
+
+    virtual ~Encoder () {}
+    virtual bool open () = 0 ;
+    // interleaved frames
+    virtual bool write (const float * data, int frames) = 0 ;
+    virtual void close () = 0 ;
+
+    // nullptr when this build cannot write that format
+    static Encoder * create (FileType type, int bitRate, int lamePreset);
+    static const char * extension (FileType type);
+    // "wav", "flac" ... as in the config, -1 if unknown
+    static int parse (const std::string & name);
+} ;
+
+#endif
@@ -2,19 +2,53 @@
 
 std::vector <Plugin *> *Engine::activePlugins = nullptr;
 
+// how many silent periods to run through a new instance of uri
+// before it goes live. per plugin entries override the default
+int Engine::warmupPeriods (const char * uri) {
+    if (warmup.contains ("plugins") && warmup ["plugins"].contains (uri))
+        return warmup ["plugins"][uri].get <int> ();
+    if (warmup.contains ("default"))
+        return warmup ["default"].get <int> ();
+    return 0 ;
+}
+
+// make sure the bundle a plugin lives in is loaded into the world
+bool Engine::loadPluginBundle (const char * uri) {
+    auto bundle = pluginBundles.find (uri);
+    if (bundle != pluginBundles.end ())
+        return lily_load_bundle (world, bundle->second);
+
+    // not something we have scanned, fall back to loading everything once
+    if (! loadedAll) {
+        LOGD ("[engine] %s not in plugin cache, loading all bundles\n", uri);
+        lilv_world_load_all (world);
+        loadedAll = true ;
+    }
+
+    return true ;
+}
+
 bool Engine::addPlugin(char* uri, int pluginIndex) {
     IN
-    processor->bypass = true ;
-
+    loadPluginBundle (uri);
     Plugin *plugin = new Plugin(uri, sampleRate, world, lilv_plugins);
-    if (plugin->uri != nullptr) {
-        activePlugins ->push_back(plugin);
-    } else {
+    if (plugin->uri == nullptr) {
         LOGE ("cannot load %s!\n", uri);
-        processor->bypass = false ;
         return false ;
     }
 
+    // warm up on this thread, the audio thread only ever sees the
+    // plugin after it has settled
+    int periods = warmupPeriods (uri);
+    if (periods > 0) {
+        int nframes = warmup.value ("nframes", 0);
+        if (nframes < 1)
+            nframes = driver -> get_buffer_size ();
+        plugin -> warmup (periods, nframes);
+    }
+
+    processor->bypass = true ;
+    activePlugins ->push_back(plugin);
     buildPluginChain();
     processor->bypass = false ;
     OUT
@@ -72,8 +106,9 @@ bool Engine::openAudio () {
 
 Engine::Engine () {
     IN
+    // bundles are scanned below and only loaded when a plugin from
+    // them is first added, see lily_scan and loadPluginBundle
     world = lilv_world_new ();
-    lilv_world_load_all(world);
     lilv_plugins = lilv_world_get_all_plugins(world);
     activePlugins = new std::vector <Plugin *> ();
 
@@ -95,6 +130,8 @@ Engine::Engine () {
     # endif
 
     g_mkdir_with_parents  (home.c_str (), 0777);
+    g_mkdir_with_parents  (config.c_str (), 0777);
+    Plugin::portCache = new PortCache (world, config + "/portcache.bin");
     
     LOGD ("home dir: %s", home.c_str ());
 
@@ -146,25 +183,47 @@ Engine::Engine () {
     ladspaPlugins  = new std::vector <std::string> ();
     lv2Plugins = new std::vector <std::string> ();
 
-    if (! std::filesystem::exists (config + "/lv2_plugins.json")) {
-        wtf ("lv2 plugins.json not found, creating...\n");
-       generateLV2Info (config);
-    }
+    Plugin::portCache->rescan ();
+    if (lily_scan (world, config))
+        wtf ("lv2 plugins.json updated\n");
 
     amps = json {};
     lv2Json = filename_to_json (config + "/lv2_plugins.json");
+    for (auto & plugin: lv2Json)
+        if (plugin.contains ("bundle"))
+            pluginBundles [plugin ["uri"].get <std::string> ()] = plugin ["bundle"].get <std::string> ();
     // LOGD ("found %d lv2 plugins\n", lv2Json.size ());
     ladspaJson = json {};
     categories = filename_to_json (config + "/lv2_categories.json");
     creators = filename_to_json (config + "/lv2_creators.json");
     knobs = filename_to_json (std::string (assetPath).append ("/knobs.json"));
 
+    // legacy plugin names from old presets, name -> uri or stub
+    lv2Map = json {};
+    if (std::filesystem::exists (config + "/lv2_aliases.json"))
+        lv2Map = filename_to_json (config + "/lv2_aliases.json");
+    catalog.build (lv2Json, ladspaJson, lv2Map);
+    catalog.buildGroups (categories, creators);
+
+    warmup = filename_to_json (std::string (assetPath).append ("/warmup.json"));
+    if (std::filesystem::exists (config + "/warmup.json"))
+        warmup.merge_patch (filename_to_json (config + "/warmup.json"));
+
     //~ initLilv ();
     queueManager = new LockFreeQueueManager ();
     queueManager->init (driver -> get_buffer_size ());
-    fileWriter = new FileWriter ();
-    queueManager->add_function (fileWriter->disk_write);
-    queueManager->add_function (check_notify);
+    // plugin outputs for re-amping, copied by the audio thread while recording
+    processor->slotSize = driver -> get_buffer_size ();
+    for (int i = 0 ; i < MAX_SLOT_TAPS ; i ++)
+        processor->slotData [i] = (float *) calloc (processor->slotSize, sizeof (float));
+    // the writer taps the queue itself, a thread per format
+    fileWriter = new FileWriter (queueManager);
+    // off until the config asks for it, see Rack
+    retro = new RetroBuffer (queueManager);
+    retro->sampleRate = driver->get_sample_rate ();
+    peaks = new PeakScanner ();
+    assets = new AssetLoader ();
+    queueManager->tap (check_notify, TAP_NEWEST);
     processor->lockFreeQueueManager = queueManager ;
     HERE LOGD ("processor status %d\n", processor->bypass);
     //~ processor -> bypass = false ;
@@ -206,42 +265,41 @@ void Engine::buildPluginChain () {
         processor->activePlugins ++ ;
     }
 
+    // slot taps follow their plugins around the chain
+    if (processor->recording)
+        tapSlots ();
     OUT
 }
 
 bool Engine::addPluginByName (char * pluginName) {
-    std::string stub = "";
-    if (lv2Map .contains (pluginName)) {
-        stub = lv2Map [pluginName].dump();
-    } 
+    const CatalogEntry * entry = catalog.find (pluginName);
+    if (entry == nullptr) {
+        LOGD ("[engine] no plugin named %s\n", pluginName);
+        return false ;
+    }
 
-# ifdef __linux__
-    LILV_FOREACH (plugins, i, plugins) {
-        const LilvPlugin* p = (LilvPlugin* )lilv_plugins_get(plugins, i);
-        const char * name = lilv_node_as_string (lilv_plugin_get_name (p));
-        const char * uri = lilv_node_as_string (lilv_plugin_get_uri (p));
-        
-        if (strcmp (pluginName, name) == 0) {
-            printf("[LV2] %s\n", name);        
-            return addPlugin ((char *)uri, 0);
-        }
+    if (entry->name != pluginName)
+        LOGD ("found mapped plugin %s -> %s\n", pluginName, entry->uri.c_str ());
+    return addPlugin (entry);
+}
 
-        std::string s (uri);
-        int x = s.find ("#");
-        if (x == -1)
-            x = s.find_last_of ("/");
-        
-        s = s.substr (x + 1, s.size ());
-        if (s == stub) {
-            LOGD ("found mapped plugin %s -> %s\n", pluginName, stub);
-            return addPlugin ((char *)uri, 0);
-        }
-    }
-# endif
-    return false ;
+bool Engine::addPlugin (const CatalogEntry * entry) {
+    if (entry->ladspa)
+        return addPlugin_ ((char *) entry->library.c_str (), entry->index, SharedLibrary::LADSPA);
+    return addPlugin ((char *) entry->library.c_str (), entry->index);
 }
 
 
+DecodedPreset Engine::capturePreset () {
+    DecodedPreset preset ;
+    if (activePlugins == nullptr)
+        return preset ;
+
+    for (int i = 0 ; i < activePlugins->size () ; i ++)
+        preset.plugins.push_back (PresetCodec::capture (activePlugins->at (i)));
+    return preset ;
+}
+
 json Engine::getPreset () {
     IN
     if (activePlugins == nullptr || activePlugins->size () == 0) {
@@ -251,38 +309,8 @@ json Engine::getPreset () {
 
     }
     
-    json preset = {} ;
-    json plugins = {} ;
-    
-    for (int i = 0 ; i < activePlugins->size () ; i ++) {
-        Plugin * plugin = activePlugins->at (i);
-        json p = {};
-        
-        p ["name"] = plugin->lv2_name;
-        if (! plugin->loadedFileName.empty ()) {
-            p ["filename"] = plugin -> loadedFileName ;
-            p ["filetype"] = plugin -> loadedFileType ;
-        }
-        
-        std::string controls = std::string () ;
-        for (int x = 0 ; x < plugin->pluginControls.size () ; x ++) {
-            if (plugin->pluginControls.at (x)->type == PluginControl::Type::ATOM ||
-                plugin->pluginControls.at (x)->type == PluginControl::Type::LV2_ATOM_INPUT_PORT ||
-                plugin->pluginControls.at (x)->type == PluginControl::Type::LV2_ATOM_OUTPUT_PORT) {
-                // skip atom ports
-                continue ;
-            }
-
-            controls.append (std::to_string (*plugin->pluginControls.at (x)->def));
-            if (x < (plugin->pluginControls.size () + 2))
-                controls.append (";");
-        }
-        
-        p ["controls"] = controls ;
-        plugins [std::to_string (i)] = p ;
-    }
-
-    preset ["controls"] = plugins;
+    json preset = PresetCodec::toJson (capturePreset ());
+    preset.erase ("desc");
     OUT
     return preset ;
 }
@@ -301,6 +329,34 @@ bool Engine::savePreset (std::string filename, std::string description) {
     return true ;
 }
 
+bool Engine::savePresetBinary (std::string filename, std::string description) {
+    IN
+    if (activePlugins == nullptr || activePlugins->size () == 0) {
+        OUT
+        return false ;
+    }
+
+    DecodedPreset preset = capturePreset ();
+    preset.desc = description ;
+    preset.name = std::string (filename).substr (filename.find_last_of ("/") + 1, filename.size ()) ;
+    bool ok = PresetCodec::save (filename, preset);
+    LOGD ("[preset save] %s: %s\n", filename.c_str (), ok ? "ok" : "failed");
+    OUT
+    return ok ;
+}
+
+// write saved values straight into the control ports, the rack syncs its
+// sliders from them afterwards
+bool Engine::applyPreset (int index, const PresetPlugin & saved) {
+    if (activePlugins == nullptr || index < 0 || index >= activePlugins->size ())
+        return false ;
+
+    Plugin * plugin = activePlugins->at (index);
+    for (const PresetParam & param: PresetCodec::resolve (saved, plugin))
+        * plugin->pluginControls [param.control]->def = param.value ;
+    return true ;
+}
+
 bool Engine::load_preset (json j) {
     IN
     auto plugins = j ["controls"];
@@ -311,36 +367,51 @@ bool Engine::load_preset (json j) {
     return true;
 }
 
+typedef struct {
+    Engine * engine ;
+    Plugin * plugin ;
+    std::string filename ;
+    std::shared_ptr <const Asset> asset ;
+} AssetLoad ;
+
+// back on the UI thread, where the chain is changed
+static gboolean asset_apply (gpointer data) {
+    AssetLoad * load = (AssetLoad *) data ;
+    Engine * engine = load -> engine ;
+    Plugin * p = load -> plugin ;
+
+    // removed, or given another file, while this one was decoding
+    bool current = false ;
+    for (Plugin * q: * Engine::activePlugins)
+        current = current || q == p ;
+    if (current && p -> loadedFileType == 0 && p -> loadedFileName == load -> filename && load -> asset) {
+        LOGD ("file read ok! set plugin: %s [%d frames]\n", p -> lv2_name.c_str (), load -> asset -> frames);
+        engine -> processor -> bypass = true ;
+        p -> setBuffer ((float *) load -> asset -> data.data (), load -> asset -> frames);
+        engine -> processor -> bypass = false ;
+        engine -> peaks -> request (load -> filename);
+    } else if (! load -> asset)
+        LOGD ("file read failed!\n");
+
+    delete load ;
+    return G_SOURCE_REMOVE ;
+}
+
+// on the loader's thread
+static void asset_ready (std::shared_ptr <const Asset> asset, void * data) {
+    AssetLoad * load = (AssetLoad *) data ;
+    load -> asset = asset ;
+    g_idle_add (asset_apply, load);
+}
+
 void Engine::set_plugin_audio_file (int index, char * filename) {
     IN
-    # ifdef __linux__
-    SoundFile * sf = snd_read (filename) ;
-    if (sf == NULL) {
-        LOGD ("file read failed!\n");
-        return ;
-    } else {
-        LOGD ("read %d bytes\n", * sf -> len);
-    }
-    
-    LOGD ("file read ok! set plugin: %d [%d bytes]\n", index, * sf -> len);
-    # endif
-    
-    //~ for (int i = 0 ; i < * sf -> len; i ++)
-        //~ LOGD ("[frame: %f]\n", sf -> data [i]);
-    //~ activePlugins->at (index)->lv2Descriptor->connect_port(
-        //~ activePlugins->at (index)->handle, 99, sf->len);
-    //~ activePlugins->at (index)->lv2Descriptor->connect_port(
-        //~ activePlugins->at (index)->handle, 100, sf->data);
-    //~ *sf -> len = * sf -> len / 2 ;
-    
-    processor->bypass = true ;
-    
-    # ifdef __linux__
-    activePlugins->at (index)->setBuffer (sf ->data, * sf -> len);
-    delete (sf) ;
-    # endif
-    
-    processor->bypass = false ;
+    // mono at our rate, whatever the file is: the plugin takes it as is
+    AssetLoad * load = new AssetLoad ();
+    load -> engine = this ;
+    load -> plugin = activePlugins->at (index);
+    load -> filename = filename ;
+    assets->request (filename, sampleRate, 1, asset_ready, load);
 
     activePlugins->at (index)->loadedFileName = std::string (filename) ;
     activePlugins->at (index)->loadedFileType = 0 ;
@@ -483,15 +554,91 @@ void Engine::startRecording () {
 
     fileWriter->setFileName (str);
     fileWriter->setSampleRate (driver->get_sample_rate ());
-    fileWriter->startRecording ();
+    fileWriter->latency = chainLatency ();
+    fileWriter->preset = getPreset ();
+    fileWriter->slotNames.clear ();
+    slotPlugins.clear ();
+    for (int slot: fileWriter->slots) {
+        Plugin * p = activePlugins != nullptr && slot < activePlugins->size () ? activePlugins->at (slot) : nullptr ;
+        fileWriter->slotNames.push_back (p != nullptr ?
+            std::to_string (slot + 1).append (".").append (p->lv2_name) : std::string ());
+        slotPlugins.push_back (p);
+    }
+    if (! fileWriter->startRecording ()) {
+        HERE LOGE ("could not open any file to record to\n");
+        OUT return ;
+    }
+
+    tapSlots ();
+    queueManager->subscribe ();
     processor->recording = true ;
     OUT
 }
 
+// what was played before anyone pressed record, saved while it goes on
+bool Engine::saveRetro () {
+    IN
+    auto t = std::time(nullptr);
+    auto tm = *std::localtime(&t);
+
+    std::ostringstream oss;
+
+    oss << std::put_time(&tm, "/%d-%m-%Y %H-%M-%S retro");
+    bool ok = retro->save (std::string (home).append (oss.str()));
+    OUT
+    return ok ;
+}
+
+// the plugins the take started with, wherever they are in the chain the
+// audio thread runs now: moved, they are still the ones recorded under
+// their names; switched off, they pass on what the one before made;
+// removed, or never there, they record silence
+void Engine::tapSlots () {
+    SlotTaps table = {} ;
+    if (fileWriter->mode != RECORD_WET)
+        table.count = std::min (fileWriter->slots.size (), slotPlugins.size ());
+
+    for (int k = 0 ; k < table.count ; k ++) {
+        int tap = -1 ;
+        bool found = false ;
+        for (int i = 0 ; activePlugins != nullptr && i < activePlugins->size () && ! found ; i ++) {
+            if (activePlugins->at (i)->active)
+                tap ++ ;
+            found = activePlugins->at (i) == slotPlugins [k] ;
+        }
+        // no plugin runs at -2, the audio thread zeroes the slot
+        table.tap [k] = found ? tap : -2 ;
+    }
+
+    // the audio thread may be in the middle of a period, it sees the old
+    // table or this one and never a mix of the two
+    processor->slotTaps.store (table, std::memory_order_release);
+}
+
+// frames the chain delays the signal by, as the plugins report it
+int Engine::chainLatency () {
+    int frames = 0 ;
+    if (activePlugins == nullptr)
+        return 0 ;
+    for (Plugin * p: * activePlugins)
+        if (p->active)
+            frames += (int) p->latency ;
+    return frames ;
+}
+
 void Engine::stopRecording () {
     IN
+    if (! processor->recording) {
+        OUT return ;
+    }
+
     processor->recording = false ;
+    queueManager->unsubscribe ();
     fileWriter->stopRecording ();
+    if (transcoder)
+        for (std::string & f: fileWriter->files)
+            if (f.size () > 4 && f.substr (f.size () - 4) == ".wav")
+                transcoder->add (f);
     OUT
 }
 
@@ -12,6 +12,7 @@
 
 #include <iostream>
 #include <filesystem>
+#include <unordered_map>
 
 #include <unistd.h>
 
@@ -21,8 +22,14 @@
 #include "util.h"
 #include "LockFreeQueue.h"
 #include "FileWriter.h"
+#include "retro.h"
+#include "transcode.h"
+#include "peaks.h"
+#include "asset.h"
 #include "log.h"
 #include "lily.h"
+#include "catalog.h"
+#include "presetcodec.h"
 
 using json = nlohmann::json;
 
@@ -32,16 +39,27 @@ public:
     const LilvPlugins* lilv_plugins = nullptr ;    
     int sampleRate ;
     FileWriter * fileWriter ;
+    // the last minutes, kept whether recording or not
+    RetroBuffer * retro ;
+    // masters to FLAC and Opus once a take is done, if the config says so
+    Transcoder * transcoder = nullptr ;
+    // waveforms for files that came without one
+    PeakScanner * peaks ;
+    // files for plugins, decoded and brought to our rate off the UI thread
+    AssetLoader * assets ;
     AudioDriver * driver = nullptr;
     std::string home, config ;
     std::vector <SharedLibrary *> libraries ;
     Processor * processor = nullptr ;
     char * libraryPath = nullptr; //= std::string ("libs/linux/x86_64/");
     std::string assetPath = std::string ();
-    nlohmann::json ladspaJson, lv2Json, creators, categories, lv2Map, amps, knobs ;
+    nlohmann::json ladspaJson, lv2Json, creators, categories, lv2Map, amps, knobs, warmup ;
     std::vector <std::string> * ladspaPlugins, * lv2Plugins ;
     LilvPlugins* plugins = nullptr ;
     LockFreeQueueManager * queueManager ;
+    std::unordered_map <std::string, std::string> pluginBundles ;
+    bool loadedAll = false ;
+    Catalog catalog ;
     
     Engine ();
     void buildPluginChain ();
@@ -51,17 +69,29 @@ public:
     
     static std::vector<Plugin *> * activePlugins ;
     bool addPlugin(char* library, int pluginIndex) ;
+    int warmupPeriods (const char * uri) ;
+    bool loadPluginBundle (const char * uri) ;
     bool addPlugin_(char *library, int pluginIndex, SharedLibrary::PluginType _type);
     bool openAudio();
     bool addPluginByName (char *);
+    // LV2 through lilv, LADSPA through its shared library
+    bool addPlugin (const CatalogEntry * entry);
     bool savePreset (std::string, std::string);
     bool load_preset (json );
     json getPreset ();
+    DecodedPreset capturePreset ();
+    bool savePresetBinary (std::string, std::string);
+    bool applyPreset (int index, const PresetPlugin & saved);
     void set_plugin_audio_file (int index, char * filename);
     void set_plugin_file (int index, char * filename) ;
     void print ();
     void startRecording ();
     void stopRecording ();
+    void tapSlots ();
+    // the plugins at the writer's slots when the take started
+    std::vector <Plugin *> slotPlugins ;
+    bool saveRetro ();
+    int chainLatency ();
     static int check_notify (AudioBuffer * a) ;
 };
 
@@ -3,126 +3,243 @@
 #include <lv2/core/lv2.h>
 #include <lv2/atom/atom.h>
 #include "util.h"
+#include "portcache.h"
 
-void generateLV2Info (std::string homedir) {
-    IN
-    json j = {}, categories = {}, creators = {};
-    categories ["All"] = std::vector <int> () ;
-    creators ["All"] = std::vector <int> () ;
+// LV2_PATH, or lilv's default search path when it is not set
+std::vector <std::string> lily_bundle_dirs () {
+    std::vector <std::string> dirs ;
+    const char * env = getenv ("LV2_PATH");
+    std::string path ;
+    # ifdef __linux__
+    char sep = ':' ;
+    const char * home = getenv ("HOME");
+    if (env)
+        path = env ;
+    else
+        path = std::string (home ? home : "").append ("/.lv2:/usr/local/lib/lv2:/usr/lib/lv2:/usr/local/lib64/lv2:/usr/lib64/lv2");
+    # else
+    char sep = ';' ;
+    const char * home = getenv ("USERPROFILE");
+    if (env)
+        path = env ;
+    else {
+        const char * appdata = getenv ("APPDATA");
+        const char * common = getenv ("COMMONPROGRAMFILES");
+        if (appdata)
+            path.append (appdata).append ("/LV2;");
+        if (common)
+            path.append (common).append ("/LV2");
+    }
+    # endif
 
-    LilvWorld* world = lilv_world_new();
-    lilv_world_load_all(world);
+    std::set <std::string> seen ;
+    std::stringstream ss (path);
+    std::string dir ;
+    while (std::getline (ss, dir, sep)) {
+        if (dir.empty ())
+            continue ;
+        if (dir [0] == '~' && home)
+            dir = std::string (home) + dir.substr (1);
 
-    const LilvPlugins* list = lilv_world_get_all_plugins(world);
-    int x = 1 ;
+        std::error_code ec ;
+        std::string canonical = std::filesystem::canonical (dir, ec).string ();
+        if (ec || seen.count (canonical))
+            continue ;
 
-    LILV_FOREACH (plugins, i, list) {
-        const LilvPlugin* p = lilv_plugins_get(list, i);
-        const char * name = lilv_node_as_string (lilv_plugin_get_name (p));
-        const char * uri = lilv_node_as_string (lilv_plugin_get_uri (p));
-        const LilvNodes* features = lilv_plugin_get_supported_features (p);
-        
-        // Get plugin classes to determine effect type
-        const LilvPluginClass* plugin_class = lilv_plugin_get_class(p);
-        const char* class_uri = lilv_node_as_uri(lilv_plugin_class_get_uri(plugin_class));
-        const char* class_label = lilv_node_as_string(lilv_plugin_class_get_label(plugin_class));
-        LilvNode* author_node = lilv_plugin_get_author_name(p);
-        std::string author_name_str = "Unknown";
-        if (author_node) author_name_str = lilv_node_as_string(author_node);
+        seen.insert (canonical);
+        dirs.push_back (dir);
+    }
 
-        LilvNode* email_node = lilv_plugin_get_author_email(p);
-        std::string author_email_str = "";
-        if (email_node) author_email_str = lilv_node_as_string(email_node);
+    return dirs ;
+}
 
-        LilvNode* homepage_node = lilv_plugin_get_author_homepage(p);
-        std::string author_homepage_str = "";
-        if (homepage_node) author_homepage_str = lilv_node_as_string(homepage_node);
+// bundles are loaded into the world at most once per session
+bool lily_load_bundle (LilvWorld * world, std::string bundle) {
+    static std::set <std::string> loaded ;
+    if (loaded.count (bundle))
+        return true ;
 
-        // Populate creators map
-        if (creators.find(author_name_str) == creators.end()) {
-            creators[author_name_str] = std::vector<int>();
-        }
-        creators[author_name_str].push_back(x);
-        // creators["All"].push_back(x);
+    LilvNode * uri = lilv_new_file_uri (world, NULL, bundle.c_str ());
+    if (uri == nullptr) {
+        LOGE ("[lily] bad bundle path %s\n", bundle.c_str ());
+        return false ;
+    }
 
-        // Free nodes
-        if (author_node) lilv_node_free(author_node);
-        if (email_node) lilv_node_free(email_node);
-        if (homepage_node) lilv_node_free(homepage_node);
-        
-        // Determine effect type based on plugin class
-        std::string effect_type = "Unknown";
-        if (strstr(class_uri, "DelayPlugin")) {
-            effect_type = "Delay";
-        } else if (strstr(class_uri, "ReverbPlugin")) {
-            effect_type = "Reverb";
-        } else if (strstr(class_uri, "DistortionPlugin")) {
-            effect_type = "Distortion";
-        } else if (strstr(class_uri, "FilterPlugin")) {
-            effect_type = "Filter";
-        } else if (strstr(class_uri, "EQPlugin")) {
-            effect_type = "EQ";
-        } else if (strstr(class_uri, "CompressorPlugin")) {
-            effect_type = "Compressor";
-        } else if (strstr(class_uri, "LimiterPlugin")) {
-            effect_type = "Limiter";
-        } else if (strstr(class_uri, "ModulatorPlugin")) {
-            effect_type = "Modulator";
-        } else if (strstr(class_uri, "ChorusPlugin")) {
-            effect_type = "Chorus";
-        } else if (strstr(class_uri, "FlangerPlugin")) {
-            effect_type = "Flanger";
-        } else if (strstr(class_uri, "PhaserPlugin")) {
-            effect_type = "Phaser";
-        } else if (strstr(class_uri, "GeneratorPlugin")) {
-            effect_type = "Generator";
-        } else if (strstr(class_uri, "InstrumentPlugin")) {
-            effect_type = "Instrument";
-        } else if (strstr(class_uri, "UtilityPlugin")) {
-            effect_type = "Utility";
-        } else if (strstr(class_uri, "AnalyserPlugin")) {
-            effect_type = "Analyser";
-        } else if (strstr(class_uri, "AmplifierPlugin")) {
-            effect_type = "Amplifier";
-        } else if (strstr(class_uri, "SpatialPlugin")) {
-            effect_type = "Spatial";
-        } else if (strstr(class_uri, "SpectralPlugin")) {
-            effect_type = "Spectral";
-        } else if (class_label) {
-            effect_type = class_label;
+    lilv_world_load_bundle (world, uri);
+    lilv_node_free (uri);
+    loaded.insert (bundle);
+    return true ;
+}
+
+static std::string lily_bundle_path (const LilvPlugin * p) {
+    char * path = lilv_file_uri_parse (lilv_node_as_uri (lilv_plugin_get_bundle_uri (p)), NULL);
+    if (path == nullptr)
+        return std::string ();
+
+    std::string bundle (path);
+    lilv_free (path);
+    if (bundle.back () != '/')
+        bundle.push_back ('/');
+    return bundle ;
+}
+
+static json lily_describe (const LilvPlugin * p, int x) {
+    LilvNode * name_node = lilv_plugin_get_name (p);
+    const char * name = lilv_node_as_string (name_node);
+    const char * uri = lilv_node_as_string (lilv_plugin_get_uri (p));
+
+    const LilvPluginClass* plugin_class = lilv_plugin_get_class(p);
+    const char* class_uri = lilv_node_as_uri(lilv_plugin_class_get_uri(plugin_class));
+    const char* class_label = lilv_node_as_string(lilv_plugin_class_get_label(plugin_class));
+    LilvNode* author_node = lilv_plugin_get_author_name(p);
+    std::string author_name_str = "Unknown";
+    if (author_node) author_name_str = lilv_node_as_string(author_node);
+    if (author_node) lilv_node_free(author_node);
+
+    std::string effect_type = lily_getEffectType (p);
+    LOGD ("[LV2] %s -> %s [Class: %s, Type: %s]\n", name, uri, class_uri, effect_type.c_str());
+
+    json plugin = {};
+    plugin ["name"] = name ;
+    plugin ["uri"] = uri ;
+    plugin ["type"] = "lv2" ;
+    plugin ["effect_type"] = effect_type ;
+    plugin ["class_uri"] = class_uri ;
+    plugin ["class_label"] = class_label ? class_label : "Unknown" ;
+    plugin ["index"] = 0 ;
+    plugin ["id"] = x ;
+    plugin ["library"] = uri ;
+    plugin ["author"] = author_name_str ;
+    plugin ["bundle"] = lily_bundle_path (p);
+
+    lilv_node_free (name_node);
+    return plugin ;
+}
+
+/*  Bring lv2_plugins.json up to date with what is installed.
+ *
+ *  Only bundle directories and the mtimes of their turtle files are looked
+ *  at. Bundles that are new or changed since the last scan are loaded into
+ *  the world and described, entries for removed bundles are dropped. Plugin
+ *  ids are stable across scans. Returns true if anything changed.
+ */
+bool lily_scan (LilvWorld * world, std::string homedir) {
+    IN
+    std::string bundles_file = homedir + "/lv2_bundles.json" ;
+    std::string plugins_file = homedir + "/lv2_plugins.json" ;
+
+    json known = {}, j = {} ;
+    if (std::filesystem::exists (bundles_file) && std::filesystem::exists (plugins_file)) {
+        known = filename_to_json (bundles_file);
+        j = filename_to_json (plugins_file);
+    }
+
+    // caches written before bundles were tracked cannot be patched
+    for (auto & plugin: j) {
+        if (! plugin.contains ("bundle")) {
+            wtf ("[lily] plugin cache has no bundle info, rescanning everything\n");
+            known = {};
+            j = {};
+            break ;
         }
-        
-        LOGD ("[LV2] %s -> %s [Class: %s, Type: %s]\n", name, uri, class_uri, effect_type.c_str());
-            // Populate categories
-        if (categories.find(effect_type) == categories.end()) {
-            categories[effect_type] = std::vector<int>();
+    }
+
+    std::map <std::string, int64_t> found ;
+    for (std::string & dir: lily_bundle_dirs ()) {
+        std::error_code ec ;
+        for (auto & entry: std::filesystem::directory_iterator (dir, ec)) {
+            if (! std::filesystem::exists (entry.path () / "manifest.ttl"))
+                continue ;
+
+            std::string bundle = entry.path ().string () + "/" ;
+            found [bundle] = PortCache::bundle_mtime (bundle.c_str ());
+
+            // plugin classes live in lv2core, everything else is loaded lazily
+            if (entry.path ().filename () == "lv2core.lv2")
+                lily_load_bundle (world, bundle);
         }
+    }
+
+    lilv_world_load_specifications (world);
+    lilv_world_load_plugin_classes (world);
+
+    std::set <std::string> changed, removed ;
+    for (auto & b: found)
+        if (! known.contains (b.first) || known [b.first].get <int64_t> () != b.second)
+            changed.insert (b.first);
+    for (auto & b: known.items ())
+        if (found.find (b.key ()) == found.end ())
+            removed.insert (b.key ());
+
+    LOGD ("[lily] %d bundles, %d changed, %d removed\n", (int) found.size (), (int) changed.size (), (int) removed.size ());
+    if (changed.empty () && removed.empty () && ! j.empty ()) {
+        OUT
+        return false ;
+    }
+
+    // drop plugins from bundles that went away or will be described again,
+    // remembering their ids so presets and favourites keep pointing at them
+    std::map <std::string, int> ids ;
+    int next_id = 1 ;
+    for (auto it = j.begin () ; it != j.end () ;) {
+        std::string bundle = (*it) ["bundle"] ;
+        int id = (*it) ["id"].get <int> ();
+        if (id >= next_id)
+            next_id = id + 1 ;
+
+        if (changed.count (bundle) || removed.count (bundle)) {
+            ids [(*it) ["uri"].get <std::string> ()] = id ;
+            it = j.erase (it);
+        } else
+            it ++ ;
+    }
 
-        categories[effect_type].push_back(x);
-
-        json plugin = {};
-        plugin ["name"] = name ;
-        plugin ["uri"] = uri ;
-        plugin ["type"] = "lv2" ;
-        plugin ["effect_type"] = effect_type ;
-        plugin ["class_uri"] = class_uri ;
-        plugin ["class_label"] = class_label ? class_label : "Unknown" ;
-        plugin ["index"] = 0 ;
-        plugin ["id"] = x ;
-        plugin ["library"] = uri ;
-
-        std::string idx = std::to_string(x);
-        j[idx] = plugin;
-        x++ ;
+    for (const std::string & bundle: changed)
+        lily_load_bundle (world, bundle);
+
+    const LilvPlugins* list = lilv_world_get_all_plugins(world);
+    LILV_FOREACH (plugins, i, list) {
+        const LilvPlugin* p = lilv_plugins_get(list, i);
+        if (! changed.count (lily_bundle_path (p)))
+            continue ;
+
+        std::string uri = lilv_node_as_uri (lilv_plugin_get_uri (p));
+        int x = ids.count (uri) ? ids [uri] : next_id ++ ;
+        j [std::to_string (x)] = lily_describe (p, x);
     }
 
-    lilv_world_free(world);
+    // categories and creators are cheap to derive from the full list
+    json categories = {}, creators = {};
+    categories ["All"] = std::vector <int> () ;
+    creators ["All"] = std::vector <int> () ;
+    for (auto & plugin: j) {
+        std::string effect_type = plugin ["effect_type"] ;
+        std::string author = plugin.value ("author", "Unknown");
+        if (! categories.contains (effect_type))
+            categories [effect_type] = std::vector <int> ();
+        if (! creators.contains (author))
+            creators [author] = std::vector <int> ();
+
+        categories [effect_type].push_back (plugin ["id"].get <int> ());
+        creators [author].push_back (plugin ["id"].get <int> ());
+    }
 
-    LOGD ("LV2 plugins found: %s\n", j.dump ().c_str ());
-    json_to_filename (j, homedir + "/lv2_plugins.json");
+    known = found ;
+    LOGD ("[lily] %d lv2 plugins\n", (int) j.size ());
+    json_to_filename (j, plugins_file);
     json_to_filename (categories, homedir + "/lv2_categories.json");
     json_to_filename (creators, homedir + "/lv2_creators.json");
-    
+    json_to_filename (known, bundles_file);
+
+    OUT
+    return true ;
+}
+
+// full rebuild of the plugin cache
+void generateLV2Info (LilvWorld * world, std::string homedir) {
+    IN
+    std::filesystem::remove (homedir + "/lv2_bundles.json");
+    lily_scan (world, homedir);
     OUT
 }
 
@@ -178,13 +295,15 @@ std::string lily_getEffectType (const LilvPlugin* plugin) {
     return "Unknown";
 }
 
-json lily_getPluginInfo (const char* plugin_uri) {
+json lily_getPluginInfo (LilvWorld * world, const char* plugin_uri) {
     IN
     json plugin_info = {};
     
-    LilvWorld* world = lilv_world_new();
-    lilv_world_load_all(world);
-    
+    LilvNode* lv2_AudioPort   = lilv_new_uri(world, LV2_CORE__AudioPort);
+    LilvNode* lv2_ControlPort = lilv_new_uri(world, LV2_CORE__ControlPort);
+    LilvNode* lv2_AtomPort    = lilv_new_uri(world, LV2_ATOM__AtomPort);
+    LilvNode* lv2_InputPort   = lilv_new_uri(world, LV2_CORE__InputPort);
+    LilvNode* lv2_OutputPort  = lilv_new_uri(world, LV2_CORE__OutputPort);
     LilvNode* uri_node = lilv_new_uri(world, plugin_uri);
     const LilvPlugin* plugin = lilv_plugins_get_by_uri(lilv_world_get_all_plugins(world), uri_node);
     
@@ -229,20 +348,20 @@ json lily_getPluginInfo (const char* plugin_uri) {
             port_info["name"] = port_name ? lilv_node_as_string(port_name) : "Unknown";
             
             // Determine port type
-            if (lilv_port_is_a(plugin, port, lilv_new_uri(world, LV2_CORE__AudioPort))) {
+            if (lilv_port_is_a(plugin, port, lv2_AudioPort)) {
                 port_info["type"] = "audio";
-            } else if (lilv_port_is_a(plugin, port, lilv_new_uri(world, LV2_CORE__ControlPort))) {
+            } else if (lilv_port_is_a(plugin, port, lv2_ControlPort)) {
                 port_info["type"] = "control";
-            } else if (lilv_port_is_a(plugin, port, lilv_new_uri(world, LV2_ATOM__AtomPort))) {
+            } else if (lilv_port_is_a(plugin, port, lv2_AtomPort)) {
                 port_info["type"] = "atom";
             } else {
                 port_info["type"] = "unknown";
             }
             
             // Determine port direction
-            if (lilv_port_is_a(plugin, port, lilv_new_uri(world, LV2_CORE__InputPort))) {
+            if (lilv_port_is_a(plugin, port, lv2_InputPort)) {
                 port_info["direction"] = "input";
-            } else if (lilv_port_is_a(plugin, port, lilv_new_uri(world, LV2_CORE__OutputPort))) {
+            } else if (lilv_port_is_a(plugin, port, lv2_OutputPort)) {
                 port_info["direction"] = "output";
             }
             
@@ -281,7 +400,11 @@ json lily_getPluginInfo (const char* plugin_uri) {
     }
     
     lilv_node_free(uri_node);
-    lilv_world_free(world);
+    lilv_node_free(lv2_AudioPort);
+    lilv_node_free(lv2_ControlPort);
+    lilv_node_free(lv2_AtomPort);
+    lilv_node_free(lv2_InputPort);
+    lilv_node_free(lv2_OutputPort);
     
     OUT
     return plugin_info;
@@ -5,11 +5,19 @@
 #include "log.h"
 #include <string>
 #include <cstring>
+#include <vector>
+#include <set>
+#include <map>
+#include <sstream>
+#include <filesystem>
 
 using json = nlohmann::json;
 
-void generateLV2Info (std::string homedir) ;
-json lily_getPluginInfo (const char* plugin_uri) ;
+void generateLV2Info (LilvWorld * world, std::string homedir) ;
+bool lily_scan (LilvWorld * world, std::string homedir) ;
+bool lily_load_bundle (LilvWorld * world, std::string bundle) ;
+std::vector <std::string> lily_bundle_dirs () ;
+json lily_getPluginInfo (LilvWorld * world, const char* plugin_uri) ;
 std::string lily_getEffectType (const LilvPlugin* plugin) ;
 
 #endif
@@ -1,34 +1,54 @@
 #include "lily.h"
+#include "util.h"
 #include <iostream>
 
 int main() {
     std::cout << "=== LV2 Plugin Information Test ===" << std::endl;
-    
-    // Get all LV2 plugins with effect types
-    json plugins = lily_getLv2Json();
-    
-    std::cout << "\nFound " << plugins.size() << " LV2 plugins:" << std::endl;
+
+    // a scratch cache, so every bundle counts as new and is described
+    std::string dir = (std::filesystem::temp_directory_path () / "lv2_info_test").string ();
+    std::filesystem::remove_all (dir);
+    std::filesystem::create_directories (dir);
+
+    LilvWorld * world = lilv_world_new ();
+    lily_scan (world, dir);
+    json plugins = filename_to_json (dir + "/lv2_plugins.json");
+
+    std::cout << "\nFound " << plugins.size() << " LV2 plugins in " << lily_bundle_dirs ().size () << " folders:" << std::endl;
     std::cout << "========================================" << std::endl;
-    
+
     for (auto& [key, plugin] : plugins.items()) {
-        std::cout << "Plugin: " << plugin["name"] << std::endl;
+        std::cout << "Plugin " << plugin["id"] << ": " << plugin["name"] << std::endl;
         std::cout << "  URI: " << plugin["uri"] << std::endl;
+        std::cout << "  Author: " << plugin["author"] << std::endl;
+        std::cout << "  Bundle: " << plugin["bundle"] << std::endl;
         std::cout << "  Effect Type: " << plugin["effect_type"] << std::endl;
         std::cout << "  Class: " << plugin["class_label"] << std::endl;
         std::cout << "  Class URI: " << plugin["class_uri"] << std::endl;
         std::cout << "  ----------------------------------------" << std::endl;
     }
-    
+
+    json categories = filename_to_json (dir + "/lv2_categories.json");
+    json creators = filename_to_json (dir + "/lv2_creators.json");
+    std::cout << "\nCategories: " << categories.size () << ", creators: " << creators.size () << std::endl;
+
+    // a second scan with nothing installed or removed has nothing to do
+    std::cout << "Rescan changed anything: " << (lily_scan (world, dir) ? "yes" : "no") << std::endl;
+
     // Test detailed plugin info for the first plugin (if any exist)
     if (!plugins.empty()) {
         auto first_plugin = plugins.begin().value();
         std::string plugin_uri = first_plugin["uri"];
-        
+
         std::cout << "\n=== Detailed Info for: " << first_plugin["name"] << " ===" << std::endl;
-        json detailed_info = lily_getPluginInfo(plugin_uri.c_str());
-        
+        // the engine loads a bundle the first time one of its plugins is added
+        lily_load_bundle (world, first_plugin["bundle"].get <std::string> ());
+        json detailed_info = lily_getPluginInfo(world, plugin_uri.c_str());
+
         std::cout << detailed_info.dump(2) << std::endl;
     }
-    
+
+    lilv_world_free (world);
+    std::filesystem::remove_all (dir);
     return 0;
-}
\ No newline at end of file
+}
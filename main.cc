@@ -23,10 +23,14 @@ void add_cb (GtkDialog* self, gint response_id, gpointer user_data) {
     
     LOGD ("[cb] id: %d\n", response_id);
     Presets * presets = (Presets *) cb -> data;
-    std::string f = std::string (presets -> presets_dir->c_str ()).append (filename) ;
-    presets -> engine -> savePreset (f, std::string (desc));    
-    json j = filename_to_json (f);
-    presets->add_preset (j, 1);
+    json j = presets -> engine -> getPreset ();
+    if (! j.is_null ()) {
+        j ["desc"] = std::string (desc);
+        j ["name"] = std::string (filename);
+        bool known = presets -> store -> contains (filename);
+        if (presets -> store -> put (j))
+            presets -> saved (j, known);
+    }
 
     gtk_window_destroy ((GtkWindow *)cb->dialog);
     delete (cb);
@@ -85,16 +89,15 @@ void save_preset_cb (void * w, void * d) {
 void onshow (void * w, void * d) {
     IN
     MyWindow * window = (MyWindow *) d ;    
-    std::string default_preset = std::string (window ->presets -> dir) .append ("/default") ;
+    // last session, binary since it has to come back exactly as it was
+    std::string default_preset = std::string (window ->presets -> dir) .append ("/default.apb") ;
+    if (! std::filesystem::exists (default_preset))
+        default_preset = std::string (window ->presets -> dir) .append ("/default") ;
     window -> rack -> load_preset (default_preset);
 
     json favs = filename_to_json (std::string (window -> presets -> dir).append ("/fav.json"));
-    for (int i = 0 ; i < window -> rack -> hearts.size (); i ++) {
-        GtkWidget * fav = (GtkWidget *) window -> rack -> hearts.at (i);
-        if (favs.contains (gtk_widget_get_name (fav))) {
-            gtk_toggle_button_set_active ((GtkToggleButton *) fav, true);
-        }
-    }
+    window -> rack -> engine -> catalog.loadFavourites (favs);
+    window -> rack -> refreshPluginDialog ();
     
     OUT
 }
@@ -106,24 +109,18 @@ void qquit (void *) {
 void quit (void * w, void * d) {
     IN
     MyWindow * window = (MyWindow *) d ;
-    LOGD ("sss %d\n", window -> rack -> hearts.size ());
     LOGD ("Closing audio ...\n");
     window -> rack -> engine -> driver -> deactivate ();
     window -> rack -> engine -> driver -> close ();
     LOGD ("Saving preset ...\n");
     
-    window -> rack -> engine -> savePreset (std::string (window -> presets -> dir) .append ("/default").c_str (), "Last saved preset") ;
+    window -> rack -> engine -> savePresetBinary (std::string (window -> presets -> dir) .append ("/default.apb").c_str (), "Last saved preset") ;
     
-    json favs = {} ;
+    if (Plugin::portCache != nullptr)
+        Plugin::portCache->flush ();
+
     LOGD ("Saving favorites ...\n");
-        
-    for (int i = 0 ; i < window -> rack -> hearts.size (); i ++) {
-        GtkWidget * fav = (GtkWidget *) window -> rack -> hearts.at (i);
-        if (gtk_toggle_button_get_active ((GtkToggleButton *)fav)) {
-            favs [gtk_widget_get_name (fav)] = true ;
-        }
-    }
-    
+    json favs = window -> rack -> engine -> catalog.favouritesJson ();
     json_to_filename (favs, std::string (window -> presets -> dir).append ("/fav.json"));    
 
     LOGD ("Saving settings ...\n");
@@ -179,6 +176,9 @@ hotkeys (MyWindow             *window,
         case 115: // 's'
             sync = new Sync (window -> rack);
             break ;
+        case 'k':
+            window -> rack -> engine -> saveRetro ();
+            break ;
         case 65366:
             window -> rack -> prev_preset ();
             break ;
@@ -373,6 +373,9 @@ MyWindow::MyWindow(GtkApplication * _app)
     
     Settings settings = Settings (rack);
     gtk_notebook_append_page (presets->notebook, (GtkWidget *)settings . grid, gtk_label_new ("Settings"));
+
+    Recordings * recordings = new Recordings (rack -> engine);
+    gtk_notebook_append_page (presets->notebook, recordings -> box, gtk_label_new ("Recordings"));
     
     
     CB * cb = new CB () ;
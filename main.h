@@ -8,6 +8,7 @@
 #include "rack.h"
 #include "presets.h"
 #include "settings.h"
+#include "recordings.h"
 
 using json = nlohmann::json;
 
@@ -3,7 +3,12 @@
 #include <filesystem>
 #include <vector>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include "json.hpp"
+#include "catalog.h"
+#include "availability.h"
+#include "presetstore.h"
 
 #ifdef __linux__
 #include <lilv/lilv.h>
@@ -42,8 +47,90 @@ void list_lilv () {
 }
 # endif
 
+static nlohmann::json load_json (std::string filename) {
+    std::ifstream f (filename);
+    if (! f.is_open ()) {
+        printf ("[missing] cannot open %s\n", filename.c_str ());
+        return nlohmann::json::object ();
+    }
+
+    std::stringstream buffer ;
+    buffer << f.rdbuf ();
+    return nlohmann::json::parse (buffer.str (), nullptr, false);
+}
+
+/*  missing --presets [--config dir] [--top n] presets.json|store dir ...
+ *
+ *  checks every preset against the plugins in lv2_plugins.json and
+ *  prints which plugins would make the most of them playable
+ */
+int report_presets (int argc, char ** argv) {
+    # ifdef __linux__
+    std::string config = std::string (getenv ("HOME")).append ("/.config/amprack") ;
+    # else
+    std::string config = std::string (getenv ("USERPROFILE")).append ("/amprack") ;
+    # endif
+    size_t top = 20 ;
+    std::vector <std::string> sources ;
+
+    for (int i = 2 ; i < argc ; i ++) {
+        std::string arg = argv [i] ;
+        if (arg == "--config" && i + 1 < argc)
+            config = argv [++ i] ;
+        else if (arg == "--top" && i + 1 < argc)
+            top = atoi (argv [++ i]);
+        else
+            sources.push_back (arg);
+    }
+
+    if (sources.empty ()) {
+        printf ("usage: %s --presets [--config dir] [--top n] presets.json|store dir ...\n", argv [0]);
+        return 1 ;
+    }
+
+    json lv2 = load_json (config + "/lv2_plugins.json");
+    json ladspa = json::array ();
+    json aliases = json::object ();
+    if (std::filesystem::exists (config + "/lv2_aliases.json"))
+        aliases = load_json (config + "/lv2_aliases.json");
+
+    Catalog catalog ;
+    catalog.build (lv2, ladspa, aliases);
+    PresetAvailability availability (& catalog);
+
+    // one tab per source, a directory is a preset store
+    for (int tab = 0 ; tab < (int) sources.size () ; tab ++) {
+        json presets ;
+        if (std::filesystem::is_directory (sources [tab])) {
+            PresetStore store (sources [tab]);
+            presets = store.all ();
+        } else
+            presets = load_json (sources [tab]);
+
+        int index = 0 ;
+        for (auto & p: presets)
+            availability.add (tab, index ++, p);
+        printf ("[presets] %s: %d\n", sources [tab].c_str (), index);
+    }
+
+    int total = availability.size ();
+    printf ("\n%d presets, %d playable, %d need plugins we do not have\n", total, total - availability.unplayable (), availability.unplayable ());
+
+    printf ("\n-------| most missing |----------\n\n");
+    for (auto & m: availability.mostMissing (top))
+        printf ("%6d  %s\n", m.second, m.first.c_str ());
+
+    printf ("\n-------| install these first |----------\n\n");
+    for (auto & step: availability.unlock (top))
+        printf ("%6d  %6d  %s\n", step.unlocked, step.total, step.plugin.c_str ());
+
+    return 0 ;
+}
+
 int main (int argc, char ** argv ) {
     std::string path = "libs";
+    if (argc > 1 && std::string (argv [1]) == "--presets")
+        return report_presets (argc, argv);
         
     std::ifstream fJson(argv [1]);
     std::stringstream buffer;
@@ -0,0 +1,357 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "peaks.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include "sndfile.h"
+#endif
+
+#ifdef _WIN32
+# include <windows.h>
+#endif
+
+#define PEAK_MAGIC "PEAK"
+#define PEAK_VERSION 1
+// frames read at a time when scanning
+#define PEAK_CHUNK 8192
+
+typedef struct {
+    char magic [4] ;
+    uint32_t version ;
+    uint32_t channels ;
+    uint32_t sampleRate ;
+    uint32_t base ;
+    uint32_t factor ;
+    uint64_t frames ;
+    uint32_t levels ;
+    uint32_t reserved ;
+} PeakHeader ;
+
+static int16_t quantize (float v) {
+    v *= 32767.0f ;
+    if (v > 32767.0f)
+        v = 32767.0f ;
+    else if (v < -32768.0f)
+        v = -32768.0f ;
+    return (int16_t) lrintf (v);
+}
+
+bool Peaks::load (std::string audio) {
+    std::string name = sidecar (audio);
+    std::error_code ec ;
+    if (! std::filesystem::exists (name, ec) ||
+        std::filesystem::last_write_time (name, ec) < std::filesystem::last_write_time (audio, ec))
+        return false ;
+
+    FILE * file = fopen (name.c_str (), "rb");
+    if (file == nullptr)
+        return false ;
+
+    PeakHeader h ;
+    bool ok = fread (& h, sizeof (h), 1, file) == 1 && memcmp (h.magic, PEAK_MAGIC, 4) == 0 &&
+        h.version == PEAK_VERSION && h.base == PEAK_BASE && h.factor == PEAK_FACTOR &&
+        h.channels > 0 && h.channels <= 64 && h.levels <= 32 ;
+
+    std::vector <uint64_t> counts (ok ? h.levels : 0);
+    if (ok)
+        ok = fread (counts.data (), sizeof (uint64_t), h.levels, file) == h.levels ;
+
+    // the counts have to add up to what is on disk before any of it is
+    // allocated, a torn or corrupt file could ask for anything
+    uintmax_t size = std::filesystem::file_size (name, ec);
+    uint64_t want = sizeof (h) + (uint64_t) h.levels * sizeof (uint64_t);
+    for (uint32_t l = 0 ; ok && l < h.levels ; l ++) {
+        if (counts [l] > size / sizeof (PeakBucket)) {
+            ok = false ;
+            break ;
+        }
+        want += counts [l] * h.channels * sizeof (PeakBucket);
+    }
+    ok = ok && ! ec && want == size ;
+
+    levels.clear ();
+    for (uint32_t l = 0 ; ok && l < h.levels ; l ++) {
+        uint64_t n = counts [l] * h.channels ;
+        if (n > (h.frames / PEAK_BASE + 1) * h.channels) {
+            ok = false ;
+            break ;
+        }
+
+        levels.emplace_back (n);
+        ok = fread (levels.back ().data (), sizeof (PeakBucket), n, file) == n ;
+    }
+
+    fclose (file);
+    if (! ok) {
+        LOGW ("[peaks] %s is not usable\n", name.c_str ());
+        levels.clear ();
+        return false ;
+    }
+
+    channels = h.channels ;
+    sampleRate = h.sampleRate ;
+    frames = h.frames ;
+    return true ;
+}
+
+void Peaks::render (uint64_t from, uint64_t to, int c, int columns, PeakBucket * out) {
+    memset (out, 0, columns * sizeof (PeakBucket));
+    if (levels.empty () || columns <= 0 || to <= from || c >= channels)
+        return ;
+
+    // the coarsest level whose buckets are no wider than a column
+    double per = (double) (to - from) / columns ;
+    int l = 0 ;
+    uint64_t width = PEAK_BASE ;
+    while (l + 1 < (int) levels.size () && width * PEAK_FACTOR <= per) {
+        l ++ ;
+        width *= PEAK_FACTOR ;
+    }
+
+    std::vector <PeakBucket> & level = levels [l] ;
+    uint64_t n = level.size () / channels ;
+    for (int i = 0 ; i < columns ; i ++) {
+        uint64_t a = (from + (uint64_t) (i * per)) / width ;
+        uint64_t b = (from + (uint64_t) ((i + 1) * per) + width - 1) / width ;
+        if (b <= a)
+            b = a + 1 ;
+        if (b > n)
+            b = n ;
+        if (a >= b)
+            continue ;
+
+        int16_t low = 32767, high = -32768 ;
+        double squares = 0 ;
+        for (uint64_t k = a ; k < b ; k ++) {
+            PeakBucket & p = level [k * channels + c] ;
+            low = p.min < low ? p.min : low ;
+            high = p.max > high ? p.max : high ;
+            squares += (double) p.rms * p.rms ;
+        }
+
+        out [i].min = low ;
+        out [i].max = high ;
+        out [i].rms = (int16_t) sqrt (squares / (b - a));
+    }
+}
+
+PeakBuilder::PeakBuilder (int channels, int sampleRate) {
+    peaks.channels = channels ;
+    peaks.sampleRate = sampleRate ;
+}
+
+// a bucket of this level is whole: into the file, and on up a level
+void PeakBuilder::push (int level, const float * l, const float * h, const double * s, uint64_t n, bool up) {
+    int ch = peaks.channels ;
+    if ((int) peaks.levels.size () <= level)
+        peaks.levels.emplace_back ();
+    for (int c = 0 ; c < ch ; c ++) {
+        PeakBucket b ;
+        b.min = quantize (l [c]);
+        b.max = quantize (h [c]);
+        b.rms = quantize (sqrt (s [c] / n));
+        peaks.levels [level].push_back (b);
+    }
+
+    if (! up)
+        return ;
+
+    if ((int) count.size () <= level + 1) {
+        count.push_back (0);
+        frames.push_back (0);
+        low.insert (low.end (), ch, 1.0f);
+        high.insert (high.end (), ch, -1.0f);
+        squares.insert (squares.end (), ch, 0);
+    }
+
+    int at = (level + 1) * ch ;
+    for (int c = 0 ; c < ch ; c ++) {
+        low [at + c] = fminf (low [at + c], l [c]);
+        high [at + c] = fmaxf (high [at + c], h [c]);
+        squares [at + c] += s [c] ;
+    }
+
+    frames [level + 1] += n ;
+    if (++ count [level + 1] == PEAK_FACTOR)
+        close (level + 1);
+}
+
+void PeakBuilder::close (int level, bool up) {
+    int ch = peaks.channels, at = level * ch ;
+    // copies, as push () may grow the vectors
+    std::vector <float> l (low.begin () + at, low.begin () + at + ch), h (high.begin () + at, high.begin () + at + ch);
+    std::vector <double> s (squares.begin () + at, squares.begin () + at + ch);
+    uint64_t n = frames [level] ;
+
+    count [level] = 0 ;
+    frames [level] = 0 ;
+    for (int c = 0 ; c < ch ; c ++) {
+        low [at + c] = 1.0f ;
+        high [at + c] = -1.0f ;
+        squares [at + c] = 0 ;
+    }
+
+    push (level, l.data (), h.data (), s.data (), n, up);
+}
+
+void PeakBuilder::add (const float * data, int n) {
+    int ch = peaks.channels ;
+    if (count.empty ()) {
+        count.push_back (0);
+        frames.push_back (0);
+        low.assign (ch, 1.0f);
+        high.assign (ch, -1.0f);
+        squares.assign (ch, 0);
+    }
+
+    for (int i = 0 ; i < n ; i ++) {
+        for (int c = 0 ; c < ch ; c ++) {
+            float v = data [i * ch + c] ;
+            low [c] = fminf (low [c], v);
+            high [c] = fmaxf (high [c], v);
+            squares [c] += (double) v * v ;
+        }
+
+        frames [0] ++ ;
+        if (++ count [0] == PEAK_BASE)
+            close (0);
+    }
+
+    peaks.frames += n ;
+}
+
+bool PeakBuilder::save (std::string audio) {
+    // the buckets still filling, from the bottom up so each lands in the
+    // one above; the top one starts no new level
+    int top = (int) count.size () - 1 ;
+    for (int l = 0 ; l <= top ; l ++)
+        if (count [l] > 0)
+            close (l, l < top);
+
+    // nothing needs a level above one that is already short
+    while (peaks.levels.size () > 1 && peaks.levels [peaks.levels.size () - 2].size () / peaks.channels <= PEAK_TOP)
+        peaks.levels.pop_back ();
+
+    std::string name = Peaks::sidecar (audio);
+    FILE * file = fopen (name.c_str (), "wb");
+    if (file == nullptr) {
+        LOGW ("[peaks] cannot write %s\n", name.c_str ());
+        return false ;
+    }
+
+    PeakHeader h = {} ;
+    memcpy (h.magic, PEAK_MAGIC, 4);
+    h.version = PEAK_VERSION ;
+    h.channels = peaks.channels ;
+    h.sampleRate = peaks.sampleRate ;
+    h.base = PEAK_BASE ;
+    h.factor = PEAK_FACTOR ;
+    h.frames = peaks.frames ;
+    h.levels = peaks.levels.size ();
+
+    bool ok = fwrite (& h, sizeof (h), 1, file) == 1 ;
+    for (auto & level: peaks.levels) {
+        uint64_t n = level.size () / peaks.channels ;
+        ok = ok && fwrite (& n, sizeof (n), 1, file) == 1 ;
+    }
+    for (auto & level: peaks.levels)
+        ok = ok && fwrite (level.data (), sizeof (PeakBucket), level.size (), file) == level.size ();
+
+    ok = fclose (file) == 0 && ok ;
+    if (! ok) {
+        LOGW ("[peaks] cannot write %s\n", name.c_str ());
+        std::remove (name.c_str ());
+    }
+    return ok ;
+}
+
+PeakScanner::PeakScanner () {
+    worker = std::thread (& PeakScanner::work, this);
+}
+
+PeakScanner::~PeakScanner () {
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        done = true ;
+    }
+    ready.notify_one ();
+    worker.join ();
+}
+
+void PeakScanner::watch (PeaksReady f, void * data) {
+    std::lock_guard <std::mutex> guard (lock);
+    callback = f ;
+    callbackData = data ;
+}
+
+void PeakScanner::request (std::string audio) {
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        for (std::string & t: todo)
+            if (t == audio)
+                return ;
+        todo.push_back (audio);
+    }
+
+    ready.notify_one ();
+}
+
+void PeakScanner::work () {
+    IN
+#ifdef __linux__
+    struct sched_param param = {};
+    pthread_setschedparam (pthread_self (), SCHED_IDLE, & param);
+#elif defined _WIN32
+    SetThreadPriority (GetCurrentThread (), THREAD_PRIORITY_IDLE);
+#endif
+
+    std::unique_lock <std::mutex> guard (lock);
+    while (true) {
+        ready.wait (guard, [this] { return done || ! todo.empty (); });
+        if (done)
+            break ;
+
+        std::string audio = todo.front ();
+        guard.unlock ();
+        // checked here, not in request (), reading it is not for the UI thread
+        Peaks peaks ;
+        bool ok = peaks.load (audio) || scan (audio);
+        guard.lock ();
+
+        todo.pop_front ();
+        PeaksReady f = callback ;
+        void * data = callbackData ;
+        guard.unlock ();
+        if (f)
+            f (audio, ok, data);
+        guard.lock ();
+    }
+
+    OUT
+}
+
+bool PeakScanner::scan (std::string audio) {
+#ifdef __linux__
+    SF_INFO info = {};
+    SNDFILE * in = sf_open (audio.c_str (), SFM_READ, & info);
+    if (in == nullptr) {
+        LOGW ("[peaks] cannot read %s: %s\n", audio.c_str (), sf_strerror (NULL));
+        return false ;
+    }
+
+    PeakBuilder builder (info.channels, info.samplerate);
+    std::vector <float> buffer (PEAK_CHUNK * info.channels);
+    sf_count_t n ;
+    while ((n = sf_readf_float (in, buffer.data (), PEAK_CHUNK)) > 0)
+        builder.add (buffer.data (), n);
+
+    sf_close (in);
+    return builder.save (audio);
+#else
+    return false ;
+#endif
+}
@@ -0,0 +1,99 @@
+#ifndef PEAKS_H
+#define PEAKS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging_macros.h"
+
+// frames in a bucket of the finest level, and buckets per bucket of the next
+#define PEAK_BASE 256
+#define PEAK_FACTOR 4
+// levels stop once one is this short
+#define PEAK_TOP 64
+
+// one bucket of one channel, full scale is 32767
+typedef struct {
+    int16_t min ;
+    int16_t max ;
+    int16_t rms ;
+} PeakBucket ;
+
+/*  Min, max and RMS of a file at PEAK_BASE frames a bucket, then four
+ *  times coarser at each level up, kept beside the file as name.peaks.
+ *
+ *  Drawing any stretch of a file at any width reads at most PEAK_FACTOR
+ *  buckets a column from the level that fits, so an hour long take costs
+ *  what a second long one does and nothing is decoded.
+ */
+class Peaks {
+public:
+    int channels = 0 ;
+    int sampleRate = 0 ;
+    uint64_t frames = 0 ;
+    // buckets of each level, channels interleaved
+    std::vector <std::vector <PeakBucket>> levels ;
+
+    static std::string sidecar (std::string audio) { return audio + ".peaks" ; }
+    // false if there is none, or the file changed after it was made
+    bool load (std::string audio);
+    // channel c of [from, to) in columns buckets
+    void render (uint64_t from, uint64_t to, int c, int columns, PeakBucket * out);
+} ;
+
+/*  Makes the pyramid as the audio goes by, a block at a time, for the
+ *  recorder's tap threads; each level only ever appends.
+ */
+class PeakBuilder {
+    Peaks peaks ;
+    // the buckets still filling, one a level and channel
+    std::vector <float> low, high ;
+    std::vector <double> squares ;
+    // children so far of each bucket still filling, and the frames under it
+    std::vector <uint64_t> count, frames ;
+
+    void push (int level, const float * low, const float * high, const double * squares, uint64_t n, bool up);
+    void close (int level, bool up = true);
+
+public:
+    PeakBuilder (int channels, int sampleRate);
+    // interleaved frames
+    void add (const float * data, int frames);
+    // the last partial buckets, and the file
+    bool save (std::string audio);
+} ;
+
+// from the scanner's thread, once audio has its peaks
+typedef void (* PeaksReady) (std::string audio, bool ok, void * data);
+
+/*  Builds peaks for files that have none, recordings from before and
+ *  audio files loaded into plugins, one at a time at idle priority.
+ */
+class PeakScanner {
+    std::deque <std::string> todo ;
+    std::mutex lock ;
+    std::condition_variable ready ;
+    std::thread worker ;
+    std::atomic <bool> done { false };
+    PeaksReady callback = nullptr ;
+    void * callbackData = nullptr ;
+
+    void work ();
+
+public:
+    PeakScanner ();
+    ~PeakScanner ();
+
+    // scans only if the peaks are missing or stale, the watcher hears either way
+    void request (std::string audio);
+    void watch (PeaksReady f, void * data);
+    // reads the whole file; false if it cannot
+    static bool scan (std::string audio);
+} ;
+
+#endif
@@ -97,18 +97,19 @@ void PluginUI::remove ()  {
   printf ("delete\n\n");
 }
 
-void PluginUI::load_preset (std::string controls) {
+// move the sliders to whatever the engine has, e.g. after a preset was
+// applied. sliders were built for every non atom control, in order
+void PluginUI::sync () {
     IN
-    //~ LOGV (controls.c_str ());
     int i = 0 ;
-    std::string c ;
-    std::istringstream str = std::istringstream(controls);
-    
-    while (std::getline(str, c, ';') && i < sliders.size ()) {
-        float f = atof(c.c_str());
-        //~ LOGD ("[%d] (%s) %f\n", i, c.c_str (), f);
-        GtkScale * scale = (GtkScale *)sliders.at (i);
-        gtk_range_set_value ((GtkRange *) scale, f);
+    for (PluginControl * control: plugin->pluginControls) {
+        if (control->type == PluginControl::Type::ATOM)
+            continue ;
+        if (i >= sliders.size ())
+            break ;
+
+        if (control->def != nullptr)
+            gtk_range_set_value ((GtkRange *) sliders.at (i), * control->def);
         i ++;
     }
     
@@ -233,6 +234,13 @@ PluginUI::PluginUI (Engine * _engine, Plugin * _plugin, GtkBox * _parent, std::s
     
     auto n = std::string ("<big><b>").append (pluginName).append ("</b></big>");
     gtk_label_set_markup (name, n.c_str ());
+    // what the warm-up measured, for plugins that had one
+    if (plugin != nullptr && plugin -> warmupPeriods > 0) {
+        char load [128];
+        snprintf (load, sizeof (load), "%.1f%% of a period, %.0f us a run, %.0f us the first time",
+            plugin -> dspLoad * 100, plugin -> runCost, plugin -> firstRunCost);
+        gtk_widget_set_tooltip_text ((GtkWidget *) name, load);
+    }
     free (s);
     card =  (GtkBox *)gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
     card_ = (GtkWidget *)card ;
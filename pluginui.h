@@ -71,7 +71,7 @@ public:
     PluginFileType * pType ;
     std::vector <GtkScale *> sliders ;
   
-    void load_preset (std::string);
+    void sync ();
     int get_index ();
     GtkSpinButton * id ;
   
@@ -0,0 +1,434 @@
+#include "portcache.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <fstream>
+
+/*  file layout (native endian):
+ *
+ *  header:  char magic [4], u32 version, u32 count
+ *  entry:   u32 size (of the whole entry), i64 mtime, str uri, u32 nports
+ *  port:    u32 index, u32 flags, f32 min, f32 max, f32 def,
+ *           i32 minimumSize, str name, str symbol, str unit,
+ *           u32 nscale, { f32 value, str label } * nscale
+ *  str:     u32 length, bytes (no terminator)
+ */
+
+static void put (std::string & out, const void * data, size_t size) {
+    out.append ((const char *) data, size);
+}
+
+static void put_u32 (std::string & out, uint32_t v) { put (out, &v, sizeof (v)); }
+static void put_f32 (std::string & out, float v) { put (out, &v, sizeof (v)); }
+
+static void put_str (std::string & out, const std::string & s) {
+    put_u32 (out, s.size ());
+    out.append (s);
+}
+
+typedef struct {
+    const char * p ;
+    const char * end ;
+    bool ok ;
+} Reader ;
+
+static bool read_bytes (Reader * r, void * data, size_t size) {
+    if (! r->ok || r->p + size > r->end) {
+        r->ok = false ;
+        return false ;
+    }
+
+    memcpy (data, r->p, size);
+    r->p += size ;
+    return true ;
+}
+
+static uint32_t get_u32 (Reader * r) { uint32_t v = 0 ; read_bytes (r, &v, sizeof (v)); return v ; }
+static float get_f32 (Reader * r) { float v = 0 ; read_bytes (r, &v, sizeof (v)); return v ; }
+
+static std::string get_str (Reader * r) {
+    uint32_t len = get_u32 (r);
+    if (! r->ok || r->p + len > r->end) {
+        r->ok = false ;
+        return std::string ();
+    }
+
+    std::string s (r->p, len);
+    r->p += len ;
+    return s ;
+}
+
+static void encode (std::string & out, const PortCacheEntry * entry) {
+    std::string body ;
+    put (body, &entry->mtime, sizeof (entry->mtime));
+    put_str (body, entry->uri);
+    put_u32 (body, entry->ports.size ());
+    for (const PortInfo & port: entry->ports) {
+        put_u32 (body, port.index);
+        put_u32 (body, port.flags);
+        put_f32 (body, port.min);
+        put_f32 (body, port.max);
+        put_f32 (body, port.def);
+        put (body, &port.minimumSize, sizeof (port.minimumSize));
+        put_str (body, port.name);
+        put_str (body, port.symbol);
+        put_str (body, port.unit);
+        put_u32 (body, port.scalePoints.size ());
+        for (auto & sp: port.scalePoints) {
+            put_f32 (body, sp.first);
+            put_str (body, sp.second);
+        }
+    }
+
+    put_u32 (out, body.size () + sizeof (uint32_t));
+    out.append (body);
+}
+
+PortCache::PortCache (LilvWorld * _world, std::string _filename) {
+    IN
+    world = _world ;
+    filename = _filename ;
+
+    lv2_InputPort          = lilv_new_uri (world, LV2_CORE__InputPort);
+    lv2_OutputPort         = lilv_new_uri (world, LV2_CORE__OutputPort);
+    lv2_AudioPort          = lilv_new_uri (world, LV2_CORE__AudioPort);
+    lv2_ControlPort        = lilv_new_uri (world, LV2_CORE__ControlPort);
+    lv2_CVPort             = lilv_new_uri (world, LV2_CORE__CVPort);
+    lv2_AtomPort           = lilv_new_uri (world, LV2_ATOM__AtomPort);
+    lv2_reportsLatency     = lilv_new_uri (world, LV2_CORE__reportsLatency);
+    lv2_toggled            = lilv_new_uri (world, LV2_CORE__toggled);
+    lv2_integer            = lilv_new_uri (world, LV2_CORE__integer);
+    lv2_enumeration        = lilv_new_uri (world, LV2_CORE__enumeration);
+    lv2_connectionOptional = lilv_new_uri (world, LV2_CORE__connectionOptional);
+    pprops_logarithmic     = lilv_new_uri (world, "http://lv2plug.in/ns/ext/port-props#logarithmic");
+    units_unit             = lilv_new_uri (world, "http://lv2plug.in/ns/extensions/units#unit");
+    rsz_minimumSize        = lilv_new_uri (world, "http://lv2plug.in/ns/ext/resize-port#minimumSize");
+
+    map ();
+    OUT
+}
+
+PortCache::~PortCache () {
+    if (dirty)
+        save ();
+    unmap ();
+
+    for (LilvNode * node: { lv2_InputPort, lv2_OutputPort, lv2_AudioPort,
+                            lv2_ControlPort, lv2_CVPort, lv2_AtomPort,
+                            lv2_reportsLatency, lv2_toggled, lv2_integer,
+                            lv2_enumeration, lv2_connectionOptional,
+                            pprops_logarithmic, units_unit, rsz_minimumSize })
+        lilv_node_free (node);
+}
+
+// map the cache file and index entries by uri. entries themselves
+// are decoded on first use
+void PortCache::map () {
+    offsets.clear ();
+    if (filename.empty () || ! std::filesystem::exists (filename))
+        return ;
+
+# ifdef __linux__
+    int fd = open (filename.c_str (), O_RDONLY);
+    if (fd == -1) {
+        LOGE ("[portcache] cannot open %s\n", filename.c_str ());
+        return ;
+    }
+
+    struct stat st ;
+    if (fstat (fd, &st) == 0 && st.st_size > 0) {
+        void * p = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            mapped = (char *) p ;
+            mapped_size = st.st_size ;
+        }
+    }
+
+    close (fd);
+# else
+    std::ifstream in (filename, std::ios::binary | std::ios::ate);
+    std::streamoff size = in.tellg ();
+    if (in.is_open () && size > 0) {
+        mapped = (char *) malloc (size);
+        in.seekg (0);
+        in.read (mapped, size);
+        mapped_size = size ;
+    }
+# endif
+
+    if (mapped == nullptr)
+        return ;
+
+    Reader r = { mapped, mapped + mapped_size, true };
+    char magic [4] ;
+    read_bytes (&r, magic, 4);
+    uint32_t version = get_u32 (&r);
+    uint32_t count = get_u32 (&r);
+    if (! r.ok || memcmp (magic, PORTCACHE_MAGIC, 4) || version != PORTCACHE_VERSION) {
+        LOGD ("[portcache] %s is stale, ignoring\n", filename.c_str ());
+        unmap ();
+        return ;
+    }
+
+    for (uint32_t i = 0 ; i < count && r.ok ; i ++) {
+        size_t offset = r.p - mapped ;
+        uint32_t size = get_u32 (&r);
+        int64_t mtime ;
+        read_bytes (&r, &mtime, sizeof (mtime));
+        std::string uri = get_str (&r);
+        if (! r.ok || size < sizeof (uint32_t) || offset + size > mapped_size)
+            break ;
+
+        offsets [uri] = offset ;
+        r.p = mapped + offset + size ;
+    }
+
+    LOGD ("[portcache] %s: %d plugins\n", filename.c_str (), (int) offsets.size ());
+}
+
+void PortCache::unmap () {
+    if (mapped == nullptr)
+        return ;
+
+# ifdef __linux__
+    munmap (mapped, mapped_size);
+# else
+    free (mapped);
+# endif
+    mapped = nullptr ;
+    mapped_size = 0 ;
+}
+
+bool PortCache::decode (size_t offset, PortCacheEntry * entry) {
+    Reader r = { mapped + offset, mapped + mapped_size, true };
+    uint32_t size = get_u32 (&r);
+    r.end = mapped + offset + size ;
+
+    read_bytes (&r, &entry->mtime, sizeof (entry->mtime));
+    entry->uri = get_str (&r);
+    uint32_t nports = get_u32 (&r);
+    if (! r.ok)
+        return false ;
+
+    entry->ports.resize (nports);
+    for (PortInfo & port: entry->ports) {
+        port.index = get_u32 (&r);
+        port.flags = get_u32 (&r);
+        port.min = get_f32 (&r);
+        port.max = get_f32 (&r);
+        port.def = get_f32 (&r);
+        read_bytes (&r, &port.minimumSize, sizeof (port.minimumSize));
+        port.name = get_str (&r);
+        port.symbol = get_str (&r);
+        port.unit = get_str (&r);
+        uint32_t nscale = get_u32 (&r);
+        if (! r.ok)
+            return false ;
+
+        port.scalePoints.resize (nscale);
+        for (auto & sp: port.scalePoints) {
+            sp.first = get_f32 (&r);
+            sp.second = get_str (&r);
+        }
+    }
+
+    return r.ok ;
+}
+
+// the only place that touches RDF
+void PortCache::build (const LilvPlugin * plugin, PortCacheEntry * entry) {
+    IN
+    const uint32_t n_ports = lilv_plugin_get_num_ports (plugin);
+    std::vector <float> min_values (n_ports), max_values (n_ports), def_values (n_ports);
+    lilv_plugin_get_port_ranges_float (plugin, min_values.data (), max_values.data (), def_values.data ());
+
+    entry->ports.clear ();
+    entry->ports.resize (n_ports);
+    for (uint32_t i = 0 ; i < n_ports ; i ++) {
+        const LilvPort * port = lilv_plugin_get_port_by_index (plugin, i);
+        PortInfo & info = entry->ports [i] ;
+        info.index = i ;
+        info.flags = 0 ;
+        info.min = min_values [i] ;
+        info.max = max_values [i] ;
+        info.def = def_values [i] ;
+        info.minimumSize = 0 ;
+
+        if (lilv_port_is_a (plugin, port, lv2_InputPort))    info.flags |= PortInfo::INPUT ;
+        if (lilv_port_is_a (plugin, port, lv2_OutputPort))   info.flags |= PortInfo::OUTPUT ;
+        if (lilv_port_is_a (plugin, port, lv2_AudioPort))    info.flags |= PortInfo::AUDIO ;
+        if (lilv_port_is_a (plugin, port, lv2_ControlPort))  info.flags |= PortInfo::CONTROL ;
+        if (lilv_port_is_a (plugin, port, lv2_CVPort))       info.flags |= PortInfo::CV ;
+        if (lilv_port_is_a (plugin, port, lv2_AtomPort))     info.flags |= PortInfo::ATOM ;
+        if (lilv_port_has_property (plugin, port, lv2_reportsLatency))     info.flags |= PortInfo::LATENCY ;
+        if (lilv_port_has_property (plugin, port, lv2_toggled))            info.flags |= PortInfo::TOGGLED ;
+        if (lilv_port_has_property (plugin, port, lv2_integer))            info.flags |= PortInfo::INTEGER ;
+        if (lilv_port_has_property (plugin, port, lv2_enumeration))        info.flags |= PortInfo::ENUMERATION ;
+        if (lilv_port_has_property (plugin, port, lv2_connectionOptional)) info.flags |= PortInfo::OPTIONAL ;
+        if (lilv_port_has_property (plugin, port, pprops_logarithmic))     info.flags |= PortInfo::LOGARITHMIC ;
+
+        LilvNode * name = lilv_port_get_name (plugin, port);
+        info.name = name ? lilv_node_as_string (name) : "" ;
+        lilv_node_free (name);
+
+        const LilvNode * symbol = lilv_port_get_symbol (plugin, port);
+        info.symbol = symbol ? lilv_node_as_string (symbol) : "" ;
+
+        LilvNode * unit = lilv_port_get (plugin, port, units_unit);
+        info.unit = unit ? lilv_node_as_string (unit) : "" ;
+        lilv_node_free (unit);
+
+        LilvNode * minimumSize = lilv_port_get (plugin, port, rsz_minimumSize);
+        if (minimumSize && lilv_node_is_int (minimumSize))
+            info.minimumSize = lilv_node_as_int (minimumSize);
+        lilv_node_free (minimumSize);
+
+        info.scalePoints.clear ();
+        LilvScalePoints * points = lilv_port_get_scale_points (plugin, port);
+        if (points) {
+            LILV_FOREACH (scale_points, it, points) {
+                const LilvScalePoint * sp = lilv_scale_points_get (points, it);
+                info.scalePoints.push_back ({
+                    lilv_node_as_float (lilv_scale_point_get_value (sp)),
+                    lilv_node_as_string (lilv_scale_point_get_label (sp))
+                });
+            }
+
+            lilv_scale_points_free (points);
+        }
+    }
+
+    OUT
+}
+
+const PortCacheEntry * PortCache::get (const LilvPlugin * plugin) {
+    if (plugin == nullptr)
+        return nullptr ;
+
+    std::string uri = lilv_node_as_uri (lilv_plugin_get_uri (plugin));
+    int64_t mtime = this -> mtime (plugin);
+
+    auto it = entries.find (uri);
+    if (it != entries.end () && it->second.mtime == mtime)
+        return & it->second ;
+
+    PortCacheEntry & entry = entries [uri] ;
+    auto off = offsets.find (uri);
+    if (off != offsets.end () && decode (off->second, &entry) && entry.mtime == mtime) {
+        LOGD ("[portcache] hit: %s\n", uri.c_str ());
+        return & entry ;
+    }
+
+    LOGD ("[portcache] miss: %s\n", uri.c_str ());
+    entry.uri = uri ;
+    entry.mtime = mtime ;
+    build (plugin, &entry);
+    // written once for the lot, see flush ()
+    dirty = true ;
+    return & entry ;
+}
+
+void PortCache::flush () {
+    if (dirty)
+        save ();
+}
+
+void PortCache::rescan () {
+    bundles.clear ();
+}
+
+int64_t PortCache::mtime (const LilvPlugin * plugin) {
+    std::string bundle = lilv_node_as_uri (lilv_plugin_get_bundle_uri (plugin));
+    auto it = bundles.find (bundle);
+    if (it != bundles.end ())
+        return it->second ;
+
+    int64_t t = bundle_mtime (plugin);
+    bundles [bundle] = t ;
+    return t ;
+}
+
+// write every known entry back out. entries we have not decoded are copied
+// straight from the mapping
+bool PortCache::save () {
+    if (filename.empty ())
+        return false ;
+
+    std::string out ;
+    put (out, PORTCACHE_MAGIC, 4);
+    put_u32 (out, PORTCACHE_VERSION);
+    put_u32 (out, 0);
+
+    uint32_t count = 0 ;
+    for (auto & e: entries) {
+        encode (out, &e.second);
+        count ++ ;
+    }
+
+    for (auto & o: offsets) {
+        if (entries.find (o.first) != entries.end ())
+            continue ;
+
+        uint32_t size ;
+        memcpy (&size, mapped + o.second, sizeof (size));
+        out.append (mapped + o.second, size);
+        count ++ ;
+    }
+
+    memcpy (& out [8], &count, sizeof (count));
+
+    // write to a temp file and rename, the old file may still be mapped
+    std::string tmp = filename + ".tmp" ;
+    std::ofstream file (tmp, std::ios::binary | std::ios::trunc);
+    if (! file.is_open ()) {
+        LOGE ("[portcache] cannot write %s\n", tmp.c_str ());
+        return false ;
+    }
+
+    file.write (out.data (), out.size ());
+    file.close ();
+
+    std::error_code ec ;
+    std::filesystem::rename (tmp, filename, ec);
+    if (ec) {
+        LOGE ("[portcache] cannot rename %s: %s\n", tmp.c_str (), ec.message ().c_str ());
+        return false ;
+    }
+
+    dirty = false ;
+    return true ;
+}
+
+// newest mtime of the bundle directory and the turtle files directly in it
+int64_t PortCache::bundle_mtime (const char * dir) {
+    std::error_code ec ;
+    int64_t mtime = std::filesystem::last_write_time (dir, ec).time_since_epoch ().count ();
+    if (ec)
+        return 0 ;
+
+    for (auto & f: std::filesystem::directory_iterator (dir, ec)) {
+        if (f.path ().extension () != ".ttl")
+            continue ;
+
+        int64_t t = f.last_write_time (ec).time_since_epoch ().count ();
+        if (! ec && t > mtime)
+            mtime = t ;
+    }
+
+    return mtime ;
+}
+
+int64_t PortCache::bundle_mtime (const LilvPlugin * plugin) {
+    const LilvNode * bundle = lilv_plugin_get_bundle_uri (plugin);
+    char * dir = lilv_file_uri_parse (lilv_node_as_uri (bundle), nullptr);
+    if (dir == nullptr)
+        return 0 ;
+
+    int64_t mtime = bundle_mtime (dir);
+    lilv_free (dir);
+    return mtime ;
+}
@@ -0,0 +1,100 @@
+#ifndef PORTCACHE_H
+#define PORTCACHE_H
+
+#include <lilv/lilv.h>
+#include <lv2/core/lv2.h>
+#include <lv2/atom/atom.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+
+#include "log.h"
+
+/*  Compiled port metadata.
+ *
+ *  Everything Plugin needs to wire up a lilv instance (port kinds, ranges,
+ *  names, units, scale points) is extracted from RDF once and kept in a
+ *  small binary file, keyed by plugin uri and the mtime of its bundle.
+ *  The file is memory mapped at startup and entries are only decoded
+ *  when a plugin is actually added to the rack.
+ */
+
+#define PORTCACHE_MAGIC     "APC1"
+#define PORTCACHE_VERSION   1
+
+typedef struct {
+    enum Flags {
+        INPUT       = 1 << 0,
+        OUTPUT      = 1 << 1,
+        AUDIO       = 1 << 2,
+        CONTROL     = 1 << 3,
+        ATOM        = 1 << 4,
+        CV          = 1 << 5,
+        LATENCY     = 1 << 6,
+        TOGGLED     = 1 << 7,
+        INTEGER     = 1 << 8,
+        ENUMERATION = 1 << 9,
+        LOGARITHMIC = 1 << 10,
+        OPTIONAL    = 1 << 11
+    };
+
+    uint32_t index ;
+    uint32_t flags ;
+    float min, max, def ;
+    int32_t minimumSize ;       // rsz:minimumSize for atom ports, 0 if unset
+    std::string name, symbol, unit ;
+    std::vector <std::pair <float, std::string>> scalePoints ;
+} PortInfo ;
+
+typedef struct {
+    std::string uri ;
+    int64_t mtime ;
+    std::vector <PortInfo> ports ;
+} PortCacheEntry ;
+
+class PortCache {
+    LilvWorld * world = nullptr ;
+    std::string filename ;
+
+    // mapped (or read, on windows) contents of the cache file
+    char * mapped = nullptr ;
+    size_t mapped_size = 0 ;
+    std::unordered_map <std::string, size_t> offsets ;
+
+    std::unordered_map <std::string, PortCacheEntry> entries ;
+    bool dirty = false ;
+    // bundle directory -> mtime, walked once a scan
+    std::unordered_map <std::string, int64_t> bundles ;
+
+    LilvNode * lv2_InputPort, * lv2_OutputPort, * lv2_AudioPort,
+             * lv2_ControlPort, * lv2_CVPort, * lv2_AtomPort,
+             * lv2_reportsLatency, * lv2_toggled, * lv2_integer,
+             * lv2_enumeration, * lv2_connectionOptional,
+             * pprops_logarithmic, * units_unit, * rsz_minimumSize ;
+
+    void map ();
+    void unmap ();
+    bool decode (size_t offset, PortCacheEntry * entry);
+    void build (const LilvPlugin * plugin, PortCacheEntry * entry);
+
+public:
+    PortCache (LilvWorld * _world, std::string _filename) ;
+    ~PortCache () ;
+
+    const PortCacheEntry * get (const LilvPlugin * plugin) ;
+    bool save () ;
+    // saves if anything was built since the last save
+    void flush () ;
+    // bundles may have changed, look at their mtimes again
+    void rescan () ;
+    int64_t mtime (const LilvPlugin * plugin) ;
+
+    static int64_t bundle_mtime (const char * dir) ;
+    static int64_t bundle_mtime (const LilvPlugin * plugin) ;
+} ;
+
+#endif
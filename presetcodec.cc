@@ -0,0 +1,352 @@
+#include "presetcodec.h"
+
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+
+/*  layout (little endian, whatever the host):
+ *
+ *  header:  char magic [4], u16 version, u16 nplugins, str name, str desc
+ *  plugin:  str name, str uri, u8 hasFile, [str filename, u8 filetype],
+ *           u16 nvalues, { sym symbol, u32 float bits } * nvalues,
+ *           u32 state size, state bytes
+ *  str:     u16 length, bytes
+ *  sym:     u8 length, bytes
+ */
+
+static void put_u8 (std::string & out, uint8_t v) {
+    out.push_back ((char) v);
+}
+
+static void put_u16 (std::string & out, uint16_t v) {
+    put_u8 (out, v & 0xFF);
+    put_u8 (out, v >> 8);
+}
+
+static void put_u32 (std::string & out, uint32_t v) {
+    put_u16 (out, v & 0xFFFF);
+    put_u16 (out, v >> 16);
+}
+
+static void put_str (std::string & out, const std::string & s) {
+    size_t len = std::min <size_t> (s.size (), 0xFFFF);
+    put_u16 (out, len);
+    out.append (s, 0, len);
+}
+
+typedef struct {
+    const unsigned char * p ;
+    const unsigned char * end ;
+    bool ok ;
+} Reader ;
+
+static bool has (Reader * r, size_t n) {
+    if (r->ok && (size_t) (r->end - r->p) >= n)
+        return true ;
+    r->ok = false ;
+    return false ;
+}
+
+static uint8_t get_u8 (Reader * r) {
+    return has (r, 1) ? * r->p ++ : 0 ;
+}
+
+static uint16_t get_u16 (Reader * r) {
+    if (! has (r, 2))
+        return 0 ;
+    uint16_t v = r->p [0] | (r->p [1] << 8);
+    r->p += 2 ;
+    return v ;
+}
+
+static uint32_t get_u32 (Reader * r) {
+    uint32_t lo = get_u16 (r);
+    return lo | ((uint32_t) get_u16 (r) << 16);
+}
+
+static void get_bytes (Reader * r, std::string * s, size_t len) {
+    if (! has (r, len))
+        return ;
+    s->assign ((const char *) r->p, len);
+    r->p += len ;
+}
+
+static uint32_t float_bits (float f) {
+    uint32_t bits ;
+    memcpy (&bits, &f, sizeof (bits));
+    return bits ;
+}
+
+static float bits_float (uint32_t bits) {
+    float f ;
+    memcpy (&f, &bits, sizeof (f));
+    return f ;
+}
+
+std::string PresetCodec::encode (const DecodedPreset & preset) {
+    std::string out ;
+    out.append (PRESETCODEC_MAGIC, 4);
+    put_u16 (out, PRESETCODEC_VERSION);
+    put_u16 (out, preset.plugins.size ());
+    put_str (out, preset.name);
+    put_str (out, preset.desc);
+
+    for (const PresetPlugin & p: preset.plugins) {
+        put_str (out, p.name);
+        put_str (out, p.uri);
+        put_u8 (out, p.hasFile);
+        if (p.hasFile) {
+            put_str (out, p.filename);
+            put_u8 (out, p.filetype);
+        }
+
+        put_u16 (out, p.values.size ());
+        for (const PresetValue & v: p.values) {
+            size_t len = std::min <size_t> (v.symbol.size (), 0xFF);
+            put_u8 (out, len);
+            out.append (v.symbol, 0, len);
+            put_u32 (out, float_bits (v.value));
+        }
+
+        put_u32 (out, p.state.size ());
+        out.append (p.state);
+    }
+
+    return out ;
+}
+
+bool PresetCodec::isBinary (const char * data, size_t size) {
+    return size >= 4 && ! memcmp (data, PRESETCODEC_MAGIC, 4);
+}
+
+bool PresetCodec::decode (const char * data, size_t size, DecodedPreset * preset) {
+    if (! isBinary (data, size))
+        return false ;
+
+    Reader r = { (const unsigned char *) data + 4, (const unsigned char *) data + size, true };
+    uint16_t version = get_u16 (&r);
+    if (version > PRESETCODEC_VERSION) {
+        LOGE ("[preset] version %d is newer than we understand\n", version);
+        return false ;
+    }
+
+    uint16_t nplugins = get_u16 (&r);
+    get_bytes (&r, &preset->name, get_u16 (&r));
+    get_bytes (&r, &preset->desc, get_u16 (&r));
+
+    preset->plugins.clear ();
+    preset->plugins.resize (nplugins);
+    for (PresetPlugin & p: preset->plugins) {
+        get_bytes (&r, &p.name, get_u16 (&r));
+        get_bytes (&r, &p.uri, get_u16 (&r));
+        p.hasFile = get_u8 (&r);
+        if (p.hasFile) {
+            get_bytes (&r, &p.filename, get_u16 (&r));
+            p.filetype = get_u8 (&r);
+        }
+
+        uint16_t nvalues = get_u16 (&r);
+        if (! has (&r, nvalues * 5))
+            return false ;
+
+        p.values.resize (nvalues);
+        for (PresetValue & v: p.values) {
+            get_bytes (&r, &v.symbol, get_u8 (&r));
+            v.value = bits_float (get_u32 (&r));
+        }
+
+        get_bytes (&r, &p.state, get_u32 (&r));
+        if (! r.ok)
+            return false ;
+    }
+
+    return r.ok ;
+}
+
+bool PresetCodec::load (const std::string & filename, DecodedPreset * preset) {
+    std::ifstream in (filename, std::ios::binary);
+    if (! in.is_open ())
+        return false ;
+
+    std::stringstream buffer ;
+    buffer << in.rdbuf ();
+    std::string data = buffer.str ();
+    return decode (data.data (), data.size (), preset);
+}
+
+bool PresetCodec::save (const std::string & filename, const DecodedPreset & preset) {
+    std::string data = encode (preset);
+    std::string tmp = filename + ".tmp" ;
+    std::ofstream out (tmp, std::ios::binary | std::ios::trunc);
+    if (! out.is_open ()) {
+        LOGE ("[preset] cannot write %s\n", tmp.c_str ());
+        return false ;
+    }
+
+    out.write (data.data (), data.size ());
+    out.close ();
+
+    std::error_code ec ;
+    std::filesystem::rename (tmp, filename, ec);
+    return ! ec ;
+}
+
+/*  old presets keep plugins under "0", "1", ... and their controls as
+ *  one ";" joined string; newer ones also carry "symbols". Keys are
+ *  walked in numeric order, so "10" no longer sorts before "2".
+ */
+bool PresetCodec::fromJson (json & j, DecodedPreset * preset) {
+    if (! j.is_object ())
+        return false ;
+
+    preset->name = j.contains ("name") && j ["name"].is_string () ? j ["name"].get <std::string> () : "" ;
+    preset->desc = j.contains ("desc") && j ["desc"].is_string () ? j ["desc"].get <std::string> () : "" ;
+    preset->plugins.clear ();
+    if (! j.contains ("controls") || ! j ["controls"].is_object ())
+        return true ;
+
+    std::map <int, json *> ordered ;
+    for (auto & p: j ["controls"].items ())
+        ordered [atoi (p.key ().c_str ())] = & p.value ();
+
+    for (auto & o: ordered) {
+        json & p = * o.second ;
+        if (! p.is_object () || ! p.contains ("name") || ! p ["name"].is_string ())
+            continue ;
+
+        PresetPlugin plugin ;
+        plugin.name = p ["name"].get <std::string> ();
+        plugin.uri = p.contains ("uri") && p ["uri"].is_string () ? p ["uri"].get <std::string> () : "" ;
+        if (p.contains ("filename") && p ["filename"].is_string ()) {
+            plugin.hasFile = true ;
+            plugin.filename = p ["filename"].get <std::string> ();
+            plugin.filetype = p.contains ("filetype") && p ["filetype"].is_number () ? p ["filetype"].get <int> () : 0 ;
+        }
+
+        if (p.contains ("symbols") && p ["symbols"].is_array ()) {
+            for (auto & s: p ["symbols"]) {
+                if (! s.is_array () || s.size () != 2 || ! s [0].is_string () || ! s [1].is_number ())
+                    continue ;
+                plugin.values.push_back ({ s [0].get <std::string> (), s [1].get <float> () });
+            }
+        } else if (p.contains ("controls") && p ["controls"].is_string ()) {
+            const std::string & controls = p ["controls"].get_ref <const std::string &> ();
+            const char * s = controls.c_str ();
+            while (* s) {
+                char * end ;
+                float f = strtof (s, &end);
+                if (end == s)
+                    break ;
+                plugin.values.push_back ({ std::string (), f });
+                s = * end == ';' ? end + 1 : end ;
+            }
+        }
+
+        preset->plugins.push_back (std::move (plugin));
+    }
+
+    return true ;
+}
+
+// the old positional string is kept so older builds can still read it
+json PresetCodec::toJson (const DecodedPreset & preset) {
+    json j = {};
+    json plugins = {};
+    for (size_t i = 0 ; i < preset.plugins.size () ; i ++) {
+        const PresetPlugin & plugin = preset.plugins [i] ;
+        json p = {};
+        p ["name"] = plugin.name ;
+        if (! plugin.uri.empty ())
+            p ["uri"] = plugin.uri ;
+        if (plugin.hasFile) {
+            p ["filename"] = plugin.filename ;
+            p ["filetype"] = plugin.filetype ;
+        }
+
+        std::string controls ;
+        json symbols = json::array ();
+        for (const PresetValue & v: plugin.values) {
+            controls.append (std::to_string (v.value)).append (";");
+            if (! v.symbol.empty ())
+                symbols.push_back ({ v.symbol, v.value });
+        }
+
+        p ["controls"] = controls ;
+        if (! symbols.empty ())
+            p ["symbols"] = symbols ;
+        plugins [std::to_string (i)] = p ;
+    }
+
+    j ["controls"] = plugins ;
+    if (! preset.name.empty ())
+        j ["name"] = preset.name ;
+    j ["desc"] = preset.desc ;
+    return j ;
+}
+
+// controls that hold a value, in the order the rack builds sliders for them
+bool PresetCodec::isValueControl (PluginControl * control) {
+    return control->def != nullptr &&
+        control->type != PluginControl::Type::ATOM &&
+        control->type != PluginControl::Type::LV2_ATOM_INPUT_PORT &&
+        control->type != PluginControl::Type::LV2_ATOM_OUTPUT_PORT ;
+}
+
+PresetPlugin PresetCodec::capture (Plugin * plugin) {
+    PresetPlugin p ;
+    p.name = plugin->lv2_name ;
+    if (plugin->uri != nullptr)
+        p.uri = lilv_node_as_uri (plugin->uri);
+    if (! plugin->loadedFileName.empty ()) {
+        p.hasFile = true ;
+        p.filename = plugin->loadedFileName ;
+        p.filetype = plugin->loadedFileType ;
+    }
+
+    for (PluginControl * control: plugin->pluginControls)
+        if (isValueControl (control))
+            p.values.push_back ({ control->symbol, * control->def });
+    return p ;
+}
+
+/*  match saved values to this build of the plugin: by symbol when the
+ *  preset has one, else by position among the value controls. Symbols
+ *  the plugin no longer has are dropped, ports the preset does not know
+ *  about keep their defaults.
+ */
+std::vector <PresetParam> PresetCodec::resolve (const PresetPlugin & saved, Plugin * plugin) {
+    std::vector <PresetParam> params ;
+    std::vector <int> positional ;
+    std::unordered_map <std::string, int> bySymbol ;
+
+    for (int i = 0 ; i < (int) plugin->pluginControls.size () ; i ++) {
+        PluginControl * control = plugin->pluginControls [i] ;
+        if (! isValueControl (control))
+            continue ;
+        positional.push_back (i);
+        if (! control->symbol.empty ())
+            bySymbol.emplace (control->symbol, i);
+    }
+
+    params.reserve (saved.values.size ());
+    size_t position = 0 ;
+    for (const PresetValue & v: saved.values) {
+        if (v.symbol.empty ()) {
+            if (position < positional.size ())
+                params.push_back ({ positional [position], v.value });
+            position ++ ;
+            continue ;
+        }
+
+        auto it = bySymbol.find (v.symbol);
+        if (it != bySymbol.end ())
+            params.push_back ({ it->second, v.value });
+        else
+            LOGD ("[preset] %s has no port %s\n", saved.name.c_str (), v.symbol.c_str ());
+    }
+
+    return params ;
+}
@@ -0,0 +1,74 @@
+#ifndef PRESETCODEC_H
+#define PRESETCODEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "log.h"
+#include "Plugin.h"
+#include "PluginControl.h"
+
+using json = nlohmann::json;
+
+/*  Binary presets.
+ *
+ *  Control values are keyed by LV2 port symbol and stored as their exact
+ *  float bits, so a preset survives a plugin adding, removing or
+ *  reordering ports and reads back bit for bit. Values without a symbol
+ *  (LADSPA, and presets converted from the old ";" joined strings) are
+ *  applied by position. JSON stays the export format; fromJson and toJson
+ *  convert both ways.
+ *
+ *  Decoding does not touch widgets: resolve () turns a decoded plugin into
+ *  (control index, value) pairs for Engine::applyPreset, and the rack
+ *  syncs its sliders from the engine afterwards.
+ */
+
+#define PRESETCODEC_MAGIC   "APB1"
+#define PRESETCODEC_VERSION 1
+
+typedef struct {
+    std::string symbol ;        // empty: apply by position
+    float value ;
+} PresetValue ;
+
+typedef struct {
+    std::string name, uri ;
+    bool hasFile = false ;
+    std::string filename ;
+    int filetype = 0 ;
+    std::vector <PresetValue> values ;
+    std::string state ;         // opaque plugin state, may be empty
+} PresetPlugin ;
+
+typedef struct {
+    std::string name, desc ;
+    std::vector <PresetPlugin> plugins ;
+} DecodedPreset ;
+
+typedef struct {
+    int control ;               // index into Plugin::pluginControls
+    float value ;
+} PresetParam ;
+
+class PresetCodec {
+public:
+    static std::string encode (const DecodedPreset & preset) ;
+    static bool decode (const char * data, size_t size, DecodedPreset * preset) ;
+    static bool isBinary (const char * data, size_t size) ;
+
+    static bool load (const std::string & filename, DecodedPreset * preset) ;
+    static bool save (const std::string & filename, const DecodedPreset & preset) ;
+
+    static bool fromJson (json & j, DecodedPreset * preset) ;
+    static json toJson (const DecodedPreset & preset) ;
+
+    static PresetPlugin capture (Plugin * plugin) ;
+    static std::vector <PresetParam> resolve (const PresetPlugin & saved, Plugin * plugin) ;
+    static bool isValueControl (PluginControl * control) ;
+} ;
+
+#endif
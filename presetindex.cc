@@ -0,0 +1,347 @@
+#include "presetindex.h"
+
+#include <algorithm>
+
+// a field's words score this much, a name hit beats a tag hit beats ...
+#define WEIGHT_NAME     8
+#define WEIGHT_TAG      4
+#define WEIGHT_PLUGIN   2
+#define WEIGHT_DESC     1
+
+// presets indexed per trip into the index lock
+#define INDEX_BATCH     256
+// most terms one short prefix is allowed to expand to
+#define MAX_EXPAND      4096
+#define MAX_WORDS       8
+
+static uint32_t trigram (const char * p) {
+    return ((uint32_t) (unsigned char) p [0] << 16) | ((uint32_t) (unsigned char) p [1] << 8) | (unsigned char) p [2] ;
+}
+
+static uint64_t key (int tab, int index) {
+    return ((uint64_t) (uint32_t) tab << 32) | (uint32_t) index ;
+}
+
+PresetIndex::PresetIndex () {
+    worker = new std::thread (& PresetIndex::work, this);
+}
+
+PresetIndex::~PresetIndex () {
+    {
+        std::lock_guard <std::mutex> q (queueLock);
+        running = false ;
+    }
+
+    wake.notify_all ();
+    worker -> join ();
+    delete worker ;
+}
+
+// lowercase runs of letters and digits; bytes of utf-8 sequences are
+// kept as they are so non-latin names are still searchable
+std::vector <std::string> PresetIndex::words (const std::string & text) {
+    std::vector <std::string> out ;
+    std::string word ;
+    for (unsigned char c: text) {
+        if (isalnum (c) || c >= 0x80) {
+            word.push_back (tolower (c));
+            continue ;
+        }
+
+        if (! word.empty ())
+            out.push_back (std::move (word));
+        word.clear ();
+    }
+
+    if (! word.empty ())
+        out.push_back (std::move (word));
+    return out ;
+}
+
+// levenshtein distance, or max + 1 once it is known to be more than max
+int PresetIndex::distance (const std::string & a, const std::string & b, int max) {
+    int n = a.size (), m = b.size ();
+    if (abs (n - m) > max)
+        return max + 1 ;
+
+    std::vector <int> prev (m + 1), cur (m + 1);
+    for (int j = 0 ; j <= m ; j ++)
+        prev [j] = j ;
+
+    for (int i = 1 ; i <= n ; i ++) {
+        cur [0] = i ;
+        int best = cur [0] ;
+        for (int j = 1 ; j <= m ; j ++) {
+            cur [j] = std::min ({ prev [j] + 1, cur [j - 1] + 1, prev [j - 1] + (a [i - 1] != b [j - 1]) });
+            best = std::min (best, cur [j]);
+        }
+
+        if (best > max)
+            return max + 1 ;
+        prev.swap (cur);
+    }
+
+    return std::min (prev [m], max + 1);
+}
+
+// called on the GTK thread: only copy out the text, the worker does the rest
+void PresetIndex::add (int tab, int index, json & preset) {
+    if (tab < 0 || tab >= 8 || ! preset.is_object ())
+        return ;
+
+    Pending pending ;
+    pending.tab = tab ;
+    pending.index = index ;
+    pending.generation = generation [tab] ;
+
+    auto text = [&] (json & j, const char * field, uint16_t weight) {
+        if (j.contains (field) && j [field].is_string ())
+            pending.words.push_back ({ j [field].get <std::string> (), weight });
+    };
+
+    text (preset, "name", WEIGHT_NAME);
+    text (preset, "desc", WEIGHT_DESC);
+    if (preset.contains ("tags") && preset ["tags"].is_array ())
+        for (auto & t: preset ["tags"])
+            if (t.is_string ())
+                pending.words.push_back ({ t.get <std::string> (), WEIGHT_TAG });
+    if (preset.contains ("controls") && preset ["controls"].is_object ())
+        for (auto & p: preset ["controls"])
+            if (p.is_object ())
+                text (p, "name", WEIGHT_PLUGIN);
+
+    {
+        std::lock_guard <std::mutex> q (queueLock);
+        queue.push_back (std::move (pending));
+    }
+
+    wake.notify_one ();
+}
+
+void PresetIndex::work () {
+    std::unique_lock <std::mutex> q (queueLock);
+    while (true) {
+        wake.wait (q, [this] { return ! running || ! queue.empty (); });
+        if (! running)
+            break ;
+
+        std::vector <Pending> batch ;
+        while (! queue.empty () && batch.size () < INDEX_BATCH) {
+            batch.push_back (std::move (queue.front ()));
+            queue.pop_front ();
+        }
+
+        bool idle = queue.empty ();
+        q.unlock ();
+        {
+            std::lock_guard <std::mutex> guard (lock);
+            for (Pending & p: batch)
+                index (p);
+        }
+
+        // once per burst, not once per batch
+        if (idle && updated != nullptr)
+            updated (data);
+        q.lock ();
+    }
+}
+
+uint32_t PresetIndex::term (const std::string & word) {
+    auto it = terms.find (word);
+    if (it != terms.end ())
+        return it->second ;
+
+    uint32_t id = termText.size ();
+    it = terms.emplace (word, id).first ;
+    termText.push_back (& it->first);
+    postings.emplace_back ();
+
+    for (size_t i = 0 ; i + 3 <= word.size () ; i ++) {
+        std::vector <uint32_t> & list = trigrams [trigram (word.c_str () + i)];
+        if (list.empty () || list.back () != id)
+            list.push_back (id);
+    }
+
+    return id ;
+}
+
+// under lock
+void PresetIndex::index (Pending & pending) {
+    // the tab was cleared after this was queued
+    if (pending.generation != generation [pending.tab])
+        return ;
+
+    uint64_t k = key (pending.tab, pending.index);
+    auto old = byKey.find (k);
+    if (old != byKey.end ()) {
+        docs [old->second].live = false ;
+        dead ++ ;
+    }
+
+    Doc doc ;
+    doc.tab = pending.tab ;
+    doc.index = pending.index ;
+    doc.live = true ;
+
+    // a word scores once per preset, in the best field it appears in
+    std::unordered_map <uint32_t, uint16_t> weights ;
+    for (auto & field: pending.words)
+        for (auto & w: words (field.first)) {
+            uint16_t & weight = weights [term (w)];
+            weight = std::max (weight, field.second);
+        }
+
+    uint32_t id = docs.size ();
+    doc.terms.assign (weights.begin (), weights.end ());
+    for (auto & t: doc.terms)
+        postings [t.first].push_back ({ id, t.second });
+
+    docs.push_back (std::move (doc));
+    byKey [k] = id ;
+}
+
+void PresetIndex::remove (int tab, int index) {
+    std::lock_guard <std::mutex> guard (lock);
+    auto it = byKey.find (key (tab, index));
+    if (it == byKey.end ())
+        return ;
+
+    docs [it->second].live = false ;
+    byKey.erase (it);
+    dead ++ ;
+}
+
+void PresetIndex::clearTab (int tab) {
+    if (tab < 0 || tab >= 8)
+        return ;
+
+    std::lock_guard <std::mutex> guard (lock);
+    generation [tab] ++ ;
+    for (Doc & doc: docs) {
+        if (doc.tab != tab || ! doc.live)
+            continue ;
+        doc.live = false ;
+        byKey.erase (key (doc.tab, doc.index));
+        dead ++ ;
+    }
+
+    if (dead > (int) docs.size () / 2)
+        compact ();
+}
+
+// drop dead presets and renumber the rest. Terms stay, an unused term
+// costs a few bytes and the library is usually reloaded with the same ones
+void PresetIndex::compact () {
+    std::vector <Doc> live ;
+    live.reserve (docs.size () - dead);
+    for (Doc & doc: docs)
+        if (doc.live)
+            live.push_back (std::move (doc));
+
+    docs.swap (live);
+    byKey.clear ();
+    for (auto & p: postings)
+        p.clear ();
+
+    for (uint32_t id = 0 ; id < docs.size () ; id ++) {
+        byKey [key (docs [id].tab, docs [id].index)] = id ;
+        for (auto & t: docs [id].terms)
+            postings [t.first].push_back ({ id, t.second });
+    }
+
+    LOGD ("[preset index] compacted to %d presets\n", (int) docs.size ());
+    dead = 0 ;
+}
+
+int PresetIndex::size () {
+    std::lock_guard <std::mutex> guard (lock);
+    return docs.size () - dead ;
+}
+
+/*  Every preset matching every word of query. The best ranked of them
+ *  come first in order, the rest follow in no particular order; with
+ *  ranked 0 all of them are ordered.
+ *
+ *  A word matches a term exactly (x3), as its prefix (x2) or within one
+ *  typo, two for words of seven letters or more (x1), times the weight
+ *  of the field the term came from. Typo candidates are the terms that
+ *  share at least half of the word's trigrams, so only those few are
+ *  compared letter by letter.
+ */
+std::vector <PresetHit> PresetIndex::search (const std::string & query, size_t ranked) {
+    std::vector <PresetHit> hits ;
+    std::vector <std::string> q = words (query);
+    if (q.empty ())
+        return hits ;
+    if (q.size () > MAX_WORDS)
+        q.resize (MAX_WORDS);
+
+    std::lock_guard <std::mutex> guard (lock);
+    // how many words each preset has matched so far, and its score
+    std::vector <uint8_t> matched (docs.size ());
+    std::vector <float> score (docs.size ());
+    std::vector <std::pair <uint32_t, float>> expanded ;
+
+    for (size_t w = 0 ; w < q.size () ; w ++) {
+        const std::string & word = q [w] ;
+        expanded.clear ();
+
+        int n = 0 ;
+        for (auto it = terms.lower_bound (word) ; it != terms.end () && n < MAX_EXPAND ; it ++, n ++) {
+            if (it->first.compare (0, word.size (), word) != 0)
+                break ;
+            expanded.push_back ({ it->second, it->first.size () == word.size () ? 3.0f : 2.0f });
+        }
+
+        if (word.size () >= 4) {
+            int max = word.size () >= 7 ? 2 : 1 ;
+            int ntris = word.size () - 2 ;
+            std::unordered_map <uint32_t, int> shared ;
+            for (int i = 0 ; i < ntris ; i ++) {
+                auto it = trigrams.find (trigram (word.c_str () + i));
+                if (it == trigrams.end ())
+                    continue ;
+                for (uint32_t t: it->second)
+                    shared [t] ++ ;
+            }
+
+            for (auto & s: shared) {
+                const std::string & text = * termText [s.first] ;
+                if (s.second < (ntris + 1) / 2 || text.compare (0, word.size (), word) == 0)
+                    continue ;
+                if (distance (word, text, max) <= max)
+                    expanded.push_back ({ s.first, 1.0f });
+            }
+        }
+
+        for (auto & e: expanded) {
+            for (const Posting & p: postings [e.first]) {
+                if (matched [p.doc] == w)
+                    matched [p.doc] = w + 1 ;
+                else if (matched [p.doc] != w + 1)
+                    continue ;
+                score [p.doc] += e.second * p.weight ;
+            }
+        }
+    }
+
+    for (uint32_t id = 0 ; id < docs.size () ; id ++)
+        if (matched [id] == q.size () && docs [id].live)
+            hits.push_back ({ docs [id].tab, docs [id].index, score [id] });
+
+    auto better = [] (const PresetHit & a, const PresetHit & b) {
+        if (a.score != b.score)
+            return a.score > b.score ;
+        if (a.tab != b.tab)
+            return a.tab < b.tab ;
+        return a.index < b.index ;
+    };
+
+    // ranking every hit of a one letter query is what costs, not finding them
+    if (ranked > 0 && hits.size () > ranked)
+        std::partial_sort (hits.begin (), hits.begin () + ranked, hits.end (), better);
+    else
+        std::sort (hits.begin (), hits.end (), better);
+
+    return hits ;
+}
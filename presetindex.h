@@ -0,0 +1,95 @@
+#ifndef PRESETINDEX_H
+#define PRESETINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "json.hpp"
+#include "log.h"
+
+using json = nlohmann::json;
+
+/*  Full text index over every preset the preset tabs know about.
+ *
+ *  Words from the name, tags, plugin names and description are indexed
+ *  per tab and position in that tab. Presets are handed over from the
+ *  GTK thread as they are appended and indexed on a worker thread; a
+ *  query is answered from whatever has been indexed so far.
+ *
+ *  Each query word matches a term exactly, as a prefix, or, for words of
+ *  four letters or more, within one typo (two for long words). Every
+ *  word has to match for a preset to be a hit.
+ */
+
+typedef struct {
+    int tab, index ;
+    float score ;
+} PresetHit ;
+
+typedef void (*PresetIndexCallback)(void *);
+
+class PresetIndex {
+    typedef struct {
+        uint32_t doc ;
+        uint16_t weight ;
+    } Posting ;
+
+    typedef struct {
+        int tab, index ;
+        bool live ;
+        std::vector <std::pair <uint32_t, uint16_t>> terms ;
+    } Doc ;
+
+    typedef struct {
+        int tab, index ;
+        uint32_t generation ;
+        std::vector <std::pair <std::string, uint16_t>> words ;
+    } Pending ;
+
+    std::mutex lock ;
+    std::vector <Doc> docs ;
+    std::unordered_map <uint64_t, uint32_t> byKey ;
+    int dead = 0 ;
+
+    std::map <std::string, uint32_t> terms ;
+    std::vector <const std::string *> termText ;
+    std::vector <std::vector <Posting>> postings ;
+    std::unordered_map <uint32_t, std::vector <uint32_t>> trigrams ;
+    uint32_t generation [8] = {0} ;
+
+    std::mutex queueLock ;
+    std::condition_variable wake ;
+    std::deque <Pending> queue ;
+    bool running = true ;
+    std::thread * worker = nullptr ;
+
+    void work ();
+    void index (Pending & pending);
+    uint32_t term (const std::string & word);
+    void compact ();
+
+public:
+    PresetIndexCallback updated = nullptr ;
+    void * data = nullptr ;
+
+    PresetIndex () ;
+    ~PresetIndex () ;
+
+    void add (int tab, int index, json & preset);
+    void remove (int tab, int index);
+    void clearTab (int tab);
+    std::vector <PresetHit> search (const std::string & query, size_t ranked = 0);
+    int size ();
+
+    static std::vector <std::string> words (const std::string & text);
+    static int distance (const std::string & a, const std::string & b, int max);
+} ;
+
+#endif
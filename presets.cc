@@ -1,4 +1,7 @@
 #include "presets.h"
+#include <thread>
+
+#define PRESET_LIBRARY_URL "https://amprack.in/presets.json"
 
 std::string * Presets::presets_dir ;
 
@@ -12,27 +15,18 @@ change_value (
     p->library_load () ;
 }
 
-void load_preset_cb (void * c, void * d) {
-    CB_Preset * cb = (CB_Preset *) d ;
-    //~ cb -> engine -> load_preset (cb -> j) ;    
-    cb -> rack -> load_preset (cb -> j);
-    
-}
-
+// the same button starts a refresh and cancels it
 void download_cb (void * w, void * d) {
-    ///>    TODO: 
-    //      clear box before refresh
     IN
     Presets * presets = (Presets *) d ;
-    gtk_spinner_start (presets->library_spinner);
-    std::string lJson = std::string (presets->dir).append ("/").append ("library.json") ;
-    download_file ((char *)"https://amprack.in/presets.json", lJson.c_str ());
-    gtk_spinner_stop (presets->library_spinner);
-    //~ presets->add_preset_multi (lJson, 2);
-    presets->page = 0 ;
-    presets->library_json = filename_to_json (std::string (presets->dir).append("/library.json"));
-    gtk_adjustment_set_upper (presets->adj, presets->library_json.size() / presets->page_size);
-    presets->library_load ();
+    if (presets -> refreshing)
+        presets -> library_cancel = true ;
+    // the last download is still being merged, from the file a new one
+    // would write over
+    else if (presets -> merge != nullptr)
+        LOGD ("[library] still merging, not refreshing\n");
+    else
+        presets -> refresh_library ();
     OUT
 }
 
@@ -117,38 +111,110 @@ void menu_clicked (void * action, void * data) {
 
 void presets_next (void * a, void * d) {
     Presets * p = (Presets *) d ;
-    p -> page ++ ;
-    gtk_adjustment_set_value (p -> adj, p -> page);
-    //~ p -> library_load ();
+    // the adjustment clamps to the last page and calls change_value
+    gtk_adjustment_set_value (p -> adj, p -> page + 1);
 }
 
 void presets_prev (void * a, void * d) {
     Presets * p = (Presets *) d ;
-    p -> page -- ;
-    
-    if (p -> page < 0)
-        p -> page = 0 ;
-    
-    gtk_adjustment_set_value (p -> adj, p -> page);
+    gtk_adjustment_set_value (p -> adj, p -> page - 1);
+}
+
+// with no query and every preset shown the filter and sorter are not
+// even attached
+static gboolean preset_filter_func (gpointer item, PresetTab * tab) {
+    Presets * presets = tab -> presets ;
+    int index = atoi (gtk_string_object_get_string ((GtkStringObject *) item));
+    if (presets -> playable_only && ! presets -> availability -> playable (tab -> which, index))
+        return false ;
+    if (presets -> query.empty ())
+        return true ;
+
+    std::vector <int> & rank = presets -> rank [tab -> which] ;
+    return index < (int) rank.size () && rank [index] >= 0 ;
+}
+
+static int preset_sort_func (gconstpointer a, gconstpointer b, PresetTab * tab) {
+    std::vector <int> & rank = tab -> presets -> rank [tab -> which] ;
+    int x = atoi (gtk_string_object_get_string ((GtkStringObject *) a));
+    int y = atoi (gtk_string_object_get_string ((GtkStringObject *) b));
+    x = x < (int) rank.size () ? rank [x] : -1 ;
+    y = y < (int) rank.size () ? rank [y] : -1 ;
+    return x < y ? GTK_ORDERING_SMALLER : x > y ? GTK_ORDERING_LARGER : GTK_ORDERING_EQUAL ;
+}
+
+void preset_search_cb (GtkSearchEntry * entry, void * d) {
+    Presets * presets = (Presets *) d ;
+    presets -> search (gtk_editable_get_text ((GtkEditable *) entry), true);
+}
+
+void preset_playable_cb (GtkCheckButton * button, void * d) {
+    Presets * presets = (Presets *) d ;
+    presets -> playable_only = gtk_check_button_get_active (button);
+    presets -> update_filters (true);
+}
+
+static gboolean preset_index_updated_cb (gpointer data) {
+    Presets * presets = (Presets *) data ;
+    // presets that came in after the last search
+    if (! presets -> query.empty ())
+        presets -> search (presets -> query, false);
+    return G_SOURCE_REMOVE ;
+}
+
+// from the index's worker thread
+static void preset_index_updated (void * data) {
+    g_idle_add (preset_index_updated_cb, data);
 }
 
 void Presets::my () {
     IN
-    for (int i = 0 ; i < 4 ; i ++)
+    for (int i = 0 ; i < 4 ; i ++) {
         list_of_presets [i] = new std::vector <json>();
+        tabs [i].presets = this ;
+        tabs [i].which = i ;
+
+        // model -> filter -> sort -> (library page) -> view
+        models [i] = gtk_string_list_new (NULL);
+        filters [i] = (GtkFilter *) gtk_custom_filter_new ((GtkCustomFilterFunc) preset_filter_func, & tabs [i], NULL);
+        sorters [i] = (GtkSorter *) gtk_custom_sorter_new ((GCompareDataFunc) preset_sort_func, & tabs [i], NULL);
+        g_object_ref (models [i]);
+        filtered [i] = gtk_filter_list_model_new ((GListModel *) models [i], NULL);
+        g_object_ref (filtered [i]);
+        sorted [i] = gtk_sort_list_model_new ((GListModel *) filtered [i], NULL);
+    }
+    
+    library_page = gtk_slice_list_model_new ((GListModel *) sorted [2], 0, page_size);
+    g_object_ref (sorted [2]);
+    
+    search_index -> updated = preset_index_updated ;
+    search_index -> data = this ;
+    availability = new PresetAvailability (& engine -> catalog);
     
     presets = (GtkNotebook *) gtk_notebook_new ();
-    gtk_notebook_append_page (notebook, (GtkWidget *)presets, gtk_label_new ("Presets"));
+    gtk_widget_set_vexpand ((GtkWidget *) presets, true);
+    
+    GtkBox * search_box = (GtkBox *) gtk_box_new (GTK_ORIENTATION_VERTICAL, 10);
+    GtkWidget * search_entry = gtk_search_entry_new ();
+    g_object_set (search_entry, "placeholder-text", "Search presets, plugins, tags", NULL);
+    g_signal_connect (search_entry, "search-changed", (GCallback) preset_search_cb, this);
+    gtk_widget_set_hexpand (search_entry, true);
+    
+    GtkWidget * playable = gtk_check_button_new_with_label ("Playable only");
+    gtk_widget_set_tooltip_text (playable, "Hide presets that need plugins that are not installed");
+    g_signal_connect (playable, "toggled", (GCallback) preset_playable_cb, this);
+    
+    GtkBox * search_bar = (GtkBox *) gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10);
+    gtk_box_append (search_bar, search_entry);
+    gtk_box_append (search_bar, playable);
+    gtk_box_append (search_box, (GtkWidget *) search_bar);
+    gtk_box_append (search_box, (GtkWidget *) presets);
+    gtk_notebook_append_page (notebook, (GtkWidget *) search_box, gtk_label_new ("Presets"));
     
     my_presets = (GtkBox *) gtk_box_new (GTK_ORIENTATION_VERTICAL, 10) ;
-    quick = (GtkBox *) gtk_box_new (GTK_ORIENTATION_VERTICAL, 10) ;
-    library = (GtkBox *) gtk_box_new (GTK_ORIENTATION_VERTICAL, 10) ;
-    favorites = (GtkBox *) gtk_box_new (GTK_ORIENTATION_VERTICAL, 10) ;
-
     gtk_widget_set_name ((GtkWidget *)my_presets, "rack");
-    gtk_widget_set_name ((GtkWidget *)quick, "rack");
-    gtk_widget_set_name ((GtkWidget *)library, "rack");
-    gtk_widget_set_name ((GtkWidget *)favorites, "rack");
+    for (int i = 0 ; i < 4 ; i ++)
+        views [i] = create_view (i);
     
     GtkLabel * l1 = (GtkLabel * ) gtk_label_new ("User");
     GtkLabel * l2 = (GtkLabel * ) gtk_label_new ("Factory");
@@ -159,9 +225,9 @@ void Presets::my () {
         * sw_l = (GtkScrolledWindow *) gtk_scrolled_window_new (),
         * sw_f = (GtkScrolledWindow *) gtk_scrolled_window_new ();
     
-    gtk_scrolled_window_set_child (sw_q, (GtkWidget *) quick);
-    gtk_scrolled_window_set_child (sw_l, (GtkWidget *) library);
-    gtk_scrolled_window_set_child (sw_f, (GtkWidget *) favorites);
+    gtk_scrolled_window_set_child (sw_q, views [0]);
+    gtk_scrolled_window_set_child (sw_l, views [2]);
+    gtk_scrolled_window_set_child (sw_f, views [3]);
     
     GtkBox * lbox = (GtkBox * ) gtk_box_new (GTK_ORIENTATION_VERTICAL, 10);
     
@@ -208,11 +274,10 @@ void Presets::my () {
     
     gtk_menu_button_set_menu_model (menu_button, (GMenuModel *) menu);
     
-    my_presets_rack = (GtkBox *) gtk_box_new (GTK_ORIENTATION_VERTICAL, 10);
     GtkScrolledWindow * sw = (GtkScrolledWindow * )gtk_scrolled_window_new ();
     
-    //~ sw.append (my_presets_rack);
-    gtk_scrolled_window_set_child (sw, (GtkWidget *)my_presets_rack);
+    gtk_scrolled_window_set_child (sw, views [1]);
+    gtk_widget_set_vexpand ((GtkWidget *) sw, true);
     gtk_box_append (my_presets, (GtkWidget *)sw);
 
     GtkButton * load_f = (GtkButton * )gtk_button_new_with_label ("Import") ;
@@ -223,15 +288,26 @@ void Presets::my () {
     
     GtkButton * refresh = (GtkButton *) gtk_button_new_with_label ("Refresh 🔃") ;
     g_signal_connect (refresh, "clicked",(GCallback) download_cb, this);
+    refresh_button = refresh ;
+    
+    // where Refresh gets the library from, a local server will do for testing
+    library_url = PRESET_LIBRARY_URL ;
+    if (rack -> config.is_object () && rack -> config.contains ("library_url") && rack -> config ["library_url"].is_string ())
+        library_url = rack -> config ["library_url"].get <std::string> ();
+    
+    library_progress = (GtkProgressBar *) gtk_progress_bar_new ();
+    gtk_widget_set_visible ((GtkWidget *) library_progress, false);
+    gtk_widget_set_valign ((GtkWidget *) library_progress, GTK_ALIGN_CENTER);
+    library_status = (GtkLabel *) gtk_label_new ("");
     
     GtkButton * next = (GtkButton *) gtk_button_new_with_label (">") ;
     g_signal_connect (next, "clicked",(GCallback) presets_next, this);
     
     //~ pno.set_visible (false);
 
-    library_json = filename_to_json (std::string (dir).append("/library.json"));
-
-    adj = gtk_adjustment_new (1,1,library_json.size() / page_size,1,1,1);
+    // pages are numbered from 0, the upper bound is set once the library
+    // has been read
+    adj = gtk_adjustment_new (0, 0, 0, 1, 10, 0);
     GtkSpinButton * pno = (GtkSpinButton * )gtk_spin_button_new (adj, 0.1, 2);
     //~ gtk_spin_button_set_adjustment (pno.gobj (), adj);
 
@@ -265,9 +341,11 @@ void Presets::my () {
     gtk_box_append (lvBox, (GtkWidget *) next);
     gtk_box_append (lvBox, (GtkWidget *)library_spinner);
     gtk_box_append (lvBox, (GtkWidget *) pno);
+    gtk_box_append (lvBox, (GtkWidget *) library_progress);
     
     gtk_box_append (lbox, (GtkWidget *) sw_l);
     gtk_box_append (lbox, (GtkWidget *) lvBox);
+    gtk_box_append (lbox, (GtkWidget *) library_status);
     
     gtk_box_append (hbox, (GtkWidget *) add);
     gtk_box_append (hbox, (GtkWidget *) load_f);
@@ -281,149 +359,234 @@ void Presets::my () {
     //~ add.set_margin (10);
     //~ menu_button.set_margin (10);
     
-    gtk_widget_set_vexpand ((GtkWidget *)my_presets_rack, true);
-    //~ add_preset (1) ;
+    // user presets, favourites and the library are read in the
+    // background and show up as they are parsed
+    add_preset_multi (std::string ("assets/quick.json"), 0);
     load_user (false);
     load_user (true);
-    add_preset_multi (std::string ("assets/quick.json"), 0);
-    //~ add_preset_multi (std::string (dir).append("/library.json"), 2);
-    library_load ();
+    load_library ();
     OUT
 }
 
 
+// the library tab only shows one page, moving it is just a new offset
 void Presets::library_load () {
     IN
-    int x = 0 ;
-    GtkWidget *iter = gtk_widget_get_first_child ((GtkWidget *)library);
-    while (iter != NULL) {
-      GtkWidget *next = gtk_widget_get_next_sibling ((GtkWidget *)iter);
-      gtk_box_remove ((GtkBox *)library, iter);
-      iter = next;
-      x ++ ;
-    }
-    
-    //~ LOGD ("removed %d boxes\n", x);
-    
-    library_boxes.clear () ;
-    
-    int i = 0, e = 0 ; 
-    int skip = page * page_size ;
-    //~ LOGD ("library: %s\n", library_json.dump ().c_str ());
-    for (json p: library_json) {
-        if (i < skip) {
-            i++ ;
-            continue ;
+    gtk_slice_list_model_set_offset (library_page, page * page_size);
+    OUT
+}
+
+// the number of results changes the number of library pages
+void Presets::update_pages () {
+    int n = g_list_model_get_n_items ((GListModel *) sorted [2]);
+    int pages = (n + page_size - 1) / page_size ;
+    gtk_adjustment_set_upper (adj, pages > 0 ? pages - 1 : 0);
+    if (page > 0 && page >= pages)
+        gtk_adjustment_set_value (adj, pages > 0 ? pages - 1 : 0);
+}
+
+// the best ranked results come first in every tab, the rest in whatever
+// order the index found them
+#define PRESET_RANKED 200
+
+void Presets::search (std::string q, bool changed) {
+    query = q ;
+    query.erase (0, query.find_first_not_of (' '));
+    query.erase (query.find_last_not_of (' ') + 1);
+
+    if (query.empty ()) {
+        for (int i = 0 ; i < 4 ; i ++)
+            rank [i].clear ();
+    } else {
+        for (int i = 0 ; i < 4 ; i ++)
+            rank [i].assign (list_of_presets [i]->size (), -1);
+
+        std::vector <PresetHit> hits = search_index -> search (query, PRESET_RANKED);
+        for (int i = 0 ; i < (int) hits.size () ; i ++) {
+            PresetHit & hit = hits [i] ;
+            if (hit.tab < 4 && hit.index < (int) rank [hit.tab].size ())
+                rank [hit.tab][hit.index] = i ;
         }
-        
-        //~ LOGD ("[%d: %d] %d: %s\n", page, skip, e, p ["name"].dump ().c_str ());
-        e ++ ;
-        if (e > page_size)
-            break ;
-        
-        add_preset (p, 2);
     }
-    
-    //~ gtk_adjustment_set_value ((GtkAdjustment *)adj, page + 1);
-    OUT
+
+    update_filters (changed);
+}
+
+// attach, detach or rerun the filter and sorter of every tab
+void Presets::update_filters (bool changed) {
+    bool filtering = ! query.empty () || playable_only ;
+    for (int i = 0 ; i < 4 ; i ++) {
+        if (! filtering)
+            gtk_filter_list_model_set_filter (filtered [i], NULL);
+        else if (gtk_filter_list_model_get_filter (filtered [i]) == NULL)
+            gtk_filter_list_model_set_filter (filtered [i], filters [i]);
+        else
+            gtk_filter_changed (filters [i], GTK_FILTER_CHANGE_DIFFERENT);
+
+        if (query.empty ())
+            gtk_sort_list_model_set_sorter (sorted [i], NULL);
+        else if (gtk_sort_list_model_get_sorter (sorted [i]) == NULL)
+            gtk_sort_list_model_set_sorter (sorted [i], sorters [i]);
+        else
+            gtk_sorter_changed (sorters [i], GTK_SORTER_CHANGE_DIFFERENT);
+    }
+
+    update_pages ();
+    if (changed)
+        gtk_adjustment_set_value (adj, 0);
+}
+
+// the catalog has it but it would not load: every preset using it is now
+// unplayable, without looking at any of the others
+void Presets::plugin_unavailable (std::string name) {
+    plugin_loaded (name, false);
+}
+
+// a catalog plugin was just loaded, or failed to; only the presets using
+// it are looked at, and nothing is redrawn if none of them changed
+void Presets::plugin_loaded (std::string name, bool ok) {
+    if (availability -> setInstalled (name, ok) == 0)
+        return ;
+
+    refresh_rows ();
+    if (playable_only)
+        update_filters (false);
+}
+
+GListModel * Presets::view_model (int which) {
+    if (which == 2)
+        return (GListModel *) library_page ;
+    return (GListModel *) sorted [which] ;
+}
+
+int Presets::count (int which) {
+    return g_list_model_get_n_items (view_model (which));
+}
+
+// preset at position in what the tab shows, or nullptr
+json * Presets::at (int which, int position) {
+    GtkStringObject * item = (GtkStringObject *) g_list_model_get_item (view_model (which), position);
+    if (item == nullptr)
+        return nullptr ;
+
+    int index = atoi (gtk_string_object_get_string (item));
+    g_object_unref (item);
+    return & list_of_presets [which]->at (index);
+}
+
+static int preset_row_index (GtkWidget * widget) {
+    GtkWidget * row = (GtkWidget *) g_object_get_data ((GObject *) widget, "row");
+    return GPOINTER_TO_INT (g_object_get_data ((GObject *) row, "index"));
+}
+
+void load_preset_cb (void * b, void * d) {
+    PresetTab * tab = (PresetTab *) d ;
+    Presets * presets = tab -> presets ;
+    int index = preset_row_index ((GtkWidget *) b);
+    if (index < 0)
+        return ;
+
+    presets -> rack -> load_preset (presets -> list_of_presets [tab -> which]->at (index));
 }
 
 void delete_callback (void * b, void * d) {
     IN
-    GtkWidget * button = (GtkWidget *) b ;
-    Presets * presets = (Presets *) d ;
-    std::string name = std::string (gtk_widget_get_name (button));
+    PresetTab * tab = (PresetTab *) d ;
+    Presets * presets = tab -> presets ;
+    int index = preset_row_index ((GtkWidget *) b);
+    if (index < 0)
+        return ;
+
+    std::string name = presets -> list_of_presets [tab -> which]->at (index).value ("name", "");
     LOGV (name.c_str ());
-    #ifdef __linux__
-    std::string filename = std::string (presets->presets_dir->c_str());
-    #else
-    std::string filename = std::string ("");
-    if (name.find (":\\") == std::string::npos)
-        filename.append (presets->presets_dir->c_str ());
-    #endif
-    
-    filename.append (name);
-    LOGV (filename.c_str ());
-    
-    if (! std::filesystem::remove (filename)) {
-        LOGD ("[delete preset] failed: %s\n", filename.c_str ()) ;
+    if (! presets -> store -> remove (name)) {
+        LOGD ("[delete preset] failed: %s\n", name.c_str ()) ;
         return ;
     }
-    
-    GtkWidget * box = gtk_widget_get_parent (button) ;
-    gtk_box_remove ((GtkBox *)gtk_widget_get_parent (box), box);
-    
-    //~ alert_yesno (name, "Do you want to delete this preset?", null, null);
+
+    presets -> remove_preset (tab -> which, index);
     OUT
 }
 
-void preset_fav_cb (void * b, void * c) {
-    CB_Preset * cb = (CB_Preset *) c ;
+typedef struct {
+    Presets * presets ;
+    int which ;
+} RowRefresh ;
+
+static gboolean refresh_rows_cb (gpointer data) {
+    RowRefresh * r = (RowRefresh *) data ;
+    r -> presets -> refresh_rows (r -> which);
+    delete r ;
+    return G_SOURCE_REMOVE ;
+}
+
+void preset_fav_cb (void * b, void * d) {
+    PresetTab * tab = (PresetTab *) d ;
+    Presets * p = tab -> presets ;
     GtkToggleButton * t = (GtkToggleButton *) b ;
-    Presets * p = (Presets *) cb -> p ;
-    
-    if (gtk_toggle_button_get_active (t)) {
-        json_to_filename (cb -> j, cb->filename.c_str ());
-        p -> add_preset (cb ->j, 3);
+    int index = preset_row_index ((GtkWidget *) b);
+    if (index < 0)
+        return ;
+
+    json j = p -> list_of_presets [tab -> which]->at (index);
+    std::string name = j.value ("name", "");
+    bool active = gtk_toggle_button_get_active (t);
+    // binding a row sets the heart too, that is not a change
+    if (active == p -> store -> isFavourite (name))
+        return ;
+
+    if (! p -> store -> setFavourite (j, active))
+        return ;
+
+    if (active) {
+        p -> add_preset (j, 3);
     } else {
-        GtkWidget * box = gtk_widget_get_parent (gtk_widget_get_parent ((GtkWidget *) t)) ;
-        gtk_box_remove ((GtkBox *)cb -> fav_rack, box);
-        remove (cb->filename.c_str ());
+        // by model position, the view may be showing search results
+        for (int i = g_list_model_get_n_items ((GListModel *) p -> models [3]) - 1 ; i >= 0 ; i --) {
+            int index = atoi (gtk_string_list_get_string (p -> models [3], i));
+            json & f = p -> list_of_presets [3]->at (index);
+            if (f.is_object () && f.value ("name", "") == name)
+                p -> remove_preset (3, index);
+        }
+    }
+
+    // the same preset may be on screen in another tab, its heart is stale
+    // there; this tab's row has it already and favourites were just redone
+    for (int i = 0 ; i < 3 ; i ++) {
+        if (i == tab -> which)
+            continue ;
+        for (json & other: * p -> list_of_presets [i])
+            if (other.is_object () && other.value ("name", "") == name) {
+                g_idle_add (refresh_rows_cb, new RowRefresh {p, i});
+                break ;
+            }
     }
 }
 
-void Presets::add_preset (json j, int which) {
-    list_of_presets [which]->push_back (j);
-    //~ IN
-    //~ std::cout << j << std::endl;
+// rows are only built for what is on screen and recycled as the list
+// scrolls, so a tab costs the same with ten presets or ten thousand
+void preset_row_setup (GtkSignalListItemFactory * factory, GtkListItem * item, PresetTab * tab) {
     GtkBox * h = (GtkBox * )gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10) ;
-    GtkBox * h2 = (GtkBox * )gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10) ;
     GtkBox * v = (GtkBox * )gtk_box_new (GTK_ORIENTATION_VERTICAL, 10) ;
     GtkBox * v2 = (GtkBox * )gtk_box_new (GTK_ORIENTATION_VERTICAL, 10) ;
-    
-    //~ v.set_margin (10);
+
     gtk_box_append (h, (GtkWidget *) v2);
-    
-    //~ GtkSeparator * sep = Gtk::Separator ();
-    //~ sep.set_hexpand (true);
     gtk_widget_set_hexpand ((GtkWidget *)h, true);
     gtk_widget_set_hexpand ((GtkWidget *)v2, true);
-    //~ h.append (sep);
     gtk_box_append (v, (GtkWidget *) h);
-    gtk_box_append (v, (GtkWidget *) h2);
-
     gtk_widget_set_name ((GtkWidget *) v, "plugin");
-       
-    switch (which) {
-        case 0:
-            gtk_box_append (quick, (GtkWidget *) v);
-            break ;
-        case 2:
-            gtk_box_append (library, (GtkWidget *) v);            
-            library_boxes.push_back ((GtkWidget *)v);
-            break ;
-        case 1:
-            gtk_box_append (my_presets_rack, (GtkWidget *) v);            
-            break;
-        case 3:
-            gtk_box_append (favorites, (GtkWidget *) v);            
-            break;
-    }
-    
+
     GtkToggleButton * fav = (GtkToggleButton *)gtk_toggle_button_new_with_label ("♥");
-        
+
     GtkLabel * title = (GtkLabel *  )gtk_label_new ("");
     gtk_label_set_wrap (title, true);
     gtk_label_set_max_width_chars (title, 20);
-    gtk_label_set_markup (title, std::string ("<big><b>").append (j ["name"]).append ( "</b></big>").c_str ());
-    GtkLabel * desc = (GtkLabel *)gtk_label_new (j ["desc"].dump ().c_str ());
+    gtk_label_set_justify (title, GTK_JUSTIFY_LEFT);
+    GtkLabel * desc = (GtkLabel *)gtk_label_new ("");
     gtk_label_set_wrap (desc, true);
     gtk_label_set_max_width_chars (desc, 20);
-    
-    //~ title.set_hexpand (true);
-    gtk_widget_set_hexpand ((GtkWidget *) h, true);
-    gtk_label_set_justify (title, GTK_JUSTIFY_LEFT);
-    
+    gtk_label_set_natural_wrap_mode (desc, GTK_NATURAL_WRAP_WORD);
+
     GtkBox * tb = (GtkBox *) gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10);
     gtk_box_append (v2, (GtkWidget *)tb);
     GtkButton * bt = (GtkButton * )gtk_button_new ();
@@ -433,67 +596,488 @@ void Presets::add_preset (json j, int which) {
     gtk_box_append (tb, GTK_WIDGET (fav));
     gtk_widget_set_hexpand ((GtkWidget *)title, true);
     gtk_widget_set_halign ((GtkWidget *)title, GTK_ALIGN_START);
-    // todo: description
-    if (j ["desc"].dump () != std::string ("\"\"")) {
-        GtkBox * tb = (GtkBox *) gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10);
-        gtk_box_append (v2, (GtkWidget *) tb);
-        gtk_box_append (tb, (GtkWidget *) desc);
-        gtk_label_set_natural_wrap_mode (desc, GTK_NATURAL_WRAP_WORD);
-    }
-   
-    GtkButton * load = (GtkButton *) gtk_button_new_with_label ("Load");
-    GtkButton * del = (GtkButton *)gtk_button_new_with_label ("Delete");
-    std::string _name = j ["name"].dump().c_str () ;
-    _name = _name.substr (1, _name.size () - 2);
-    gtk_widget_set_name ((GtkWidget *) del, _name.c_str ());
-    
-    g_signal_connect (del, "clicked", (GCallback)delete_callback, this);
-    
-    //~ h2.append (load);
 
-    CB_Preset * cb = new CB_Preset ();
-    cb -> engine = engine ;
-    cb->filename = std::string (dir).append ("/favs/").append (_name);
-    cb -> rack = rack ;
-    cb -> j = j ;
-    cb -> fav = (GtkWidget *)fav ;
-    cb -> fav_rack = (GtkWidget *) favorites;
-    cb -> p = (void *) this ;
-    
-    if (g_file_test (cb->filename.c_str (), G_FILE_TEST_EXISTS))
-        gtk_toggle_button_set_active ((GtkToggleButton *) fav, true);
-    
-    g_signal_connect (load, "clicked", (GCallback) load_preset_cb, cb);
-    g_signal_connect (bt, "clicked", (GCallback) load_preset_cb, cb);
-    g_signal_connect (fav, "toggled", (GCallback) preset_fav_cb, cb);
+    GtkBox * db = (GtkBox *) gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10);
+    gtk_box_append (v2, (GtkWidget *) db);
+    gtk_box_append (db, (GtkWidget *) desc);
 
-    gtk_widget_set_halign ((GtkWidget *) load, GTK_ALIGN_END);
-    
-    //~ v.append (h2);
-    if (which == 1)
+    g_object_set_data ((GObject *) v, "index", GINT_TO_POINTER (-1));
+    g_object_set_data ((GObject *) v, "title", title);
+    g_object_set_data ((GObject *) v, "desc", desc);
+    g_object_set_data ((GObject *) v, "desc-box", db);
+    g_object_set_data ((GObject *) v, "fav", fav);
+    g_object_set_data ((GObject *) bt, "row", v);
+    g_object_set_data ((GObject *) fav, "row", v);
+
+    g_signal_connect (bt, "clicked", (GCallback) load_preset_cb, tab);
+    g_signal_connect (fav, "toggled", (GCallback) preset_fav_cb, tab);
+
+    if (tab -> which == 1) {
+        GtkButton * del = (GtkButton *)gtk_button_new_with_label ("Delete");
+        gtk_widget_set_halign ((GtkWidget *) del, GTK_ALIGN_CENTER);
+        g_object_set_data ((GObject *) del, "row", v);
+        g_signal_connect (del, "clicked", (GCallback) delete_callback, tab);
         gtk_box_append (v, (GtkWidget *) del);
-    //~ h2.append (fav);
-    gtk_widget_set_halign ((GtkWidget *) del, GTK_ALIGN_CENTER);
-    //~ OUT
+    }
+
+    gtk_list_item_set_child (item, (GtkWidget *) v);
+}
+
+void preset_row_bind (GtkSignalListItemFactory * factory, GtkListItem * item, PresetTab * tab) {
+    GtkWidget * v = gtk_list_item_get_child (item);
+    Presets * presets = tab -> presets ;
+    int index = atoi (gtk_string_object_get_string ((GtkStringObject *) gtk_list_item_get_item (item)));
+    json & j = presets -> list_of_presets [tab -> which]->at (index);
+    if (! j.is_object ())
+        return ;
+
+    std::string name = j.value ("name", "");
+    std::string desc = j.contains ("desc") && j ["desc"].is_string () ? j ["desc"].get <std::string> () : "" ;
+
+    // the heart has to see the new index before it is toggled
+    g_object_set_data ((GObject *) v, "index", GINT_TO_POINTER (index));
+
+    char * markup = g_markup_printf_escaped ("<big><b>%s</b></big>", name.c_str ());
+    gtk_label_set_markup ((GtkLabel *) g_object_get_data ((GObject *) v, "title"), markup);
+    g_free (markup);
+
+    gtk_label_set_text ((GtkLabel *) g_object_get_data ((GObject *) v, "desc"), desc.c_str ());
+    gtk_widget_set_visible ((GtkWidget *) g_object_get_data ((GObject *) v, "desc-box"), ! desc.empty ());
+    gtk_toggle_button_set_active ((GtkToggleButton *) g_object_get_data ((GObject *) v, "fav"), presets -> store -> isFavourite (name));
+
+    // grey out what cannot be played here and say why
+    std::vector <std::string> missing = presets -> availability -> missing (tab -> which, index);
+    gtk_widget_set_opacity (v, missing.empty () ? 1.0 : 0.5);
+    if (missing.empty ()) {
+        gtk_widget_set_tooltip_text (v, NULL);
+    } else {
+        std::string tip = "Missing plugins:" ;
+        for (auto & m: missing)
+            tip.append ("\n").append (m);
+        gtk_widget_set_tooltip_text (v, tip.c_str ());
+    }
+}
+
+GtkWidget * Presets::create_view (int which) {
+    GtkListItemFactory * factory = gtk_signal_list_item_factory_new ();
+    g_signal_connect (factory, "setup", (GCallback) preset_row_setup, & tabs [which]);
+    g_signal_connect (factory, "bind", (GCallback) preset_row_bind, & tabs [which]);
+
+    g_object_ref (view_model (which));
+    GtkWidget * view = gtk_list_view_new ((GtkSelectionModel *) gtk_no_selection_new (view_model (which)), factory);
+    gtk_widget_set_name (view, "rack");
+    gtk_widget_set_vexpand (view, true);
+    gtk_widget_set_hexpand (view, true);
+    return view ;
+}
+
+// hearts changed behind the rows' back, rebind what one tab, or every
+// tab with -1, has on screen
+void Presets::refresh_rows (int which) {
+    for (int i = 0 ; i < 4 ; i ++) {
+        if (which >= 0 && i != which)
+            continue ;
+        GtkListItemFactory * factory = gtk_list_view_get_factory ((GtkListView *) views [i]);
+        g_object_ref (factory);
+        gtk_list_view_set_factory ((GtkListView *) views [i], NULL);
+        gtk_list_view_set_factory ((GtkListView *) views [i], factory);
+        g_object_unref (factory);
+    }
+}
+
+// lay one batch of a refreshed library over the library tab
+static void merge_batch (Presets * presets, PresetBatch * batch) {
+    LibraryMerge * merge = presets -> merge ;
+    if (merge == nullptr)
+        return ;
+
+    std::vector <json> & library = * presets -> list_of_presets [2] ;
+    std::vector <json> fresh ;
+    for (json & j: batch -> list) {
+        auto it = merge -> byName.find (j.value ("name", ""));
+        if (it == merge -> byName.end () || it -> second.empty ()) {
+            fresh.push_back (std::move (j));
+            continue ;
+        }
+
+        int index = it -> second.front ();
+        it -> second.erase (it -> second.begin ());
+        merge -> seen [index] = true ;
+        if (library [index] == j)
+            continue ;
+
+        library [index] = std::move (j);
+        presets -> search_index -> add (2, index, library [index]);
+        presets -> availability -> add (2, index, library [index]);
+        merge -> changed.push_back (index);
+    }
+
+    merge -> added += fresh.size ();
+    presets -> add_presets (fresh, 2);
+    if (! batch -> done)
+        return ;
+
+    int removed = 0 ;
+    for (int i = 0 ; i < (int) merge -> seen.size () ; i ++) {
+        if (merge -> seen [i] || ! library [i].is_object ())
+            continue ;
+        presets -> remove_preset (2, i);
+        removed ++ ;
+    }
+
+    // rebind the rows of changed presets: replace each model string with
+    // itself, which is one items-changed per row
+    std::unordered_map <int, int> position ;
+    int n = g_list_model_get_n_items ((GListModel *) presets -> models [2]);
+    for (int i = 0 ; i < n ; i ++)
+        position [atoi (gtk_string_list_get_string (presets -> models [2], i))] = i ;
+    for (int index: merge -> changed) {
+        auto p = position.find (index);
+        if (p == position.end ())
+            continue ;
+        std::string s = std::to_string (index);
+        const char * strings [] = { s.c_str (), NULL };
+        gtk_string_list_splice (presets -> models [2], p -> second, 1, strings);
+    }
+
+    std::string status = std::to_string (merge -> added).append (" new, ")
+        .append (std::to_string (merge -> changed.size ())).append (" changed, ")
+        .append (std::to_string (removed)).append (" removed");
+    LOGD ("[library] %s\n", status.c_str ());
+    gtk_label_set_text (presets -> library_status, status.c_str ());
+
+    delete presets -> merge ;
+    presets -> merge = nullptr ;
+    presets -> update_pages ();
+    gtk_spinner_stop (presets -> library_spinner);
+}
+
+static gboolean preset_batch_cb (gpointer data) {
+    PresetBatch * batch = (PresetBatch *) data ;
+    Presets * presets = batch -> presets ;
+
+    // the tab was cleared and reloaded since this was read
+    if (batch -> generation != presets -> generation [batch -> which]) {
+        delete batch ;
+        return G_SOURCE_REMOVE ;
+    }
+
+    if (batch -> merge) {
+        merge_batch (presets, batch);
+        delete batch ;
+        return G_SOURCE_REMOVE ;
+    }
+
+    presets -> add_presets (batch -> list, batch -> which);
+    if (batch -> done) {
+        LOGD ("[presets] tab %d: %d presets\n", batch -> which, (int) presets -> list_of_presets [batch -> which]->size ());
+        if (batch -> which == 2) {
+            presets -> update_pages ();
+            gtk_spinner_stop (presets -> library_spinner);
+            presets -> library_load ();
+        }
+    }
+
+    delete batch ;
+    return G_SOURCE_REMOVE ;
+}
+
+void Presets::add_presets (std::vector <json> & list, int which) {
+    std::vector <std::string> index ;
+    std::vector <const char *> strings ;
+    index.reserve (list.size ());
+
+    for (json & j: list) {
+        int i = list_of_presets [which]->size ();
+        index.push_back (std::to_string (i));
+        list_of_presets [which]->push_back (std::move (j));
+        search_index -> add (which, i, list_of_presets [which]->back ());
+        availability -> add (which, i, list_of_presets [which]->back ());
+    }
+
+    for (auto & s: index)
+        strings.push_back (s.c_str ());
+    strings.push_back (NULL);
+
+    // one items-changed for the whole batch
+    int n = g_list_model_get_n_items ((GListModel *) models [which]);
+    gtk_string_list_splice (models [which], n, 0, strings.data ());
+}
+
+static gboolean add_preset_cb (gpointer data) {
+    PresetBatch * batch = (PresetBatch *) data ;
+    batch -> presets -> add_presets (batch -> list, batch -> which);
+    delete batch ;
+    return G_SOURCE_REMOVE ;
+}
+
+void Presets::add_preset (json j, int which) {
+    // the sync server imports from its own thread
+    if (! g_main_context_is_owner (g_main_context_default ())) {
+        PresetBatch * batch = new PresetBatch ();
+        batch -> presets = this ;
+        batch -> which = which ;
+        batch -> list.push_back (j);
+        g_idle_add (add_preset_cb, batch);
+        return ;
+    }
+
+    std::vector <json> list ;
+    list.push_back (j);
+    add_presets (list, which);
+}
+
+// put in the store, known if the name was there before
+void Presets::saved (json & preset, bool known) {
+    if (! known) {
+        add_preset (preset, 1);
+        return ;
+    }
+
+    replace_preset (preset, 1);
+    if (store -> isFavourite (preset.value ("name", "")))
+        replace_preset (preset, 3);
+}
+
+// saved over a name already in the tab: same slot, same place in the list
+void Presets::replace_preset (json j, int which) {
+    std::string name = j.value ("name", "");
+    for (int index = list_of_presets [which]->size () - 1 ; index >= 0 ; index --) {
+        json & old = list_of_presets [which]->at (index);
+        if (! old.is_object () || old.value ("name", "") != name)
+            continue ;
+
+        search_index -> remove (which, index);
+        availability -> remove (which, index);
+        old = j ;
+        search_index -> add (which, index, old);
+        availability -> add (which, index, old);
+
+        // splicing the same string back in rebinds the row
+        std::string s = std::to_string (index);
+        const char * strings [] = { s.c_str (), NULL };
+        int n = g_list_model_get_n_items ((GListModel *) models [which]);
+        for (int i = 0 ; i < n ; i ++)
+            if (s == gtk_string_list_get_string (models [which], i)) {
+                gtk_string_list_splice (models [which], i, 1, strings);
+                break ;
+            }
+        return ;
+    }
+
+    add_preset (j, which);
+}
+
+// the slot in list_of_presets stays, so indices in the model stay valid
+void Presets::remove_preset (int which, int index) {
+    std::string s = std::to_string (index);
+    int n = g_list_model_get_n_items ((GListModel *) models [which]);
+    for (int i = 0 ; i < n ; i ++) {
+        if (s == gtk_string_list_get_string (models [which], i)) {
+            gtk_string_list_remove (models [which], i);
+            break ;
+        }
+    }
+
+    list_of_presets [which]->at (index) = json ();
+    search_index -> remove (which, index);
+    availability -> remove (which, index);
+}
+
+void Presets::clear (int which) {
+    generation [which] ++ ;
+    if (which == 2) {
+        delete merge ;
+        merge = nullptr ;
+    }
+    search_index -> clearTab (which);
+    availability -> clearTab (which);
+    rank [which].clear ();
+
+    list_of_presets [which]->clear ();
+    int n = g_list_model_get_n_items ((GListModel *) models [which]);
+    gtk_string_list_splice (models [which], 0, n, NULL);
+}
+
+#define PRESET_BATCH 64
+
+static void post_batch (Presets * presets, int which, int generation, std::vector <json> & list, bool done, bool merge = false) {
+    PresetBatch * batch = new PresetBatch ();
+    batch -> presets = presets ;
+    batch -> which = which ;
+    batch -> generation = generation ;
+    batch -> list.swap (list);
+    batch -> done = done ;
+    batch -> merge = merge ;
+    g_idle_add (preset_batch_cb, batch);
+}
+
+// read user presets or favourites out of the store on a worker thread and
+// hand them to the tab PRESET_BATCH at a time
+void Presets::stream_store (int which) {
+    clear (which);
+    int gen = generation [which] ;
+
+    std::thread ([this, which, gen] () {
+        std::vector <json> list ;
+        for (auto & name: which == 3 ? store -> favourites () : store -> user ()) {
+            json j = store -> get (name);
+            if (! j.is_object ())
+                continue ;
+
+            list.push_back (std::move (j));
+            if (list.size () == PRESET_BATCH)
+                post_batch (this, which, gen, list, false);
+        }
+
+        post_batch (this, which, gen, list, true);
+    }).detach ();
 }
 
 void Presets::load_user (bool isFav) {
     IN
-    std::string where = std::string (presets_dir->c_str ()) ;
-    if (isFav)
-        where = favs_dir ;
-        
-    for (const auto & entry : std::filesystem::directory_iterator(where)) {
-        //~ std::cout << entry.path() << std::endl;
-        LOGD ("[preset] %s\n", entry.path ().string ().c_str ());
-    
-        json j = filename_to_json (entry.path ().string ());
-        if (! isFav)
-            add_preset (j, 1);
-        else
-            add_preset (j, 3);
-    } 
-    OUT   
+    stream_store (isFav ? 3 : 1);
+    OUT
+}
+
+void Presets::load_library () {
+    IN
+    clear (2);
+    stream_library (false);
+    OUT
+}
+
+/*  Read library.json on a worker thread, handing presets over as each one
+ *  is parsed rather than after the whole file is in memory. merge lays
+ *  them over what the tab already has instead of filling an empty tab.
+ */
+void Presets::stream_library (bool merge) {
+    int gen = generation [2] ;
+    std::string filename = std::string (dir).append ("/library.json") ;
+    gtk_spinner_start (library_spinner);
+
+    std::thread ([this, filename, gen, merge] () {
+        std::vector <json> list ;
+        std::ifstream in (filename);
+        if (in.is_open ()) {
+            // each preset is taken out of the tree as soon as it is complete
+            json::parse (in, [&] (int depth, json::parse_event_t event, json & parsed) {
+                if (depth != 1 || event != json::parse_event_t::object_end)
+                    return true ;
+                list.push_back (std::move (parsed));
+                if (list.size () == PRESET_BATCH * 16)
+                    post_batch (this, 2, gen, list, false, merge);
+                return false ;
+            }, false);
+        } else {
+            LOGD ("[library] cannot open %s\n", filename.c_str ());
+        }
+
+        post_batch (this, 2, gen, list, true, merge);
+    }).detach ();
+}
+
+// the download lands in library.json, so the parse after it is the same
+// as at startup except that it merges
+void Presets::merge_library () {
+    // batches still on their way from an earlier stream are dropped
+    generation [2] ++ ;
+    delete merge ;
+    merge = new LibraryMerge ();
+    merge -> added = 0 ;
+    std::vector <json> & library = * list_of_presets [2] ;
+    merge -> seen.assign (library.size (), false);
+    for (int i = 0 ; i < (int) library.size () ; i ++)
+        if (library [i].is_object ())
+            merge -> byName [library [i].value ("name", "")].push_back (i);
+
+    stream_library (true);
+}
+
+static gboolean library_progress_cb (gpointer data) {
+    Presets * presets = (Presets *) data ;
+    presets -> progress_pending = false ;
+    uint64_t got = presets -> library_got, total = presets -> library_total ;
+    if (total > 0)
+        gtk_progress_bar_set_fraction (presets -> library_progress, (double) got / total);
+    else
+        gtk_progress_bar_pulse (presets -> library_progress);
+    return G_SOURCE_REMOVE ;
+}
+
+// from the download thread: one idle in flight at a time however fast
+// the bytes come in
+static bool library_progress (uint64_t got, uint64_t total, void * data) {
+    Presets * presets = (Presets *) data ;
+    presets -> library_got = got ;
+    presets -> library_total = total ;
+    if (! presets -> progress_pending.exchange (true))
+        g_idle_add (library_progress_cb, presets);
+    return ! presets -> library_cancel ;
+}
+
+typedef struct {
+    Presets * presets ;
+    DownloadStatus status ;
+} LibraryDownload ;
+
+static gboolean library_downloaded_cb (gpointer data) {
+    LibraryDownload * d = (LibraryDownload *) data ;
+    Presets * presets = d -> presets ;
+    presets -> refreshing = false ;
+    gtk_button_set_label (presets -> refresh_button, "Refresh 🔃");
+    gtk_widget_set_visible ((GtkWidget *) presets -> library_progress, false);
+
+    switch (d -> status) {
+        case DOWNLOAD_OK:
+            gtk_label_set_text (presets -> library_status, "Updating library ...");
+            presets -> merge_library ();
+            break ;
+        case DOWNLOAD_NOT_MODIFIED:
+            gtk_label_set_text (presets -> library_status, "Library is up to date");
+            gtk_spinner_stop (presets -> library_spinner);
+            break ;
+        case DOWNLOAD_OFFLINE:
+            gtk_label_set_text (presets -> library_status, "Offline, showing the saved library");
+            gtk_spinner_stop (presets -> library_spinner);
+            break ;
+        case DOWNLOAD_CANCELLED:
+            gtk_label_set_text (presets -> library_status, "Refresh cancelled");
+            gtk_spinner_stop (presets -> library_spinner);
+            break ;
+        default:
+            gtk_label_set_text (presets -> library_status, "Could not refresh the library");
+            gtk_spinner_stop (presets -> library_spinner);
+            break ;
+    }
+
+    delete d ;
+    return G_SOURCE_REMOVE ;
+}
+
+/*  Fetch the library on a worker thread. Nothing on screen changes until
+ *  it has all arrived; if it has not changed, cannot be reached or is
+ *  cancelled, the saved copy stays as it is.
+ */
+void Presets::refresh_library () {
+    IN
+    refreshing = true ;
+    library_cancel = false ;
+    gtk_button_set_label (refresh_button, "Cancel");
+    gtk_progress_bar_set_fraction (library_progress, 0);
+    gtk_widget_set_visible ((GtkWidget *) library_progress, true);
+    gtk_label_set_text (library_status, "");
+    gtk_spinner_start (library_spinner);
+
+    std::string url = library_url ;
+    std::string filename = std::string (dir).append ("/library.json") ;
+    std::thread ([this, url, filename] () {
+        LibraryDownload * d = new LibraryDownload ();
+        d -> presets = this ;
+        d -> status = download_if_changed (url, filename, library_progress, this);
+        g_idle_add (library_downloaded_cb, d);
+    }).detach ();
+    OUT
 }
 
 void Presets::add_preset_multi (std::string s, int which) {
@@ -504,27 +1088,26 @@ void Presets::add_preset_multi (std::string s, int which) {
 
 void Presets::add_preset_multi (json j, int which) {
     IN
+    std::vector <json> list ;
     for (auto n: j) {
-        add_preset (n, which);
+        list.push_back (n);
     }
     
+    add_presets (list, which);
     OUT
 }
 
 int Presets::import_presets_from_json (json j) {
     IN
     int how_many = 0 ;
-    LOGV (presets_dir->c_str());
     for (auto preset: j) {
+        bool known = preset.is_object () && store -> contains (preset.value ("name", ""));
+        if (! store -> put (preset))
+            continue ;
         how_many ++ ;
-        std::string basename = preset ["name"].dump () ;
-        basename = basename.substr (1, basename.size () - 2);
-        std::string filename = std::string (presets_dir->c_str ()) .append (basename) ;
-        wtf ("writing file: %s\n", filename.c_str ());
-        json_to_filename (preset, filename) ;
         LOGD ("[presets] warning: not adding preset to UI\n");
         # ifdef __linux__
-            add_preset (preset, 1);
+            saved (preset, known);
         # endif
     }
     
@@ -533,31 +1116,57 @@ int Presets::import_presets_from_json (json j) {
 }
 
 void Presets::save_presets_to_json (std::string filename) {
-    json ex = json {};
-    int i = 0 ;
-    for (const auto & entry : std::filesystem::directory_iterator(*presets_dir)) {
-        //~ std::cout << entry.path() << std::endl;
-        json j = filename_to_json (entry.path ().string ());
-        ex [std::to_string (i++)] = j ;
-    } 
-    
+    json ex = store -> all ();
     if (json_to_filename (ex, filename))
         msg ("Exported presets successfully");
     else 
         msg ("Error exporting presets");
 }
 
+typedef struct {
+    Presets * presets ;
+    GtkLabel * status ;
+    int imported, exported, files ;
+    std::string error ;
+} SyncResult ;
+
+static gboolean sync_finished_cb (gpointer data) {
+    SyncResult * r = (SyncResult *) data ;
+    char * ss ;
+    if (r -> error.empty ())
+        ss = g_markup_printf_escaped ("<span foreground=\"green\" weight=\"bold\" size=\"x-large\">Received %d, sent %d presets, %d files</span>", r -> imported, r -> exported, r -> files);
+    else
+        ss = g_markup_printf_escaped ("<span foreground=\"red\" weight=\"bold\" size=\"x-large\">Sync failed: %s</span>", r -> error.c_str ());
+    gtk_label_set_markup (r -> status, ss);
+    g_free (ss);
+    g_object_unref (r -> status);
+
+    // whatever arrived is already in the store, even if the sync broke off
+    if (r -> imported > 0)
+        r -> presets -> load_user (false);
+
+    delete r ;
+    return G_SOURCE_REMOVE ;
+}
+
+// from the sync threads: report on the UI thread
+void Presets::sync_finished (GtkLabel * status, SyncSession * session) {
+    SyncResult * r = new SyncResult ();
+    r -> presets = this ;
+    r -> status = status ;
+    r -> imported = session -> imported ;
+    r -> exported = session -> exported ;
+    r -> files = session -> blobsIn + session -> blobsOut ;
+    r -> error = session -> error ;
+    // the window may be closed before the idle runs
+    g_object_ref (status);
+    g_idle_add (sync_finished_cb, r);
+}
+
 json Presets::get_all_user_presets () {
     IN
-    json ex = json {};
-    int i = 0 ;
-    for (const auto & entry : std::filesystem::directory_iterator(*presets_dir)) {
-        //~ std::cout << entry.path() << std::endl;
-        json j = filename_to_json (entry.path ().string ());
-        LOGD ("[preset] %s: %s\n", entry.path ().string ().c_str (), j.dump().c_str ());
-        ex [std::to_string (i++)] = j ;
-    } 
-
+    json ex = store -> all ();
+    LOGD ("[presets] %d user presets\n", (int) ex.size ());
     OUT
     return ex ;
 }
@@ -4,27 +4,51 @@
 #include <filesystem>
 #include "json.hpp"
 #include <iostream>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
 #include "util.h"
+#include "presetstore.h"
+#include "presetindex.h"
+#include "availability.h"
+#include "syncproto.h"
 #include "engine.h"
 #include "rack.h"
 
 using json = nlohmann::json;
 
-void delete_callback (void * b, void * d) ;
+class Presets ;
 
-class CB_Preset {
-    public:
-        Engine * engine ;
-        json j ;
-        Rack * rack ;
-        GtkWidget * fav, * fav_rack ;
-        void * p ;
-        std::string filename ;
-};
+// user data for a tab's row factory
+typedef struct {
+    Presets * presets ;
+    int which ;
+} PresetTab ;
+
+// presets parsed off the main thread, handed to the tab in one go
+typedef struct {
+    Presets * presets ;
+    int which, generation ;
+    std::vector <json> list ;
+    bool done ;
+    bool merge ;            // a refreshed library, see LibraryMerge
+} PresetBatch ;
+
+/*  A downloaded library being laid over the one on screen. Presets are
+ *  matched by name: unchanged ones are left alone, changed ones are
+ *  replaced in their slot, new ones appended and the ones that were not
+ *  in the download removed once it has all been read.
+ */
+typedef struct {
+    std::unordered_map <std::string, std::vector <int>> byName ;
+    std::vector <bool> seen ;
+    std::vector <int> changed ;
+    int added ;
+} LibraryMerge ;
 
 class Presets {
 public:
-    GtkBox * master, * my_presets, * quick, * library, * my_presets_rack, * favorites ;
+    GtkBox * master, * my_presets ;
     GtkNotebook * notebook, * presets ;
     GtkButton * add, * imp, * exp ;
     void my () ;
@@ -33,13 +57,54 @@ public:
     Engine * engine ;
     Rack * rack ;
     GtkApplication * app ;
-    std::vector <GtkWidget *> library_boxes ;
     int page = 0;
-    json library_json ;
     
+    /*  One tab per index: 0 factory, 1 user, 2 library, 3 favourites.
+     *  list_of_presets holds the presets, the models hold their indices
+     *  as strings, and the list views only build rows for what is on
+     *  screen. The library view shows a page_size slice of its model.
+     *
+     *  Between a model and its view sit a filter and a sort model. They
+     *  pass everything through until there is a query; then rank holds
+     *  each preset's place in the search results, -1 for no match.
+     *  playable_only also hides presets that need plugins we do not have.
+     */
+    GtkStringList * models [4] ;
+    GtkFilterListModel * filtered [4] ;
+    GtkSortListModel * sorted [4] ;
+    GtkFilter * filters [4] ;
+    GtkSorter * sorters [4] ;
+    std::vector <int> rank [4] ;
+    std::string query ;
+    PresetIndex * search_index ;
+    PresetAvailability * availability ;
+    bool playable_only = false ;
+    GtkWidget * views [4] ;
+    GtkSliceListModel * library_page ;
+    PresetTab tabs [4] ;
+    int generation [4] = {0, 0, 0, 0} ;
+    PresetStore * store ;
+    BlobStore * blobs ;
     
     void add_preset (json, int);
+    void add_presets (std::vector <json> &, int);
+    void replace_preset (json, int);
+    void saved (json &, bool);
+    void remove_preset (int which, int index);
+    void clear (int which);
+    int count (int which);
+    json * at (int which, int position);
+    GListModel * view_model (int which);
+    GtkWidget * create_view (int which);
+    void refresh_rows (int which = -1);
+    void search (std::string, bool);
+    void update_filters (bool);
+    void plugin_unavailable (std::string);
+    void plugin_loaded (std::string, bool);
+    void update_pages ();
+    void stream_store (int which);
     void load_user (bool);
+    void load_library ();
     void add_preset_multi (json, int) ;
     void add_preset_multi (std::string, int) ;
     int import_presets_from_json (json);
@@ -53,7 +118,21 @@ public:
     GtkWidget * page_no ;
     GtkAdjustment * adj ;
     
+    // library refresh, see refresh_library
+    std::string library_url ;
+    GtkButton * refresh_button ;
+    GtkProgressBar * library_progress ;
+    GtkLabel * library_status ;
+    bool refreshing = false ;
+    std::atomic <bool> library_cancel { false }, progress_pending { false } ;
+    std::atomic <uint64_t> library_got { 0 }, library_total { 0 } ;
+    LibraryMerge * merge = nullptr ;
+    void refresh_library ();
+    void merge_library ();
+    void stream_library (bool merge);
+    
     json get_all_user_presets ();
+    void sync_finished (GtkLabel * status, SyncSession * session);
     
     Presets () {
         # ifdef __linux__
@@ -90,6 +169,25 @@ public:
         favs_dir = std::string (dir).append ("/favs") ;
         g_mkdir_with_parents (favs_dir.c_str (), 0777);
         
+        // user presets and favourites used to be one file each in
+        // presets_dir and favs_dir, bring them over the first time
+        # ifdef __linux__
+        std::string db = std::string (getenv ("HOME")).append ("/amprack") ;
+        # else
+        std::string db = std::string (getenv ("USERPROFILE")).append ("\\amprack") ;
+        # endif
+        
+        bool fresh = ! std::filesystem::exists (std::string (db).append ("/presets.log"));
+        store = new PresetStore (db);
+        if (fresh)
+            store -> import (* presets_dir, favs_dir);
+        // models and IRs that came with synced presets
+        blobs = new BlobStore (std::string (db).append ("/blobs"));
+        // where loaded models are copied to, the only other folder we send from
+        blobs -> share (std::string (db).append ("/models"));
+        
+        search_index = new PresetIndex ();
+        
         master = (GtkBox *)gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0) ;
         
         notebook = (GtkNotebook *)gtk_notebook_new ();
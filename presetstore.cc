@@ -0,0 +1,762 @@
+#include "presetstore.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <array>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+
+/*  presets.log (native endian):
+ *
+ *  header:  char magic [4], u32 version, u64 id
+ *  record:  char magic [4], u32 op, u32 flags, u32 length, u32 crc,
+ *           payload [length]
+ *
+ *  OP_PUT payload is the name, a 0 and the preset json. OP_FLAGS payload
+ *  is just the name; a record with no flags left is deleted.
+ *
+ *  presets.idx:
+ *
+ *  header:  char magic [4], u32 version, u64 log id, u64 log size, u32 count
+ *  record:  u64 offset, u32 length, u32 flags, str name,
+ *           u32 ntags, str * ntags, u32 nplugins, str * nplugins
+ *  str:     u32 length, bytes (no terminator)
+ */
+
+#define OP_PUT      1
+#define OP_FLAGS    2
+
+#define LOG_HEADER  16
+#define REC_HEADER  20
+
+// compact when more than half of a log bigger than this is garbage
+#define COMPACT_MIN (1 << 20)
+// snapshot the index after this many records
+#define INDEX_EVERY 256
+
+static void put_bytes (std::string & out, const void * data, size_t size) {
+    out.append ((const char *) data, size);
+}
+
+static void put_u32 (std::string & out, uint32_t v) { put_bytes (out, &v, sizeof (v)); }
+static void put_u64 (std::string & out, uint64_t v) { put_bytes (out, &v, sizeof (v)); }
+
+static void put_str (std::string & out, const std::string & s) {
+    put_u32 (out, s.size ());
+    out.append (s);
+}
+
+typedef struct {
+    const char * p ;
+    const char * end ;
+    bool ok ;
+} Reader ;
+
+static bool read_bytes (Reader * r, void * data, size_t size) {
+    if (! r->ok || r->p + size > r->end) {
+        r->ok = false ;
+        return false ;
+    }
+
+    memcpy (data, r->p, size);
+    r->p += size ;
+    return true ;
+}
+
+static uint32_t get_u32 (Reader * r) { uint32_t v = 0 ; read_bytes (r, &v, sizeof (v)); return v ; }
+static uint64_t get_u64 (Reader * r) { uint64_t v = 0 ; read_bytes (r, &v, sizeof (v)); return v ; }
+
+static std::string get_str (Reader * r) {
+    uint32_t len = get_u32 (r);
+    if (! r->ok || r->p + len > r->end) {
+        r->ok = false ;
+        return std::string ();
+    }
+
+    std::string s (r->p, len);
+    r->p += len ;
+    return s ;
+}
+
+uint32_t PresetStore::crc32 (const char * data, size_t size) {
+    // built by whichever thread gets here first, the others wait for it
+    static const std::array <uint32_t, 256> table = [] {
+        std::array <uint32_t, 256> t ;
+        for (uint32_t i = 0 ; i < 256 ; i ++) {
+            uint32_t c = i ;
+            for (int k = 0 ; k < 8 ; k ++)
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1 ;
+            t [i] = c ;
+        }
+        return t ;
+    } ();
+
+    uint32_t crc = 0xFFFFFFFF ;
+    for (size_t i = 0 ; i < size ; i ++)
+        crc = table [(crc ^ (unsigned char) data [i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF ;
+}
+
+// presets with the same plugins in any order share a key
+std::string PresetStore::pluginKey (std::vector <std::string> plugins) {
+    std::sort (plugins.begin (), plugins.end ());
+    std::string key ;
+    for (auto & p: plugins)
+        key.append (p).append ("\n");
+    return key ;
+}
+
+static void describe (json & preset, PresetRecord * record) {
+    record->tags.clear ();
+    record->plugins.clear ();
+
+    if (preset.contains ("tags") && preset ["tags"].is_array ())
+        for (auto & t: preset ["tags"])
+            if (t.is_string ())
+                record->tags.push_back (t.get <std::string> ());
+
+    if (preset.contains ("controls") && preset ["controls"].is_object ())
+        for (auto & p: preset ["controls"])
+            if (p.is_object () && p.contains ("name") && p ["name"].is_string ())
+                record->plugins.push_back (p ["name"].get <std::string> ());
+}
+
+PresetStore::PresetStore (std::string dir) {
+    IN
+    logname = std::string (dir).append ("/presets.log");
+    idxname = std::string (dir).append ("/presets.idx");
+
+    bool fresh = ! std::filesystem::exists (logname);
+    log = fopen (logname.c_str (), fresh ? "w+b" : "r+b");
+    if (log == nullptr) {
+        LOGE ("[presetstore] cannot open %s: %s\n", logname.c_str (), strerror (errno));
+        OUT
+        return ;
+    }
+
+    if (fresh) {
+        std::string header ;
+        put_bytes (header, PRESETSTORE_LOG_MAGIC, 4);
+        put_u32 (header, PRESETSTORE_VERSION);
+        put_u64 (header, std::chrono::system_clock::now ().time_since_epoch ().count ());
+        fwrite (header.data (), 1, header.size (), log);
+        fflush (log);
+        logSize = LOG_HEADER ;
+    } else {
+        if (! loadIndex ())
+            replay (LOG_HEADER);
+    }
+
+    LOGD ("[presetstore] %s: %d presets, %d kb garbage\n", logname.c_str (), (int) byName.size (), (int) (deadBytes / 1024));
+    if (deadBytes > COMPACT_MIN && deadBytes * 2 > logSize)
+        compact ();
+    OUT
+}
+
+PresetStore::~PresetStore () {
+    if (log == nullptr)
+        return ;
+    if (unindexed)
+        saveIndex ();
+    fclose (log);
+}
+
+static uint64_t log_id (FILE * log) {
+    char header [LOG_HEADER] ;
+    fseek (log, 0, SEEK_SET);
+    if (fread (header, 1, LOG_HEADER, log) != LOG_HEADER || memcmp (header, PRESETSTORE_LOG_MAGIC, 4))
+        return 0 ;
+
+    uint64_t id ;
+    memcpy (&id, header + 8, sizeof (id));
+    return id ;
+}
+
+// read the snapshot, then replay whatever was logged after it
+bool PresetStore::loadIndex () {
+    if (! std::filesystem::exists (idxname))
+        return false ;
+
+    char * mapped = nullptr ;
+    size_t mapped_size = 0 ;
+# ifdef __linux__
+    int fd = open (idxname.c_str (), O_RDONLY);
+    if (fd == -1)
+        return false ;
+
+    struct stat st ;
+    if (fstat (fd, &st) == 0 && st.st_size > 0) {
+        void * p = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            mapped = (char *) p ;
+            mapped_size = st.st_size ;
+        }
+    }
+
+    close (fd);
+# else
+    std::ifstream in (idxname, std::ios::binary | std::ios::ate);
+    std::streamoff size = in.tellg ();
+    if (in.is_open () && size > 0) {
+        mapped = (char *) malloc (size);
+        in.seekg (0);
+        in.read (mapped, size);
+        mapped_size = size ;
+    }
+# endif
+
+    if (mapped == nullptr)
+        return false ;
+
+    std::error_code ec ;
+    uint64_t actual = std::filesystem::file_size (logname, ec);
+
+    Reader r = { mapped, mapped + mapped_size, true };
+    char magic [4] ;
+    read_bytes (&r, magic, 4);
+    uint32_t version = get_u32 (&r);
+    uint64_t id = get_u64 (&r);
+    uint64_t size = get_u64 (&r);
+    uint32_t count = get_u32 (&r);
+
+    // the log was compacted or replaced under the snapshot
+    bool ok = r.ok && ! memcmp (magic, PRESETSTORE_IDX_MAGIC, 4) && version == PRESETSTORE_VERSION
+        && id == log_id (log) && size >= LOG_HEADER && size <= actual ;
+
+    for (uint32_t i = 0 ; ok && i < count ; i ++) {
+        PresetRecord record ;
+        record.offset = get_u64 (&r);
+        record.length = get_u32 (&r);
+        record.flags = get_u32 (&r);
+        record.name = get_str (&r);
+        record.tags.resize (get_u32 (&r));
+        for (auto & t: record.tags)
+            t = get_str (&r);
+        record.plugins.resize (get_u32 (&r));
+        for (auto & p: record.plugins)
+            p = get_str (&r);
+
+        if (! r.ok || record.offset + record.length > size) {
+            ok = false ;
+            break ;
+        }
+
+        record.live = true ;
+        insert (std::move (record));
+    }
+
+# ifdef __linux__
+    munmap (mapped, mapped_size);
+# else
+    free (mapped);
+# endif
+
+    if (! ok) {
+        LOGD ("[presetstore] %s is stale, replaying the log\n", idxname.c_str ());
+        records.clear (); byName.clear (); byTag.clear ();
+        byPlugins.clear (); favs.clear (); users.clear ();
+        return false ;
+    }
+
+    // garbage is whatever the snapshot covers that no live preset uses
+    deadBytes = size - LOG_HEADER ;
+    for (auto & rec: records)
+        deadBytes -= std::min <uint64_t> (deadBytes, REC_HEADER + rec.name.size () + 1 + rec.length);
+
+    replay (size);
+    return true ;
+}
+
+// apply every intact record from offset from, and cut off a torn tail
+void PresetStore::replay (uint64_t from) {
+    std::error_code ec ;
+    uint64_t end = std::filesystem::file_size (logname, ec);
+    uint64_t at = from ;
+    std::string payload ;
+
+    fseek (log, at, SEEK_SET);
+    while (at + REC_HEADER <= end) {
+        char header [REC_HEADER] ;
+        if (fread (header, 1, REC_HEADER, log) != REC_HEADER || memcmp (header, PRESETSTORE_LOG_MAGIC, 4))
+            break ;
+
+        uint32_t op, flags, length, crc ;
+        memcpy (&op, header + 4, 4);
+        memcpy (&flags, header + 8, 4);
+        memcpy (&length, header + 12, 4);
+        memcpy (&crc, header + 16, 4);
+        if (at + REC_HEADER + length > end)
+            break ;
+
+        payload.resize (length);
+        if (fread (& payload [0], 1, length, log) != length || crc32 (payload.data (), length) != crc)
+            break ;
+
+        std::string name (payload.c_str ());
+        auto it = byName.find (name);
+        if (op == OP_PUT && name.size () < length) {
+            PresetRecord record ;
+            record.offset = at + REC_HEADER + name.size () + 1 ;
+            record.length = length - name.size () - 1 ;
+            record.flags = flags ;
+            record.live = true ;
+            record.name = name ;
+            try {
+                json preset = json::parse (payload.begin () + name.size () + 1, payload.end ());
+                describe (preset, &record);
+            } catch (json::exception & e) {
+                LOGD ("[presetstore] %s: %s\n", name.c_str (), e.what ());
+            }
+
+            if (it != byName.end ())
+                unlink (it->second);
+            insert (std::move (record));
+        } else if (op == OP_FLAGS && it != byName.end ()) {
+            setFlags (it->second, flags);
+            deadBytes += REC_HEADER + length ;
+        }
+
+        at += REC_HEADER + length ;
+        unindexed ++ ;
+    }
+
+    if (at < end) {
+        LOGE ("[presetstore] %s: dropping %d bytes of torn log\n", logname.c_str (), (int) (end - at));
+        std::filesystem::resize_file (logname, at, ec);
+    }
+
+    logSize = at ;
+}
+
+bool PresetStore::append (uint32_t op, uint32_t flags, const std::string & payload, uint64_t * where) {
+    if (log == nullptr)
+        return false ;
+
+    std::string rec ;
+    put_bytes (rec, PRESETSTORE_LOG_MAGIC, 4);
+    put_u32 (rec, op);
+    put_u32 (rec, flags);
+    put_u32 (rec, payload.size ());
+    put_u32 (rec, crc32 (payload.data (), payload.size ()));
+    rec.append (payload);
+
+    fseek (log, logSize, SEEK_SET);
+    if (fwrite (rec.data (), 1, rec.size (), log) != rec.size () || fflush (log)) {
+        LOGE ("[presetstore] write failed: %s\n", strerror (errno));
+        return false ;
+    }
+
+# ifdef __linux__
+    fdatasync (fileno (log));
+# endif
+
+    if (where)
+        * where = logSize + REC_HEADER ;
+    logSize += rec.size ();
+    return true ;
+}
+
+// called once a logged change is in the index, never between the two
+void PresetStore::logged () {
+    if (++ unindexed >= INDEX_EVERY)
+        saveIndex ();
+}
+
+void PresetStore::insert (PresetRecord record) {
+    int slot = records.size ();
+    byName [record.name] = slot ;
+    for (auto & t: record.tags)
+        byTag [t].insert (slot);
+    if (! record.plugins.empty ())
+        byPlugins [pluginKey (record.plugins)].insert (slot);
+    if (record.flags & PresetRecord::FAVOURITE)
+        favs.insert (slot);
+    if (record.flags & PresetRecord::USER)
+        users.insert (slot);
+    records.push_back (std::move (record));
+}
+
+void PresetStore::unlink (int slot) {
+    PresetRecord & record = records [slot] ;
+    if (! record.live)
+        return ;
+
+    for (auto & t: record.tags) {
+        byTag [t].erase (slot);
+        if (byTag [t].empty ())
+            byTag.erase (t);
+    }
+
+    if (! record.plugins.empty ()) {
+        std::string key = pluginKey (record.plugins);
+        byPlugins [key].erase (slot);
+        if (byPlugins [key].empty ())
+            byPlugins.erase (key);
+    }
+
+    favs.erase (slot);
+    users.erase (slot);
+    byName.erase (record.name);
+    record.live = false ;
+    deadBytes += REC_HEADER + record.name.size () + 1 + record.length ;
+}
+
+void PresetStore::setFlags (int slot, uint32_t flags) {
+    if (flags == 0) {
+        unlink (slot);
+        return ;
+    }
+
+    records [slot].flags = flags ;
+    if (flags & PresetRecord::FAVOURITE)
+        favs.insert (slot);
+    else
+        favs.erase (slot);
+    if (flags & PresetRecord::USER)
+        users.insert (slot);
+    else
+        users.erase (slot);
+}
+
+bool PresetStore::put (json & preset, uint32_t flags) {
+    if (! preset.is_object () || ! preset.contains ("name") || ! preset ["name"].is_string ())
+        return false ;
+
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    std::string name = preset ["name"].get <std::string> ();
+    auto it = byName.find (name);
+    if (it != byName.end ())
+        flags |= records [it->second].flags ;
+
+    std::string body = preset.dump ();
+    std::string payload = std::string (name).append (1, '\0').append (body);
+    PresetRecord record ;
+    if (! append (OP_PUT, flags, payload, & record.offset))
+        return false ;
+
+    record.offset += name.size () + 1 ;
+    record.length = body.size ();
+    record.flags = flags ;
+    record.live = true ;
+    record.name = name ;
+    describe (preset, &record);
+
+    it = byName.find (name);
+    if (it != byName.end ())
+        unlink (it->second);
+    insert (std::move (record));
+    logged ();
+    return true ;
+}
+
+// drop the user flag, the preset stays if it is a favourite
+bool PresetStore::remove (const std::string & name) {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    auto it = byName.find (name);
+    if (it == byName.end ())
+        return false ;
+
+    uint32_t flags = records [it->second].flags & ~PresetRecord::USER ;
+    if (! append (OP_FLAGS, flags, name, nullptr))
+        return false ;
+    // the flags record is garbage as soon as it is applied
+    deadBytes += REC_HEADER + name.size ();
+    setFlags (it->second, flags);
+    logged ();
+    return true ;
+}
+
+// hearting a factory or library preset keeps a copy of it
+bool PresetStore::setFavourite (json & preset, bool fav) {
+    if (! preset.is_object () || ! preset.contains ("name") || ! preset ["name"].is_string ())
+        return false ;
+
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    std::string name = preset ["name"].get <std::string> ();
+    auto it = byName.find (name);
+    if (it == byName.end ())
+        return fav ? put (preset, PresetRecord::FAVOURITE) : true ;
+
+    uint32_t flags = records [it->second].flags ;
+    flags = fav ? flags | PresetRecord::FAVOURITE : flags & ~PresetRecord::FAVOURITE ;
+    if (flags == records [it->second].flags)
+        return true ;
+    if (! append (OP_FLAGS, flags, name, nullptr))
+        return false ;
+    deadBytes += REC_HEADER + name.size ();
+    setFlags (it->second, flags);
+    logged ();
+    return true ;
+}
+
+bool PresetStore::isFavourite (const std::string & name) {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    auto it = byName.find (name);
+    return it != byName.end () && (records [it->second].flags & PresetRecord::FAVOURITE);
+}
+
+bool PresetStore::contains (const std::string & name) {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    return byName.find (name) != byName.end ();
+}
+
+// the preset as logged, with lock held: a compaction moves every slot
+std::string PresetStore::read (int slot) {
+    PresetRecord & record = records [slot] ;
+    std::string body (record.length, '\0');
+    fseek (log, record.offset, SEEK_SET);
+    if (fread (& body [0], 1, record.length, log) != record.length)
+        return std::string ();
+    return body ;
+}
+
+json PresetStore::get (const std::string & name) {
+    std::string body ;
+    {
+        std::lock_guard <std::recursive_mutex> guard (lock);
+        auto it = byName.find (name);
+        if (it == byName.end ())
+            return json {};
+        body = read (it->second);
+    }
+
+    if (body.empty ())
+        return json {};
+
+    try {
+        return json::parse (body);
+    } catch (json::exception & e) {
+        LOGE ("[presetstore] bad preset in log: %s\n", e.what ());
+        return json {};
+    }
+}
+
+std::vector <std::string> PresetStore::list (const std::set <int> & slots) {
+    std::vector <std::string> names ;
+    names.reserve (slots.size ());
+    for (int slot: slots)
+        names.push_back (records [slot].name);
+    return names ;
+}
+
+// in the order they were saved
+std::vector <std::string> PresetStore::user () {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    return list (users);
+}
+
+std::vector <std::string> PresetStore::favourites () {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    return list (favs);
+}
+
+std::vector <std::string> PresetStore::tagged (const std::string & tag) {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    auto it = byTag.find (tag);
+    return it == byTag.end () ? std::vector <std::string> () : list (it->second);
+}
+
+// presets that use exactly these plugins, in any order
+std::vector <std::string> PresetStore::withPlugins (std::vector <std::string> plugins) {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    auto it = byPlugins.find (pluginKey (plugins));
+    return it == byPlugins.end () ? std::vector <std::string> () : list (it->second);
+}
+
+// user presets keyed "0", "1", ... like the old directory dump
+json PresetStore::all () {
+    json ex = json {};
+    int i = 0 ;
+    for (auto & name: user ()) {
+        json j = get (name);
+        if (! j.is_null ())
+            ex [std::to_string (i++)] = j ;
+    }
+
+    return ex ;
+}
+
+int PresetStore::size () {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    return users.size ();
+}
+
+// the old layout: one json file per preset, favourites copied into favs/.
+// the files are left where they are
+int PresetStore::import (std::string presetsDir, std::string favsDir) {
+    IN
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    int how_many = 0 ;
+    for (auto d: { std::make_pair (presetsDir, (uint32_t) PresetRecord::USER), std::make_pair (favsDir, (uint32_t) PresetRecord::FAVOURITE) }) {
+        std::error_code ec ;
+        for (const auto & entry : std::filesystem::directory_iterator (d.first, ec)) {
+            if (! entry.is_regular_file ())
+                continue ;
+
+            json j ;
+            try {
+                std::ifstream in (entry.path ());
+                j = json::parse (in);
+            } catch (json::exception & e) {
+                LOGD ("[presetstore] skipping %s: %s\n", entry.path ().string ().c_str (), e.what ());
+                continue ;
+            }
+
+            if (! j.is_object ())
+                continue ;
+            // the file name is the preset name
+            if (! j.contains ("name") || ! j ["name"].is_string ())
+                j ["name"] = entry.path ().filename ().string ();
+            if (put (j, d.second))
+                how_many ++ ;
+        }
+    }
+
+    saveIndex ();
+    LOGD ("[presetstore] imported %d presets from %s\n", how_many, presetsDir.c_str ());
+    OUT
+    return how_many ;
+}
+
+// copy the live presets to a new log and swap it in
+bool PresetStore::compact () {
+    IN
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    if (log == nullptr) {
+        OUT
+        return false ;
+    }
+
+    std::string tmp = logname + ".tmp" ;
+    FILE * out = fopen (tmp.c_str (), "w+b");
+    if (out == nullptr) {
+        LOGE ("[presetstore] cannot write %s\n", tmp.c_str ());
+        OUT
+        return false ;
+    }
+
+    std::string header ;
+    put_bytes (header, PRESETSTORE_LOG_MAGIC, 4);
+    put_u32 (header, PRESETSTORE_VERSION);
+    put_u64 (header, std::chrono::system_clock::now ().time_since_epoch ().count ());
+    bool ok = fwrite (header.data (), 1, header.size (), out) == header.size ();
+
+    std::vector <PresetRecord> live ;
+    uint64_t at = LOG_HEADER ;
+    std::string body ;
+    for (auto & record: records) {
+        if (! record.live)
+            continue ;
+
+        body.resize (record.length);
+        fseek (log, record.offset, SEEK_SET);
+        ok = ok && fread (& body [0], 1, record.length, log) == record.length ;
+
+        std::string payload = std::string (record.name).append (1, '\0').append (body);
+        std::string rec ;
+        put_bytes (rec, PRESETSTORE_LOG_MAGIC, 4);
+        put_u32 (rec, OP_PUT);
+        put_u32 (rec, record.flags);
+        put_u32 (rec, payload.size ());
+        put_u32 (rec, crc32 (payload.data (), payload.size ()));
+        rec.append (payload);
+        ok = ok && fwrite (rec.data (), 1, rec.size (), out) == rec.size ();
+
+        PresetRecord moved = record ;
+        moved.offset = at + REC_HEADER + record.name.size () + 1 ;
+        at += rec.size ();
+        live.push_back (std::move (moved));
+    }
+
+    ok = ok && fflush (out) == 0 ;
+# ifdef __linux__
+    ok = ok && fsync (fileno (out)) == 0 ;
+# endif
+
+    if (! ok) {
+        LOGE ("[presetstore] compaction failed: %s\n", strerror (errno));
+        fclose (out);
+        std::filesystem::remove (tmp);
+        OUT
+        return false ;
+    }
+
+    // on windows the old log has to be closed before it can be replaced
+    fclose (log);
+    fclose (out);
+    std::error_code ec ;
+    std::filesystem::rename (tmp, logname, ec);
+    log = fopen (logname.c_str (), "r+b");
+    if (ec || log == nullptr) {
+        LOGE ("[presetstore] cannot replace %s: %s\n", logname.c_str (), ec.message ().c_str ());
+        OUT
+        return false ;
+    }
+
+    LOGD ("[presetstore] compacted %d kb to %d kb\n", (int) (logSize / 1024), (int) (at / 1024));
+    records.clear (); byName.clear (); byTag.clear ();
+    byPlugins.clear (); favs.clear (); users.clear ();
+    for (auto & record: live)
+        insert (std::move (record));
+
+    logSize = at ;
+    deadBytes = 0 ;
+    saveIndex ();
+    OUT
+    return true ;
+}
+
+bool PresetStore::saveIndex () {
+    std::lock_guard <std::recursive_mutex> guard (lock);
+    if (log == nullptr)
+        return false ;
+
+    std::string out ;
+    put_bytes (out, PRESETSTORE_IDX_MAGIC, 4);
+    put_u32 (out, PRESETSTORE_VERSION);
+    put_u64 (out, log_id (log));
+    put_u64 (out, logSize);
+    put_u32 (out, byName.size ());
+
+    for (auto & record: records) {
+        if (! record.live)
+            continue ;
+
+        put_u64 (out, record.offset);
+        put_u32 (out, record.length);
+        put_u32 (out, record.flags);
+        put_str (out, record.name);
+        put_u32 (out, record.tags.size ());
+        for (auto & t: record.tags)
+            put_str (out, t);
+        put_u32 (out, record.plugins.size ());
+        for (auto & p: record.plugins)
+            put_str (out, p);
+    }
+
+    // the old snapshot may still be mapped by another instance
+    std::string tmp = idxname + ".tmp" ;
+    std::ofstream file (tmp, std::ios::binary | std::ios::trunc);
+    if (! file.is_open ()) {
+        LOGE ("[presetstore] cannot write %s\n", tmp.c_str ());
+        return false ;
+    }
+
+    file.write (out.data (), out.size ());
+    file.close ();
+
+    std::error_code ec ;
+    std::filesystem::rename (tmp, idxname, ec);
+    if (ec) {
+        LOGE ("[presetstore] cannot rename %s: %s\n", tmp.c_str (), ec.message ().c_str ());
+        return false ;
+    }
+
+    unindexed = 0 ;
+    return true ;
+}
@@ -0,0 +1,98 @@
+#ifndef PRESETSTORE_H
+#define PRESETSTORE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+
+#include "json.hpp"
+#include "log.h"
+
+using json = nlohmann::json;
+
+/*  All user presets and favourites in one place.
+ *
+ *  presets.log is append only: every save, delete and heart is one
+ *  checksummed record, and a torn record at the end (we crashed while
+ *  writing it) is cut off the next time the log is opened. presets.idx
+ *  is a snapshot of the in-memory index (names, flags, tags, plugins and
+ *  where each preset lives in the log) so opening the store does not
+ *  parse a single preset; only records written after the snapshot are
+ *  replayed.
+ *
+ *  A preset is kept while it is a user preset, a favourite or both.
+ */
+
+#define PRESETSTORE_LOG_MAGIC   "APR1"
+#define PRESETSTORE_IDX_MAGIC   "APX1"
+#define PRESETSTORE_VERSION     1
+
+typedef struct {
+    enum Flags {
+        USER        = 1 << 0,
+        FAVOURITE   = 1 << 1
+    };
+
+    uint64_t offset ;       // of the preset json in the log
+    uint32_t length ;
+    uint32_t flags ;
+    bool live ;
+    std::string name ;
+    std::vector <std::string> tags, plugins ;
+} PresetRecord ;
+
+class PresetStore {
+    std::string logname, idxname ;
+    FILE * log = nullptr ;
+    uint64_t logSize = 0, deadBytes = 0 ;
+    int unindexed = 0 ;
+    std::recursive_mutex lock ;
+
+    std::vector <PresetRecord> records ;
+    std::unordered_map <std::string, int> byName ;
+    std::unordered_map <std::string, std::set <int>> byTag, byPlugins ;
+    std::set <int> favs, users ;
+
+    bool loadIndex ();
+    void replay (uint64_t from);
+    bool append (uint32_t op, uint32_t flags, const std::string & payload, uint64_t * at);
+    void logged ();
+    void insert (PresetRecord record);
+    void unlink (int slot);
+    void setFlags (int slot, uint32_t flags);
+    std::vector <std::string> list (const std::set <int> & slots);
+    std::string read (int slot);
+
+public:
+    PresetStore (std::string dir) ;
+    ~PresetStore () ;
+
+    bool put (json & preset, uint32_t flags = PresetRecord::USER);
+    bool remove (const std::string & name);
+    bool setFavourite (json & preset, bool fav);
+    bool isFavourite (const std::string & name);
+    bool contains (const std::string & name);
+    json get (const std::string & name);
+
+    std::vector <std::string> user ();
+    std::vector <std::string> favourites ();
+    std::vector <std::string> tagged (const std::string & tag);
+    std::vector <std::string> withPlugins (std::vector <std::string> plugins);
+    json all ();
+    int size ();
+
+    int import (std::string presetsDir, std::string favsDir);
+    bool compact ();
+    bool saveIndex ();
+
+    static std::string pluginKey (std::vector <std::string> plugins);
+    static uint32_t crc32 (const char * data, size_t size);
+} ;
+
+#endif
@@ -10,6 +10,9 @@ int Processor::outputPorts2 [MAX_PLUGINS];
 void * Processor::handle [MAX_PLUGINS] ;
 LilvInstance * Processor::lilv_instance [MAX_PLUGINS] ;
 LockFreeQueueManager * Processor::lockFreeQueueManager;
+std::atomic <SlotTaps> Processor::slotTaps { SlotTaps {} };
+float * Processor::slotData [MAX_SLOT_TAPS] ;
+int Processor::slotSize = 0 ;
 
 void (*Processor::connect_port [MAX_PLUGINS])(LADSPA_Handle Instance,
                      unsigned long Port,
@@ -25,6 +28,14 @@ void (*Processor::set_run_adding_gain [MAX_PLUGINS])(LADSPA_Handle Instance,
 
 void Processor::process (int n_samples, float * in, float * data) {
     memcpy (data, in, sizeof (float) * n_samples);
+    // once a period, a change lands between two of them
+    SlotTaps taps = slotTaps.load (std::memory_order_acquire);
+    if (recording)
+        for (int k = 0 ; k < taps.count ; k ++)
+            if (taps.tap [k] == -1 && n_samples <= slotSize)
+                memcpy (slotData [k], in, sizeof (float) * n_samples);
+            else if (taps.tap [k] == -2 && n_samples <= slotSize)
+                memset (slotData [k], 0, sizeof (float) * n_samples);
     //~ LOGD ("[process] %d\n", GetCurrentThreadId());
     if (bypass) {
         //~ LOGD ("[status: %d] WARNING: audio driver process bypass\n", bypass);
@@ -51,6 +62,10 @@ void Processor::process (int n_samples, float * in, float * data) {
             lilv_instance_connect_port ((LilvInstance *) lilv_instance [i], outputPorts2 [i], (LADSPA_Data *) data);
 
         lilv_instance_run ((LilvInstance *) lilv_instance [i], n_samples);
+        if (recording)
+            for (int k = 0 ; k < taps.count ; k ++)
+                if (taps.tap [k] == i && n_samples <= slotSize)
+                    memcpy (slotData [k], data, sizeof (float) * n_samples);
         // if (run [i] == NULL)
         //     LOGD ("run %d is null", i);
         // else
@@ -65,7 +80,7 @@ void Processor::process (int n_samples, float * in, float * data) {
     }
 
     //~ if (recording)
-    lockFreeQueueManager->process(in, data, n_samples) ;
+    lockFreeQueueManager->process(in, data, n_samples, slotData, recording ? taps.count : 0) ;
 }
 
 Processor::Processor () {
@@ -1,6 +1,8 @@
 #ifndef PROCESS_H
 #define PROCESS_H
 
+#include <atomic>
+#include <cstdint>
 #include <cstring>
 #include <ladspa.h>
 #include <cstdio>
@@ -14,6 +16,13 @@
 
 #define MAX_PLUGINS 10 // aaarrrrghhhhhh
 
+// which output each recorded slot takes: -1 is the input before any
+// plugin, -2 is silence; small enough to swap in with one atomic store
+typedef struct {
+    int8_t tap [MAX_SLOT_TAPS] ;
+    int32_t count ;
+} SlotTaps ;
+
 class Processor {
 public:
     static void (*connect_port [MAX_PLUGINS])(LADSPA_Handle Instance,
@@ -40,6 +49,12 @@ public:
     void process (int, float *, float *);
     static bool bypass, recording;
     static LockFreeQueueManager * lockFreeQueueManager;
+
+    // while recording, the output of these plugins goes to the queue too,
+    // for re-amping; the UI thread only ever publishes a whole new table
+    static std::atomic <SlotTaps> slotTaps ;
+    static float * slotData [MAX_SLOT_TAPS] ;
+    static int slotSize ;
     
     Processor () ;
 };
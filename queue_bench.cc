@@ -0,0 +1,240 @@
+// throughput and latency of LockFreeQueue against the queue it replaced
+// make bench
+
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "LockFreeQueue.h"
+
+// the queue as it was: adjacent counters, seq_cst everywhere, one item at a time
+template <typename T, uint32_t CAPACITY, typename INDEX_TYPE = uint32_t>
+class LegacyQueue {
+public:
+    bool pop(T &val) {
+        if (isEmpty()){
+            return false;
+        } else {
+            val = buffer[mask(readCounter)];
+            ++readCounter;
+            return true;
+        }
+    }
+
+    bool push(const T& item) {
+        if (isFull()){
+            return false;
+        } else {
+            buffer[mask(writeCounter)] = item;
+            ++writeCounter;
+            return true;
+        }
+    }
+
+    INDEX_TYPE size() const { return writeCounter - readCounter; }
+
+private:
+    bool isEmpty() const { return readCounter == writeCounter; }
+    bool isFull() const { return size() == CAPACITY; }
+    INDEX_TYPE mask(INDEX_TYPE n) const { return static_cast<INDEX_TYPE>(n & (CAPACITY - 1)); }
+
+    T buffer[CAPACITY];
+    std::atomic<INDEX_TYPE> writeCounter { 0 };
+    std::atomic<INDEX_TYPE> readCounter { 0 };
+};
+
+#define BENCH_CAPACITY  8192
+#define BENCH_ITEMS     (20 << 20)
+#define BENCH_BLOCK     256
+#define BENCH_PINGS     20000
+
+typedef std::chrono::steady_clock Clock ;
+
+static double seconds (Clock::time_point from) {
+    return std::chrono::duration <double> (Clock::now () - from).count ();
+}
+
+// on a single core a spinning thread holds up the one it waits for
+static void wait () {
+    std::this_thread::yield ();
+}
+
+static void report (const char * name, double secs, uint64_t checksum, uint64_t expected) {
+    printf ("  %-28s %8.1f M samples/s%s\n", name, BENCH_ITEMS / secs / 1e6,
+            checksum == expected ? "" : "   CHECKSUM MISMATCH");
+}
+
+template <typename Q>
+static double single (Q * q, uint64_t * checksum) {
+    auto start = Clock::now ();
+    std::thread producer ([q] {
+        for (uint32_t i = 0 ; i < BENCH_ITEMS ; i ++)
+            while (! q->push ((float) (i & 0xFFFF)))
+                wait ();
+    });
+
+    uint64_t sum = 0 ;
+    float v ;
+    for (uint32_t i = 0 ; i < BENCH_ITEMS ; i ++) {
+        while (! q->pop (v))
+            wait ();
+        sum += (uint64_t) v ;
+    }
+
+    producer.join ();
+    * checksum = sum ;
+    return seconds (start);
+}
+
+template <typename Q>
+static double bulk (Q * q, uint64_t * checksum) {
+    auto start = Clock::now ();
+    std::thread producer ([q] {
+        float block [BENCH_BLOCK] ;
+        for (uint32_t i = 0 ; i < BENCH_ITEMS ; i += BENCH_BLOCK) {
+            for (int k = 0 ; k < BENCH_BLOCK ; k ++)
+                block [k] = (float) ((i + k) & 0xFFFF);
+            uint32_t done = 0 ;
+            while ((done += q->try_push_n (block + done, BENCH_BLOCK - done)) < BENCH_BLOCK)
+                wait ();
+        }
+    });
+
+    uint64_t sum = 0 ;
+    float block [BENCH_BLOCK] ;
+    for (uint32_t got = 0 ; got < BENCH_ITEMS ; ) {
+        uint32_t n = q->try_pop_n (block, BENCH_BLOCK);
+        if (n == 0)
+            wait ();
+        for (uint32_t k = 0 ; k < n ; k ++)
+            sum += (uint64_t) block [k] ;
+        got += n ;
+    }
+
+    producer.join ();
+    * checksum = sum ;
+    return seconds (start);
+}
+
+template <typename Q>
+static double spans (Q * q, uint64_t * checksum) {
+    auto start = Clock::now ();
+    std::thread producer ([q] {
+        for (uint32_t i = 0 ; i < BENCH_ITEMS ; ) {
+            uint32_t n ;
+            float * p = q->write_span (n);
+            if (n == 0) {
+                wait ();
+                continue ;
+            }
+            n = std::min (n, (uint32_t) BENCH_ITEMS - i);
+            for (uint32_t k = 0 ; k < n ; k ++)
+                p [k] = (float) ((i + k) & 0xFFFF);
+            q->commit_write (n);
+            i += n ;
+        }
+    });
+
+    uint64_t sum = 0 ;
+    for (uint32_t got = 0 ; got < BENCH_ITEMS ; ) {
+        uint32_t n ;
+        const float * p = q->read_span (n);
+        if (n == 0) {
+            wait ();
+            continue ;
+        }
+        for (uint32_t k = 0 ; k < n ; k ++)
+            sum += (uint64_t) p [k] ;
+        q->commit_read (n);
+        got += n ;
+    }
+
+    producer.join ();
+    * checksum = sum ;
+    return seconds (start);
+}
+
+// round trip of one item through a queue and back through another
+template <typename Q>
+static void latency (const char * name, Q * there, Q * back) {
+    std::thread echo ([there, back] {
+        uint64_t v ;
+        for (int i = 0 ; i < BENCH_PINGS ; i ++) {
+            while (! there->pop (v))
+                wait ();
+            while (! back->push (v))
+                wait ();
+        }
+    });
+
+    std::vector <double> trips ;
+    trips.reserve (BENCH_PINGS);
+    for (int i = 0 ; i < BENCH_PINGS ; i ++) {
+        uint64_t v = i ;
+        auto sent = Clock::now ();
+        there->push (v);
+        while (! back->pop (v))
+            wait ();
+        trips.push_back (std::chrono::duration <double, std::micro> (Clock::now () - sent).count ());
+    }
+
+    echo.join ();
+    std::sort (trips.begin (), trips.end ());
+    printf ("  %-28s median %7.2f us   p99 %7.2f us\n", name,
+            trips [trips.size () / 2], trips [trips.size () * 99 / 100]);
+}
+
+int main () {
+    uint64_t expected = 0 ;
+    for (uint32_t i = 0 ; i < BENCH_ITEMS ; i ++)
+        expected += i & 0xFFFF ;
+
+    printf ("%d samples through a %d slot queue, %u cores\n", BENCH_ITEMS, BENCH_CAPACITY,
+            std::thread::hardware_concurrency ());
+
+    uint64_t sum ;
+    double t ;
+    {
+        auto q = new LegacyQueue <float, BENCH_CAPACITY> ();
+        t = single (q, & sum);
+        report ("old push/pop", t, sum, expected);
+        delete q ;
+    }
+    {
+        auto q = new LockFreeQueue <float, BENCH_CAPACITY> ();
+        t = single (q, & sum);
+        report ("push/pop", t, sum, expected);
+        delete q ;
+    }
+    {
+        auto q = new LockFreeQueue <float, BENCH_CAPACITY> ();
+        t = bulk (q, & sum);
+        report ("try_push_n/try_pop_n, 256", t, sum, expected);
+        delete q ;
+    }
+    {
+        auto q = new LockFreeQueue <float, BENCH_CAPACITY> ();
+        t = spans (q, & sum);
+        report ("write_span/read_span", t, sum, expected);
+        delete q ;
+    }
+
+    printf ("round trip, %d pings\n", BENCH_PINGS);
+    {
+        auto a = new LegacyQueue <uint64_t, 16> (), b = new LegacyQueue <uint64_t, 16> ();
+        latency ("old push/pop", a, b);
+        delete a ;
+        delete b ;
+    }
+    {
+        auto a = new LockFreeQueue <uint64_t, 16> (), b = new LockFreeQueue <uint64_t, 16> ();
+        latency ("push/pop", a, b);
+        delete a ;
+        delete b ;
+    }
+
+    return 0 ;
+}
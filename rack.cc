@@ -10,6 +10,11 @@ void toggle_record (GtkToggleButton * button, Engine * engine) {
     }
 }
 
+void save_retro (GtkButton * button, Engine * engine) {
+    if (! engine -> saveRetro ())
+        msg ("The last save is still being written");
+}
+
 void preset_next (void * b, void * d) {
     Rack * rack = (Rack *) d ;
     rack -> next_preset () ;
@@ -69,6 +74,56 @@ void test_plugins (void * d) {
     OUT ;
 }
 
+// work out what the plugin dialog shows from the catalog index. search
+// text, the category / creator dropdown and the favourites toggle all
+// narrow the same set. the list model only sees the result through
+// its filter and sorter
+void apply_plugin_filters (Sorter * sorter) {
+    if (sorter == nullptr || sorter -> filter == nullptr)
+        return ;
+
+    Catalog & catalog = sorter -> engine -> catalog ;
+    CatalogSet set = * sorter -> allowed ;
+    if (sorter -> favs)
+        set &= catalog.favourites ;
+
+    GtkDropDown * dropdown = (GtkDropDown *) (sorter -> mode == 0 ? sorter -> categories : sorter -> creators);
+    GtkStringObject * selected = (GtkStringObject *) gtk_drop_down_get_selected_item (dropdown);
+    const char * group = selected ? gtk_string_object_get_string (selected) : NULL ;
+    if (group && strcmp (group, "All") != 0) {
+        const CatalogSet * g = sorter -> mode == 0 ? catalog.category (group) : catalog.creator (group);
+        if (g)
+            set &= *g ;
+    }
+
+    std::vector <int> result = catalog.search (sorter -> query, set);
+    * sorter -> visible = CatalogSet (catalog.size ());
+    for (int i = 0 ; i < result.size () ; i ++) {
+        sorter -> visible -> set (result [i]);
+        sorter -> rank -> at (result [i]) = i ;
+    }
+
+    gtk_filter_changed ((GtkFilter *) sorter -> filter, GTK_FILTER_CHANGE_DIFFERENT);
+    gtk_sorter_changed ((GtkSorter *) sorter -> order, GTK_SORTER_CHANGE_DIFFERENT);
+}
+
+// items in the plugin model are catalog positions
+static int plugin_item_position (gpointer item) {
+    return atoi (gtk_string_object_get_string ((GtkStringObject *) item));
+}
+
+gboolean plugin_filter_func (gpointer item, gpointer d) {
+    Sorter * sorter = (Sorter *) d ;
+    return sorter -> visible -> test (plugin_item_position (item));
+}
+
+int plugin_sort_func (gconstpointer a, gconstpointer b, gpointer d) {
+    Sorter * sorter = (Sorter *) d ;
+    int ra = sorter -> rank -> at (plugin_item_position ((gpointer) a));
+    int rb = sorter -> rank -> at (plugin_item_position ((gpointer) b));
+    return ra < rb ? -1 : ra > rb ;
+}
+
 void do_search (void * w, void *d) {
     Sorter * sorter = (Sorter *) d ;
     Rack * rack = (Rack *) sorter -> rack ;
@@ -85,89 +140,43 @@ void do_search (void * w, void *d) {
         return ;
     }
     
-    std::string str = std::string (text);
-    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
-    bool all = str.size () == 0;
-    
-    for (int i = 0 ; i < rack -> hearts.size (); i ++) {
-        GtkWidget * w = (GtkWidget * )rack -> hearts.at (i);
-        char * wname = (char *)gtk_widget_get_name (w);
-        w = gtk_widget_get_parent (w);
-        
-        if (all) {           
-            gtk_widget_set_visible (gtk_widget_get_parent (w), true);
-            continue ;
-        }
-        
-        LOGD ("[match] %s -> %s\n", wname, text) ;
-        std::string haystack = std::string (wname) ;
-        std::transform(haystack.begin(), haystack.end(), haystack.begin(), ::tolower);
-
-        if (haystack.find (str) != -1) 
-            gtk_widget_set_visible (gtk_widget_get_parent (w), true);
-        else
-            gtk_widget_set_visible (gtk_widget_get_parent (w), false);
-        
-    }
-    
+    sorter -> query = std::string (text);
+    apply_plugin_filters (sorter);
+}
+
+// filter as you type, hash commands still need enter
+void search_changed (void * w, void * d) {
+    Sorter * sorter = (Sorter *) d ;
+    const char * text = gtk_entry_buffer_get_text (gtk_entry_get_buffer ((GtkEntry *) w));
+    if (text [0] == '#')
+        return ;
+
+    sorter -> query = std::string (text);
+    apply_plugin_filters (sorter);
 }
 
 void show_only_fav_plugins (void * w, void * d) {
     IN
     Sorter * sorter = (Sorter *) d ;
-    Rack * rack = (Rack *) sorter -> rack ;
-    GtkToggleButton * tb = (GtkToggleButton *) w ;
-    
-    bool show = !gtk_toggle_button_get_active (tb) ;
-    for (int i = 0 ; i < rack -> hearts.size () ; i ++) {
-        auto fav = rack -> hearts.at (i);
-        gtk_widget_set_visible (gtk_widget_get_parent (sorter -> boxes->at (i)), show || gtk_toggle_button_get_active ((GtkToggleButton *)fav));
-    }
-    
+    sorter -> favs = gtk_toggle_button_get_active ((GtkToggleButton *) w) ;
+    apply_plugin_filters (sorter);
     OUT
 }
 
-void show_only_categories (void * w, int event, void * d) {
-    GtkWidget * dropdown = (GtkWidget * ) w ;
-    Sorter * sorter = (Sorter *) d;
-    
-    //~ printf ("select %s\n", gtk_string_object_get_string ((GtkStringObject *)gtk_drop_down_get_selected_item ((GtkDropDown *)dropdown)));    
-    char * name = (char *) malloc (20);
-    std::vector <int> ps ;
+void plugin_fav_toggled (GtkToggleButton * heart, Sorter * sorter) {
+    int pos = GPOINTER_TO_INT (g_object_get_data ((GObject *) heart, "position"));
+    bool fav = gtk_toggle_button_get_active (heart);
+    // rows being bound to a new item set the heart too
+    if (pos < 0 || sorter -> engine -> catalog.favourites.test (pos) == fav)
+        return ;
 
-    bool all = false ;
-    if (strcmp ((char *) gtk_widget_get_name (dropdown), "categories") == 0) {
-        if (strcmp (gtk_string_object_get_string ((GtkStringObject *)gtk_drop_down_get_selected_item ((GtkDropDown *)dropdown)), "All") == 0) {
-            all = true ;
-        }
-        
-        ps = sorter -> engine ->categories [gtk_string_object_get_string ((GtkStringObject *)gtk_drop_down_get_selected_item ((GtkDropDown *)dropdown))].get <std::vector<int>>() ;
-    }
-    else
-        ps = sorter -> engine ->creators [gtk_string_object_get_string ((GtkStringObject *)gtk_drop_down_get_selected_item ((GtkDropDown *)dropdown))].get <std::vector<int>>() ;
-    
-    for (int i = 0 ; i < sorter -> boxes->size (); i ++) {
-        GtkWidget * w = (GtkWidget * )sorter->boxes->at (i);
-        char * wname = (char *)gtk_widget_get_name (w);
-        
-        if (all) {           
-            gtk_widget_set_visible (gtk_widget_get_parent (w), true);
-            continue ;
-        }
-            
-        gtk_widget_set_visible (gtk_widget_get_parent (w), false);
-        for (int i = 0 ; i < ps.size();  i++) {
-            int plugin = ps.at (i);
-            sprintf (name, "%d", plugin);
-            if (strcmp (name, wname) == 0) {
-                //~ LOGD ("[sorter] matched %s to %s\n", name, wname);
-                gtk_widget_set_visible (gtk_widget_get_parent (w), true);
-            } 
-        }
-    }
+    sorter -> engine -> catalog.setFavourite (pos, fav);
+    if (sorter -> favs)
+        apply_plugin_filters (sorter);
+}
 
-    
-    free (name);
+void show_only_categories (void * w, int event, void * d) {
+    apply_plugin_filters ((Sorter *) d);
 }
 
 void change_sort_by (void * w, int event, void * d) {
@@ -181,6 +190,9 @@ void change_sort_by (void * w, int event, void * d) {
         gtk_widget_set_visible (sorter -> categories, false);
         gtk_widget_set_visible (sorter -> creators, true);        
     }    
+
+    sorter -> mode = gtk_drop_down_get_selected ((GtkDropDown *)sortBy) ;
+    apply_plugin_filters (sorter);
 }
 
 void Rack::move_down (PluginUI * ui) {
@@ -251,45 +263,23 @@ PluginUI * Rack::addPluginByName (char * requested) {
     bool has_file = false ;
     PluginFileType file_type = FILE_AUDIO ;
     
-    for (auto plugin : engine ->lv2Json) {
-        std::string a = plugin ["name"].dump() ;
-        a = a.substr (1, a.size () - 2);
-        //~ LOGD ("[lv2] %s | %s\n", requested, a.c_str());
-        if (strcmp (a.c_str (), requested) == 0) {
-            int index = plugin ["index"].get <int> () ;
-            std::string lib = plugin ["library"] ;
-            // lib = std::string (engine -> libraryPath) + lib.substr (1, lib.size () - 2);
-            //~ LOGD ("found plugin %s: loading %s\n", requested, lib.c_str ());
-            res = engine ->addPlugin ((char *)lib.c_str (), index);
-            if (plugin.contains ("file")) {
-                has_file = true ;                
-                file_type = (PluginFileType) plugin ["fileType"].get <int> ();
-                //~ LOGD ("got file type: %d\n", file_type);
-            }
-            break ;
-        }
-    }
-    
-    if (! res) {
-        for (auto plugin : engine ->ladspaJson) {
-            std::string a = plugin ["name"].dump() ;
-            a = a.substr (1, a.size () - 2);
-            //~ LOGD ("[ladspa] %s | %s\n", requested, a.c_str());
-            if (strcmp (a.c_str (), requested) == 0) {
-                std::string lib = plugin ["library"] ;
-                //~ LOGD ("[ladspa] found plugin %s: loading %s\n", requested, lib.c_str ());
-                int index = plugin ["plugin"].get <int> () ;
-                // lib = std::string (engine -> libraryPath) + lib.substr (1, lib.size () - 2);
-                res = engine ->addPlugin ((char *)lib.c_str (), index);
-                if (plugin.contains ("file") && plugin ["file"].get <bool>()) {
-                    has_file = true ;                
-                    file_type = (PluginFileType) plugin ["fileType"].get <int> ();
-                }
-                break ;
-            }
+    // not just the display name: a URI, a legacy alias from old presets or
+    // the name in another case find the plugin too, see Catalog::find
+    const CatalogEntry * entry = engine -> catalog.find (requested);
+    if (entry != nullptr) {
+        //~ LOGD ("found plugin %s: loading %s\n", requested, entry -> library.c_str ());
+        res = engine ->addPlugin (entry);
+        if (entry -> hasFile) {
+            has_file = true ;                
+            file_type = (PluginFileType) entry -> fileType ;
         }
     }
     
+    // what loads and what does not is the plugin change we get to see:
+    // a plugin that failed once gets its presets back when it loads
+    if (entry != nullptr && presets != nullptr)
+        ((Presets *) presets) -> plugin_loaded (requested, res);
+
     //~ return ;
     if (res) {
         int index = engine -> activePlugins->size () - 1;
@@ -324,54 +314,61 @@ void addPluginCallback (void * b, void * c) {
     rack -> addPluginByName (requested);
 }
 
-GtkWidget * Rack::addPluginEntry (std::string plug) {
+// row widgets are only created for rows on screen and recycled as the
+// list scrolls
+void plugin_row_setup (GtkSignalListItemFactory * factory, GtkListItem * item, Sorter * sorter) {
+        Rack * rack = (Rack *) sorter -> rack ;
         GtkWidget * box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10);
         gtk_widget_set_margin_start (box, 10);
         gtk_widget_set_margin_end (box, 10);
-        GtkWidget * label = gtk_button_new_with_label (plug.c_str ());
+        GtkWidget * label = gtk_button_new_with_label ("");
         gtk_widget_set_hexpand (box, true);
         gtk_widget_set_hexpand (label, true);
-        //~ gtk_label_set_wrap ((GtkLabel *)label, true);
         GtkWidget * fav = gtk_toggle_button_new ();
         gtk_button_set_label ((GtkButton *) fav, "♥");
-        gtk_widget_set_name (fav, plug.c_str ());
-        
-        hearts.push_back (fav);
-        
-        GtkWidget * button = gtk_button_new () ;
-        gtk_button_set_label ((GtkButton *) button, "+");
-        
-        gtk_widget_set_name (button, plug.c_str ());
         
-        //~ g_signal_connect (button, "clicked", GCallback (addPluginCallback), this);
-        g_signal_connect (label, "clicked", GCallback (addPluginCallback), this);
+        g_signal_connect (label, "clicked", GCallback (addPluginCallback), rack);
+        g_object_set_data ((GObject *) fav, "position", GINT_TO_POINTER (-1));
+        g_signal_connect (fav, "toggled", (GCallback) plugin_fav_toggled, sorter);
         
-        gtk_widget_set_hexpand (box, true);
         GtkBox * B = (GtkBox *)gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
         gtk_widget_set_name ((GtkWidget *)B, "plugin");
         gtk_box_append (B, (GtkWidget *) label);
         gtk_box_append (B, (GtkWidget *) fav);
-        gtk_widget_set_hexpand (label, true);
         gtk_widget_set_hexpand ((GtkWidget *) B, true);
-        //~ gtk_widget_set_halign (label, GTK_ALIGN);
-        //~ gtk_label_set_justify ((GtkLabel *) label, GTK_JUSTIFY_LEFT);
-        //~ gtk_widget_set_halign ((GtkWidget *) gtk_button_get_child ((GtkButton *) label), GTK_ALIGN_START);
         gtk_widget_set_halign ((GtkWidget *) label, GTK_ALIGN_START);
         gtk_widget_set_hexpand ((GtkWidget *) gtk_button_get_child ((GtkButton *) label), true);
         gtk_label_set_wrap ((GtkLabel *) gtk_button_get_child ((GtkButton *) label), true);
         gtk_label_set_justify ((GtkLabel *) gtk_button_get_child ((GtkButton *) label), GTK_JUSTIFY_LEFT);
-        //~ gtk_button_set_has_frame ((GtkButton *)fav, false);
-        //~ gtk_widget_add_css_class (fav, "flat");
         gtk_widget_set_name (label, "effect-button");
-        //~ gtk_widget_set_name (fav, "effect-fav");
-        //~ gtk_widget_set_name (gtk_button_get_child ((GtkButton *) label), "effect-label");
         
         gtk_box_append ((GtkBox *)box, (GtkWidget *)B);
-        //~ gtk_box_append ((GtkBox *)box, button);
-        //~ gtk_box_append ((GtkBox *)box,  fav);
-        
-        gtk_list_box_append ((GtkListBox *)listBox, box);      
-        return box ;      
+        g_object_set_data ((GObject *) box, "label", label);
+        g_object_set_data ((GObject *) box, "fav", fav);
+        gtk_list_item_set_child (item, box);
+}
+
+void plugin_row_bind (GtkSignalListItemFactory * factory, GtkListItem * item, Sorter * sorter) {
+        GtkWidget * box = gtk_list_item_get_child (item);
+        GtkWidget * label = (GtkWidget *) g_object_get_data ((GObject *) box, "label");
+        GtkWidget * fav = (GtkWidget *) g_object_get_data ((GObject *) box, "fav");
+        int pos = plugin_item_position (gtk_list_item_get_item (item));
+        const CatalogEntry & entry = sorter -> engine -> catalog.entries [pos] ;
+
+        gtk_button_set_label ((GtkButton *) label, entry.name.c_str ());
+        gtk_widget_set_name (fav, entry.name.c_str ());
+        g_object_set_data ((GObject *) fav, "position", GINT_TO_POINTER (pos));
+        gtk_toggle_button_set_active ((GtkToggleButton *) fav, sorter -> engine -> catalog.favourites.test (pos));
+}
+
+// favourites changed behind the rows' back, rebind whatever is on screen
+void Rack::refreshPluginDialog () {
+    GtkListItemFactory * factory = gtk_list_view_get_factory ((GtkListView *) listBox);
+    g_object_ref (factory);
+    gtk_list_view_set_factory ((GtkListView *) listBox, NULL);
+    gtk_list_view_set_factory ((GtkListView *) listBox, factory);
+    g_object_unref (factory);
+    apply_plugin_filters (sorter);
 }
 
 void Rack::add () {
@@ -397,39 +394,25 @@ GtkWidget * Rack::createPluginDialog () {
     gtk_box_append ((GtkBox *)master, chooser);
     gtk_widget_set_name (chooser, "rack");
     
-    char * category [50] ;
-    char * creators [60] ;
+    std::vector <const char *> category, creators ;
+    for (auto cat=engine->categories.begin () ; cat != engine -> categories.end () ; cat ++)
+        category.push_back (cat.key ().c_str ());
+    category.push_back (NULL);
     
-    int i = 0 ;
-    for (auto cat=engine->categories.begin () ; cat != engine -> categories.end () ; cat ++) {
-        std::string a = cat.key () ;
-        //~ LOGD ("[category] %s\n", a.c_str ());
-        category [i] = strdup (a.c_str ());
-        i ++ ;
-    }
-    
-    category [i] = NULL;
-    
-    i = 0 ;
-    for (auto cat=engine->creators.begin () ; cat != engine -> creators.end () ; cat ++) {
-        std::string a = cat.key () ;
-        //~ LOGD ("[creator] %s\n", a.c_str ());
-        creators [i] = strdup (a.c_str ());
-        i ++ ;
-    }
-
-    creators [i] = NULL;
+    for (auto cat=engine->creators.begin () ; cat != engine -> creators.end () ; cat ++)
+        creators.push_back (cat.key ().c_str ());
+    creators.push_back (NULL);
     
-    char * ob [] = {
-        strdup ("Category"),
-        strdup ("Creator"),
+    const char * ob [] = {
+        "Category",
+        "Creator",
         NULL
     } ;
     
     GtkWidget * sortBy = gtk_drop_down_new_from_strings (ob) ;
-    GtkWidget * categories = gtk_drop_down_new_from_strings (category);
+    GtkWidget * categories = gtk_drop_down_new_from_strings (category.data ());
     gtk_widget_set_name(categories, "categories");
-    GtkWidget * creators_w = gtk_drop_down_new_from_strings (creators);
+    GtkWidget * creators_w = gtk_drop_down_new_from_strings (creators.data ());
     gtk_widget_set_name (creators_w, "creators");
     
     GtkWidget * show_only_favorites = (GtkWidget *) gtk_toggle_button_new_with_label ("♥");
@@ -444,16 +427,27 @@ GtkWidget * Rack::createPluginDialog () {
     gtk_box_append ((GtkBox *)hbox, show_only_favorites);
 
     gtk_widget_set_hexpand (hbox, false);
-    //~ gtk_widget_set_halign (show_only_favorites, GTK_ALIGN_END);
-    //~ gtk_widget_set_halign (hbox, GTK_ALIGN_END);
         
-    Sorter * sorter = (Sorter *) malloc (sizeof (Sorter));
-    sorter -> boxes = new std::vector <GtkWidget *>();
+    Catalog & catalog = engine -> catalog ;
+    sorter = new Sorter ();
     sorter->categories = categories;
     sorter->creators = creators_w ;
     sorter -> engine = engine ;
-    sorter -> listBox = listBox ;
     sorter -> rack = (void *) this ;
+    sorter -> visible = new CatalogSet (catalog.size (), true);
+    sorter -> rank = new std::vector <int> (catalog.size ());
+    for (int i = 0 ; i < catalog.size () ; i ++)
+        sorter -> rank -> at (i) = i ;
+
+    // blacklist is keyed by lv2_plugins.json key, which is the id
+    sorter -> allowed = new CatalogSet (catalog.size (), true);
+    for (auto & b: blacklist.items ()) {
+        int pos = catalog.position (atoi (b.key ().c_str ()));
+        if (pos != -1)
+            sorter -> allowed -> set (pos, false);
+    }
+
+    * sorter -> visible = * sorter -> allowed ;
     
     gtk_box_append ((GtkBox *)chooser, sortBy);
     gtk_box_append ((GtkBox *)chooser, categories);
@@ -469,14 +463,36 @@ GtkWidget * Rack::createPluginDialog () {
     g_signal_connect (creators_w, "notify::selected", (GCallback)show_only_categories, sorter);
     g_signal_connect (show_only_favorites, "toggled", (GCallback)show_only_fav_plugins, sorter);
     g_signal_connect (search, "activate", (GCallback)do_search, sorter);
+    g_signal_connect (search, "changed", (GCallback)search_changed, sorter);
     
     gtk_widget_set_hexpand (sortBy, true);
     gtk_widget_set_hexpand (categories, true);
     gtk_widget_set_hexpand (chooser, true);
     gtk_widget_set_vexpand (master, true);
     
+    // one string per catalog entry, its position. everything else is
+    // looked up from the catalog when a row is bound
+    GtkStringList * plugins = gtk_string_list_new (NULL);
+    char name [16] ;
+    for (int i = 0 ; i < catalog.size () ; i ++) {
+        snprintf (name, sizeof (name), "%d", i);
+        gtk_string_list_append (plugins, name);
+    }
+
+    sorter -> filter = gtk_custom_filter_new (plugin_filter_func, sorter, NULL);
+    sorter -> order = gtk_custom_sorter_new (plugin_sort_func, sorter, NULL);
+    GtkFilterListModel * filtered = gtk_filter_list_model_new ((GListModel *) plugins, (GtkFilter *) sorter -> filter);
+    g_object_ref (sorter -> filter);
+    GtkSortListModel * sorted = gtk_sort_list_model_new ((GListModel *) filtered, (GtkSorter *) sorter -> order);
+    g_object_ref (sorter -> order);
+    
+    GtkListItemFactory * factory = gtk_signal_list_item_factory_new ();
+    g_signal_connect (factory, "setup", (GCallback) plugin_row_setup, sorter);
+    g_signal_connect (factory, "bind", (GCallback) plugin_row_bind, sorter);
+    
     GtkWidget * sw = gtk_scrolled_window_new ();
-    listBox = gtk_list_box_new ();
+    listBox = gtk_list_view_new ((GtkSelectionModel *) gtk_no_selection_new ((GListModel *) sorted), factory);
+    sorter -> listBox = listBox ;
     gtk_scrolled_window_set_child ((GtkScrolledWindow *)sw, listBox);
     
     gtk_box_append ((GtkBox *) master, sw);
@@ -485,52 +501,7 @@ GtkWidget * Rack::createPluginDialog () {
 
     gtk_widget_set_vexpand (listBox, true);
     gtk_widget_set_hexpand (listBox, true);
-    
-    char * name = (char *) malloc (100);
-    for (auto it=engine->lv2Json.begin () ; it != engine -> lv2Json.end () ; it ++) {
-    //~ for (auto plugin : engine ->lv2Json) {
-        auto plugin = it .value ();
-        std::string a = plugin ["name"].dump() ;
-        // LOGD ("p: %s\n", it.key ().c_str ());
-        
-        if (blacklist.contains (it.key ().c_str ())) {
-            //~ LOGD ("blacklisted plugin: %s\n", a.c_str ()) ;
-            continue;
-        }
-        
-        int id = plugin ["id"].get <int>() ;
-        //~ printf ("plugin %d: %s\n", id, a.c_str());
-        GtkWidget * w = (GtkWidget *) addPluginEntry (a.substr (1, a.size () - 2));
-        sorter -> boxes->push_back (w);
-        sprintf (name, "%d", id);
-        gtk_widget_set_name (w, name);
-    }
-   
-    for (auto plugin : engine ->ladspaJson) {
-        std::string a = plugin ["name"].dump() ;
-        std::string id = plugin ["id"].dump () ;
-        //~ printf ("[ladspa] plugin %s: %s\n", id.c_str (), a.c_str());
-        if (blacklist.contains (id)) {
-            //~ LOGD ("blacklisted plugin [%s]: %s\n", id.c_str (), a.c_str ()) ;
-            continue;
-        }        
-
-        GtkWidget * w = (GtkWidget *) addPluginEntry (a.substr (1, a.size () - 2));
-        //~ sprintf (name, "%d", id);
-
-        sorter -> boxes->push_back (w);
-        gtk_widget_set_name (w, id.c_str ());
-    }
-    
-    free (name);
-
-    //~ for (int i = 0 ; i < engine -> lv2Plugins->size () ; i ++) {
-        //~ addPluginEntry (engine -> lv2Plugins->at (i));
-    //~ }
-    
-    //~ for (int i = 0 ; i < engine -> ladspaPlugins->size () ; i ++) {
-        //~ addPluginEntry (engine -> ladspaPlugins->at (i));
-    //~ }
+    gtk_widget_set_vexpand (sw, true);
        
     //~ gtk_window_present ((GtkWindow *)pluginDialog);
     OUT
@@ -539,6 +510,10 @@ GtkWidget * Rack::createPluginDialog () {
 
 
 bool Rack::load_preset (std::string filename) {
+    DecodedPreset preset ;
+    if (PresetCodec::load (filename, & preset))
+        return load_preset (preset);
+
     json j = filename_to_json (filename) ;
     if (j != NULL)
         return load_preset (j);
@@ -547,38 +522,50 @@ bool Rack::load_preset (std::string filename) {
 }
 
 bool Rack::load_preset (json j) {
+    DecodedPreset preset ;
+    if (! PresetCodec::fromJson (j, & preset))
+        return false ;
+    return load_preset (preset);
+}
+
+bool Rack::load_preset (const DecodedPreset & preset) {
     IN
-    gtk_label_set_text (current_patch, j ["name"].dump ().c_str ());
-    auto plugins = j ["controls"];
+    // whatever is installed is loaded, the rest is named so it can be
+    gtk_label_set_text (current_patch, preset.name.c_str ());
     clear () ;
     int index = 0 ;
-    for (auto p: plugins) {
-        auto plugin = p ["name"].dump () ;
-        plugin = plugin.substr (1, plugin.size () - 2) ;
-        PluginUI * ui = addPluginByName ((char *) plugin.c_str ());
+    std::string missing ;
+    for (const PresetPlugin & p: preset.plugins) {
+        PluginUI * ui = addPluginByName ((char *) p.name.c_str ());
         if (ui == NULL) {
-            HERE LOGD ("-----| error loading plugin %s |-------\n", plugin.c_str ());
+            HERE LOGD ("-----| error loading plugin %s |-------\n", p.name.c_str ());
+            missing.append (missing.empty () ? "" : ", ").append (p.name);
             continue ;
         }
-        auto controls = p ["controls"].dump () ;
-        controls = controls.substr (1, controls.size () - 2);
-        ui -> load_preset (controls) ;
-        if (p.contains ("filename")) {
-            std::string filename = p ["filename"].dump () ;
-            filename = filename.substr (1, filename.size () - 2) ;
-            wtf ("[preset] loading file: %s\n", filename.c_str ());
+
+        // values go to the engine first, the sliders follow
+        engine -> applyPreset (index, p);
+        ui -> sync () ;
+        if (p.hasFile) {
+            wtf ("[preset] loading file: %s\n", p.filename.c_str ());
             
-            if (p ["filetype"].get <int> () == 0) {
-                engine -> set_plugin_audio_file (index, (char *) filename.c_str ());
+            if (p.filetype == 0) {
+                engine -> set_plugin_audio_file (index, (char *) p.filename.c_str ());
             } else {
-                engine -> set_plugin_file (index, (char *)  filename.c_str ());          
+                engine -> set_plugin_file (index, (char *)  p.filename.c_str ());          
             }
         }
         
         index ++ ;
     }
     
-    //~ build () ;
+    if (! missing.empty ()) {
+        LOGD ("[preset] %s: missing %s\n", preset.name.c_str (), missing.c_str ());
+        msg (std::string ("Loaded ").append (preset.name).append (" without ").append (missing));
+    }
+
+    // port metadata for any plugin seen for the first time, in one write
+    Plugin::portCache->flush ();
     OUT
     return true;
 }
@@ -630,6 +617,43 @@ Rack::Rack () {
     config = filename_to_json (std::string (getenv ("USERPROFILE")).append ("/.config/amprack/config.json"));    
     # endif
     
+    // e.g. ["wav", "mp3"] or ["flac", "opus"], an MP3 otherwise
+    if (config.contains ("recording_formats"))
+        engine -> fileWriter -> setFileTypes (config ["recording_formats"]);
+    // "dry_wet" or "split" keeps the input for re-amping, see FileWriter
+    if (config.contains ("recording_mode"))
+        engine -> fileWriter -> setMode (config ["recording_mode"]);
+    if (config.contains ("recording_slots"))
+        engine -> fileWriter -> setSlots (config ["recording_slots"]);
+
+    // keep the last few minutes of dry and wet, "retro_storage": "s16"
+    // keeps the same minutes in half the memory
+    if (config.contains ("retro_minutes") && config ["retro_minutes"].is_number_integer ()) {
+        engine -> retro -> minutes = config ["retro_minutes"].get <int> ();
+        if (config.value ("retro_storage", "") == "s16")
+            engine -> retro -> storage = RETRO_S16 ;
+        int type = Encoder::parse (config.value ("retro_format", "wav"));
+        if (type >= 0)
+            engine -> retro -> type = (FileType) type ;
+        if (engine -> retro -> minutes > 0)
+            engine -> retro -> enable ();
+    }
+
+    // "peak" or "energy" levels IRs and other files loaded into plugins
+    if (config.contains ("asset_normalize"))
+        engine -> assets -> setNormalize (config ["asset_normalize"]);
+
+    // {"formats": ["flac", "opus"], "source": "delete"}: WAV masters are
+    // turned into these in the background once a take is done
+    if (config.contains ("archive") && config ["archive"].is_object ()) {
+        engine -> transcoder = new Transcoder (engine -> config + "/transcode.json");
+        if (config ["archive"].contains ("formats"))
+            engine -> transcoder -> setFormats (config ["archive"]["formats"]);
+        if (config ["archive"].contains ("source"))
+            engine -> transcoder -> setPolicy (config ["archive"]["source"]);
+        engine -> transcoder -> start ();
+    }
+
     if (config.contains ("theme")) {
         theme = config ["theme"].dump ();
         theme = theme.substr (1, theme.size () - 2);
@@ -658,6 +682,14 @@ Rack::Rack () {
     //~ onoff.set_label ("On");
     record = (GtkToggleButton *) gtk_toggle_button_new_with_label ("Rec");
     g_signal_connect (record, "toggled", (GCallback) toggle_record, engine);
+    keep = (GtkButton *) gtk_button_new_with_label ("Keep");
+    g_signal_connect (keep, "clicked", (GCallback) save_retro, engine);
+    gtk_widget_set_visible ((GtkWidget *) keep, engine -> retro -> enabled ());
+    if (engine -> retro -> enabled ()) {
+        std::string tip = std::string ("Save the last ").append (std::to_string (engine -> retro -> minutes))
+            .append (" minutes (K), ").append (std::to_string (engine -> retro -> bytes () >> 20)).append (" MB held");
+        gtk_widget_set_tooltip_text ((GtkWidget *) keep, tip.c_str ());
+    }
     
     GtkButton * syn = (GtkButton * ) gtk_button_new_with_label ("Sync");
     GtkButton * tune = (GtkButton * ) gtk_button_new_with_label ("Tuner");
@@ -743,6 +775,7 @@ Rack::Rack () {
     gtk_box_append (v, (GtkWidget *)patch_down);
 
     gtk_box_append (v, (GtkWidget *) record);
+    gtk_box_append (v, (GtkWidget *) keep);
     gtk_box_append (v, (GtkWidget *) onoff);
     gtk_box_append (v, (GtkWidget *) l);
     
@@ -799,20 +832,22 @@ void Rack:: next_preset () {
     Rack * rack = this ;
     Presets * presets = (Presets *) rack -> presets ;
     int which = gtk_notebook_get_current_page (presets -> presets);
+    int count = presets -> count (which);
     
-    if (presets -> list_of_presets [which]->size () == 0) {
+    if (count == 0) {
         wtf ("[patch] no patches in %d\n", which);
         return ;
     }
     
     rack -> patch ++ ;
-    if (rack -> patch > presets -> list_of_presets [which]->size () - 1)
+    if (rack -> patch > count - 1)
         rack -> patch = 0 ;
     
     wtf ("[patch] tab: %d: %d\n", which, rack -> patch);
 
-    rack -> load_preset (presets -> list_of_presets [which]-> at (rack -> patch));
-    gtk_label_set_text (rack -> current_patch, presets -> list_of_presets [which]-> at (rack -> patch) ["name"].dump().c_str ());
+    json * j = presets -> at (which, rack -> patch);
+    rack -> load_preset (* j);
+    gtk_label_set_text (rack -> current_patch, (* j) ["name"].dump().c_str ());
     
 }
 
@@ -820,17 +855,19 @@ void Rack::prev_preset () {
     Rack * rack = this ;
     Presets * presets = (Presets *) rack -> presets ;
     int which =  gtk_notebook_get_current_page (presets -> presets);
-    if (presets -> list_of_presets [which]->size () == 0) {
+    int count = presets -> count (which);
+    if (count == 0) {
         wtf ("[patch] no patches in %d\n", which);
         return ;
     }
     
     rack -> patch -- ;
-    if (rack -> patch < 0)
-        rack -> patch =  presets -> list_of_presets [which]->size () - 1;
+    if (rack -> patch < 0 || rack -> patch > count - 1)
+        rack -> patch =  count - 1;
     
     wtf ("[patch] tab: %d: %d\n", which, rack -> patch);
-    rack -> load_preset ( presets -> list_of_presets [which]-> at (rack -> patch));
-    gtk_label_set_text (rack -> current_patch, presets -> list_of_presets [which]-> at (rack -> patch) ["name"].dump().c_str ());
+    json * j = presets -> at (which, rack -> patch);
+    rack -> load_preset (* j);
+    gtk_label_set_text (rack -> current_patch, (* j) ["name"].dump().c_str ());
     
 }
@@ -22,8 +22,15 @@ using json = nlohmann::json;
 typedef struct _Sorter {
     GtkWidget * creators, * categories, * listBox;
     Engine * engine ;
-    std::vector <GtkWidget *> * boxes;
+    GtkCustomFilter * filter ;
+    GtkCustomSorter * order ;
+    CatalogSet * allowed ;              // everything not blacklisted
+    CatalogSet * visible ;              // current result set
+    std::vector <int> * rank ;          // result order, by catalog position
     void * rack ;
+    std::string query ;
+    int mode = 0 ;                      // 0: category, 1: creator
+    bool favs = false ;
 } Sorter;
 
 typedef void (*HashCommand)(void *);
@@ -33,7 +40,7 @@ public:
     json config ;
     std::string theme ;
     Engine * engine ;
-    void * presets ;
+    void * presets = nullptr ;
     std::map <std::string, HashCommand> hashCommands ;
     std::map <int, GtkWidget*> pMap ;
     GtkBox * master, * mixer;
@@ -52,6 +59,7 @@ public:
     GtkButton * logo, * menu_button, * patch_up, * patch_down ;
     GtkLabel * current_patch ;
     GtkToggleButton * mixer_toggle, * record ;
+    GtkButton * keep ;
     GtkWidget * listBox ;
     GtkSwitch * onoff ;
     GtkToggleButton * toggle_presets ;
@@ -60,15 +68,16 @@ public:
     int patch = 0;
     
     std::vector <PluginUI> plugins ;        
-    std::vector <GtkWidget *> hearts ;
+    Sorter * sorter = nullptr ;
     void add ();
     PluginUI * addPluginByName (char *);
     bool load_preset (json);
     bool load_preset (std::string filename);
+    bool load_preset (const DecodedPreset &);
     
     GtkWidget * pluginDialog, * rack ;
     GtkWidget * createPluginDialog () ;
-    GtkWidget * addPluginEntry (std::string plug) ;
+    void refreshPluginDialog () ;
     
     json blacklist ;
     GtkWidget * search ;
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include "recordings.h"
+
+Recordings::Recordings (Engine * engine) {
+    this -> engine = engine ;
+    box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 10);
+    gtk_widget_set_name (box, "plugin");
+
+    GtkBox * top = (GtkBox *) gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10);
+    info = (GtkLabel *) gtk_label_new ("");
+    gtk_widget_set_hexpand ((GtkWidget *) info, true);
+    gtk_label_set_xalign (info, 0);
+    GtkWidget * refresh = gtk_button_new_with_label ("Refresh");
+    g_signal_connect (refresh, "clicked", (GCallback) refresh_cb, this);
+    gtk_box_append (top, (GtkWidget *) info);
+    gtk_box_append (top, refresh);
+    gtk_box_append ((GtkBox *) box, (GtkWidget *) top);
+
+    waveform = new Waveform ();
+    gtk_widget_set_vexpand (waveform -> area, false);
+    gtk_box_append ((GtkBox *) box, waveform -> area);
+
+    list = (GtkListBox *) gtk_list_box_new ();
+    g_signal_connect (list, "row-selected", (GCallback) selected, this);
+    GtkWidget * sw = gtk_scrolled_window_new ();
+    gtk_widget_set_vexpand (sw, true);
+    gtk_scrolled_window_set_child ((GtkScrolledWindow *) sw, (GtkWidget *) list);
+    gtk_box_append ((GtkBox *) box, sw);
+
+    engine -> peaks -> watch (scanned, this);
+    this -> refresh ();
+}
+
+void Recordings::refresh_cb (GtkButton * button, gpointer data) {
+    ((Recordings *) data) -> refresh ();
+}
+
+void Recordings::refresh () {
+    IN
+    std::vector <std::pair <std::filesystem::file_time_type, std::string>> found ;
+    std::error_code ec ;
+    for (auto & entry: std::filesystem::directory_iterator (engine -> home, ec)) {
+        std::string ext = entry.path ().extension ().string ();
+        if (! entry.is_regular_file (ec) || (ext != ".wav" && ext != ".flac" && ext != ".ogg" && ext != ".mp3"))
+            continue ;
+        // still being written, its peaks come when it stops
+        std::string name = entry.path ().string ();
+        if (Processor::recording && std::find (engine -> fileWriter -> files.begin (), engine -> fileWriter -> files.end (), name) != engine -> fileWriter -> files.end ())
+            continue ;
+        found.push_back ({entry.last_write_time (ec), name});
+    }
+
+    std::sort (found.begin (), found.end (), [] (auto & a, auto & b) { return a.first > b.first ; });
+    files.clear ();
+    GtkWidget * row ;
+    while ((row = gtk_widget_get_first_child ((GtkWidget *) list)) != nullptr)
+        gtk_list_box_remove (list, row);
+
+    for (auto & f: found) {
+        files.push_back (f.second);
+        GtkWidget * label = gtk_label_new (std::filesystem::path (f.second).filename ().string ().c_str ());
+        gtk_label_set_xalign ((GtkLabel *) label, 0);
+        gtk_list_box_append (list, label);
+    }
+
+    waveform -> clear ();
+    describe ();
+    OUT
+}
+
+void Recordings::describe () {
+    std::string text ;
+    if (waveform -> file.empty ())
+        text = files.empty () ? "Nothing recorded yet" : std::to_string (files.size ()).append (" recordings") ;
+    else if (waveform -> empty ()) {
+        std::lock_guard <std::mutex> guard (lock);
+        text = std::filesystem::path (waveform -> file).filename ().string ().append (
+            waveform -> file == unreadable ? ": cannot read it" : ": building the waveform ...");
+    }
+    else {
+        char detail [64];
+        int s = (int) waveform -> seconds ();
+        snprintf (detail, sizeof (detail), ": %d:%02d:%02d, %d channels", s / 3600, s / 60 % 60, s % 60, waveform -> channels ());
+        text = std::filesystem::path (waveform -> file).filename ().string ().append (detail);
+    }
+
+    gtk_label_set_text (info, text.c_str ());
+}
+
+void Recordings::selected (GtkListBox * list, GtkListBoxRow * row, gpointer data) {
+    Recordings * r = (Recordings *) data ;
+    int index = row ? gtk_list_box_row_get_index (row) : -1 ;
+    if (index < 0 || index >= (int) r -> files.size ()) {
+        r -> waveform -> clear ();
+        r -> describe ();
+        return ;
+    }
+
+    std::string file = r -> files [index] ;
+    if (! r -> waveform -> load (file))
+        r -> engine -> peaks -> request (file);
+    r -> describe ();
+}
+
+// from the scanner's thread: one idle in flight at a time
+void Recordings::scanned (std::string audio, bool ok, void * data) {
+    Recordings * r = (Recordings *) data ;
+    if (! ok) {
+        std::lock_guard <std::mutex> guard (r -> lock);
+        r -> unreadable = audio ;
+    }
+
+    if (! r -> pending.exchange (true))
+        g_idle_add (scanned_cb, r);
+}
+
+// whatever finished, the one on screen may be it
+gboolean Recordings::scanned_cb (gpointer data) {
+    Recordings * r = (Recordings *) data ;
+    r -> pending = false ;
+    if (! r -> waveform -> file.empty () && r -> waveform -> empty ())
+        r -> waveform -> load (r -> waveform -> file);
+    r -> describe ();
+    return G_SOURCE_REMOVE ;
+}
@@ -0,0 +1,38 @@
+#ifndef RECORDINGS_H
+#define RECORDINGS_H
+
+#include <atomic>
+#include <mutex>
+#include <gtk/gtk.h>
+#include "engine.h"
+#include "waveform.h"
+
+/*  The takes in the recordings folder, newest first, with the waveform
+ *  of the one picked. Files recorded before peaks existed get theirs
+ *  built in the background the first time they are picked.
+ */
+class Recordings {
+    Engine * engine ;
+    std::vector <std::string> files ;
+    std::atomic <bool> pending { false };
+    // the last file the scanner could not read
+    std::mutex lock ;
+    std::string unreadable ;
+
+    static void refresh_cb (GtkButton * button, gpointer data);
+    static void selected (GtkListBox * list, GtkListBoxRow * row, gpointer data);
+    static void scanned (std::string audio, bool ok, void * data);
+    static gboolean scanned_cb (gpointer data);
+    void describe ();
+
+public:
+    GtkWidget * box ;
+    GtkListBox * list ;
+    GtkLabel * info ;
+    Waveform * waveform ;
+
+    Recordings (Engine * engine);
+    void refresh ();
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include "resampler.h"
+
+// zero crossings of the sinc each side, before any widening for downsampling
+#define RESAMPLE_ZEROS 32
+// of the lower Nyquist, kept flat
+#define RESAMPLE_PASS 0.95
+// about 90 dB down in the stop band
+#define RESAMPLE_BETA 9.0
+// more phases than this are worked out for each sample instead
+#define RESAMPLE_PHASES 4096
+
+static double bessel_i0 (double x) {
+    double sum = 1, term = 1 ;
+    for (int k = 1 ; k < 50 && term > sum * 1e-12 ; k ++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term ;
+    }
+
+    return sum ;
+}
+
+Resampler::Resampler (int from, int to) {
+    int g = std::gcd (from, to);
+    up = to / g ;
+    down = from / g ;
+
+    double ratio = (double) up / down ;
+    double narrow = ratio < 1 ? ratio : 1 ;
+    cutoff = RESAMPLE_PASS * narrow ;
+    half = (int) ceil (RESAMPLE_ZEROS / narrow);
+    taps = half * 2 ;
+
+    if (up != down && up <= RESAMPLE_PHASES) {
+        table.resize ((size_t) up * taps);
+        for (int p = 0 ; p < up ; p ++)
+            phase ((double) p / up, table.data () + (size_t) p * taps);
+    }
+}
+
+// the taps for an output that falls offset past an input sample, summing to one
+void Resampler::phase (double offset, float * out) {
+    double i0 = bessel_i0 (RESAMPLE_BETA), sum = 0 ;
+    std::vector <double> h (taps);
+    for (int k = 0 ; k < taps ; k ++) {
+        double x = k - half + 1 - offset ;
+        double u = x / half ;
+        double w = fabs (u) >= 1 ? 0 : bessel_i0 (RESAMPLE_BETA * sqrt (1 - u * u)) / i0 ;
+        double s = x == 0 ? 1 : sin (M_PI * cutoff * x) / (M_PI * cutoff * x);
+        h [k] = cutoff * s * w ;
+        sum += h [k] ;
+    }
+
+    for (int k = 0 ; k < taps ; k ++)
+        out [k] = h [k] / sum ;
+}
+
+int Resampler::length (int frames) {
+    return (int) (((long long) frames * up + down - 1) / down);
+}
+
+void Resampler::process (const float * in, int frames, int stride, float * out) {
+    int n = length (frames);
+    if (up == down) {
+        for (int i = 0 ; i < frames ; i ++)
+            out [i] = in [(size_t) i * stride] ;
+        return ;
+    }
+
+    // zeros either side, so every output is the same full length dot product
+    std::vector <float> padded ((size_t) frames + taps + 1, 0);
+    for (int i = 0 ; i < frames ; i ++)
+        padded [half + i] = in [(size_t) i * stride] ;
+
+    std::vector <float> own (table.empty () ? taps : 0);
+    for (int j = 0 ; j < n ; j ++) {
+        long long at = (long long) j * down ;
+        long long i = at / up ;
+        int p = at % up ;
+
+        const float * h ;
+        if (table.empty ()) {
+            phase ((double) p / up, own.data ());
+            h = own.data ();
+        } else
+            h = table.data () + (size_t) p * taps ;
+
+        const float * __restrict x = padded.data () + i + 1 ;
+        float sum = 0 ;
+        for (int k = 0 ; k < taps ; k ++)
+            sum += x [k] * h [k] ;
+        out [j] = sum ;
+    }
+}
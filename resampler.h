@@ -0,0 +1,31 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <vector>
+
+/*  Kaiser windowed sinc, polyphase, for whole buffers at a time: IRs
+ *  and other files loaded into plugins, never the live signal.
+ *
+ *  from -> to is reduced to L / M and the taps of every one of the L
+ *  phases are worked out once, so each output sample is one straight
+ *  dot product that the compiler turns into SIMD. The filter is centred,
+ *  the output starts where the input does, which an IR needs.
+ */
+class Resampler {
+    int up, down ;
+    // taps a phase, and how far the first is before the sample
+    int taps, half ;
+    // up phases of taps, or empty when up is too big to keep them all
+    std::vector <float> table ;
+    double cutoff ;
+
+    void phase (double offset, float * out);
+
+public:
+    Resampler (int from, int to);
+    int length (int frames);
+    // one channel, every stride-th sample of in; out has length () room
+    void process (const float * in, int frames, int stride, float * out);
+};
+
+#endif
@@ -0,0 +1,233 @@
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include "retro.h"
+#include "lame.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// frames a save reads at a time
+#define RETRO_CHUNK 4096
+
+RetroBuffer::RetroBuffer (LockFreeQueueManager * queue) {
+    this -> queue = queue ;
+}
+
+RetroBuffer::~RetroBuffer () {
+    disable ();
+}
+
+bool RetroBuffer::enable () {
+    IN
+    if (enabled ()) {
+        OUT return true ;
+    }
+
+    if (minutes < 1)
+        minutes = 1 ;
+    capacity = (uint64_t) minutes * 60 * sampleRate ;
+    held = capacity * 2 * (storage == RETRO_S16 ? sizeof (short) : sizeof (float));
+    void * memory = malloc (held);
+    if (memory == nullptr) {
+        LOGE ("[retro] cannot allocate %zu MB for %d minutes\n", held >> 20, minutes);
+        held = 0 ;
+        OUT return false ;
+    }
+
+    // every page now, rather than on the tap thread as the window fills
+    memset (memory, 0, held);
+#ifdef __linux__
+    locked = mlock (memory, held) == 0 ;
+    if (! locked)
+        LOGW ("[retro] cannot lock %zu MB in memory: %s\n", held >> 20, strerror (errno));
+#endif
+
+    if (storage == RETRO_S16)
+        ring16 = (short *) memory ;
+    else
+        ring = (float *) memory ;
+    written = 0 ;
+
+    tapId = queue -> tap (capture, this, TAP_OLDEST);
+    if (tapId < 0) {
+        LOGE ("[retro] no tap left on the queue\n");
+        disable ();
+        OUT return false ;
+    }
+
+    queue -> subscribe ();
+    LOGD ("[retro] keeping the last %d minutes in %zu MB\n", minutes, held >> 20);
+    OUT
+    return true ;
+}
+
+void RetroBuffer::disable () {
+    IN
+    // a save still needs the ring
+    if (saver.joinable ())
+        saver.join ();
+
+    if (tapId >= 0) {
+        queue -> untap (tapId);
+        queue -> unsubscribe ();
+        tapId = -1 ;
+    }
+
+    void * memory = ring16 ? (void *) ring16 : (void *) ring ;
+#ifdef __linux__
+    if (memory && locked)
+        munlock (memory, held);
+#endif
+    free (memory);
+    ring = nullptr ;
+    ring16 = nullptr ;
+    locked = false ;
+    held = 0 ;
+    capacity = 0 ;
+    OUT
+}
+
+double RetroBuffer::window () {
+    return (double) capacity / sampleRate ;
+}
+
+double RetroBuffer::seconds () {
+    uint64_t w = written ;
+    return (double) (w < capacity ? w : capacity) / sampleRate ;
+}
+
+// on the tap thread
+int RetroBuffer::capture (AudioBuffer * buffer, void * data) {
+    RetroBuffer * r = (RetroBuffer *) data ;
+    if (buffer -> pos == 0)
+        return 0 ;
+
+    // blocks the tap was lapped for go in as silence, to keep the timing
+    for (uint64_t i = 0 ; i < buffer -> overruns && i * buffer -> pos < r -> capacity ; i ++)
+        r -> store (nullptr, nullptr, buffer -> pos);
+    r -> store (buffer -> raw, buffer -> data, buffer -> pos);
+    return 1 ;
+}
+
+void RetroBuffer::store (const float * dry, const float * wet, int frames) {
+    block.resize (frames * 2);
+    for (int i = 0 ; i < frames ; i ++) {
+        block [i * 2] = dry ? dry [i] : 0 ;
+        block [i * 2 + 1] = wet ? wet [i] : 0 ;
+    }
+
+    uint64_t w = written.load (std::memory_order_relaxed);
+    for (int done = 0 ; done < frames ; ) {
+        uint64_t at = (w + done) % capacity ;
+        int n = frames - done ;
+        if (n > capacity - at)
+            n = capacity - at ;
+
+        if (ring16)
+            float_to_s16 (block.data () + done * 2, ring16 + at * 2, n * 2, seed);
+        else
+            memcpy (ring + at * 2, block.data () + done * 2, n * 2 * sizeof (float));
+        done += n ;
+    }
+
+    written.store (w + frames, std::memory_order_release);
+}
+
+void RetroBuffer::load (uint64_t from, float * out, int frames) {
+    for (int done = 0 ; done < frames ; ) {
+        uint64_t at = (from + done) % capacity ;
+        int n = frames - done ;
+        if (n > capacity - at)
+            n = capacity - at ;
+
+        if (ring16)
+            for (int i = 0 ; i < n * 2 ; i ++)
+                out [done * 2 + i] = ring16 [at * 2 + i] / 32767.0f ;
+        else
+            memcpy (out + done * 2, ring + at * 2, n * 2 * sizeof (float));
+        done += n ;
+    }
+}
+
+bool RetroBuffer::save (std::string filename) {
+    IN
+    if (! enabled ()) {
+        OUT return false ;
+    }
+
+    if (saving) {
+        LOGW ("[retro] the last save is still going\n");
+        OUT return false ;
+    }
+
+    if (saver.joinable ())
+        saver.join ();
+    saving = true ;
+    lost = 0 ;
+    saver = std::thread (& RetroBuffer::write, this, filename, type);
+    OUT
+    return true ;
+}
+
+// on the saver thread
+void RetroBuffer::write (std::string filename, FileType type) {
+    IN
+    // dry and wet for the lossless ones, the compressed ones are for listening
+    int channels = type == WAV || type == FLAC ? 2 : 1 ;
+    Encoder * e = Encoder::create (type, 64000, MEDIUM);
+    if (e == nullptr) {
+        saving = false ;
+        OUT return ;
+    }
+
+    e -> filename = filename + Encoder::extension (type);
+    e -> sampleRate = sampleRate ;
+    e -> channels = channels ;
+    if (channels == 2)
+        e -> comment = "{\"channels\": [\"dry\", \"wet\"]}" ;
+    if (! e -> open ()) {
+        delete e ;
+        saving = false ;
+        OUT return ;
+    }
+
+    // room kept between us and the capture thread, more than any block
+    uint64_t guard = sampleRate / 2 ;
+    uint64_t end = written.load (std::memory_order_acquire);
+    uint64_t pos = end + guard > capacity ? end + guard - capacity : 0 ;
+    std::vector <float> frames (RETRO_CHUNK * 2), wet (RETRO_CHUNK);
+
+    bool ok = true ;
+    while (pos < end && ok) {
+        int n = end - pos < RETRO_CHUNK ? end - pos : RETRO_CHUNK ;
+        load (pos, frames.data (), n);
+
+        // the capture thread came round while we copied: that part is gone
+        std::atomic_thread_fence (std::memory_order_acquire);
+        if (written.load (std::memory_order_acquire) + guard > pos + capacity) {
+            memset (frames.data (), 0, n * 2 * sizeof (float));
+            lost += n ;
+        }
+
+        if (channels == 1) {
+            for (int i = 0 ; i < n ; i ++)
+                wet [i] = frames [i * 2 + 1] ;
+            ok = e -> write (wet.data (), n);
+        } else
+            ok = e -> write (frames.data (), n);
+
+        e -> frames += n ;
+        pos += n ;
+    }
+
+    e -> close ();
+    if (! ok)
+        LOGE ("[retro] cannot write %s\n", e -> filename.c_str ());
+    LOGD ("[retro] %s: %llu frames, %llu lost\n", e -> filename.c_str (), (unsigned long long) e -> frames, (unsigned long long) (uint64_t) lost);
+    file = e -> filename ;
+    delete e ;
+    saving = false ;
+    OUT
+}
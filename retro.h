@@ -0,0 +1,79 @@
+#ifndef RETRO_H
+#define RETRO_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging_macros.h"
+#include "encoder.h"
+#include "LockFreeQueue.h"
+
+typedef enum {
+    RETRO_FLOAT,    // the samples as they are
+    RETRO_S16       // dithered to 16 bit, the same minutes in half the memory
+} RetroStorage ;
+
+/*  The last few minutes of the rack, recorded or not.
+ *
+ *  A tap of its own copies every block, dry and wet side by side, into a
+ *  ring allocated and locked in memory up front, so how much it holds
+ *  never changes once it is on. The audio thread does nothing more for
+ *  it than for any other tap.
+ *
+ *  save () writes the ring out on a thread of its own while capture goes
+ *  on. It reads the oldest audio first, staying ahead of the capture
+ *  thread coming round behind it; whatever gets written over before it
+ *  is read is saved as silence and counted, never saved torn.
+ */
+class RetroBuffer {
+    LockFreeQueueManager * queue ;
+    int tapId = -1 ;
+    // frames of dry and wet, interleaved
+    float * ring = nullptr ;
+    short * ring16 = nullptr ;
+    uint64_t capacity = 0 ;
+    size_t held = 0 ;
+    bool locked = false ;
+    // frames written since it was switched on
+    std::atomic<uint64_t> written { 0 };
+    std::vector <float> block ;
+    uint32_t seed [4] = { 0x2545f491, 0x9e3779b9, 0x6a09e667, 0xbb67ae85 } ;
+
+    std::thread saver ;
+    std::atomic<bool> saving { false };
+
+    static int capture (AudioBuffer * buffer, void * data);
+    void store (const float * dry, const float * wet, int frames);
+    void load (uint64_t from, float * out, int frames);
+    void write (std::string filename, FileType type);
+
+public:
+    int sampleRate = 48000 ;
+    int minutes = 10 ;
+    RetroStorage storage = RETRO_FLOAT ;
+    FileType type = WAV ;
+    // frames written over before a save could read them, for the last save
+    std::atomic<uint64_t> lost { 0 };
+    // the file of the last save
+    std::string file ;
+
+    RetroBuffer (LockFreeQueueManager * queue);
+    ~RetroBuffer ();
+
+    // allocates the whole window, false if the memory is not there
+    bool enable ();
+    void disable ();
+    bool enabled () { return tapId >= 0 ; }
+    // filename without an extension; false if a save is still going
+    bool save (std::string filename);
+    bool busy () { return saving ; }
+
+    // memory held for the window
+    size_t bytes () { return held ; }
+    // seconds the window holds when full, and seconds in it now
+    double window ();
+    double seconds ();
+};
+
+#endif
@@ -2,33 +2,54 @@
 #include "sync.h"
 
 #include "server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 Server::Server() {
     IN
     // setup variables
     int port = 6906 ;
     port_ = port;
-    buflen_ = 1024;
-    buf_ = new char[buflen_+1];
-    context = g_main_context_get_thread_default ();
     OUT
 }
 
 Server::~Server() {
-    delete buf_;
 }
 
 void
 Server::run() {
     IN
     // create and run the server
-    create();
-    //~ std::thread t (&Server::serve, this);
+    if (! create()) {
+        LOGD ("[server] not listening on %d\n", port_);
+        return ;
+    }
+
+    worker = std::thread (&Server::work, this);
     serve();
+
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        done = true ;
+    }
+    ready.notify_one ();
+    worker.join ();
+
+    close(epoll_);
+    close(wake_);
+    close(server_);
     OUT
 }
 
-void
+static bool non_blocking (int fd) {
+    int flags = fcntl (fd, F_GETFL, 0);
+    return flags >= 0 && fcntl (fd, F_SETFL, flags | O_NONBLOCK) == 0 ;
+}
+
+bool
 Server::create() {
     IN
     struct sockaddr_in server_addr;
@@ -41,191 +62,347 @@ Server::create() {
 
     // create socket
     server_ = socket(PF_INET,SOCK_STREAM,0);
-    if (!server_) {
+    if (server_ < 0) {
         perror("socket");
-        exit(-1);
+        return false ;
     }
 
     // set socket to immediately reuse port when the application closes
     int reuse = 1;
     if (setsockopt(server_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
         perror("setsockopt");
-        exit(-1);
+        return false ;
     }
 
     // call bind to associate the socket with our local address and
     // port
     if (bind(server_,(const struct sockaddr *)&server_addr,sizeof(server_addr)) < 0) {
         perror("bind");
-        exit(-1);
+        close(server_);
+        return false ;
     }
 
     // convert the socket to listen for incoming connections
-    if (listen(server_,SOMAXCONN) < 0) {
+    if (listen(server_,SOMAXCONN) < 0 || ! non_blocking (server_)) {
         perror("listen");
-        exit(-1);
+        close(server_);
+        return false ;
     }
+
+    // close_socket pokes wake_ to get the loop out of epoll_wait
+    epoll_ = epoll_create1 (EPOLL_CLOEXEC);
+    wake_ = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_ < 0 || wake_ < 0) {
+        perror("epoll");
+        close(server_);
+        return false ;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN ;
+    ev.data.fd = server_ ;
+    epoll_ctl (epoll_, EPOLL_CTL_ADD, server_, & ev);
+    ev.data.fd = wake_ ;
+    epoll_ctl (epoll_, EPOLL_CTL_ADD, wake_, & ev);
+    OUT
+    return true ;
 }
 
+// from the UI thread
 void
 Server::close_socket() {
     IN
-    shutdown(server_, SHUT_RD);
-    close(server_);
+    uint64_t one = 1 ;
+    closing = true ;
+    if (wake_ >= 0 && write (wake_, & one, sizeof (one)) < 0)
+        perror ("eventfd");
     OUT
 }
 
 void
 Server::serve() {
     IN
-    // setup client
-    int client;
-    struct sockaddr_in client_addr;
-    socklen_t clientlen = sizeof(client_addr);
-    while (g_main_context_pending (context))
-        g_main_context_iteration (context, true);
+    struct epoll_event events [32] ;
+    while (! stopping) {
+        // wake up every second to drop peers that went quiet
+        int n = epoll_wait (epoll_, events, 32, 1000);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue ;
+            perror ("epoll_wait");
+            break ;
+        }
 
-      // accept clients
-    while ((client = accept(server_,(struct sockaddr *)&client_addr,&clientlen)) > 0) {
-        while (g_main_context_pending (context))
-            g_main_context_iteration (context, true);
+        for (int i = 0 ; i < n ; i ++) {
+            int fd = events [i].data.fd ;
+            if (fd == wake_) {
+                // the worker has output for someone, or we are closing
+                uint64_t count ;
+                if (read (wake_, & count, sizeof (count)) < 0 && errno != EAGAIN)
+                    perror ("eventfd");
+                if (closing)
+                    stopping = true ;
+                collect ();
+            } else if (fd == server_)
+                accept_peers ();
+            else
+                service (fd, events [i].events);
+        }
 
-        handle(client);
+        expire ();
     }
-    
+
+    while (! peers.empty ())
+        drop (peers.begin () -> first);
     OUT
-    close_socket();
 }
 
 void
-Server::handle(int client) {
-    IN
-    // loop to handle all requests
-    json toSend = presets->get_all_user_presets ();
-    
-    while (1) {
-        // get a request
-        string request = get_request(client);
-        // break if client is done or an error occurred
-        if (request.empty()) {
-            LOGD ("[server] empty response recieved from client\n");
-            //~ break;
-        }
-        // send response
-        else {
-            LOGD ("[server] request: %s\n", request.c_str ());
-            while (request.find ("}}}") != string::npos)
-                request.pop_back () ; ///| aargh!
-            //~ LOGD ("[pop] request: %s\n", request.c_str ());
-            json j = json::parse (request);
-            Sync * _sync = (Sync *) sync ;
-            /*
-            if (! j.contains ("key") || j ["key"].get <int>() != _sync -> sec_key) {
-                LOGD ("[key] %d %d\n", j ["key"].get <int>(), _sync -> sec_key);
-                gtk_label_set_markup (_sync -> status, "Security key mismatch");
-                return ;
-            }
-            */
-            
-            int how_many = presets->import_presets_from_json (j);
-            char * ss = g_strdup_printf ("<span foreground=\"green\" weight=\"bold\" size=\"x-large\">Imported %d presets successfully</span>", how_many);
-            gtk_label_set_markup (_sync -> header, ss);
-            g_free (ss);
-            
-            LOGD ("[server] synced %d presets\n", how_many);
-        }
-        
-        std::string toSendStr = toSend.dump () ;
-        if (toSend.empty ()) {
-            toSendStr = std::string ("{}");
-        }
-        
-        bool success = send_response(client,toSendStr);
-        // break if an error occurred
-        if (not success) {
-            HERE LOGD ("break if an error occurred\n");
-            break;
+Server::accept_peers() {
+    struct sockaddr_in client_addr;
+    socklen_t clientlen = sizeof(client_addr);
+    int client ;
+    while ((client = accept4 (server_, (struct sockaddr *) &client_addr, &clientlen, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (peers.size () >= SYNC_MAX_PEERS) {
+            LOGD ("[server] %d peers already, turning one away\n", (int) peers.size ());
+            close (client);
+            continue ;
         }
+
+        SyncPeer peer ;
+        peer.fd = client ;
+        peer.id = nextId ++ ;
+        peer.last = time (NULL);
+        peer.events = EPOLLIN | EPOLLRDHUP ;
+        peer.pumping = 0 ;
+        peer.more = peer.finished = peer.failed = false ;
+        // the peer sends its manifest first, see syncproto.h
+        peer.session = new SyncSession (presets -> store, false, presets -> blobs);
+        peers [client] = peer ;
+
+        struct epoll_event ev = {};
+        ev.events = peer.events ;
+        ev.data.fd = client ;
+        epoll_ctl (epoll_, EPOLL_CTL_ADD, client, & ev);
+        LOGD ("[server] peer %s, %d connected\n", inet_ntoa (client_addr.sin_addr), (int) peers.size ());
     }
-    
-    OUT
-    close(client);
 }
 
-string
-Server::get_request(int client) {
-    IN
-    string request = "";
-    // read until we get a newline
-    int count = -1 ;
-    while (request.find("}}}") == string::npos) {
-        count ++ ;
-        
-        int nread = recv(client,buf_,1024,0);
-        if (nread < 0) {
-            if (errno == EINTR) {
-                LOGD ("the socket call was interrupted -- try again\n");
-                continue;
-            }
-            else {
-                HERE LOGD ("[%s]  an error occurred, so break out\n", strerror (errno));
-                return std::string ("");
-            }
-        } else if (nread == 0) {
-            LOGD ("the socket is closed\n");
-            return std::string ("");
+// write what the socket will take; false if the peer is gone
+bool
+Server::flush(SyncPeer & peer) {
+    size_t at = 0 ;
+    while (at < peer.out.size ()) {
+        long n = send (peer.fd, peer.out.data () + at, peer.out.size () - at, MSG_NOSIGNAL);
+        if (n > 0) {
+            at += n ;
+            peer.last = time (NULL);
+            continue ;
         }
 
-        // be sure to use append in case we have binary data
-        HERE LOGD ("[request %d:%d] %s\n", count, nread, buf_);
-        request.append(buf_,nread);
-        if (request.c_str ()[1] == '}')
-            return std::string ("");
+        if (n < 0 && errno == EINTR)
+            continue ;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break ;
+        return false ;
     }
-    
-    LOGD ("[server] read ended: \n");
-    // a better server would cut off anything after the newline and
-    // save it in a cache
-    OUT
-    return request;
+
+    peer.out.erase (0, at);
+    arm (peer);
+    return true ;
 }
 
-bool
-Server::send_response(int client, string response) {
-    IN
-    // prepare to send response
-    response.append ("}\n");
-    LOGD ("[server] send: %s", response.c_str ());
-    const char* ptr = response.c_str();
-    int nleft = response.length();
-    int nleft_ = response.length();
-    int nwritten;
-    // loop to be sure it is all sent
-    while (nleft) {
-        if ((nwritten = send(client, ptr, nleft, 0)) < 0) {
-            if (errno == EINTR) {
-                OUT
-                LOGD ("the socket call was interrupted -- try again\n");
-                continue;
-            } else {
-                HERE LOGD ("[%s] an error occurred, so break out\n", strerror (errno));
-                perror("write");
-                OUT
-                return false;
+// nothing more is read while the worker has the last of its input, so a
+// peer that sends faster than it is parsed waits in the kernel's buffers,
+// not in jobs; and the socket draining only matters while we have output
+void
+Server::arm(SyncPeer & peer) {
+    uint32_t events = EPOLLRDHUP | (peer.pumping == 0 ? EPOLLIN : 0) | (peer.out.empty () ? 0 : EPOLLOUT);
+    if (events == peer.events)
+        return ;
+
+    struct epoll_event ev = {};
+    ev.events = events ;
+    ev.data.fd = peer.fd ;
+    epoll_ctl (epoll_, EPOLL_CTL_MOD, peer.fd, & ev);
+    peer.events = events ;
+}
+
+void
+Server::service(int fd, uint32_t events) {
+    auto it = peers.find (fd);
+    if (it == peers.end ())
+        return ;
+
+    SyncPeer & peer = it -> second ;
+    bool gone = false ;
+    std::string in ;
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        char buf [16384] ;
+        // a few reads at most, so one fast peer cannot starve the others
+        for (int i = 0 ; i < 4 && ! gone ; i ++) {
+            long n = recv (fd, buf, sizeof (buf), 0);
+            if (n > 0) {
+                peer.last = time (NULL);
+                in.append (buf, n);
+                continue ;
             }
-        } else if (nwritten == 0) {
-            LOGD ("the socket is closed\n");
-            OUT
-            return false;
+
+            if (n < 0 && errno == EINTR)
+                continue ;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break ;
+            gone = true ;
         }
-        nleft -= nwritten;
-        ptr += nwritten;
     }
 
-    LOGD ("[send response] left %d of %d bytes\n", nleft, nleft_);
-    OUT    
-    //~ close_socket ();
-    return true;
+    if (! in.empty ())
+        pump (peer, std::move (in));
+
+    // what it sent last is still taken, the drop is queued behind it
+    if (gone)
+        drop (fd, "connection closed before the sync finished");
+    else
+        settle (fd);
+}
+
+// hand what came in to the session on the worker, and take back the next
+// window of what it has to say
+void
+Server::pump(SyncPeer & peer, std::string in) {
+    peer.pumping ++ ;
+    arm (peer);
+    SyncSession * session = peer.session ;
+    uint64_t id = peer.id ;
+    post ([this, session, id, in = std::move (in)] () {
+        if (! in.empty ())
+            session -> receive (in.data (), in.size ());
+
+        SyncPumped p ;
+        p.id = id ;
+        p.out.swap (session -> output ());
+        p.finished = session -> finished ();
+        p.failed = session -> failed ();
+        {
+            std::lock_guard <std::mutex> guard (lock);
+            pumped.push_back (std::move (p));
+        }
+
+        uint64_t one = 1 ;
+        if (write (wake_, & one, sizeof (one)) < 0)
+            perror ("eventfd");
+    });
+}
+
+// what the worker made, onto the sockets
+void
+Server::collect() {
+    std::deque <SyncPumped> got ;
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        got.swap (pumped);
+    }
+
+    for (SyncPumped & p: got) {
+        auto it = std::find_if (peers.begin (), peers.end (), [&p] (auto & e) { return e.second.id == p.id ; });
+        // dropped while the worker was at it
+        if (it == peers.end ())
+            continue ;
+
+        SyncPeer & peer = it -> second ;
+        peer.pumping -- ;
+        peer.more = ! p.out.empty ();
+        peer.finished = p.finished ;
+        peer.failed = p.failed ;
+        peer.out.append (p.out);
+        peer.last = time (NULL);
+        settle (it -> first);
+    }
+}
+
+// send what we have, then ask the worker for more or let the peer go; a
+// failed session still gets its error frame out first
+void
+Server::settle(int fd) {
+    SyncPeer & peer = peers [fd] ;
+    if (! flush (peer)) {
+        drop (fd, "connection closed before the sync finished");
+        return ;
+    }
+
+    if (! peer.out.empty () || peer.pumping > 0)
+        return ;
+    if (peer.finished || peer.failed)
+        drop (fd);
+    else if (peer.more)
+        pump (peer, std::string ());
+}
+
+void
+Server::expire() {
+    time_t now = time (NULL);
+    std::vector <int> quiet ;
+    // a peer waiting on the worker is waiting on us, not the other way
+    for (auto & p: peers)
+        if (now - p.second.last > SYNC_TIMEOUT && p.second.pumping == 0)
+            quiet.push_back (p.first);
+
+    for (int fd: quiet)
+        drop (fd, "timed out");
+}
+
+void
+Server::drop(int fd, const char * why) {
+    auto it = peers.find (fd);
+    if (it == peers.end ())
+        return ;
+
+    epoll_ctl (epoll_, EPOLL_CTL_DEL, fd, NULL);
+    close (fd);
+
+    // reported after the presets it brought are in the store
+    SyncSession * session = it -> second.session ;
+    Sync * _sync = (Sync *) sync ;
+    Presets * p = presets ;
+    // the sync window is on its way out if we are stopping
+    bool report = ! stopping ;
+    std::string reason = why != nullptr ? why : "" ;
+    post ([p, _sync, session, report, reason] () {
+        // it may have finished with the bytes queued before this
+        if (! reason.empty () && ! session -> finished () && ! session -> failed ())
+            session -> error = reason ;
+        if (report)
+            p -> sync_finished (_sync -> header, session);
+        delete session ;
+    });
+
+    peers.erase (it);
+    LOGD ("[server] %d peers left\n", (int) peers.size ());
+}
+
+void
+Server::post(std::function <void ()> job) {
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        jobs.push_back (std::move (job));
+    }
+    ready.notify_one ();
+}
+
+void
+Server::work() {
+    std::unique_lock <std::mutex> guard (lock);
+    while (true) {
+        ready.wait (guard, [this] { return done || ! jobs.empty (); });
+        if (jobs.empty ())
+            break ;
+
+        std::function <void ()> job = std::move (jobs.front ());
+        jobs.pop_front ();
+        guard.unlock ();
+        job ();
+        guard.lock ();
+    }
 }
 
 #endif
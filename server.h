@@ -8,15 +8,54 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <time.h>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <unordered_map>
 #include <string>
 #include <gtk/gtk.h>
 #include "log.h"
 #include "json.hpp"
 #include "presets.h"
+#include "syncproto.h"
 
 using namespace std;
 
+// more than a band's worth of rigs at once is someone scanning the port
+#define SYNC_MAX_PEERS  16
+
+typedef struct {
+    int fd ;
+    uint64_t id ;           // fds are reused, this is not
+    SyncSession * session ; // the worker's alone
+    time_t last ;
+    uint32_t events ;       // what epoll is watching for
+    int pumping ;           // jobs of ours the worker has not answered
+    bool more ;             // the last one filled a window, ask again
+    bool finished, failed ;
+    std::string out ;       // what the worker made, for the socket
+} SyncPeer ;
+
+// a window of output the worker made for a peer, and where it got to
+typedef struct {
+    uint64_t id ;
+    std::string out ;
+    bool finished, failed ;
+} SyncPumped ;
+
+/*  Answers syncs from any number of rigs at once.
+ *
+ *  One thread runs an epoll loop over non-blocking sockets, so a slow
+ *  peer only holds up itself. The loop only moves bytes: the sessions run
+ *  on a worker, which reads the store, hashes and writes files and hands
+ *  back a window of output at a time through wake_. The result of each
+ *  sync is posted to the UI after its presets are in. Nothing here
+ *  touches GTK.
+ */
 class Server {
 public:
     Server();
@@ -25,18 +64,39 @@ public:
     Presets * presets ;
     void * sync ;
     void run();
-    
-    GMainContext * context ;
-    void create();
+
+    bool create();
     void close_socket();
     void serve();
-    void handle(int);
-    string get_request(int);
-    bool send_response(int, string);
 
     int port_;
-    int server_;
-    int buflen_;
-    char* buf_;
-};
+    int server_ = -1 ;
+    int epoll_ = -1 ;
+    int wake_ = -1 ;
+
+private:
+    std::unordered_map <int, SyncPeer> peers ;
+    uint64_t nextId = 0 ;
+    bool stopping = false ;
+    std::atomic <bool> closing { false };
 
+    std::thread worker ;
+    std::mutex lock ;
+    std::condition_variable ready ;
+    std::deque <std::function <void ()>> jobs ;
+    // under lock, from the worker to the loop
+    std::deque <SyncPumped> pumped ;
+    bool done = false ;
+
+    void accept_peers ();
+    void service (int fd, uint32_t events);
+    bool flush (SyncPeer & peer);
+    void arm (SyncPeer & peer);
+    void pump (SyncPeer & peer, std::string in);
+    void collect ();
+    void settle (int fd);
+    void drop (int fd, const char * why = nullptr);
+    void expire ();
+    void post (std::function <void ()> job);
+    void work ();
+};
@@ -31,6 +31,35 @@ void switch_theme (GtkDropDown * dropdown, int event, Rack * rack) {
     
 }
 
+typedef struct {
+	Transcoder * transcoder ;
+	GtkLabel * status ;
+	GtkProgressBar * bar ;
+	std::atomic <bool> pending ;
+} ArchiveProgress ;
+
+static gboolean archive_progress_cb (gpointer data) {
+	ArchiveProgress * a = (ArchiveProgress *) data ;
+	a -> pending = false ;
+	std::string now = a -> transcoder -> status ();
+	int waiting = a -> transcoder -> pending (), failed = a -> transcoder -> failed ();
+	std::string text = now.empty () ? std::string ("Nothing to do") : now ;
+	if (waiting > 1)
+		text.append (", ").append (std::to_string (waiting - 1)).append (" more");
+	if (failed)
+		text.append (", ").append (std::to_string (failed)).append (" failed, see transcode.json");
+	gtk_label_set_text (a -> status, text.c_str ());
+	gtk_progress_bar_set_fraction (a -> bar, now.empty () ? 0 : a -> transcoder -> progressFraction ());
+	return G_SOURCE_REMOVE ;
+}
+
+// from the transcoder's thread: one idle in flight at a time
+static void archive_progress (void * data) {
+	ArchiveProgress * a = (ArchiveProgress *) data ;
+	if (! a -> pending.exchange (true))
+		g_idle_add (archive_progress_cb, a);
+}
+
 Settings::Settings (Rack * rack) {
 	grid = gtk_grid_new () ;
 	gtk_widget_set_name ((GtkWidget *) grid, "plugin");
@@ -76,4 +105,22 @@ Settings::Settings (Rack * rack) {
 	gtk_grid_attach ((GtkGrid *) grid, (GtkWidget *)rend, 1, 2, 1, 1);
 	
 	gtk_drop_down_set_selected (rend, current_rend);
+
+	if (rack -> engine -> transcoder) {
+		// outlives this page, as long as the transcoder does
+		ArchiveProgress * a = new ArchiveProgress ();
+		a -> transcoder = rack -> engine -> transcoder ;
+		a -> status = (GtkLabel *) gtk_label_new ("");
+		a -> bar = (GtkProgressBar *) gtk_progress_bar_new ();
+		a -> pending = false ;
+
+		GtkLabel * l3 = (GtkLabel *)gtk_label_new ("Archive");
+		gtk_widget_set_margin_end ((GtkWidget *) l3, 10);
+		gtk_grid_attach ((GtkGrid *) grid, (GtkWidget *)l3, 0, 3, 1, 1);
+		gtk_grid_attach ((GtkGrid *) grid, (GtkWidget *)a -> bar, 1, 3, 1, 1);
+		gtk_grid_attach ((GtkGrid *) grid, (GtkWidget *)a -> status, 1, 4, 1, 1);
+
+		a -> transcoder -> watch (archive_progress, a);
+		archive_progress (a);
+	}
 }
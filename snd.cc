@@ -9,15 +9,17 @@ SoundFile * snd_read (char * filename) {
     SNDFILE * sndfile = sf_open (filename, SFM_READ, &info);
     LOGD ("opening file %s: %d frames\n", filename, info.frames);
     if (sndfile == NULL) {
-        LOGD ("cannot open file [%s]: %s\n", sf_strerror (NULL));
+        LOGD ("cannot open file [%s]: %s\n", filename, sf_strerror (NULL));
         OUT
         return NULL ;
     }
     
-    SoundFile * soundFile = new SoundFile (info.frames);
+    SoundFile * soundFile = new SoundFile (info.frames, info.channels);
+    soundFile->sampleRate = info.samplerate ;
     int val = sf_readf_float (sndfile, soundFile->data, info.frames);
     if (val != info.frames) {
-        LOGD ("file read mismatch! total: %d\tread: %d\n", val, info.frames);
+        LOGD ("file read mismatch! total: %d\tread: %d\n", info.frames, val);
+        * soundFile->len = val > 0 ? val : 0 ;
     } else {
         LOGD ("read %d bytes\n", val);
     }
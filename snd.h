@@ -8,13 +8,18 @@
 
 class SoundFile {
     public:
+    // interleaved, len frames of channels each
     float * data ;
     int * len ;
+    int channels ;
+    int sampleRate ;
     
-    SoundFile (int _len) {
+    SoundFile (int _len, int _channels) {
         len = (int *) malloc (sizeof (int));
         * len = _len ;
-        data = (float *) malloc (sizeof (float) * *len + 1);
+        channels = _channels ;
+        sampleRate = 0 ;
+        data = (float *) malloc (sizeof (float) * *len * channels);
     }
     
     ~SoundFile () {
@@ -17,31 +17,44 @@ void sync_send (Sync * sync) {
     std::string ip = where.substr (0, find1);
     std::string port = where.substr (find1 + 1, find2 - 1);
     std::string key = where.substr (find2 + find1 + 1);
-    Client * client = new Client (ip, std::stoi (port));
-    client -> create ();
-    Presets * p = (Presets *) sync -> rack -> presets ;
-    json j =  p -> get_all_user_presets ();
-    //~ j ["key"] = std::stoi (key);
-    //~ j ["end"] = {"end: end of input"};
-    std::string response = client -> send_preset (j);
-    LOGD ("[client] response: %s\n", response.c_str ());
     LOGD ("ip: %s, port: %s, key: %s\n", ip.c_str(), port.c_str (), key.c_str ());
+    {
+        std::lock_guard <std::mutex> guard (sync -> lock);
+        if (sync -> client != nullptr) {
+            LOGD ("[sync] already syncing\n");
+            OUT
+            return ;
+        }
+    }
+
+    // the last one is over, it only has to be reaped
+    if (sync -> sender != nullptr) {
+        sync -> sender -> join ();
+        delete sync -> sender ;
+    }
+
+    gtk_label_set_markup (sync -> header, "<span weight='bold' size='x-large'>Syncing ...</span>");
+
+    // off the UI thread, the result comes back through sync_finished
+    Presets * p = (Presets *) sync -> rack -> presets ;
+    int portno = std::stoi (port);
+    sync -> client = new Client (ip, portno);
+    sync -> sender = new std::thread ([sync, p] () {
+        Client * client = sync -> client ;
+        SyncSession session (p -> store, true, p -> blobs);
+        if (client -> create ())
+            client -> sync (& session);
+        else
+            session.error = "cannot connect" ;
 
-    /// ayyo, importing what we already have!
-    if (response.size () > 0) {
-        while (response.find ("}}}") != std::string::npos)
-            response.pop_back ();
-            
-        j = json::parse (response);
-        int how_many = p -> import_presets_from_json (j);
-        char * ss = g_strdup_printf ("<span foreground=\"green\" weight=\"bold\" size=\"x-large\">Imported %d presets successfully</span>", how_many);
-        gtk_label_set_markup (sync -> header, ss);
-        g_free (ss);
-    } else {
-        LOGD ("[client] server returned empty response\n");
-    }    
-    //~ LOGD ("[client] synced %d presets\n", how_many);
-    client -> close_socket ();
+        {
+            std::lock_guard <std::mutex> guard (sync -> lock);
+            client -> close_socket ();
+            sync -> client = nullptr ;
+        }
+        delete client ;
+        p -> sync_finished (sync -> header, & session);
+    });
     OUT
 }
 
@@ -62,13 +75,21 @@ void run_server (Sync * sync) {
 
 void close_sync (Sync * sync) {
     IN
+    {
+        std::lock_guard <std::mutex> guard (sync -> lock);
+        if (sync -> client != nullptr)
+            sync -> client -> cancel ();
+    }
+
+    if (sync -> sender != nullptr) {
+        sync -> sender -> join ();
+        delete sync -> sender ;
+        sync -> sender = nullptr ;
+    }
+
     sync -> server -> close_socket ();
     sync -> t -> join () ;
     gtk_window_destroy (sync -> window);
-    # ifndef __linux__
-        Presets * p = (Presets *) sync -> rack -> presets ;
-        p -> load_user (false);
-    # endif
     OUT
 }
 
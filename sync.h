@@ -22,6 +22,10 @@ class Sync {
     GtkLabel * header ;
     GtkWindow * window ;
     std::thread * t;
+    // the outgoing sync, joined when the window closes
+    std::thread * sender = nullptr ;
+    Client * client = nullptr ;
+    std::mutex lock ;
     Rack * rack;
     int port ;
     int sec_key ;
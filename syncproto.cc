@@ -0,0 +1,657 @@
+#include "syncproto.h"
+
+#include <algorithm>
+#include <zlib.h>
+
+/*  frame:     char magic [4], u8 type, u8 flags, u16 0, u32 length,
+ *             payload [length]
+ *  deflated:  u32 inflated length, zlib stream
+ *
+ *  HELLO:     u32 version, u32 user presets
+ *  MANIFEST:  u32 count, (u64 hash, str name) * count
+ *  WANT:      u32 count, str name * count
+ *  PRESET:    the preset json, each file as filename (no path),
+ *             filehash and filesize
+ *  DONE:      u32 presets sent, ends a turn
+ *  ERROR:     text
+ *  BLOBWANT:  u32 count, (str sha256, u64 from) * count
+ *  BLOB:      str sha256, u64 offset, u64 total, bytes
+ *  str:       u32 length, bytes
+ *
+ *  Numbers are little endian; the two racks need not agree on anything.
+ */
+
+// keep this much queued for the socket before reading more presets
+#define SYNC_WINDOW     (64 << 10)
+// deflating a frame smaller than this is not worth it
+#define SYNC_DEFLATE_MIN 128
+// file pieces, one frame each
+#define SYNC_CHUNK      (64 << 10)
+#define SYNC_TURNS      5
+
+static void put_u32 (std::string & out, uint32_t v) {
+    for (int i = 0 ; i < 4 ; i ++)
+        out.push_back ((char) (v >> (8 * i)));
+}
+
+static void put_u64 (std::string & out, uint64_t v) {
+    put_u32 (out, (uint32_t) v);
+    put_u32 (out, (uint32_t) (v >> 32));
+}
+
+static void put_str (std::string & out, const std::string & s) {
+    put_u32 (out, s.size ());
+    out.append (s);
+}
+
+typedef struct {
+    const unsigned char * p ;
+    const unsigned char * end ;
+    bool ok ;
+} Reader ;
+
+static Reader reader_of (const std::string & s) {
+    return { (const unsigned char *) s.data (), (const unsigned char *) s.data () + s.size (), true };
+}
+
+static uint32_t get_u32 (Reader * r) {
+    if (! r->ok || r->end - r->p < 4) {
+        r->ok = false ;
+        return 0 ;
+    }
+
+    uint32_t v = r->p [0] | r->p [1] << 8 | r->p [2] << 16 | (uint32_t) r->p [3] << 24 ;
+    r->p += 4 ;
+    return v ;
+}
+
+static uint64_t get_u64 (Reader * r) {
+    uint64_t lo = get_u32 (r);
+    return lo | (uint64_t) get_u32 (r) << 32 ;
+}
+
+static std::string get_str (Reader * r) {
+    uint32_t len = get_u32 (r);
+    if (! r->ok || (size_t) (r->end - r->p) < len) {
+        r->ok = false ;
+        return std::string ();
+    }
+
+    std::string s ((const char *) r->p, len);
+    r->p += len ;
+    return s ;
+}
+
+// FNV-1a, a manifest only has to tell presets apart, not resist anyone
+uint64_t SyncSession::hash (const std::string & data) {
+    uint64_t h = 0xcbf29ce484222325ULL ;
+    for (unsigned char c: data) {
+        h ^= c ;
+        h *= 0x100000001b3ULL ;
+    }
+
+    return h ;
+}
+
+std::string SyncSession::deflate (const std::string & data) {
+    uLongf size = compressBound (data.size ());
+    std::string out ;
+    put_u32 (out, data.size ());
+    out.resize (4 + size);
+    if (compress2 ((Bytef *) & out [4], & size, (const Bytef *) data.data (), data.size (), Z_DEFAULT_COMPRESSION) != Z_OK)
+        return std::string ();
+    out.resize (4 + size);
+    return out ;
+}
+
+bool SyncSession::inflate (const std::string & data, std::string * out) {
+    Reader r = reader_of (data);
+    uLongf size = get_u32 (& r);
+    if (! r.ok || size > SYNC_MAX_FRAME)
+        return false ;
+
+    out -> resize (size);
+    if (uncompress ((Bytef *) out -> data (), & size, r.p, r.end - r.p) != Z_OK || size != out -> size ())
+        return false ;
+    return true ;
+}
+
+void SyncReader::feed (const char * data, size_t size) {
+    buffer.append (data, size);
+}
+
+bool SyncReader::next (SyncFrame * frame) {
+    size_t have = buffer.size () - offset ;
+    const unsigned char * h = (const unsigned char *) buffer.data () + offset ;
+    if (failed () || have == 0)
+        return false ;
+
+    // the old protocol sent bare json, say so as soon as we can tell
+    if (memcmp (h, SYNC_MAGIC, std::min (have, (size_t) 4)) != 0) {
+        error = "peer does not speak this sync protocol (older Amp Rack?)" ;
+        return false ;
+    }
+
+    if (have < SYNC_HEADER)
+        return false ;
+
+    int type = h [4], flags = h [5] ;
+    uint32_t length = h [8] | h [9] << 8 | h [10] << 16 | (uint32_t) h [11] << 24 ;
+    if (length > SYNC_MAX_FRAME) {
+        error = "frame too big" ;
+        return false ;
+    }
+
+    if (buffer.size () - offset < SYNC_HEADER + length)
+        return false ;
+
+    std::string payload = buffer.substr (offset + SYNC_HEADER, length);
+    offset += SYNC_HEADER + length ;
+
+    // drop what has been read once it is worth the copy
+    if (offset == buffer.size ()) {
+        buffer.clear ();
+        offset = 0 ;
+    } else if (offset > SYNC_WINDOW) {
+        buffer.erase (0, offset);
+        offset = 0 ;
+    }
+
+    frame -> type = type ;
+    if (flags & SYNC_DEFLATED) {
+        if (! SyncSession::inflate (payload, & frame -> payload)) {
+            error = "bad deflated frame" ;
+            return false ;
+        }
+    } else
+        frame -> payload.swap (payload);
+
+    return true ;
+}
+
+SyncSession::SyncSession (PresetStore * store, bool initiator, BlobStore * blobs) {
+    this -> store = store ;
+    this -> initiator = initiator ;
+    this -> blobs = blobs ;
+}
+
+void SyncSession::frame (int type, const std::string & payload) {
+    const std::string * body = & payload ;
+    std::string deflated ;
+    int flags = 0 ;
+    if (payload.size () >= SYNC_DEFLATE_MIN) {
+        deflated = deflate (payload);
+        if (! deflated.empty () && deflated.size () < payload.size ()) {
+            body = & deflated ;
+            flags = SYNC_DEFLATED ;
+        }
+    }
+
+    out.append (SYNC_MAGIC, 4);
+    out.push_back ((char) type);
+    out.push_back ((char) flags);
+    out.append (2, '\0');
+    put_u32 (out, body -> size ());
+    out.append (* body);
+}
+
+void SyncSession::fail (const std::string & why) {
+    if (failed ())
+        return ;
+    LOGD ("[sync] %s\n", why.c_str ());
+    error = why ;
+    outgoing.clear ();
+    sending.clear ();
+}
+
+static std::string basename_of (const std::string & path) {
+    size_t slash = path.find_last_of ("/\\");
+    return slash == std::string::npos ? path : path.substr (slash + 1);
+}
+
+json SyncSession::portable (json preset) {
+    if (! preset.is_object () || ! preset.contains ("controls") || ! preset ["controls"].is_object ())
+        return preset ;
+
+    for (auto & p: preset ["controls"]) {
+        if (! p.is_object () || ! p.contains ("filename") || ! p ["filename"].is_string ())
+            continue ;
+
+        std::string path = p ["filename"].get <std::string> ();
+        // never hash a path from a preset unless it is one of our models
+        std::string h = blobs != nullptr && blobs -> shareable (path) ? blobs -> hashOf (path) : std::string ();
+        // a file we were sent but never got still has its hash
+        if (h.empty () && p.contains ("filehash") && p ["filehash"].is_string ())
+            h = p ["filehash"].get <std::string> ();
+
+        p ["filename"] = basename_of (path);
+        if (h.empty ())
+            p.erase ("filehash");
+        else
+            p ["filehash"] = h ;
+        p.erase ("filesize");
+    }
+
+    return preset ;
+}
+
+// a preset on its way out, noting the files we can send with it
+json SyncSession::outbound (json preset) {
+    json p = portable (preset);
+    if (! p.contains ("controls") || ! p ["controls"].is_object ())
+        return p ;
+
+    for (auto & e: p ["controls"].items ()) {
+        json & c = e.value ();
+        if (! c.is_object () || ! c.contains ("filehash"))
+            continue ;
+
+        std::string local = preset ["controls"][e.key ()].value ("filename", "");
+        if (blobs == nullptr || ! blobs -> shareable (local))
+            continue ;
+        std::error_code ec ;
+        uint64_t size = std::filesystem::file_size (local, ec);
+        if (ec)
+            continue ;
+        offered [c ["filehash"].get <std::string> ()] = local ;
+        c ["filesize"] = size ;
+    }
+
+    return p ;
+}
+
+// a preset that came in: point its files at the blob store
+void SyncSession::inbound (json & preset) {
+    if (! preset.contains ("controls") || ! preset ["controls"].is_object ())
+        return ;
+
+    for (auto & c: preset ["controls"]) {
+        if (! c.is_object () || ! c.contains ("filename"))
+            continue ;
+
+        std::string h = c.contains ("filehash") && c ["filehash"].is_string () ? c ["filehash"].get <std::string> () : std::string ();
+        std::string name = c ["filename"].is_string () ? basename_of (c ["filename"].get <std::string> ()) : std::string ();
+        uint64_t size = c.contains ("filesize") && c ["filesize"].is_number_unsigned () ? c ["filesize"].get <uint64_t> () : 0 ;
+        c.erase ("filesize");
+
+        // their path means nothing here, and kept it would be read and
+        // offered back to whoever asks next sync
+        if (blobs == nullptr || ! BlobStore::validHash (h) || ! BlobStore::validName (name)) {
+            c.erase ("filename");
+            c.erase ("filehash");
+            continue ;
+        }
+
+        if (size > 0 && ! blobs -> adopt (h, name) && expected.find (h) == expected.end ())
+            missing [h] = { name, size };
+        c ["filename"] = blobs -> target (h, name);
+    }
+}
+
+// files that presets we already have point at but that never arrived: a
+// sync broke off, or a piece did not check out
+void SyncSession::stranded () {
+    for (auto & name: store -> user ()) {
+        json j = store -> get (name);
+        if (! j.is_object () || ! j.contains ("controls") || ! j ["controls"].is_object ())
+            continue ;
+
+        for (auto & c: j ["controls"]) {
+            if (! c.is_object () || ! c.contains ("filehash") || ! c ["filehash"].is_string () ||
+                    ! c.contains ("filename") || ! c ["filename"].is_string ())
+                continue ;
+
+            std::string h = c ["filehash"].get <std::string> ();
+            std::string file = basename_of (c ["filename"].get <std::string> ());
+            if (! BlobStore::validHash (h) || ! BlobStore::validName (file) || expected.count (h) || missing.count (h))
+                continue ;
+            if (! blobs -> has (h) && ! blobs -> adopt (h, file))
+                missing [h] = { file, 0 };
+        }
+    }
+}
+
+std::string SyncSession::manifest () {
+    std::string payload ;
+    std::vector <std::string> names = store -> user ();
+    put_u32 (payload, names.size ());
+    for (auto & name: names) {
+        json j = store -> get (name);
+        put_u64 (payload, j.is_object () ? hash (portable (j).dump ()) : 0);
+        put_str (payload, name);
+    }
+
+    return payload ;
+}
+
+void SyncSession::start () {
+    output ();
+}
+
+// on the answering side: work out both halves of the difference at once
+bool SyncSession::answer (const std::string & payload) {
+    Reader r = reader_of (payload);
+    std::unordered_map <std::string, uint64_t> theirs ;
+    uint32_t count = get_u32 (& r);
+    for (uint32_t i = 0 ; i < count && r.ok ; i ++) {
+        uint64_t h = get_u64 (& r);
+        theirs [get_str (& r)] = h ;
+    }
+
+    if (! r.ok)
+        return false ;
+
+    std::vector <std::string> want ;
+    for (auto & name: store -> user ()) {
+        auto it = theirs.find (name);
+        if (it == theirs.end ()) {
+            outgoing.push_back (name);
+            continue ;
+        }
+
+        json j = store -> get (name);
+        if (! j.is_object () || hash (portable (j).dump ()) != it->second)
+            want.push_back (name);
+        theirs.erase (it);
+    }
+
+    for (auto & t: theirs)
+        want.push_back (t.first);
+
+    wantList.clear ();
+    put_u32 (wantList, want.size ());
+    for (auto & name: want)
+        put_str (wantList, name);
+
+    answered = true ;
+    LOGD ("[sync] sending %d, asking for %d\n", (int) outgoing.size (), (int) want.size ());
+    return true ;
+}
+
+bool SyncSession::wantBlobs (const std::string & payload) {
+    Reader r = reader_of (payload);
+    uint32_t count = get_u32 (& r);
+    for (uint32_t i = 0 ; i < count && r.ok ; i ++) {
+        std::string h = get_str (& r);
+        uint64_t offset = get_u64 (& r);
+        if (! r.ok)
+            break ;
+
+        auto it = offered.find (h);
+        std::string path = it != offered.end () ? it->second : blobs != nullptr ? blobs -> path (h) : std::string ();
+        std::error_code ec ;
+        uint64_t size = path.empty () ? 0 : std::filesystem::file_size (path, ec);
+        if (path.empty () || ec) {
+            LOGD ("[sync] asked for %s, which we do not have\n", h.c_str ());
+            continue ;
+        }
+
+        // their part file is not from this one, send it all
+        if (offset > size)
+            offset = 0 ;
+        sending.push_back ({ h, path, offset, size });
+    }
+
+    return r.ok ;
+}
+
+bool SyncSession::takeBlob (const std::string & payload) {
+    Reader r = reader_of (payload);
+    std::string h = get_str (& r);
+    uint64_t offset = get_u64 (& r);
+    uint64_t total = get_u64 (& r);
+    if (! r.ok)
+        return false ;
+
+    // a piece of one we gave up on, or never asked for
+    auto it = expected.find (h);
+    if (it == expected.end () || blobs == nullptr)
+        return true ;
+
+    int done = blobs -> write (h, it->second.name, offset, (const char *) r.p, r.end - r.p, total);
+    blobBytes += r.end - r.p ;
+    if (done == 0)
+        return true ;
+
+    if (done > 0)
+        blobsIn ++ ;
+    else {
+        // on our next turn if there is one, or from stranded () next sync
+        LOGD ("[sync] could not take %s, will ask again next time\n", it->second.name.c_str ());
+        missing [h] = it->second ;
+    }
+    expected.erase (it);
+    return true ;
+}
+
+bool SyncSession::handle (SyncFrame & f) {
+    if (f.type == SYNC_ERROR) {
+        fail (std::string ("peer: ").append (f.payload));
+        return false ;
+    }
+
+    if (! peerHello) {
+        Reader r = reader_of (f.payload);
+        if (f.type != SYNC_HELLO || get_u32 (& r) != SYNC_VERSION || ! r.ok) {
+            fail ("peer speaks another version of the sync protocol");
+            frame (SYNC_ERROR, error);
+            return false ;
+        }
+
+        peerHello = true ;
+        return true ;
+    }
+
+    // nothing may arrive while it is our turn to talk
+    if (ours ()) {
+        fail ("peer talked out of turn");
+        frame (SYNC_ERROR, error);
+        return false ;
+    }
+
+    switch (f.type) {
+        case SYNC_MANIFEST:
+            if (initiator || answered || ! answer (f.payload))
+                break ;
+            return true ;
+        case SYNC_WANT: {
+            if (! initiator || turn != 1)
+                break ;
+            Reader r = reader_of (f.payload);
+            uint32_t count = get_u32 (& r);
+            for (uint32_t i = 0 ; i < count && r.ok ; i ++)
+                outgoing.push_back (get_str (& r));
+            if (! r.ok)
+                break ;
+            return true ;
+        }
+        case SYNC_PRESET: {
+            json j = json::parse (f.payload, nullptr, false);
+            if (j.is_discarded ())
+                break ;
+            inbound (j);
+            if (store -> put (j))
+                imported ++ ;
+            return true ;
+        }
+        case SYNC_BLOBWANT:
+            if (! wantBlobs (f.payload))
+                break ;
+            return true ;
+        case SYNC_BLOB:
+            if (! takeBlob (f.payload))
+                break ;
+            return true ;
+        case SYNC_DONE:
+            turn ++ ;
+            if (! initiator && turn == 1 && ! answered)
+                break ;
+            return true ;
+        default:
+            break ;
+    }
+
+    fail (std::string ("unexpected frame ").append (std::to_string (f.type)));
+    frame (SYNC_ERROR, error);
+    return false ;
+}
+
+bool SyncSession::receive (const char * data, size_t size) {
+    if (failed ())
+        return false ;
+
+    reader.feed (data, size);
+    SyncFrame f ;
+    while (reader.next (& f))
+        if (! handle (f))
+            return false ;
+
+    if (reader.failed ()) {
+        fail (reader.error);
+        return false ;
+    }
+
+    return true ;
+}
+
+bool SyncSession::ours () {
+    return turn < SYNC_TURNS && (turn % 2 == 0) == initiator ;
+}
+
+void SyncSession::beginTurn () {
+    started = true ;
+    if (turn < 2) {
+        std::string hello ;
+        put_u32 (hello, SYNC_VERSION);
+        put_u32 (hello, store -> size ());
+        frame (SYNC_HELLO, hello);
+        if (initiator)
+            frame (SYNC_MANIFEST, manifest ());
+        else
+            frame (SYNC_WANT, wantList);
+
+        // once a sync is enough, the list only changes as files arrive
+        if (blobs != nullptr)
+            stranded ();
+    }
+
+    if (missing.empty ())
+        return ;
+
+    // resume anything a sync that broke off left half done
+    std::string list ;
+    put_u32 (list, missing.size ());
+    for (auto & m: missing) {
+        put_str (list, m.first);
+        put_u64 (list, blobs -> partial (m.first, m.second.name));
+        expected [m.first] = m.second ;
+    }
+
+    frame (SYNC_BLOBWANT, list);
+    LOGD ("[sync] asking for %d files\n", (int) missing.size ());
+    missing.clear ();
+}
+
+void SyncSession::endTurn () {
+    std::string done ;
+    put_u32 (done, exported);
+    frame (SYNC_DONE, done);
+    turn ++ ;
+    started = false ;
+}
+
+std::string & SyncSession::output () {
+    if (failed () || ! ours ())
+        return out ;
+    if (! started)
+        beginTurn ();
+
+    while (out.size () < SYNC_WINDOW && ! outgoing.empty ()) {
+        json j = store -> get (outgoing.front ());
+        outgoing.pop_front ();
+        if (! j.is_object ())
+            continue ;
+        frame (SYNC_PRESET, outbound (j).dump ());
+        exported ++ ;
+    }
+
+    while (out.size () < SYNC_WINDOW && outgoing.empty () && ! sending.empty ()) {
+        BlobSending & b = sending.front ();
+        std::string piece ;
+        put_str (piece, b.hash);
+        put_u64 (piece, b.offset);
+        put_u64 (piece, b.size);
+
+        size_t n = 0 ;
+        FILE * f = fopen (b.path.c_str (), "rb");
+        if (f != nullptr && fseek (f, b.offset, SEEK_SET) == 0) {
+            size_t want = std::min ((uint64_t) SYNC_CHUNK, b.size - b.offset);
+            size_t at = piece.size ();
+            piece.resize (at + want);
+            n = fread (& piece [at], 1, want, f);
+            piece.resize (at + n);
+        }
+        if (f != nullptr)
+            fclose (f);
+
+        // the file went away or shrank under us, the peer will ask again
+        if (n == 0 && b.offset < b.size) {
+            LOGD ("[sync] cannot read %s\n", b.path.c_str ());
+            sending.pop_front ();
+            continue ;
+        }
+
+        frame (SYNC_BLOB, piece);
+        b.offset += n ;
+        blobBytes += n ;
+        if (b.offset >= b.size) {
+            blobsOut ++ ;
+            sending.pop_front ();
+        }
+    }
+
+    if (outgoing.empty () && sending.empty ())
+        endTurn ();
+
+    return out ;
+}
+
+void SyncSession::sent (size_t n) {
+    out.erase (0, n);
+}
+
+bool SyncSession::finished () {
+    return ! failed () && turn >= SYNC_TURNS && out.empty ();
+}
+
+bool SyncSession::run (SyncIO write, SyncIO read, void * user) {
+    char buf [16384] ;
+    while (! failed ()) {
+        for (std::string * o = & output () ; ! o -> empty () ; o = & output ()) {
+            long n = write (& (* o) [0], o -> size (), user);
+            if (n <= 0) {
+                fail ("connection lost while sending");
+                return false ;
+            }
+            sent (n);
+        }
+
+        if (finished ())
+            break ;
+
+        long n = read (buf, sizeof (buf), user);
+        if (n <= 0) {
+            fail ("connection closed before the sync finished");
+            return false ;
+        }
+
+        receive (buf, n);
+    }
+
+    // tell the peer why, if there is anything to tell
+    if (failed () && ! out.empty ())
+        write (& out [0], out.size (), user);
+
+    LOGD ("[sync] sent %d, received %d presets; sent %d, received %d files\n", exported, imported, blobsOut, blobsIn);
+    return ! failed ();
+}
@@ -0,0 +1,158 @@
+#ifndef SYNCPROTO_H
+#define SYNCPROTO_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include "json.hpp"
+#include "log.h"
+#include "presetstore.h"
+#include "blobstore.h"
+
+using json = nlohmann::json;
+
+/*  Preset sync between two racks.
+ *
+ *  Everything on the wire is a frame: a 12 byte header and a payload,
+ *  deflated when that makes it smaller, so a reader always knows how many
+ *  bytes it is waiting for and never has to look for the end of a message
+ *  in the text. One preset is one frame, and each is parsed and stored as
+ *  soon as it is complete.
+ *
+ *  The two sides take turns, each ending with DONE:
+ *
+ *  1. the rack that connected sends a manifest, one hash per user preset
+ *  2. the other answers with the names it wants and the presets the first
+ *     one does not have
+ *  3. the first sends what was asked for, and asks for the model and IR
+ *     files of the presets it got in 2 that it does not have yet
+ *  4. the other sends those files and asks for the ones it is missing
+ *  5. the first sends those
+ *
+ *  So a sync is one manifest plus the difference, whatever the size of
+ *  the libraries. A preset both sides have but with different contents is
+ *  taken from the rack that connected. Files go by their sha256 (see
+ *  BlobStore): a preset names its file and its hash, and a file either
+ *  side already has, under any name, is never sent again. Files are sent
+ *  in pieces from wherever the other side got to last time.
+ *
+ *  Each side only talks while the other listens, so a blocking socket on
+ *  both ends cannot deadlock with full send buffers.
+ */
+
+#define SYNC_MAGIC          "APS1"
+#define SYNC_VERSION        2
+#define SYNC_HEADER         12
+// a single preset is a few KB, anything this big is garbage
+#define SYNC_MAX_FRAME      (16 << 20)
+// seconds either side may go quiet before the other gives up
+#define SYNC_TIMEOUT        30
+
+typedef enum {
+    SYNC_HELLO = 1,
+    SYNC_MANIFEST,
+    SYNC_WANT,
+    SYNC_PRESET,
+    SYNC_DONE,
+    SYNC_ERROR,
+    SYNC_BLOBWANT,
+    SYNC_BLOB
+} SyncFrameType ;
+
+#define SYNC_DEFLATED   1
+
+typedef struct {
+    int type ;
+    std::string payload ;       // inflated
+} SyncFrame ;
+
+// splits incoming bytes into frames, holding at most one partial frame
+class SyncReader {
+    std::string buffer ;
+    size_t offset = 0 ;
+
+public:
+    std::string error ;
+    void feed (const char * data, size_t size);
+    // false when no whole frame is buffered yet or on error
+    bool next (SyncFrame * frame);
+    bool failed () { return ! error.empty (); }
+} ;
+
+// returns bytes moved, 0 when the connection closed, < 0 on error
+typedef long (* SyncIO) (char * data, size_t size, void * user);
+
+class SyncSession {
+    typedef struct {
+        std::string name ;
+        uint64_t size ;
+    } BlobWanted ;
+
+    typedef struct {
+        std::string hash, path ;
+        uint64_t offset, size ;
+    } BlobSending ;
+
+    PresetStore * store ;
+    BlobStore * blobs ;
+    bool initiator ;
+    SyncReader reader ;
+    std::string out ;
+    std::deque <std::string> outgoing ;
+    std::deque <BlobSending> sending ;
+    // files named by presets we got, to ask for on our next turn
+    std::unordered_map <std::string, BlobWanted> missing ;
+    // ... and once asked for, until they arrive
+    std::unordered_map <std::string, BlobWanted> expected ;
+    // files we offered, by hash
+    std::unordered_map <std::string, std::string> offered ;
+    std::string wantList ;
+    bool peerHello = false, answered = false, started = false ;
+    int turn = 0 ;          // turns finished, by either side
+
+    void frame (int type, const std::string & payload);
+    bool handle (SyncFrame & frame);
+    std::string manifest ();
+    bool answer (const std::string & manifest);
+    bool ours ();
+    void beginTurn ();
+    void endTurn ();
+    json outbound (json preset);
+    void inbound (json & preset);
+    void stranded ();
+    bool wantBlobs (const std::string & payload);
+    bool takeBlob (const std::string & payload);
+    void fail (const std::string & why);
+
+public:
+    std::string error ;
+    int imported = 0, exported = 0 ;
+    int blobsIn = 0, blobsOut = 0 ;
+    uint64_t blobBytes = 0 ;
+
+    SyncSession (PresetStore * store, bool initiator, BlobStore * blobs = nullptr) ;
+
+    void start ();
+    bool receive (const char * data, size_t size);
+    // what to send next, filled from the queue as it drains
+    std::string & output ();
+    void sent (size_t n);
+    bool finished () ;
+    bool failed () { return ! error.empty (); }
+
+    // drive a session over a blocking connection
+    bool run (SyncIO write, SyncIO read, void * user);
+
+    // a preset as both racks see it: files by name and hash, not path
+    json portable (json preset);
+
+    static uint64_t hash (const std::string & data);
+    static std::string deflate (const std::string & data);
+    static bool inflate (const std::string & data, std::string * out);
+} ;
+
+#endif
@@ -0,0 +1,401 @@
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include "transcode.h"
+#include "peaks.h"
+#include "lame.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "sndfile.h"
+#endif
+
+#ifdef _WIN32
+# include <windows.h>
+#endif
+
+// frames read at a time
+#define TRANSCODE_CHUNK 8192
+// what a 16 bit FLAC may be off by: dither, rounding and libsndfile's scale
+#define TRANSCODE_TOLERANCE (4.0f / 32768.0f)
+// seconds the length of a lossy copy may be off by
+#define TRANSCODE_SLACK 0.1
+
+Transcoder::Transcoder (std::string queueFile) {
+    this -> queueFile = queueFile ;
+}
+
+Transcoder::~Transcoder () {
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        done = true ;
+    }
+    ready.notify_one ();
+    if (worker.joinable ())
+        worker.join ();
+}
+
+void Transcoder::setFormats (nlohmann::json names) {
+    if (! names.is_array ())
+        return ;
+
+    formats.clear ();
+    for (auto & n: names) {
+        int type = n.is_string () ? Encoder::parse (n.get <std::string> ()) : -1 ;
+        if (type != FLAC && type != OPUS)
+            LOGW ("[transcode] cannot archive to %s\n", n.dump ().c_str ());
+        else
+            formats.push_back ((FileType) type);
+    }
+}
+
+void Transcoder::setPolicy (nlohmann::json name) {
+    if (name == "delete")
+        policy = SOURCE_DELETE ;
+    else if (name == "keep")
+        policy = SOURCE_KEEP ;
+    else
+        LOGW ("[transcode] unknown source policy %s\n", name.dump ().c_str ());
+}
+
+void Transcoder::start () {
+    IN
+    if (std::filesystem::exists (queueFile)) {
+        std::ifstream in (queueFile);
+        nlohmann::json saved = nlohmann::json::parse (in, nullptr, false);
+        if (saved.is_array ())
+            jobs = saved ;
+        else
+            LOGW ("[transcode] %s is not a queue, starting a new one\n", queueFile.c_str ());
+    }
+
+    LOGD ("[transcode] %d jobs waiting\n", pending ());
+    worker = std::thread (& Transcoder::work, this);
+    OUT
+}
+
+void Transcoder::add (std::string source) {
+    IN
+    nlohmann::json names = nlohmann::json::array ();
+    for (FileType f: formats)
+        names.push_back (Encoder::extension (f) + 1);
+    if (formats.empty ()) {
+        OUT return ;
+    }
+
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        for (auto & job: jobs)
+            if (job ["source"] == source && job ["state"] == "pending") {
+                OUT return ;
+            }
+
+        jobs.push_back ({
+            {"source", source},
+            {"formats", names},
+            {"policy", policy == SOURCE_DELETE ? "delete" : "keep"},
+            {"state", "pending"}
+        });
+        save ();
+    }
+
+    ready.notify_one ();
+    tell ();
+    OUT
+}
+
+int Transcoder::pending () {
+    std::lock_guard <std::mutex> guard (lock);
+    int n = 0 ;
+    for (auto & job: jobs)
+        n += job ["state"] == "pending" ;
+    return n ;
+}
+
+int Transcoder::failed () {
+    std::lock_guard <std::mutex> guard (lock);
+    int n = 0 ;
+    for (auto & job: jobs)
+        n += job ["state"] == "failed" ;
+    return n ;
+}
+
+std::string Transcoder::status () {
+    std::lock_guard <std::mutex> guard (lock);
+    return current ;
+}
+
+void Transcoder::watch (TranscodeProgress f, void * data) {
+    std::lock_guard <std::mutex> guard (lock);
+    progress = f ;
+    progressData = data ;
+}
+
+// without the lock, the UI asks for the rest
+void Transcoder::tell () {
+    TranscodeProgress f ;
+    void * data ;
+    {
+        std::lock_guard <std::mutex> guard (lock);
+        f = progress ;
+        data = progressData ;
+    }
+
+    if (f)
+        f (data);
+}
+
+// with the lock held; a new file renamed over the old, so a crash
+// leaves one or the other
+void Transcoder::save () {
+    std::string tmp = queueFile + ".tmp" ;
+    {
+        std::ofstream out (tmp);
+        out << jobs.dump (4);
+        if (! out.good ()) {
+            LOGE ("[transcode] cannot write %s\n", tmp.c_str ());
+            return ;
+        }
+    }
+
+    std::error_code ec ;
+    std::filesystem::rename (tmp, queueFile, ec);
+    if (ec)
+        LOGE ("[transcode] cannot write %s: %s\n", queueFile.c_str (), ec.message ().c_str ());
+}
+
+void Transcoder::work () {
+    IN
+    // idle for the CPU, and for the disk too with SCHED_IDLE
+#ifdef __linux__
+    struct sched_param param = {};
+    if (pthread_setschedparam (pthread_self (), SCHED_IDLE, & param) != 0 &&
+        setpriority (PRIO_PROCESS, syscall (SYS_gettid), 19) != 0)
+        LOGW ("[transcode] running at normal priority\n");
+#elif defined _WIN32
+    SetThreadPriority (GetCurrentThread (), THREAD_PRIORITY_IDLE);
+#endif
+
+    std::unique_lock <std::mutex> guard (lock);
+    while (true) {
+        int next = -1 ;
+        ready.wait (guard, [this, & next] {
+            for (int i = 0 ; i < (int) jobs.size () && next < 0 ; i ++)
+                if (jobs [i]["state"] == "pending")
+                    next = i ;
+            return done || next >= 0 ;
+        });
+        if (done)
+            break ;
+
+        // only this thread takes jobs out, so next stays put
+        nlohmann::json job = jobs [next] ;
+        current = std::filesystem::path (job ["source"].get <std::string> ()).filename ().string ();
+        fraction = 0 ;
+        guard.unlock ();
+        tell ();
+
+        bool ok = run (job);
+
+        guard.lock ();
+        current.clear ();
+        // stopped half way: still pending, for next time
+        if (done && ! ok && job ["state"] == "pending")
+            break ;
+
+        if (ok)
+            jobs.erase (next);
+        else
+            jobs [next] = job ;
+        save ();
+
+        guard.unlock ();
+        tell ();
+        guard.lock ();
+    }
+
+    OUT
+}
+
+bool Transcoder::run (nlohmann::json & job) {
+    std::string source = job ["source"] ;
+    std::string base = source.substr (0, source.rfind ('.'));
+    std::string error ;
+    bool ok = std::filesystem::exists (source);
+    if (! ok)
+        error = "the source is gone" ;
+
+    for (auto & name: job ["formats"]) {
+        if (! ok)
+            break ;
+
+        FileType type = (FileType) Encoder::parse (name.get <std::string> ());
+        std::string target = base + Encoder::extension (type);
+        // recorded in this format as well, or done before a restart
+        if (std::filesystem::exists (target)) {
+            if (job ["policy"] == "delete")
+                ok = verify (source, type, target, error);
+            continue ;
+        }
+
+        ok = transcode (source, type, target, error);
+    }
+
+    if (! ok) {
+        if (! done) {
+            job ["state"] = "failed" ;
+            job ["error"] = error ;
+            LOGE ("[transcode] %s: %s\n", source.c_str (), error.c_str ());
+        }
+        return false ;
+    }
+
+    if (job ["policy"] == "delete") {
+        std::error_code ec ;
+        std::filesystem::remove (source, ec);
+        if (ec)
+            LOGW ("[transcode] cannot remove %s: %s\n", source.c_str (), ec.message ().c_str ());
+        std::filesystem::remove (Peaks::sidecar (source), ec);
+    }
+
+    LOGD ("[transcode] %s done\n", source.c_str ());
+    return true ;
+}
+
+bool Transcoder::transcode (std::string source, FileType type, std::string target, std::string & error) {
+#ifdef __linux__
+    SF_INFO info = {};
+    SNDFILE * in = sf_open (source.c_str (), SFM_READ, & info);
+    if (in == nullptr) {
+        error = sf_strerror (NULL);
+        return false ;
+    }
+
+    if (type == OPUS && info.channels > 2) {
+        error = "opus takes one or two channels" ;
+        sf_close (in);
+        return false ;
+    }
+
+    Encoder * e = Encoder::create (type, bitRate, MEDIUM);
+    if (e == nullptr) {
+        error = "not available in this build" ;
+        sf_close (in);
+        return false ;
+    }
+
+    std::string part = target + ".part" ;
+    e -> filename = part ;
+    e -> sampleRate = info.samplerate ;
+    e -> channels = info.channels ;
+    // the latency and preset of a take
+    const char * comment = sf_get_string (in, SF_STR_COMMENT);
+    if (comment)
+        e -> comment = comment ;
+
+    bool ok = e -> open ();
+    std::vector <float> buffer (TRANSCODE_CHUNK * info.channels);
+    sf_count_t n, total = 0 ;
+    while (ok && ! done && (n = sf_readf_float (in, buffer.data (), TRANSCODE_CHUNK)) > 0) {
+        ok = e -> write (buffer.data (), n);
+        total += n ;
+        float f = info.frames > 0 ? (float) total / info.frames : 0 ;
+        if (f - fraction >= 0.01f) {
+            fraction = f ;
+            tell ();
+        }
+    }
+
+    e -> close ();
+    delete e ;
+    sf_close (in);
+
+    if (! ok)
+        error = std::string ("cannot write ").append (part);
+    else if (done)
+        ok = false ;
+    else
+        ok = verify (source, type, part, error);
+
+    std::error_code ec ;
+    if (ok)
+        std::filesystem::rename (part, target, ec);
+    if (ec) {
+        error = ec.message ();
+        ok = false ;
+    }
+
+    // the same audio, so the same waveform; Opus is resampled and gets its own later
+    if (ok && type == FLAC && std::filesystem::exists (Peaks::sidecar (source)))
+        std::filesystem::copy_file (Peaks::sidecar (source), Peaks::sidecar (target), std::filesystem::copy_options::overwrite_existing, ec);
+
+    if (! ok)
+        std::filesystem::remove (part, ec);
+    return ok ;
+#else
+    error = "needs libsndfile" ;
+    return false ;
+#endif
+}
+
+// the whole of target read back; FLAC sample by sample, Opus by length
+bool Transcoder::verify (std::string source, FileType type, std::string target, std::string & error) {
+#ifdef __linux__
+    SF_INFO a = {}, b = {};
+    SNDFILE * src = sf_open (source.c_str (), SFM_READ, & a);
+    SNDFILE * out = sf_open (target.c_str (), SFM_READ, & b);
+    bool ok = src && out ;
+    if (! ok)
+        error = std::string ("cannot read back ").append (target);
+    else if (a.channels != b.channels) {
+        error = "the channels differ" ;
+        ok = false ;
+    }
+
+    std::vector <float> x (TRANSCODE_CHUNK * a.channels), y (TRANSCODE_CHUNK * a.channels);
+    sf_count_t n, got = 0 ;
+    while (ok && (n = sf_readf_float (out, y.data (), TRANSCODE_CHUNK)) > 0) {
+        if (type == FLAC) {
+            if (sf_readf_float (src, x.data (), n) != n) {
+                error = "longer than the source" ;
+                ok = false ;
+                break ;
+            }
+
+            for (int i = 0 ; i < n * a.channels ; i ++) {
+                float s = fmaxf (-1.0f, fminf (1.0f, x [i]));
+                if (fabsf (s - y [i]) > TRANSCODE_TOLERANCE) {
+                    error = std::string ("differs from the source at frame ").append (std::to_string (got + i / a.channels));
+                    ok = false ;
+                    break ;
+                }
+            }
+        }
+
+        got += n ;
+    }
+
+    if (ok && type == FLAC && got != a.frames) {
+        error = "shorter than the source" ;
+        ok = false ;
+    }
+
+    if (ok && type != FLAC && fabs ((double) got / b.samplerate - (double) a.frames / a.samplerate) > TRANSCODE_SLACK) {
+        error = "not as long as the source" ;
+        ok = false ;
+    }
+
+    if (src)
+        sf_close (src);
+    if (out)
+        sf_close (out);
+    return ok ;
+#else
+    error = "needs libsndfile" ;
+    return false ;
+#endif
+}
@@ -0,0 +1,79 @@
+#ifndef TRANSCODE_H
+#define TRANSCODE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging_macros.h"
+#include "json.hpp"
+#include "encoder.h"
+
+typedef enum {
+    SOURCE_KEEP,
+    // only once every format has been written and read back
+    SOURCE_DELETE
+} SourcePolicy ;
+
+// from the worker thread, whenever there is something new to show
+typedef void (* TranscodeProgress) (void * data);
+
+/*  Turns finished masters into FLAC and Opus in the background.
+ *
+ *  Jobs go into a queue kept on disk, so whatever was left when the rack
+ *  closed picks up again the next time. One worker runs them at idle
+ *  priority, CPU and disk both, so it only ever uses what the rack and
+ *  everything else leave over.
+ *
+ *  Each format is written next to the source as name.part, read back in
+ *  full and compared, and only then renamed into place; the source goes
+ *  only after that, and only if the policy says so.
+ */
+class Transcoder {
+    std::string queueFile ;
+    nlohmann::json jobs = nlohmann::json::array ();
+    std::mutex lock ;
+    std::condition_variable ready ;
+    std::thread worker ;
+    std::atomic <bool> done { false };
+
+    std::string current ;
+    std::atomic <float> fraction { 0 };
+    TranscodeProgress progress = nullptr ;
+    void * progressData = nullptr ;
+
+    void work ();
+    bool run (nlohmann::json & job);
+    bool transcode (std::string source, FileType type, std::string target, std::string & error);
+    bool verify (std::string source, FileType type, std::string target, std::string & error);
+    void save ();
+    void tell ();
+
+public:
+    std::vector <FileType> formats = { FLAC };
+    SourcePolicy policy = SOURCE_KEEP ;
+    int bitRate = 96000 ;
+
+    Transcoder (std::string queueFile);
+    ~Transcoder ();
+
+    // loads the queue and starts on it
+    void start ();
+    void add (std::string source);
+
+    // names as in the config: ["flac", "opus"]
+    void setFormats (nlohmann::json names);
+    // "keep" or "delete"
+    void setPolicy (nlohmann::json name);
+
+    // for the UI, from any thread
+    void watch (TranscodeProgress f, void * data);
+    int pending ();
+    int failed ();
+    std::string status ();
+    float progressFraction () { return fraction ; }
+};
+
+#endif
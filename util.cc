@@ -1,5 +1,6 @@
 # ifndef __linux__1
 #define CPPHTTPLIB_OPENSSL_SUPPORT
+#define CPPHTTPLIB_ZLIB_SUPPORT
 # include "httplib.h"
 # endif
 #include "util.h"
@@ -167,17 +168,148 @@ bool download_file (char *name, const char * filename) {
     return ret;
 }
 # else
-bool download_file (char *name, const char * filename) {
+static bool split_url (const std::string & url, std::string * host, std::string * path) {
+    size_t scheme = url.find ("://");
+    size_t slash = url.find ('/', scheme == std::string::npos ? 0 : scheme + 3);
+    if (scheme == std::string::npos)
+        return false ;
+
+    * host = url.substr (0, slash);
+    * path = slash == std::string::npos ? "/" : url.substr (slash);
+    return true ;
+}
+
+/*  Fetch url into filename on the calling thread; never call it from the
+ *  GTK thread.
+ *
+ *  The body is streamed to filename.part and only renamed over filename
+ *  once it has all arrived, so a cancelled or broken download leaves the
+ *  old copy alone. The ETag and Last-Modified of what we have are kept in
+ *  filename.etag and sent back, and the server answers 304 if nothing
+ *  changed. gzip is asked for and undone on the fly. progress may be
+ *  null; it is called as bytes arrive and returning false cancels.
+ */
+DownloadStatus download_if_changed (std::string url, std::string filename, DownloadProgress progress, void * data) {
     IN
-    httplib::Client cli("http://amprack.in");
-    LOGV ("client init ok, getting file ...");
-    auto res = cli.Get ("/presets.json");
-    LOGD ("[download] %s\n[%d] -> %s\n", name, res -> status, res -> body.c_str ());
-    std::ofstream out (filename);
-    out << res -> body ;
-    out.close ();
+    std::string metaname = filename + ".etag" ;
+    std::string partname = filename + ".part" ;
+    json meta = json::object ();
+    if (std::filesystem::exists (metaname) && std::filesystem::exists (filename)) {
+        std::ifstream m (metaname);
+        meta = json::parse (m, nullptr, false);
+        // validators for a different url say nothing about this one
+        if (! meta.is_object () || meta.value ("url", "") != url)
+            meta = json::object ();
+    }
+
+    httplib::Headers headers ;
+    // httplib only asks for gzip itself when it holds the whole body
+    headers.emplace ("Accept-Encoding", "gzip, deflate");
+    if (meta.contains ("etag"))
+        headers.emplace ("If-None-Match", meta ["etag"].get <std::string> ());
+    if (meta.contains ("last-modified"))
+        headers.emplace ("If-Modified-Since", meta ["last-modified"].get <std::string> ());
+
+    // redirects are followed here: httplib would also treat a 304 as one
+    std::string location = url ;
+    int status = 0 ;
+    std::string etag, modified ;
+    bool writeFailed = false ;
+    httplib::Error error = httplib::Error::Success ;
+
+    for (int hops = 0 ; hops < 5 && ! location.empty () ; hops ++) {
+        std::string host, path ;
+        if (! split_url (location, & host, & path)) {
+            LOGD ("[download] bad url %s\n", location.c_str ());
+            OUT
+            return DOWNLOAD_FAILED ;
+        }
+
+        httplib::Client cli (host);
+        cli.set_connection_timeout (10);
+        cli.set_read_timeout (30);
+        cli.set_decompress (true);
+
+        std::ofstream out ;
+        status = 0 ;
+        location.clear ();
+        auto res = cli.Get (path, headers,
+            [&] (const httplib::Response & response) {
+                status = response.status ;
+                if (status >= 300 && status < 400 && status != 304)
+                    location = response.get_header_value ("Location");
+                // a 304 has nothing to read, and neither has anything else
+                // we are not going to keep
+                if (status != 200)
+                    return false ;
+
+                etag = response.get_header_value ("ETag");
+                modified = response.get_header_value ("Last-Modified");
+                out.open (partname, std::ios::binary | std::ios::trunc);
+                writeFailed = ! out.is_open ();
+                return ! writeFailed ;
+            },
+            [&] (const char * bytes, size_t length) {
+                out.write (bytes, length);
+                writeFailed = ! out.good ();
+                return ! writeFailed ;
+            },
+            [&] (uint64_t got, uint64_t total) {
+                return progress == nullptr || progress (got, total, data);
+            });
+
+        error = res.error ();
+        if (out.is_open ())
+            out.close ();
+        if (! location.empty () && location.find ("://") == std::string::npos)
+            location = host + location ;
+    }
+
+    DownloadStatus result ;
+    if (status == 0) {
+        // never got as far as a status line
+        LOGD ("[download] %s: %s\n", url.c_str (), httplib::to_string (error).c_str ());
+        result = error == httplib::Error::Canceled ? DOWNLOAD_CANCELLED : DOWNLOAD_OFFLINE ;
+    } else if (status == 304) {
+        result = DOWNLOAD_NOT_MODIFIED ;
+    } else if (status != 200 || writeFailed) {
+        LOGD ("[download] %s: http %d\n", url.c_str (), status);
+        result = DOWNLOAD_FAILED ;
+    } else if (error == httplib::Error::Canceled) {
+        result = DOWNLOAD_CANCELLED ;
+    } else if (error != httplib::Error::Success) {
+        LOGD ("[download] %s: %s\n", url.c_str (), httplib::to_string (error).c_str ());
+        result = DOWNLOAD_OFFLINE ;
+    } else {
+        std::error_code ec ;
+        std::filesystem::rename (partname, filename, ec);
+        if (ec) {
+            LOGD ("[download] cannot move %s into place: %s\n", partname.c_str (), ec.message ().c_str ());
+            result = DOWNLOAD_FAILED ;
+        } else {
+            json m = json::object ();
+            m ["url"] = url ;
+            if (! etag.empty ())
+                m ["etag"] = etag ;
+            if (! modified.empty ())
+                m ["last-modified"] = modified ;
+            std::ofstream o (metaname);
+            o << m ;
+            result = DOWNLOAD_OK ;
+        }
+    }
+
+    if (result != DOWNLOAD_OK)
+        std::filesystem::remove (partname);
+    LOGD ("[download] %s -> %s: %d\n", url.c_str (), filename.c_str (), result);
     OUT
-    return true;
+    return result ;
+}
+
+bool download_file (char *name, const char * filename) {
+    std::string etag = std::string (filename).append (".etag");
+    std::filesystem::remove (etag);
+    return download_if_changed (name, filename, nullptr, nullptr) == DOWNLOAD_OK ;
 }
 
 # endif
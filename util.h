@@ -24,12 +24,24 @@ class Alert_CB {
         gpointer data ;
 };
 
+typedef enum {
+    DOWNLOAD_OK,            // a new copy is in place
+    DOWNLOAD_NOT_MODIFIED,  // the server says ours is current
+    DOWNLOAD_OFFLINE,       // could not reach the server, ours is kept
+    DOWNLOAD_FAILED,        // reached it but something went wrong, ours is kept
+    DOWNLOAD_CANCELLED
+} DownloadStatus ;
+
+// bytes so far and expected (0 if unknown), return false to cancel
+typedef bool (* DownloadProgress) (uint64_t got, uint64_t total, void * data);
+
 json filename_to_json (std::string filename);
 bool json_to_filename (json j, std::string filename) ;
 void alert_yesno (std::string title, std::string msg, GAsyncReadyCallback cb, gpointer data) ;
 void alert (char * title, char * msg, AlertType type, gpointer callback, gpointer data) ;
 void msg (std::string message) ;
 bool download_file (char *name, const char * filename) ;
+DownloadStatus download_if_changed (std::string url, std::string filename, DownloadProgress progress, void * data) ;
 void copy_file (std::string src, std::string dest) ;
 char ** list_directory (std::string dir) ;
 void set_random_background (GtkWidget * widget) ;
@@ -0,0 +1,148 @@
+#include <cmath>
+#include "waveform.h"
+
+// zoom for one step of the wheel
+#define WAVEFORM_ZOOM 1.25
+// closest zoom, as pixels a finest bucket may take
+#define WAVEFORM_WIDEST 8
+
+Waveform::Waveform () {
+    area = gtk_drawing_area_new ();
+    gtk_widget_set_hexpand (area, true);
+    gtk_widget_set_vexpand (area, true);
+    gtk_drawing_area_set_content_height ((GtkDrawingArea *) area, 160);
+    gtk_drawing_area_set_draw_func ((GtkDrawingArea *) area, draw, this, NULL);
+
+    GtkEventController * scroller = gtk_event_controller_scroll_new (GTK_EVENT_CONTROLLER_SCROLL_VERTICAL);
+    g_signal_connect (scroller, "scroll", (GCallback) scroll, this);
+    gtk_widget_add_controller (area, scroller);
+
+    GtkEventController * mover = gtk_event_controller_motion_new ();
+    g_signal_connect (mover, "motion", (GCallback) motion, this);
+    gtk_widget_add_controller (area, mover);
+
+    GtkGesture * drag = gtk_gesture_drag_new ();
+    g_signal_connect (drag, "drag-begin", (GCallback) drag_begin, this);
+    g_signal_connect (drag, "drag-update", (GCallback) drag_update, this);
+    gtk_widget_add_controller (area, (GtkEventController *) drag);
+}
+
+bool Waveform::load (std::string audio) {
+    file = audio ;
+    bool ok = peaks.load (audio);
+    if (! ok)
+        peaks = Peaks ();
+
+    // the whole file to start with
+    from = 0 ;
+    span = peaks.frames ;
+    gtk_widget_queue_draw (area);
+    return ok ;
+}
+
+void Waveform::clear () {
+    file.clear ();
+    peaks = Peaks ();
+    from = span = 0 ;
+    gtk_widget_queue_draw (area);
+}
+
+void Waveform::clamp () {
+    int width = gtk_widget_get_width (area);
+    double least = (double) width * PEAK_BASE / WAVEFORM_WIDEST ;
+    if (span > peaks.frames)
+        span = peaks.frames ;
+    if (span < least)
+        span = least ;
+    if (from > peaks.frames - span)
+        from = peaks.frames - span ;
+    if (from < 0)
+        from = 0 ;
+}
+
+static void timestamp (char * out, size_t size, double seconds) {
+    int s = (int) seconds ;
+    snprintf (out, size, "%d:%02d:%04.1f", s / 3600, s / 60 % 60, fmod (seconds, 60));
+}
+
+void Waveform::draw (GtkDrawingArea * a, cairo_t * cr, int width, int height, gpointer data) {
+    Waveform * w = (Waveform *) data ;
+    cairo_set_source_rgb (cr, 0.08, 0.08, 0.08);
+    cairo_paint (cr);
+    if (w -> empty () || width <= 0)
+        return ;
+
+    w -> clamp ();
+    w -> columns.resize (width);
+    uint64_t from = w -> from, to = w -> from + w -> span ;
+    double lane = (double) height / w -> peaks.channels ;
+    double scale = lane / 2 / 32768.0 ;
+
+    for (int c = 0 ; c < w -> peaks.channels ; c ++) {
+        w -> peaks.render (from, to, c, width, w -> columns.data ());
+        double middle = lane * c + lane / 2 ;
+
+        // peaks, then RMS over them, one path each
+        for (int i = 0 ; i < width ; i ++) {
+            PeakBucket & b = w -> columns [i] ;
+            cairo_rectangle (cr, i, middle - b.max * scale, 1, (b.max - b.min) * scale + 1);
+        }
+        cairo_set_source_rgb (cr, 0.25, 0.55, 0.75);
+        cairo_fill (cr);
+
+        for (int i = 0 ; i < width ; i ++) {
+            PeakBucket & b = w -> columns [i] ;
+            cairo_rectangle (cr, i, middle - b.rms * scale, 1, 2 * b.rms * scale + 1);
+        }
+        cairo_set_source_rgb (cr, 0.45, 0.8, 1.0);
+        cairo_fill (cr);
+
+        cairo_set_source_rgba (cr, 1, 1, 1, 0.15);
+        cairo_rectangle (cr, 0, lane * (c + 1) - 1, width, 1);
+        cairo_fill (cr);
+    }
+
+    char start [32], end [32], text [80];
+    timestamp (start, sizeof (start), (double) from / w -> peaks.sampleRate);
+    timestamp (end, sizeof (end), (double) to / w -> peaks.sampleRate);
+    snprintf (text, sizeof (text), "%s - %s", start, end);
+    cairo_set_source_rgb (cr, 0.9, 0.9, 0.9);
+    cairo_move_to (cr, 6, 14);
+    cairo_show_text (cr, text);
+}
+
+// around the frame under the pointer, so it stays put
+gboolean Waveform::scroll (GtkEventControllerScroll * controller, double dx, double dy, gpointer data) {
+    Waveform * w = (Waveform *) data ;
+    int width = gtk_widget_get_width (w -> area);
+    if (w -> empty () || width <= 0)
+        return false ;
+
+    double at = w -> pointer / width ;
+    double anchor = w -> from + at * w -> span ;
+    w -> span *= pow (WAVEFORM_ZOOM, dy);
+    w -> from = anchor - at * w -> span ;
+    w -> clamp ();
+    gtk_widget_queue_draw (w -> area);
+    return true ;
+}
+
+void Waveform::motion (GtkEventControllerMotion * controller, double x, double y, gpointer data) {
+    ((Waveform *) data) -> pointer = x ;
+}
+
+void Waveform::drag_begin (GtkGestureDrag * gesture, double x, double y, gpointer data) {
+    Waveform * w = (Waveform *) data ;
+    w -> grabbed = w -> from ;
+}
+
+void Waveform::drag_update (GtkGestureDrag * gesture, double x, double y, gpointer data) {
+    Waveform * w = (Waveform *) data ;
+    int width = gtk_widget_get_width (w -> area);
+    if (w -> empty () || width <= 0)
+        return ;
+
+    w -> from = w -> grabbed - x * w -> span / width ;
+    w -> clamp ();
+    gtk_widget_queue_draw (w -> area);
+}
@@ -0,0 +1,41 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <gtk/gtk.h>
+#include <string>
+#include <vector>
+#include "peaks.h"
+
+/*  Draws a file from its peaks, a lane per channel. Scrolling zooms
+ *  around the pointer, dragging moves along; every redraw is a render ()
+ *  of the width in columns, whatever the zoom or the length of the file.
+ */
+class Waveform {
+    Peaks peaks ;
+    std::vector <PeakBucket> columns ;
+    // the stretch on screen, in frames
+    double from = 0, span = 0 ;
+    // where the pointer is, and where a drag started
+    double pointer = 0, grabbed = 0 ;
+
+    void clamp ();
+    static void draw (GtkDrawingArea * area, cairo_t * cr, int width, int height, gpointer data);
+    static gboolean scroll (GtkEventControllerScroll * controller, double dx, double dy, gpointer data);
+    static void motion (GtkEventControllerMotion * controller, double x, double y, gpointer data);
+    static void drag_begin (GtkGestureDrag * gesture, double x, double y, gpointer data);
+    static void drag_update (GtkGestureDrag * gesture, double x, double y, gpointer data);
+
+public:
+    GtkWidget * area ;
+    std::string file ;
+
+    Waveform ();
+    // false if it has no current peaks yet, and it shows nothing
+    bool load (std::string audio);
+    void clear ();
+    bool empty () { return peaks.levels.empty (); }
+    int channels () { return peaks.channels ; }
+    double seconds () { return peaks.sampleRate ? (double) peaks.frames / peaks.sampleRate : 0 ; }
+};
+
+#endif
@@ -4,56 +4,42 @@
 asio::thread_pool ioc(1);
 
 
+// SyncIO over an asio socket
+static long asio_write (char * data, size_t size, void * sock) {
+    boost::system::error_code ec ;
+    size_t n = ((tcp::socket *) sock) -> write_some (asio::buffer (data, size), ec);
+    return ec.failed () ? -1 : (long) n ;
+}
+
+static long asio_read (char * data, size_t size, void * sock) {
+    boost::system::error_code ec ;
+    size_t n = ((tcp::socket *) sock) -> read_some (asio::buffer (data, size), ec);
+    if (ec == asio::error::eof)
+        return 0 ;
+    return ec.failed () ? -1 : (long) n ;
+}
+
 void read_session(Presets * p, GtkLabel * status, tcp::socket sock) {
     IN
     LOGD ("Connection established");
 
-    std::array<char, 1000> buffer;
-    std::string str ("");
-
-    for (boost::system::error_code ec;;) {
-        size_t n = sock.read_some(asio::buffer(buffer), ec);
-        LOGD( "Received %d bytes: %s (%s)", n, std::string(buffer.data(), n).c_str (), ec.message().c_str ());
-
-        str.append (std::string(buffer.data(), n));
-        if (ec.failed() || str.find("}}}") != string::npos || str.c_str () [1] == '}')
-            break;
-    }
-
-    if (str.c_str () [1] != '}') {
-        while (str.find ("}}}") != std::string::npos)
-            str.pop_back () ;
-    } else {
-        while (str.find ("}}") != std::string::npos)
-            str.pop_back () ;        
-    }
-        
-    LOGD ("[server] got request: %s", str.c_str ());
-    json j = json::parse (str);
-    
-    json our = p -> get_all_user_presets ();
-    std::string toSendStr = our.dump () ;
-    if (our.empty ()) {
-        toSendStr = std::string ("{}");
-    }
-    
-    std::string msg = toSendStr.append (string ("}\n")) ;
-    LOGD ("[server] send message: %s", msg.c_str ());
-    write(sock, asio::buffer(msg));
-
-    int how_many = p -> import_presets_from_json (j);
-    char * ss = g_strdup_printf ("<span foreground=\"green\" weight=\"bold\" size=\"x-large\">Imported %d presets successfully</span>", how_many);
-    LOGD("[server] %s\n", ss);
-    gtk_label_set_markup (status, ss);
-    g_free (ss);
+    // the peer sends its manifest first, see syncproto.h
+    SyncSession session (p -> store, false, p -> blobs);
+    session.run (asio_write, asio_read, & sock);
+    p -> sync_finished (status, & session);
     LOGD ("Connection closed");
     OUT
 }
 
-void Client::create () {
+bool Client::create () {
     IN
     
     OUT
+    return true ;
+}
+
+// the socket only exists inside sync (), where a failed read ends it
+void Client::cancel () {
 }
 
 Client::Client (string host, int port) {
@@ -63,54 +49,33 @@ Client::Client (string host, int port) {
     OUT
 }
 
-std::string Client::send_preset (json j) {
+Client::~Client () {
+}
+
+bool Client::sync (SyncSession * session) {
     IN
     asio::io_service ioc(1);
-    std::array<char, 1000> buffer;
-    std::string str ("");
+    bool ok = false ;
 
     try {
         tcp::socket m_Socket(ioc);
         ///| todo enter hostname here
         boost::asio::ip::tcp::endpoint endpoint(
-            boost::asio::ip::address::from_string(host_), 6906);
+            boost::asio::ip::address::from_string(host_), port_);
         
         m_Socket.connect(endpoint);
 
         LOGD ("Client connected");
-
-        ///| todo: add extra } here
-        std::string msg = j.dump ().append (string ("}")) ;
-        if (j.empty ())
-            msg = string ("{}}");
-        LOGD ("[client] send message: %s", msg.c_str ());
-        write(m_Socket, asio::buffer(msg));
-        std::this_thread::sleep_for(100ms);
-
-        LOGV ("[client] reading server response ...");
-        for (boost::system::error_code ec;;) {
-            size_t n = m_Socket.read_some(asio::buffer(buffer), ec);
-            LOGD( "Received %d bytes: %s (%s)", n, std::string(buffer.data(), n).c_str (), ec.message().c_str ());
-
-            str.append (std::string(buffer.data(), n));
-            if (ec.failed() || str.find("}}}") != string::npos || str.c_str () [1] == '}')
-                break;
-        }
-
-        LOGV (str.c_str ());
-        if (str.c_str () [1] != '}') {
-            while (str.find ("}}}") != std::string::npos)
-                str.pop_back () ;
-        } else {
-            while (str.find ("}}") != std::string::npos)
-                str.pop_back () ;            
-        }
+        // we connected, so we go first
+        session -> start ();
+        ok = session -> run (asio_write, asio_read, & m_Socket);
     } catch (std::exception& e) {
         LOGD("Exception: %s",e.what());
+        session -> error = e.what ();
     }
     
-    return str ;
     OUT
+    return ok ;
 }
 
 void Server::close_socket () {
@@ -1,6 +1,7 @@
 # ifndef WINSERVER
 # define WINSERVER
 # include "presets.h"
+# include "syncproto.h"
 #include <winsock2.h>
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
@@ -62,9 +63,10 @@ public:
     ~Client();
 
     void run();
-    std::string send_preset(json j) ;
-    virtual void create();
+    bool sync(SyncSession * session) ;
+    virtual bool create();
     virtual void close_socket();
+    void cancel();
     void echo();
     bool get_response();
     